@@ -0,0 +1,209 @@
+﻿#include "InputEventQueue.h"
+#include "Math/Math.h"
+
+#include <chrono>
+#include <thread>
+
+InputEventQueue::InputEventQueue(int32 capacity)
+    : m_Mask(0)
+    , m_Head(0)
+    , m_Tail(0)
+    , m_Dropped(0)
+{
+    uint32 size = 2;
+    while (size < (uint32)capacity)
+    {
+        size <<= 1;
+    }
+
+    m_Events.resize(size);
+    m_Mask = size - 1;
+}
+
+InputEventQueue::~InputEventQueue()
+{
+
+}
+
+double InputEventQueue::Now()
+{
+    std::chrono::steady_clock::duration time = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(time).count();
+}
+
+bool InputEventQueue::Push(const InputEvent& event)
+{
+    uint32 tail = m_Tail.load(std::memory_order_relaxed);
+    uint32 head = m_Head.load(std::memory_order_acquire);
+
+    if (tail - head > m_Mask)
+    {
+        return false;
+    }
+
+    InputEvent& slot = m_Events[tail & m_Mask];
+    slot = event;
+    if (slot.timestamp == 0.0)
+    {
+        slot.timestamp = Now();
+    }
+
+    // 写完数据之后再发布新的tail
+    m_Tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool InputEventQueue::PushOrWait(const InputEvent& event, const std::atomic<bool>& running)
+{
+    while (!Push(event))
+    {
+        if (event.type == InputEventType::MouseMove || !running.load(std::memory_order_relaxed))
+        {
+            m_Dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+bool InputEventQueue::Pop(InputEvent& outEvent)
+{
+    uint32 head = m_Head.load(std::memory_order_relaxed);
+    uint32 tail = m_Tail.load(std::memory_order_acquire);
+
+    if (head == tail)
+    {
+        return false;
+    }
+
+    outEvent = m_Events[head & m_Mask];
+
+    // 读完数据之后才把槽位还给生产者
+    m_Head.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+int32 InputEventQueue::Dispatch(GenericApplicationMessageHandler* handler)
+{
+    // 只处理当前已有的事件，生产者持续写入时也不会让一帧无限延长
+    uint32 head  = m_Head.load(std::memory_order_relaxed);
+    uint32 count = m_Tail.load(std::memory_order_acquire) - head;
+
+    InputEvent pendingMove;
+    InputEvent pendingSize;
+    bool hasMove = false;
+    bool hasSize = false;
+    int32 dispatched = 0;
+
+    double now = Now();
+
+    for (uint32 i = 0; i < count; ++i)
+    {
+        InputEvent event;
+        Pop(event);
+        m_Stats.received += 1;
+
+        if (event.type == InputEventType::MouseMove)
+        {
+            m_Stats.coalesced += hasMove ? 1 : 0;
+            pendingMove = event;
+            hasMove = true;
+            continue;
+        }
+
+        if (event.type == InputEventType::SizeChanged)
+        {
+            m_Stats.coalesced += hasSize ? 1 : 0;
+            pendingSize = event;
+            hasSize = true;
+            continue;
+        }
+
+        // 按键之前先把光标移动到最新位置，保证按下时的位置和顺序正确
+        if (hasMove)
+        {
+            DispatchEvent(handler, pendingMove, now);
+            dispatched += 1;
+            hasMove = false;
+        }
+
+        DispatchEvent(handler, event, now);
+        dispatched += 1;
+    }
+
+    if (hasSize)
+    {
+        DispatchEvent(handler, pendingSize, now);
+        dispatched += 1;
+    }
+
+    if (hasMove)
+    {
+        DispatchEvent(handler, pendingMove, now);
+        dispatched += 1;
+    }
+
+    return dispatched;
+}
+
+void InputEventQueue::DispatchEvent(GenericApplicationMessageHandler* handler, const InputEvent& event, double now)
+{
+    double latency = MMath::Max(now - event.timestamp, 0.0);
+    m_Stats.dispatched   += 1;
+    m_Stats.lastLatency   = latency;
+    m_Stats.maxLatency    = MMath::Max(m_Stats.maxLatency, latency);
+    m_Stats.totalLatency += latency;
+
+    if (handler == nullptr)
+    {
+        return;
+    }
+
+    switch (event.type)
+    {
+        case InputEventType::KeyDown:
+        {
+            handler->OnKeyDown(event.key);
+            break;
+        }
+        case InputEventType::KeyUp:
+        {
+            handler->OnKeyUp(event.key);
+            break;
+        }
+        case InputEventType::MouseDown:
+        {
+            handler->OnMouseDown(event.button, event.pos);
+            break;
+        }
+        case InputEventType::MouseUp:
+        {
+            handler->OnMouseUp(event.button, event.pos);
+            break;
+        }
+        case InputEventType::MouseMove:
+        {
+            handler->OnMouseMove(event.pos);
+            break;
+        }
+        case InputEventType::MouseWheel:
+        {
+            handler->OnMouseWheel(event.wheelDelta, event.pos);
+            break;
+        }
+        case InputEventType::SizeChanged:
+        {
+            handler->OnSizeChanged(event.width, event.height);
+            break;
+        }
+        case InputEventType::RequestingExit:
+        {
+            handler->OnRequestingExit();
+            break;
+        }
+    }
+}
@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Vector2.h"
+#include "GenericPlatform/InputManager.h"
+#include "GenericApplicationMessageHandler.h"
+
+#include <vector>
+#include <atomic>
+
+enum class InputEventType : uint8
+{
+    KeyDown = 0,
+    KeyUp,
+    MouseDown,
+    MouseUp,
+    MouseMove,
+    MouseWheel,
+    SizeChanged,
+    RequestingExit,
+};
+
+struct InputEvent
+{
+    InputEventType  type = InputEventType::MouseMove;
+    KeyboardType    key = KeyboardType::KEY_UNKNOWN;
+    MouseType       button = MouseType::MOUSE_BUTTON_LEFT;
+    Vector2         pos = Vector2(0, 0);
+    float           wheelDelta = 0.0f;
+    int32           width = 0;
+    int32           height = 0;
+    // 事件产生的时间，InputEventQueue::Now()
+    double          timestamp = 0.0;
+};
+
+struct InputEventStats
+{
+    int32   received = 0;
+    int32   dispatched = 0;
+    // 被后续MouseMove合并掉的数量
+    int32   coalesced = 0;
+    // 队列满时被生产者放弃的数量，等待后成功写入的事件不计入
+    int32   dropped = 0;
+    // 从事件产生到分发的延迟，单位秒
+    double  lastLatency = 0.0;
+    double  maxLatency = 0.0;
+    double  totalLatency = 0.0;
+
+    FORCE_INLINE double GetAverageLatency() const
+    {
+        return dispatched > 0 ? totalLatency / dispatched : 0.0;
+    }
+};
+
+// 单生产者单消费者的无锁事件队列。平台的输入线程负责Push，主线程每帧调用Dispatch，
+// 帧耗时再长也不会阻塞输入线程读取系统事件。不依赖窗口系统，可以直接Push构造的事件。
+class InputEventQueue
+{
+public:
+
+    // capacity向上取整为2的幂
+    InputEventQueue(int32 capacity = 1024);
+
+    virtual ~InputEventQueue();
+
+    // 仅生产者线程调用，timestamp为0时使用当前时间，队列满时返回false
+    bool Push(const InputEvent& event);
+
+    // 仅生产者线程调用。队列满时MouseMove会被后面的移动取代，直接丢弃；
+    // 其它事件等待消费者腾出空间，running变为false时放弃。丢弃的事件计入dropped，返回是否写入
+    bool PushOrWait(const InputEvent& event, const std::atomic<bool>& running);
+
+    // 仅消费者线程调用
+    bool Pop(InputEvent& outEvent);
+
+    // 仅消费者线程调用。分发调用时已经在队列中的事件，连续的MouseMove和SizeChanged只保留最后一个，
+    // 其它事件保持原有顺序。返回分发的事件数量
+    int32 Dispatch(GenericApplicationMessageHandler* handler);
+
+    // 单调的高精度时钟，单位秒
+    static double Now();
+
+    FORCE_INLINE bool IsEmpty() const
+    {
+        return m_Head.load(std::memory_order_acquire) == m_Tail.load(std::memory_order_acquire);
+    }
+
+    FORCE_INLINE int32 GetCapacity() const
+    {
+        return (int32)m_Events.size();
+    }
+
+    // 统计只在消费者线程读取
+    FORCE_INLINE InputEventStats GetStats() const
+    {
+        InputEventStats stats = m_Stats;
+        stats.dropped = m_Dropped.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    FORCE_INLINE void ResetStats()
+    {
+        m_Stats = InputEventStats();
+        m_Dropped.store(0, std::memory_order_relaxed);
+    }
+
+private:
+
+    void DispatchEvent(GenericApplicationMessageHandler* handler, const InputEvent& event, double now);
+
+private:
+
+    std::vector<InputEvent>     m_Events;
+    uint32                      m_Mask;
+
+    // 读写位置分别由消费者和生产者修改，放在不同的缓存行避免伪共享
+    alignas(64) std::atomic<uint32> m_Head;
+    alignas(64) std::atomic<uint32> m_Tail;
+    alignas(64) std::atomic<int32>  m_Dropped;
+
+    InputEventStats             m_Stats;
+};
@@ -5,11 +5,15 @@
 #include <memory>
 #include <map>
 #include <string>
+#include <chrono>
+#include <cstring>
 
 std::shared_ptr<LinuxApplication> G_CurrentPlatformApplication = nullptr;
 
 LinuxApplication::LinuxApplication()
     : m_Window(nullptr)
+    , m_InputQueue(1024)
+    , m_InputRunning(false)
 {
 
 }
@@ -28,102 +32,71 @@ void LinuxApplication::SetMessageHandler(GenericApplicationMessageHandler* messa
 }
 
 void LinuxApplication::PumpMessages()
+{
+    // xcb事件由输入线程读取，这里只分发已经进入队列的事件
+    m_InputQueue.Dispatch(m_MessageHandler);
+}
+
+void LinuxApplication::InputThreadLoop()
 {
     xcb_connection_t* connection = m_Window->GetConnection();
-    static Vector2 mousePos(0, 0);
+    xcb_atom_t wmDeleteWindow    = m_Window->GetAtomWmDeleteWindow()->atom;
 
-    xcb_generic_event_t* event = nullptr;
-    while ((event = xcb_poll_for_event(connection)))
+    while (m_InputRunning)
     {
-        int32 eventType = event->response_type & 0x7f;
-        xcb_intern_atom_reply_t* atomWmDeleteWindow = m_Window->GetAtomWmDeleteWindow();
-
-        switch (eventType)
+        // 阻塞等待，事件到达时立即记录时间戳
+        xcb_generic_event_t* event = xcb_wait_for_event(connection);
+        if (event == nullptr)
         {
-            case XCB_CLIENT_MESSAGE:
+            // 连接已经断开
+            if (m_InputRunning)
             {
-                if ((*(xcb_client_message_event_t*)event).data.data32[0] == (*atomWmDeleteWindow).atom)
-                {
-                    m_MessageHandler->OnRequestingExit();
-                }
-                break;
-            }
-            case XCB_MOTION_NOTIFY:
-            {
-                xcb_motion_notify_event_t* motion = (xcb_motion_notify_event_t*)event;
-                mousePos.x = (int32_t)motion->event_x;
-                mousePos.y = (int32_t)motion->event_y;
-                m_MessageHandler->OnMouseMove(mousePos);
-                break;
-            }
-            case XCB_BUTTON_PRESS:
-            {
-                xcb_button_press_event_t* press = (xcb_button_press_event_t*)event;
-                if (press->detail == XCB_BUTTON_INDEX_1)
-                {
-                    m_MessageHandler->OnMouseDown(MouseType::MOUSE_BUTTON_LEFT, mousePos);
-                }
-                if (press->detail == XCB_BUTTON_INDEX_2)
-                {
-                    m_MessageHandler->OnMouseDown(MouseType::MOUSE_BUTTON_MIDDLE, mousePos);
-                }
-                if (press->detail == XCB_BUTTON_INDEX_3)
-                {
-                    m_MessageHandler->OnMouseDown(MouseType::MOUSE_BUTTON_RIGHT, mousePos);
-                }
-                break;
-            }
-            case XCB_BUTTON_RELEASE:
-            {
-                xcb_button_press_event_t* press = (xcb_button_press_event_t*)event;
-                if (press->detail == XCB_BUTTON_INDEX_1)
-                {
-                    m_MessageHandler->OnMouseUp(MouseType::MOUSE_BUTTON_LEFT, mousePos);
-                }
-                if (press->detail == XCB_BUTTON_INDEX_2)
-                {
-                    m_MessageHandler->OnMouseUp(MouseType::MOUSE_BUTTON_MIDDLE, mousePos);
-                }
-                if (press->detail == XCB_BUTTON_INDEX_3)
-                {
-                    m_MessageHandler->OnMouseUp(MouseType::MOUSE_BUTTON_RIGHT, mousePos);
-                }
-                break;
-            }
-            case XCB_KEY_PRESS:
-            {
-                const xcb_key_release_event_t* keyEvent = (const xcb_key_release_event_t*)event;
-                KeyboardType key = InputManager::GetKeyFromKeyCode(keyEvent->detail);
-                m_MessageHandler->OnKeyDown(key);
-                break;
-            }
-            case XCB_KEY_RELEASE:
-            {
-                const xcb_key_release_event_t* keyEvent = (const xcb_key_release_event_t*)event;
-                KeyboardType key = InputManager::GetKeyFromKeyCode(keyEvent->detail);
-                m_MessageHandler->OnKeyUp(key);
-                break;
-            }
-            case XCB_DESTROY_NOTIFY:
-            {
-                m_MessageHandler->OnRequestingExit();
-                break;
-            }
-            case XCB_CONFIGURE_NOTIFY:
-            {
-                const xcb_configure_notify_event_t* cfgEvent = (const xcb_configure_notify_event_t*)event;
-                if (cfgEvent->width != m_Window->GetWidth() || cfgEvent->height != m_Window->GetHeight())
-                {
-                    m_MessageHandler->OnSizeChanged(cfgEvent->width, cfgEvent->height);
-                }
-                break;
+                InputEvent exitEvent;
+                exitEvent.type = InputEventType::RequestingExit;
+                PushInputEvent(exitEvent);
             }
+            break;
+        }
+
+        InputEvent inputEvent;
+        inputEvent.timestamp = InputEventQueue::Now();
+        if (m_InputTranslator.Translate(event, wmDeleteWindow, inputEvent))
+        {
+            PushInputEvent(inputEvent);
         }
 
         free(event);
     }
 }
 
+void LinuxApplication::PushInputEvent(const InputEvent& event)
+{
+    // MouseMove可以丢弃，按键等事件等待主线程腾出空间
+    m_InputQueue.PushOrWait(event, m_InputRunning);
+}
+
+void LinuxApplication::StopInputThread()
+{
+    if (!m_InputThread.joinable())
+    {
+        return;
+    }
+
+    m_InputRunning = false;
+
+    // 给自己的窗口发送一个空的ClientMessage，唤醒阻塞在xcb_wait_for_event的输入线程
+    xcb_client_message_event_t wakeEvent;
+    memset(&wakeEvent, 0, sizeof(wakeEvent));
+    wakeEvent.response_type = XCB_CLIENT_MESSAGE;
+    wakeEvent.format        = 32;
+    wakeEvent.window        = m_Window->GetXcbWindow();
+    wakeEvent.type          = XCB_ATOM_NOTICE;
+    xcb_send_event(m_Window->GetConnection(), 0, m_Window->GetXcbWindow(), XCB_EVENT_MASK_NO_EVENT, (const char*)&wakeEvent);
+    xcb_flush(m_Window->GetConnection());
+
+    m_InputThread.join();
+}
+
 void LinuxApplication::Tick(float time, float delta)
 {
 
@@ -147,12 +120,18 @@ void LinuxApplication::InitializeWindow(const std::shared_ptr<GenericWindow> win
     {
         m_Window->Show();
     }
+
+    m_InputTranslator.SetWindowSize(m_Window->GetWidth(), m_Window->GetHeight());
+    m_InputRunning = true;
+    m_InputThread  = std::thread(&LinuxApplication::InputThreadLoop, this);
 }
 
 void LinuxApplication::Destroy()
 {
     if (m_Window != nullptr)
     {
+        // 先停止输入线程，再断开连接
+        StopInputThread();
         m_Window->Destroy();
         m_Window = nullptr;
     }
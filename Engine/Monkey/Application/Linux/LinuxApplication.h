@@ -3,10 +3,15 @@
 #include "Application/GenericApplication.h"
 #include "Application/GenericWindow.h"
 
+#include "Application/InputEventQueue.h"
+
 #include "LinuxWindow.h"
+#include "LinuxInputTranslator.h"
 
 #include <memory>
 #include <vector>
+#include <thread>
+#include <atomic>
 
 class LinuxApplication : public GenericApplication
 {
@@ -29,8 +34,27 @@ public:
 
     virtual void InitializeWindow(const std::shared_ptr<GenericWindow> window, const bool showImmediately) override;
 
+    // 输入线程写入、PumpMessages分发的事件队列，也可以直接写入构造的事件
+    FORCE_INLINE InputEventQueue& GetInputQueue()
+    {
+        return m_InputQueue;
+    }
+
 protected:
 
+    void InputThreadLoop();
+
+    void PushInputEvent(const InputEvent& event);
+
+    void StopInputThread();
+
 private:
     std::shared_ptr<LinuxWindow> m_Window;
+
+    InputEventQueue     m_InputQueue;
+    std::thread         m_InputThread;
+    std::atomic<bool>   m_InputRunning;
+
+    // 只在输入线程访问
+    LinuxInputTranslator m_InputTranslator;
 };
@@ -0,0 +1,100 @@
+﻿#include "LinuxInputTranslator.h"
+
+LinuxInputTranslator::LinuxInputTranslator()
+    : m_MousePos(0, 0)
+    , m_LastWidth(0)
+    , m_LastHeight(0)
+{
+
+}
+
+LinuxInputTranslator::~LinuxInputTranslator()
+{
+
+}
+
+void LinuxInputTranslator::SetWindowSize(int32 width, int32 height)
+{
+    m_LastWidth  = width;
+    m_LastHeight = height;
+}
+
+bool LinuxInputTranslator::Translate(const xcb_generic_event_t* event, xcb_atom_t wmDeleteWindow, InputEvent& outEvent)
+{
+    int32 eventType = event->response_type & 0x7f;
+
+    switch (eventType)
+    {
+        case XCB_CLIENT_MESSAGE:
+        {
+            if ((*(const xcb_client_message_event_t*)event).data.data32[0] == wmDeleteWindow)
+            {
+                outEvent.type = InputEventType::RequestingExit;
+                return true;
+            }
+            return false;
+        }
+        case XCB_MOTION_NOTIFY:
+        {
+            const xcb_motion_notify_event_t* motion = (const xcb_motion_notify_event_t*)event;
+            m_MousePos.x  = (int32_t)motion->event_x;
+            m_MousePos.y  = (int32_t)motion->event_y;
+            outEvent.type = InputEventType::MouseMove;
+            outEvent.pos  = m_MousePos;
+            return true;
+        }
+        case XCB_BUTTON_PRESS:
+        case XCB_BUTTON_RELEASE:
+        {
+            const xcb_button_press_event_t* press = (const xcb_button_press_event_t*)event;
+            if (press->detail == XCB_BUTTON_INDEX_1)
+            {
+                outEvent.button = MouseType::MOUSE_BUTTON_LEFT;
+            }
+            else if (press->detail == XCB_BUTTON_INDEX_2)
+            {
+                outEvent.button = MouseType::MOUSE_BUTTON_MIDDLE;
+            }
+            else if (press->detail == XCB_BUTTON_INDEX_3)
+            {
+                outEvent.button = MouseType::MOUSE_BUTTON_RIGHT;
+            }
+            else
+            {
+                return false;
+            }
+            outEvent.type = eventType == XCB_BUTTON_PRESS ? InputEventType::MouseDown : InputEventType::MouseUp;
+            outEvent.pos  = m_MousePos;
+            return true;
+        }
+        case XCB_KEY_PRESS:
+        case XCB_KEY_RELEASE:
+        {
+            const xcb_key_release_event_t* keyEvent = (const xcb_key_release_event_t*)event;
+            outEvent.type = eventType == XCB_KEY_PRESS ? InputEventType::KeyDown : InputEventType::KeyUp;
+            outEvent.key  = InputManager::GetKeyFromKeyCode(keyEvent->detail);
+            return true;
+        }
+        case XCB_DESTROY_NOTIFY:
+        {
+            outEvent.type = InputEventType::RequestingExit;
+            return true;
+        }
+        case XCB_CONFIGURE_NOTIFY:
+        {
+            const xcb_configure_notify_event_t* cfgEvent = (const xcb_configure_notify_event_t*)event;
+            if (cfgEvent->width == m_LastWidth && cfgEvent->height == m_LastHeight)
+            {
+                return false;
+            }
+            m_LastWidth     = cfgEvent->width;
+            m_LastHeight    = cfgEvent->height;
+            outEvent.type   = InputEventType::SizeChanged;
+            outEvent.width  = cfgEvent->width;
+            outEvent.height = cfgEvent->height;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Vector2.h"
+#include "Application/InputEventQueue.h"
+
+#include <xcb/xcb.h>
+
+// 把xcb事件转换为InputEvent。不依赖窗口和X连接，可以直接输入构造的xcb事件
+class LinuxInputTranslator
+{
+public:
+    LinuxInputTranslator();
+
+    virtual ~LinuxInputTranslator();
+
+    // 记录当前窗口大小，大小没有变化的ConfigureNotify不会产生SizeChanged
+    void SetWindowSize(int32 width, int32 height);
+
+    // wmDeleteWindow为窗口的WM_DELETE_WINDOW，不需要处理的事件返回false
+    bool Translate(const xcb_generic_event_t* event, xcb_atom_t wmDeleteWindow, InputEvent& outEvent);
+
+private:
+    Vector2     m_MousePos;
+    int32       m_LastWidth;
+    int32       m_LastHeight;
+};
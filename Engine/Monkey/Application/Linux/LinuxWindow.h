@@ -92,6 +92,11 @@ public:
         return m_AtomWmDeleteWindow;
     }
 
+    FORCE_INLINE xcb_window_t GetXcbWindow() const
+    {
+        return m_Window;
+    }
+
 private:
     LinuxWindow(int32 width, int32 height, const char* title);
 
@@ -0,0 +1,618 @@
+﻿#include "Common/Log.h"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+// 每个线程的记录数量，写满时后续记录被丢弃
+static const uint32 LOG_RING_CAPACITY = 512;
+
+// 单生产者单消费者的环形队列，head只由所属线程写入，tail只由输出线程写入
+struct LogRing
+{
+    LogRing()
+        : head(0)
+        , tail(0)
+        , dropped(0)
+        , exited(false)
+    {
+
+    }
+
+    LogRecord               records[LOG_RING_CAPACITY];
+    std::atomic<uint32>     head;
+    uint8                   padding[64];
+    std::atomic<uint32>     tail;
+    std::atomic<uint32>     dropped;
+    std::atomic<bool>       exited;
+};
+
+struct LogArg
+{
+    uint8       type = LogRecord::ARG_INTEGER;
+    uint64      bits = 0;
+    double      value = 0.0;
+    std::string text;
+};
+
+class LogArgReader
+{
+public:
+    explicit LogArgReader(const LogRecord& inRecord)
+        : record(inRecord)
+    {
+
+    }
+
+    bool Next(LogArg& arg)
+    {
+        if (offset >= record.size)
+        {
+            return false;
+        }
+
+        arg.type = record.data[offset];
+        offset  += 1;
+
+        if (arg.type == LogRecord::ARG_STRING)
+        {
+            uint16 length = 0;
+            memcpy(&length, record.data + offset, sizeof(uint16));
+            arg.text.assign((const char*)(record.data + offset + sizeof(uint16)), length);
+            offset += sizeof(uint16) + length;
+        }
+        else
+        {
+            memcpy(&arg.bits, record.data + offset, sizeof(uint64));
+            memcpy(&arg.value, record.data + offset, sizeof(double));
+            offset += sizeof(uint64);
+        }
+
+        return true;
+    }
+
+public:
+    const LogRecord&    record;
+    uint32              offset = 0;
+};
+
+static int64 LogArgToInteger(const LogArg& arg)
+{
+    return arg.type == LogRecord::ARG_DOUBLE ? (int64)arg.value : (int64)arg.bits;
+}
+
+static double LogArgToDouble(const LogArg& arg)
+{
+    return arg.type == LogRecord::ARG_DOUBLE ? arg.value : (double)(int64)arg.bits;
+}
+
+// 按printf的规则逐个转换说明符格式化，参数类型以格式串中的长度修饰为准
+static void LogFormat(const LogRecord& record, std::string& out)
+{
+    char buffer[512];
+
+    const LogSite* site = record.site;
+    snprintf(buffer, sizeof(buffer), "%-6s%-40s:%-5d", site->level == MLOG_LEVEL_ERROR ? "ERROR:" : "LOG:", site->func, site->line);
+    out += buffer;
+
+    LogArgReader reader(record);
+    LogArg arg;
+
+    const char* ptr = record.format;
+    while (*ptr)
+    {
+        if (*ptr != '%')
+        {
+            out += *ptr++;
+            continue;
+        }
+
+        const char* start = ptr++;
+        if (*ptr == '%')
+        {
+            out += '%';
+            ptr += 1;
+            continue;
+        }
+
+        std::string spec = "%";
+        while (*ptr && strchr("-+ #0", *ptr))
+        {
+            spec += *ptr++;
+        }
+
+        // 宽度与精度，*从参数中读取
+        for (int32 part = 0; part < 2; ++part)
+        {
+            if (part == 1)
+            {
+                if (*ptr != '.')
+                {
+                    break;
+                }
+                spec += *ptr++;
+            }
+
+            if (*ptr == '*')
+            {
+                ptr += 1;
+                if (reader.Next(arg))
+                {
+                    spec += std::to_string((int32)LogArgToInteger(arg));
+                }
+            }
+            else
+            {
+                while (*ptr >= '0' && *ptr <= '9')
+                {
+                    spec += *ptr++;
+                }
+            }
+        }
+
+        std::string length;
+        while (*ptr && strchr("hlLqjzt", *ptr))
+        {
+            length += *ptr++;
+        }
+
+        char conversion = *ptr;
+        if (conversion == 0)
+        {
+            out += start;
+            break;
+        }
+        ptr += 1;
+
+        if (conversion == 'n')
+        {
+            reader.Next(arg);
+            continue;
+        }
+
+        if (!reader.Next(arg))
+        {
+            out.append(start, ptr - start);
+            continue;
+        }
+
+        buffer[0] = 0;
+        if (conversion == 'd' || conversion == 'i')
+        {
+            int64 value = LogArgToInteger(arg);
+            if (length == "hh")
+            {
+                value = (int8)value;
+            }
+            else if (length == "h")
+            {
+                value = (int16)value;
+            }
+            else if (length.empty())
+            {
+                value = (int32)value;
+            }
+            else if (length == "l")
+            {
+                value = (long)value;
+            }
+            snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(), (long long)value);
+        }
+        else if (conversion == 'u' || conversion == 'o' || conversion == 'x' || conversion == 'X')
+        {
+            uint64 value = (uint64)LogArgToInteger(arg);
+            if (length == "hh")
+            {
+                value = (uint8)value;
+            }
+            else if (length == "h")
+            {
+                value = (uint16)value;
+            }
+            else if (length.empty())
+            {
+                value = (uint32)value;
+            }
+            else if (length == "l")
+            {
+                value = (unsigned long)value;
+            }
+            snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), (unsigned long long)value);
+        }
+        else if (conversion == 'c')
+        {
+            snprintf(buffer, sizeof(buffer), (spec + 'c').c_str(), (int32)LogArgToInteger(arg));
+        }
+        else if (strchr("fFeEgGaA", conversion))
+        {
+            snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), LogArgToDouble(arg));
+        }
+        else if (conversion == 's')
+        {
+            snprintf(buffer, sizeof(buffer), (spec + 's').c_str(), arg.type == LogRecord::ARG_STRING ? arg.text.c_str() : "(null)");
+        }
+        else if (conversion == 'p')
+        {
+            snprintf(buffer, sizeof(buffer), (spec + 'p').c_str(), (void*)(uintptr_t)arg.bits);
+        }
+        else
+        {
+            out.append(start, ptr - start);
+            continue;
+        }
+
+        out += buffer;
+    }
+
+    if (record.truncated)
+    {
+        out += " [truncated]";
+    }
+
+    if (record.suppressed > 0)
+    {
+        snprintf(buffer, sizeof(buffer), " [%u similar messages suppressed]", record.suppressed);
+        out += buffer;
+    }
+
+    out += '\n';
+}
+
+static void LogOutput(const std::string& text)
+{
+#if PLATFORM_WINDOWS
+    OutputDebugStringA(text.c_str());
+#elif PLATFORM_ANDROID
+    __android_log_print(ANDROID_LOG_DEBUG, "t", "%s", text.c_str());
+#else
+    fwrite(text.data(), 1, text.size(), stdout);
+#endif
+}
+
+static void LogOutputFlush()
+{
+#if !PLATFORM_WINDOWS && !PLATFORM_ANDROID
+    fflush(stdout);
+#endif
+}
+
+// 重复日志过滤使用的秒数，由输出线程更新，调用线程不需要读取时钟
+static std::atomic<uint32> G_LogClock(0);
+
+// 后台输出线程，定时收集所有线程的记录，按序号排序后格式化输出
+class LogWriter
+{
+public:
+    LogWriter()
+        : accepting(true)
+        , sequence(0)
+    {
+        thread = std::thread(&LogWriter::Run, this);
+    }
+
+    LogRing* Register()
+    {
+        LogRing* ring = new LogRing();
+        std::lock_guard<std::mutex> lockGuard(ringsMutex);
+        rings.push_back(ring);
+        return ring;
+    }
+
+    void Shutdown()
+    {
+        accepting.store(false);
+        {
+            std::lock_guard<std::mutex> lockGuard(wakeMutex);
+            running = false;
+        }
+        wakeCV.notify_one();
+
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+
+        Drain();
+    }
+
+    void Drain()
+    {
+        std::lock_guard<std::mutex> drainGuard(drainMutex);
+
+        uint32 dropped = 0;
+        batch.clear();
+
+        {
+            std::lock_guard<std::mutex> lockGuard(ringsMutex);
+            for (size_t i = 0; i < rings.size();)
+            {
+                LogRing* ring = rings[i];
+                uint32 tail = ring->tail.load(std::memory_order_relaxed);
+                uint32 head = ring->head.load(std::memory_order_acquire);
+                for (; tail != head; ++tail)
+                {
+                    batch.push_back(ring->records[tail % LOG_RING_CAPACITY]);
+                }
+                ring->tail.store(tail, std::memory_order_release);
+                dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+
+                // 线程已经退出且记录全部取出
+                if (ring->exited.load(std::memory_order_acquire) && ring->head.load(std::memory_order_acquire) == tail)
+                {
+                    delete ring;
+                    rings[i] = rings.back();
+                    rings.pop_back();
+                }
+                else
+                {
+                    i += 1;
+                }
+            }
+        }
+
+        if (batch.empty() && dropped == 0)
+        {
+            return;
+        }
+
+        std::sort(batch.begin(), batch.end(), [](const LogRecord& a, const LogRecord& b) -> bool {
+            return a.sequence < b.sequence;
+        });
+
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            text.clear();
+            LogFormat(batch[i], text);
+            LogOutput(text);
+        }
+
+        if (dropped > 0)
+        {
+            text = "ERROR:" + std::to_string(dropped) + " log records dropped, ring buffer is full\n";
+            LogOutput(text);
+        }
+
+        LogOutputFlush();
+    }
+
+private:
+
+    void Run()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (running)
+        {
+            wakeCV.wait_for(lock, std::chrono::milliseconds(10));
+
+            std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+            G_LogClock.store((uint32)std::chrono::duration_cast<std::chrono::seconds>(elapsed).count(), std::memory_order_relaxed);
+
+            lock.unlock();
+            Drain();
+            lock.lock();
+        }
+    }
+
+public:
+    std::atomic<bool>           accepting;
+    std::atomic<uint64>         sequence;
+
+private:
+    std::thread                 thread;
+    std::mutex                  wakeMutex;
+    std::condition_variable     wakeCV;
+    bool                        running = true;
+
+    std::mutex                  ringsMutex;
+    std::vector<LogRing*>       rings;
+
+    std::mutex                  drainMutex;
+    std::vector<LogRecord>      batch;
+    std::string                 text;
+};
+
+// 程序退出时停止输出线程并输出剩余记录，LogWriter本身不释放，之后的日志走同步输出
+class LogWriterShutdown
+{
+public:
+    explicit LogWriterShutdown(LogWriter* inWriter)
+        : writer(inWriter)
+    {
+
+    }
+
+    ~LogWriterShutdown()
+    {
+        writer->Shutdown();
+    }
+
+    LogWriter* writer;
+};
+
+static LogWriter* GetLogWriter()
+{
+    static LogWriter* writer = new LogWriter();
+    static LogWriterShutdown shutdown(writer);
+    return writer->accepting.load(std::memory_order_relaxed) ? writer : nullptr;
+}
+
+static thread_local bool        t_LogExited = false;
+static thread_local LogRecord   t_LogDirect;
+
+// 线程退出时标记它的队列，由输出线程在取空后释放
+class LogThreadRing
+{
+public:
+    ~LogThreadRing()
+    {
+        if (ring)
+        {
+            ring->exited.store(true, std::memory_order_release);
+        }
+        t_LogExited = true;
+    }
+
+    LogRing* ring = nullptr;
+};
+
+static thread_local LogThreadRing t_LogThreadRing;
+
+// 同步输出用于输出线程停止之后，不释放以免在静态析构中使用
+static std::mutex& GetLogDirectMutex()
+{
+    static std::mutex* mutex = new std::mutex();
+    return *mutex;
+}
+
+// 格式化后立即输出，用于输出线程停止之后
+static void LogOutputDirect(const LogRecord& record)
+{
+    std::string text;
+    LogFormat(record, text);
+
+    std::lock_guard<std::mutex> lockGuard(GetLogDirectMutex());
+    LogOutput(text);
+    LogOutputFlush();
+}
+
+bool LogSite::Accept(uint64 hash, uint32 now)
+{
+    // 多线程同时写入时计数可能不精确，只影响过滤的条数
+    if (lastHash.load(std::memory_order_relaxed) != hash || window.load(std::memory_order_relaxed) != now)
+    {
+        lastHash.store(hash, std::memory_order_relaxed);
+        window.store(now, std::memory_order_relaxed);
+        repeats.store(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    if (repeats.fetch_add(1, std::memory_order_relaxed) < MLOG_RATE_LIMIT)
+    {
+        return true;
+    }
+
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void LogRecord::PackString(const char* value)
+{
+    if (value == nullptr)
+    {
+        value = "(null)";
+    }
+
+    if (truncated || size + 1 + sizeof(uint16) > DataSize)
+    {
+        truncated = true;
+        return;
+    }
+
+    uint32 room   = DataSize - size - 1 - sizeof(uint16);
+    uint16 length = (uint16)strnlen(value, room + 1);
+    if (length > room)
+    {
+        length    = room;
+        truncated = true;
+    }
+
+    data[size] = ARG_STRING;
+    memcpy(data + size + 1, &length, sizeof(uint16));
+    memcpy(data + size + 1 + sizeof(uint16), value, length);
+    size += 1 + sizeof(uint16) + length;
+}
+
+LogRecord* LogBackend::BeginRecord(LogSite& site, const char* format)
+{
+    LogWriter* writer = t_LogExited ? nullptr : GetLogWriter();
+    LogRecord* record = &t_LogDirect;
+
+    if (writer)
+    {
+        LogRing* ring = t_LogThreadRing.ring;
+        if (ring == nullptr)
+        {
+            ring = writer->Register();
+            t_LogThreadRing.ring = ring;
+        }
+
+        uint32 head = ring->head.load(std::memory_order_relaxed);
+        if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_CAPACITY)
+        {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        record = &(ring->records[head % LOG_RING_CAPACITY]);
+    }
+
+    record->site       = &site;
+    record->format     = format;
+    record->suppressed = 0;
+    record->size       = 0;
+    record->truncated  = false;
+
+    return record;
+}
+
+void LogBackend::EndRecord(LogRecord* record)
+{
+    LogSite* site = record->site;
+
+    // 格式串为字面量，地址相同即内容相同，与参数一起计算FNV-1a
+    uint64 hash = 14695981039346656037ULL ^ (uint64)(uintptr_t)record->format;
+    for (uint32 i = 0; i < record->size; ++i)
+    {
+        hash = (hash ^ record->data[i]) * 1099511628211ULL;
+    }
+
+    // 未提交的记录不会被输出线程读取，直接丢弃
+    if (!site->Accept(hash, G_LogClock.load(std::memory_order_relaxed)))
+    {
+        return;
+    }
+    if (site->suppressed.load(std::memory_order_relaxed) > 0)
+    {
+        record->suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+    }
+
+    if (record == &t_LogDirect)
+    {
+        LogOutputDirect(*record);
+        return;
+    }
+
+    // 记录期间输出线程已经停止，不再提交到队列，直接输出
+    LogWriter* writer = GetLogWriter();
+    if (writer == nullptr)
+    {
+        LogOutputDirect(*record);
+        return;
+    }
+
+    record->sequence = writer->sequence.fetch_add(1, std::memory_order_relaxed);
+
+    LogRing* ring = t_LogThreadRing.ring;
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+    // 错误之后可能紧接着终止程序，在当前线程同步输出
+    if (site->level == MLOG_LEVEL_ERROR)
+    {
+        writer->Drain();
+    }
+}
+
+void LogBackend::Flush()
+{
+    LogWriter* writer = GetLogWriter();
+    if (writer)
+    {
+        writer->Drain();
+    }
+}
@@ -1,17 +1,198 @@
 ﻿#pragma once
 
 #include "Configuration/Platform.h"
+#include "Common/Common.h"
+
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
 
 #if PLATFORM_WINDOWS
     #include <Windows.h>
-    #define MLOG(...) { char __str__buf__[2048]; sprintf_s(__str__buf__, "%-6s", "LOG:");   OutputDebugString(__str__buf__); sprintf_s(__str__buf__, "%-40s:%-5d", __func__, __LINE__); OutputDebugString(__str__buf__); sprintf_s(__str__buf__, __VA_ARGS__); OutputDebugString(__str__buf__); sprintf_s(__str__buf__, "\n"); OutputDebugString(__str__buf__); }
-    #define MLOGE(...) { char __str__buf__[2048]; sprintf_s(__str__buf__, "%-6s", "ERROR:"); OutputDebugString(__str__buf__); sprintf_s(__str__buf__, "%-40s:%-5d", __func__, __LINE__); OutputDebugString(__str__buf__); sprintf_s(__str__buf__, __VA_ARGS__); OutputDebugString(__str__buf__); sprintf_s(__str__buf__, "\n"); OutputDebugString(__str__buf__); }
-#elif PLATFORM_MAC || PLATFORM_LINUX || PLATFORM_IOS
-    #define MLOG(...) { fprintf(stdout, "%-6s", "LOG:");    fprintf(stdout, "%-40s:%-5d", __func__, __LINE__); fprintf(stdout, __VA_ARGS__); fprintf(stdout, "\n"); }
-    #define MLOGE(...) { fprintf(stdout, "%-6s", "ERROR:");  fprintf(stdout, "%-40s:%-5d", __func__, __LINE__); fprintf(stdout, __VA_ARGS__); fprintf(stdout, "\n"); }
 #elif PLATFORM_ANDROID
     #include <android/log.h>
-    #define MLOG(FORMAT,...) { __android_log_print(ANDROID_LOG_DEBUG, "t", FORMAT, ## __VA_ARGS__); }
-    #define MLOGE(FORMAT,...) { __android_log_print(ANDROID_LOG_DEBUG, "t", FORMAT, ## __VA_ARGS__); }
-#endif
\ No newline at end of file
+#endif
+
+// 编译期日志等级，低于该等级的MLOG/MLOGE连同参数一起被去掉，例如-DMLOG_LEVEL=1只保留错误
+#define MLOG_LEVEL_NONE     0
+#define MLOG_LEVEL_ERROR    1
+#define MLOG_LEVEL_INFO     2
+
+#ifndef MLOG_LEVEL
+    #define MLOG_LEVEL MLOG_LEVEL_INFO
+#endif
+
+// 同一调用点内容完全相同的日志每秒最多输出的条数，超出的部分只计数，下一条输出时附带被省略的数量
+#ifndef MLOG_RATE_LIMIT
+    #define MLOG_RATE_LIMIT 8
+#endif
+
+// 一个MLOG/MLOGE调用点，静态存储，记录中只保存它的指针
+class LogSite
+{
+public:
+    LogSite(int32 inLevel, const char* inFunc, int32 inLine)
+        : level(inLevel)
+        , func(inFunc)
+        , line(inLine)
+        , lastHash(0)
+        , window(0)
+        , repeats(0)
+        , suppressed(0)
+    {
+
+    }
+
+    // 根据记录内容的hash判断是否为重复日志，返回false时丢弃
+    bool Accept(uint64 hash, uint32 now);
+
+public:
+    int32                   level;
+    const char*             func;
+    int32                   line;
+
+    std::atomic<uint64>     lastHash;
+    std::atomic<uint32>     window;
+    std::atomic<uint32>     repeats;
+    std::atomic<uint32>     suppressed;
+};
+
+// 二进制日志记录，参数按类型打包，格式化由后台线程完成。字符串参数会被拷贝，超出容量的部分被截断。
+class LogRecord
+{
+public:
+    enum ArgType
+    {
+        ARG_INTEGER = 0,
+        ARG_DOUBLE,
+        ARG_POINTER,
+        ARG_STRING,
+    };
+
+    static const uint32 DataSize = 224;
+
+    FORCE_INLINE void PackInteger(uint64 value)
+    {
+        PackValue(ARG_INTEGER, &value, sizeof(value));
+    }
+
+    FORCE_INLINE void PackDouble(double value)
+    {
+        PackValue(ARG_DOUBLE, &value, sizeof(value));
+    }
+
+    FORCE_INLINE void PackPointer(const void* value)
+    {
+        uint64 bits = (uint64)(uintptr_t)value;
+        PackValue(ARG_POINTER, &bits, sizeof(bits));
+    }
+
+    void PackString(const char* value);
+
+private:
+
+    FORCE_INLINE void PackValue(uint8 type, const void* value, uint32 valueSize)
+    {
+        if (truncated || size + 1 + valueSize > DataSize)
+        {
+            truncated = true;
+            return;
+        }
+        data[size] = type;
+        memcpy(data + size + 1, value, valueSize);
+        size += 1 + valueSize;
+    }
+
+public:
+    LogSite*        site;
+    const char*     format;
+    uint64          sequence;
+    uint32          suppressed;
+    uint16          size;
+    bool            truncated;
+    uint8           data[DataSize];
+};
+
+template<typename T>
+FORCE_INLINE typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type LogPackArg(LogRecord& record, T value)
+{
+    record.PackInteger((uint64)static_cast<int64>(value));
+}
+
+template<typename T>
+FORCE_INLINE typename std::enable_if<std::is_floating_point<T>::value>::type LogPackArg(LogRecord& record, T value)
+{
+    record.PackDouble((double)value);
+}
+
+template<typename T>
+FORCE_INLINE void LogPackArg(LogRecord& record, T* value)
+{
+    record.PackPointer((const void*)value);
+}
+
+FORCE_INLINE void LogPackArg(LogRecord& record, const char* value)
+{
+    record.PackString(value);
+}
+
+FORCE_INLINE void LogPackArg(LogRecord& record, char* value)
+{
+    record.PackString(value);
+}
+
+FORCE_INLINE void LogPackArgs(LogRecord& record)
+{
+
+}
+
+template<typename T, typename... Args>
+FORCE_INLINE void LogPackArgs(LogRecord& record, T value, Args... args)
+{
+    LogPackArg(record, value);
+    LogPackArgs(record, args...);
+}
+
+// 异步日志：每个线程一个无锁环形队列，调用线程只打包参数，后台线程按提交顺序格式化并输出。
+// 队列满时丢弃并计数，不会阻塞调用线程；重复的日志在提交前被过滤，不占用队列。
+// 错误日志提交后在调用线程立即输出所有已提交的记录，之后终止程序也不会丢失。
+// 程序退出时输出剩余的记录，之后的日志改为同步输出。
+class LogBackend
+{
+public:
+    template<typename... Args>
+    static void Write(LogSite& site, const char* format, Args... args)
+    {
+        LogRecord* record = BeginRecord(site, format);
+        if (record)
+        {
+            LogPackArgs(*record, args...);
+            EndRecord(record);
+        }
+    }
+
+    // 在调用线程上输出所有已经提交的记录，例如即将崩溃或者调试时
+    static void Flush();
+
+private:
+
+    static LogRecord* BeginRecord(LogSite& site, const char* format);
+
+    static void EndRecord(LogRecord* record);
+};
+
+#define MLOG_WRITE(LEVEL, ...) { static LogSite __log__site__(LEVEL, __func__, __LINE__); LogBackend::Write(__log__site__, __VA_ARGS__); }
+
+#if MLOG_LEVEL >= MLOG_LEVEL_INFO
+    #define MLOG(...) MLOG_WRITE(MLOG_LEVEL_INFO, __VA_ARGS__)
+#else
+    #define MLOG(...) { }
+#endif
+
+#if MLOG_LEVEL >= MLOG_LEVEL_ERROR
+    #define MLOGE(...) MLOG_WRITE(MLOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+    #define MLOGE(...) { }
+#endif
@@ -0,0 +1,531 @@
+﻿#include "DVKAnimCompression.h"
+
+#include "Common/Log.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    #include <emmintrin.h>
+    #define DVK_ANIM_SSE 1
+#else
+    #define DVK_ANIM_SSE 0
+#endif
+
+namespace vk_demo
+{
+
+    // smallest-three：另外三个分量的范围为[-1/sqrt(2), 1/sqrt(2)]，每个分量15位
+    static const float QUAT_RANGE = 0.70710678f;
+    static const float QUAT_SCALE = 2.0f * QUAT_RANGE / 32767.0f;
+
+    static FORCE_INLINE uint16 QuantizeTime(float time, float duration)
+    {
+        if (duration <= 0.0f)
+        {
+            return 0;
+        }
+        return (uint16)MMath::Clamp(MMath::RoundToInt(time / duration * 65535.0f), 0, 65535);
+    }
+
+    static FORCE_INLINE float QuatDot(const Quat& a, const Quat& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    }
+
+    static FORCE_INLINE float QuatError(const Quat& a, const Quat& b)
+    {
+        float d = MMath::Min(MMath::Abs(QuatDot(a, b)), 1.0f);
+        return 2.0f * MMath::Acos(d);
+    }
+
+    static FORCE_INLINE Quat QuatNLerp(const Quat& a, const Quat& b, float alpha)
+    {
+        float bias = QuatDot(a, b) >= 0.0f ? 1.0f : -1.0f;
+        Quat result(
+            a.x + (b.x * bias - a.x) * alpha,
+            a.y + (b.y * bias - a.y) * alpha,
+            a.z + (b.z * bias - a.z) * alpha,
+            a.w + (b.w * bias - a.w) * alpha
+        );
+        result.Normalize();
+        return result;
+    }
+
+    static FORCE_INLINE float VectorError(const Vector3& a, const Vector3& b)
+    {
+        return (a - b).Size();
+    }
+
+    static FORCE_INLINE float ScaleError(const Vector3& a, const Vector3& b)
+    {
+        Vector3 d = a - b;
+        return MMath::Max(MMath::Abs(d.x), MMath::Max(MMath::Abs(d.y), MMath::Abs(d.z)));
+    }
+
+    static FORCE_INLINE Quat Interpolate(const Quat& a, const Quat& b, float alpha)
+    {
+        return QuatNLerp(a, b, alpha);
+    }
+
+    static FORCE_INLINE Vector3 Interpolate(const Vector3& a, const Vector3& b, float alpha)
+    {
+        return MMath::Lerp(a, b, alpha);
+    }
+
+    static void EncodeQuat(Quat quat, uint16* dst)
+    {
+        quat.Normalize();
+
+        float comps[4] = { quat.x, quat.y, quat.z, quat.w };
+        int32 largest = 0;
+        for (int32 i = 1; i < 4; ++i)
+        {
+            if (MMath::Abs(comps[i]) > MMath::Abs(comps[largest]))
+            {
+                largest = i;
+            }
+        }
+
+        // q与-q等价，保证最大分量为正，解码时由其余三个分量求出
+        float sign = comps[largest] < 0.0f ? -1.0f : 1.0f;
+
+        int32 index = 0;
+        for (int32 i = 0; i < 4; ++i)
+        {
+            if (i == largest)
+            {
+                continue;
+            }
+            float value = MMath::Clamp(comps[i] * sign, -QUAT_RANGE, QUAT_RANGE);
+            dst[index++] = (uint16)MMath::Clamp(MMath::RoundToInt((value + QUAT_RANGE) / QUAT_SCALE), 0, 32767);
+        }
+
+        // 最大分量的序号存放在前两个分量的最高位
+        dst[0] |= (uint16)((largest >> 1) << 15);
+        dst[1] |= (uint16)((largest & 1) << 15);
+    }
+
+    static FORCE_INLINE void EncodeVector(const Vector3& value, const Vector3& scale, const Vector3& offset, uint16* dst)
+    {
+        dst[0] = scale.x > 0.0f ? (uint16)MMath::Clamp(MMath::RoundToInt((value.x - offset.x) / scale.x), 0, 65535) : 0;
+        dst[1] = scale.y > 0.0f ? (uint16)MMath::Clamp(MMath::RoundToInt((value.y - offset.y) / scale.y), 0, 65535) : 0;
+        dst[2] = scale.z > 0.0f ? (uint16)MMath::Clamp(MMath::RoundToInt((value.z - offset.z) / scale.z), 0, 65535) : 0;
+    }
+
+    static FORCE_INLINE void AssembleQuat(const uint16* src, const float* smallest, float* dst)
+    {
+        int32 largest = ((src[0] >> 15) << 1) | (src[1] >> 15);
+        float sum = smallest[0] * smallest[0] + smallest[1] * smallest[1] + smallest[2] * smallest[2];
+
+        int32 index = 0;
+        for (int32 i = 0; i < 4; ++i)
+        {
+            dst[i] = i == largest ? MMath::Sqrt(MMath::Max(0.0f, 1.0f - sum)) : smallest[index++];
+        }
+    }
+
+#if DVK_ANIM_SSE
+
+    static FORCE_INLINE __m128 Dot4(__m128 a, __m128 b)
+    {
+        __m128 m = _mm_mul_ps(a, b);
+        __m128 s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+    }
+
+    static FORCE_INLINE __m128 DecodeVector(const uint16* src, __m128 scale, __m128 offset)
+    {
+        __m128i raw = _mm_setr_epi32(src[0], src[1], src[2], 0);
+        return _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(raw), scale), offset);
+    }
+
+    static FORCE_INLINE __m128 DecodeQuat(const uint16* src)
+    {
+        __m128i raw = _mm_setr_epi32(src[0] & 0x7FFF, src[1] & 0x7FFF, src[2] & 0x7FFF, 0);
+        __m128 smallest = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(raw), _mm_set1_ps(QUAT_SCALE)), _mm_set1_ps(QUAT_RANGE));
+
+        float comps[4];
+        float quat[4];
+        _mm_storeu_ps(comps, smallest);
+        AssembleQuat(src, comps, quat);
+        return _mm_loadu_ps(quat);
+    }
+
+    // 两个关键帧之间nlerp
+    static FORCE_INLINE __m128 LerpQuat(__m128 a, __m128 b, float alpha)
+    {
+        __m128 sign = _mm_and_ps(Dot4(a, b), _mm_set1_ps(-0.0f));
+        b = _mm_xor_ps(b, sign);
+        __m128 result = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(alpha)));
+        return _mm_div_ps(result, _mm_sqrt_ps(Dot4(result, result)));
+    }
+
+#else
+
+    static FORCE_INLINE Vector3 DecodeVector(const uint16* src, const Vector3& scale, const Vector3& offset)
+    {
+        return Vector3(src[0] * scale.x + offset.x, src[1] * scale.y + offset.y, src[2] * scale.z + offset.z);
+    }
+
+    static FORCE_INLINE Quat DecodeQuat(const uint16* src)
+    {
+        float comps[3] = {
+            (src[0] & 0x7FFF) * QUAT_SCALE - QUAT_RANGE,
+            (src[1] & 0x7FFF) * QUAT_SCALE - QUAT_RANGE,
+            (src[2] & 0x7FFF) * QUAT_SCALE - QUAT_RANGE
+        };
+        float quat[4];
+        AssembleQuat(src, comps, quat);
+        return Quat(quat[0], quat[1], quat[2], quat[3]);
+    }
+
+#endif
+
+    // 原始数据在time处的值，与压缩后的插值方式一致，用于统计误差
+    template <class ValueType>
+    static ValueType SampleRaw(const std::vector<float>& keys, const std::vector<ValueType>& values, float time)
+    {
+        if (time <= keys.front())
+        {
+            return values.front();
+        }
+
+        if (time >= keys.back())
+        {
+            return values.back();
+        }
+
+        int32 next = (int32)(std::upper_bound(keys.begin(), keys.end(), time) - keys.begin());
+        int32 prev = next - 1;
+        float alpha = (time - keys[prev]) / (keys[next] - keys[prev]);
+        return Interpolate(values[prev], values[next], alpha);
+    }
+
+    // 贪心删除关键帧：从锚点开始尽可能向后延伸，中间所有关键帧都能由插值还原时才跳过
+    template <class ValueType, class ErrorFunc>
+    static std::vector<int32> ReduceKeys(const std::vector<float>& keys, const std::vector<ValueType>& values, float tolerance, ErrorFunc errorFunc)
+    {
+        std::vector<int32> kept;
+        int32 count = (int32)keys.size();
+        if (count == 0)
+        {
+            return kept;
+        }
+
+        kept.push_back(0);
+
+        int32 anchor = 0;
+        for (int32 i = anchor + 2; i < count; ++i)
+        {
+            bool fit = true;
+            for (int32 j = anchor + 1; j < i && fit; ++j)
+            {
+                float range = keys[i] - keys[anchor];
+                float alpha = range > 0.0f ? (keys[j] - keys[anchor]) / range : 0.0f;
+                fit = errorFunc(Interpolate(values[anchor], values[i], alpha), values[j]) <= tolerance;
+            }
+
+            if (!fit)
+            {
+                anchor = i - 1;
+                kept.push_back(anchor);
+            }
+        }
+
+        if (count > 1)
+        {
+            kept.push_back(count - 1);
+        }
+
+        // 常量轨道只保留一帧
+        if (kept.size() == 2 && errorFunc(values[kept[0]], values[kept[1]]) <= tolerance)
+        {
+            bool constant = true;
+            for (int32 i = 1; i < count - 1 && constant; ++i)
+            {
+                constant = errorFunc(values[0], values[i]) <= tolerance;
+            }
+
+            if (constant)
+            {
+                kept.pop_back();
+            }
+        }
+
+        return kept;
+    }
+
+    static void WriteTimes(std::vector<uint8>& data, DVKCompressedClip::Track& track, const std::vector<float>& keys, const std::vector<int32>& kept, float duration)
+    {
+        track.numKeys     = (uint32)kept.size();
+        track.timesOffset = (uint32)data.size();
+        data.resize(data.size() + kept.size() * sizeof(uint16));
+
+        uint16* times = (uint16*)(data.data() + track.timesOffset);
+        for (int32 i = 0; i < kept.size(); ++i)
+        {
+            times[i] = QuantizeTime(keys[kept[i]], duration);
+        }
+
+        track.valuesOffset = (uint32)data.size();
+        data.resize(data.size() + kept.size() * 3 * sizeof(uint16));
+    }
+
+    static void WriteVectorTrack(std::vector<uint8>& data, DVKCompressedClip::Track& track, const std::vector<float>& keys, const std::vector<Vector3>& values, const std::vector<int32>& kept, float duration)
+    {
+        WriteTimes(data, track, keys, kept, duration);
+
+        if (kept.size() == 0)
+        {
+            return;
+        }
+
+        // 轨道范围内的16位定点数
+        Vector3 minValue = values[kept[0]];
+        Vector3 maxValue = values[kept[0]];
+        for (int32 i = 1; i < kept.size(); ++i)
+        {
+            minValue = Vector3::Min(minValue, values[kept[i]]);
+            maxValue = Vector3::Max(maxValue, values[kept[i]]);
+        }
+
+        Vector3 extent = maxValue - minValue;
+        track.offset = minValue;
+        track.scale  = Vector3(extent.x / 65535.0f, extent.y / 65535.0f, extent.z / 65535.0f);
+
+        uint16* dst = (uint16*)(data.data() + track.valuesOffset);
+        for (int32 i = 0; i < kept.size(); ++i)
+        {
+            EncodeVector(values[kept[i]], track.scale, track.offset, dst + i * 3);
+        }
+    }
+
+    static void WriteQuatTrack(std::vector<uint8>& data, DVKCompressedClip::Track& track, const std::vector<float>& keys, const std::vector<Quat>& values, const std::vector<int32>& kept, float duration)
+    {
+        WriteTimes(data, track, keys, kept, duration);
+
+        uint16* dst = (uint16*)(data.data() + track.valuesOffset);
+        for (int32 i = 0; i < kept.size(); ++i)
+        {
+            EncodeQuat(values[kept[i]], dst + i * 3);
+        }
+    }
+
+    template <class ValueType, class ErrorFunc>
+    static float MeasureError(const DVKCompressedClip& clip, const std::vector<float>& keys, const std::vector<ValueType>& values, ErrorFunc errorFunc, ValueType (*getter)(const Quat&, const Vector3&, const Vector3&))
+    {
+        float maxError = 0.0f;
+        for (int32 i = 0; i < keys.size(); ++i)
+        {
+            // 关键帧以及与下一帧的中点
+            for (int32 j = 0; j < 2; ++j)
+            {
+                if (j == 1 && i + 1 >= keys.size())
+                {
+                    break;
+                }
+
+                float time = j == 0 ? keys[i] : (keys[i] + keys[i + 1]) * 0.5f;
+
+                Quat rotation;
+                Vector3 position;
+                Vector3 scale;
+                clip.Sample(time, rotation, position, scale);
+
+                maxError = MMath::Max(maxError, errorFunc(getter(rotation, position, scale), SampleRaw(keys, values, time)));
+            }
+        }
+        return maxError;
+    }
+
+    static Quat GetRotation(const Quat& rotation, const Vector3& position, const Vector3& scale)
+    {
+        return rotation;
+    }
+
+    static Vector3 GetPosition(const Quat& rotation, const Vector3& position, const Vector3& scale)
+    {
+        return position;
+    }
+
+    static Vector3 GetScale(const Quat& rotation, const Vector3& position, const Vector3& scale)
+    {
+        return scale;
+    }
+
+    // -------------------- DVKCompressedClip --------------------
+    DVKCompressedClip DVKCompressedClip::Compress(
+        float duration,
+        const std::vector<float>& rotationKeys, const std::vector<Quat>& rotations,
+        const std::vector<float>& positionKeys, const std::vector<Vector3>& positions,
+        const std::vector<float>& scaleKeys, const std::vector<Vector3>& scales,
+        const DVKAnimCompressionSettings& settings,
+        float errorScale,
+        DVKAnimClipReport* report
+    )
+    {
+        DVKCompressedClip clip;
+        clip.valid    = true;
+        clip.duration = duration;
+
+        // 相邻四元数保持在同一半球，插值走最短路径
+        std::vector<Quat> continuous(rotations.size());
+        for (int32 i = 0; i < rotations.size(); ++i)
+        {
+            continuous[i] = rotations[i].GetNormalized();
+            if (i > 0 && QuatDot(continuous[i], continuous[i - 1]) < 0.0f)
+            {
+                continuous[i] = Quat(-continuous[i].x, -continuous[i].y, -continuous[i].z, -continuous[i].w);
+            }
+        }
+
+        std::vector<int32> keptRotations = ReduceKeys(rotationKeys, continuous, settings.rotationError * errorScale, QuatError);
+        std::vector<int32> keptPositions = ReduceKeys(positionKeys, positions,  settings.positionError * errorScale, VectorError);
+        std::vector<int32> keptScales    = ReduceKeys(scaleKeys,    scales,     settings.scaleError    * errorScale, ScaleError);
+
+        WriteQuatTrack(clip.data,   clip.tracks[RotationTrack], rotationKeys, continuous, keptRotations, duration);
+        WriteVectorTrack(clip.data, clip.tracks[PositionTrack], positionKeys, positions,  keptPositions, duration);
+        WriteVectorTrack(clip.data, clip.tracks[ScaleTrack],    scaleKeys,    scales,     keptScales,    duration);
+
+        if (report)
+        {
+            report->rawKeys  = (int32)(rotationKeys.size() + positionKeys.size() + scaleKeys.size());
+            report->keptKeys = (int32)clip.GetNumKeys();
+            report->rawBytes = (uint32)(
+                rotationKeys.size() * (sizeof(float) + sizeof(Quat)) +
+                positionKeys.size() * (sizeof(float) + sizeof(Vector3)) +
+                scaleKeys.size()    * (sizeof(float) + sizeof(Vector3))
+            );
+            report->compressedBytes = clip.GetDataSize();
+            report->rotationError   = rotationKeys.size() > 0 ? MeasureError(clip, rotationKeys, continuous, QuatError, GetRotation) : 0.0f;
+            report->positionError   = positionKeys.size() > 0 ? MeasureError(clip, positionKeys, positions, VectorError, GetPosition) : 0.0f;
+            report->scaleError      = scaleKeys.size()    > 0 ? MeasureError(clip, scaleKeys,    scales,    ScaleError,  GetScale)    : 0.0f;
+        }
+
+        return clip;
+    }
+
+    void DVKCompressedClip::FindKeys(const Track& track, float time, uint32& outPrev, uint32& outNext, float& outAlpha) const
+    {
+        const uint16* times = (const uint16*)(data.data() + track.timesOffset);
+        float key = duration > 0.0f ? time / duration * 65535.0f : 0.0f;
+
+        outAlpha = 0.0f;
+
+        if (track.numKeys == 1 || key <= times[0])
+        {
+            outPrev = 0;
+            outNext = 0;
+            return;
+        }
+
+        if (key >= times[track.numKeys - 1])
+        {
+            outPrev = track.numKeys - 1;
+            outNext = track.numKeys - 1;
+            return;
+        }
+
+        // 时间是有序的，二分查找
+        const uint16* it = std::upper_bound(times, times + track.numKeys, key, [](float value, uint16 element) {
+            return value < (float)element;
+        });
+
+        outNext  = (uint32)(it - times);
+        outPrev  = outNext - 1;
+        outAlpha = (key - times[outPrev]) / (float)(times[outNext] - times[outPrev]);
+    }
+
+    void DVKCompressedClip::Sample(float time, Quat& outRotation, Vector3& outPosition, Vector3& outScale) const
+    {
+        uint32 prev = 0;
+        uint32 next = 0;
+        float alpha = 0.0f;
+
+        outRotation = Quat(0, 0, 0, 1);
+        outPosition = Vector3(0, 0, 0);
+        outScale    = Vector3(1, 1, 1);
+
+        // rotation
+        const Track& rotationTrack = tracks[RotationTrack];
+        if (rotationTrack.numKeys > 0)
+        {
+            FindKeys(rotationTrack, time, prev, next, alpha);
+            const uint16* values = (const uint16*)(data.data() + rotationTrack.valuesOffset);
+#if DVK_ANIM_SSE
+            float result[4];
+            _mm_storeu_ps(result, LerpQuat(DecodeQuat(values + prev * 3), DecodeQuat(values + next * 3), alpha));
+            outRotation = Quat(result[0], result[1], result[2], result[3]);
+#else
+            outRotation = QuatNLerp(DecodeQuat(values + prev * 3), DecodeQuat(values + next * 3), alpha);
+#endif
+        }
+
+        // position、scale
+        for (int32 i = PositionTrack; i <= ScaleTrack; ++i)
+        {
+            const Track& track = tracks[i];
+            if (track.numKeys == 0)
+            {
+                continue;
+            }
+
+            FindKeys(track, time, prev, next, alpha);
+            const uint16* values = (const uint16*)(data.data() + track.valuesOffset);
+            Vector3& outValue = i == PositionTrack ? outPosition : outScale;
+#if DVK_ANIM_SSE
+            __m128 scale  = _mm_setr_ps(track.scale.x,  track.scale.y,  track.scale.z,  0.0f);
+            __m128 offset = _mm_setr_ps(track.offset.x, track.offset.y, track.offset.z, 0.0f);
+            __m128 a = DecodeVector(values + prev * 3, scale, offset);
+            __m128 b = DecodeVector(values + next * 3, scale, offset);
+
+            float result[4];
+            _mm_storeu_ps(result, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(alpha))));
+            outValue = Vector3(result[0], result[1], result[2]);
+#else
+            outValue = MMath::Lerp(DecodeVector(values + prev * 3, track.scale, track.offset), DecodeVector(values + next * 3, track.scale, track.offset), alpha);
+#endif
+        }
+    }
+
+    void DVKCompressedClip::Evaluate(float time, Matrix4x4& outMatrix) const
+    {
+        Quat rotation;
+        Vector3 position;
+        Vector3 scale;
+        Sample(time, rotation, position, scale);
+
+        outMatrix.SetIdentity();
+        outMatrix.AppendScale(scale);
+        outMatrix.Append(rotation.ToMatrix());
+        outMatrix.AppendTranslation(position);
+    }
+
+    // -------------------- DVKAnimCompressionReport --------------------
+    void DVKAnimCompressionReport::Append(const DVKAnimClipReport& clip)
+    {
+        rawKeys         += clip.rawKeys;
+        keptKeys        += clip.keptKeys;
+        rawBytes        += clip.rawBytes;
+        compressedBytes += clip.compressedBytes;
+        rotationError    = MMath::Max(rotationError, clip.rotationError);
+        positionError    = MMath::Max(positionError, clip.positionError);
+        scaleError       = MMath::Max(scaleError,    clip.scaleError);
+        clips.push_back(clip);
+    }
+
+    void DVKAnimCompressionReport::Print(bool verbose) const
+    {
+        if (verbose)
+        {
+            for (int32 i = 0; i < clips.size(); ++i)
+            {
+                const DVKAnimClipReport& clip = clips[i];
+                MLOG("%s : keys %d -> %d, bytes %u -> %u, error rot %.4f deg pos %.5f scale %.5f", clip.nodeName.c_str(), clip.rawKeys, clip.keptKeys, clip.rawBytes, clip.compressedBytes, MMath::RadiansToDegrees(clip.rotationError), clip.positionError, clip.scaleError);
+            }
+        }
+
+        MLOG("Animation compression : keys %d -> %d, bytes %u -> %u (%.2fx), max error rot %.4f deg pos %.5f scale %.5f", rawKeys, keptKeys, rawBytes, compressedBytes, GetRatio(), MMath::RadiansToDegrees(rotationError), positionError, scaleError);
+    }
+
+}
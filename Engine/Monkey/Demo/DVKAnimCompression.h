@@ -0,0 +1,138 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Quat.h"
+#include "Math/Matrix4x4.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace vk_demo
+{
+
+    struct DVKAnimCompressionSettings
+    {
+        // 删除关键帧时允许的误差，rotation为弧度，position为模型单位
+        float   rotationError = 0.0005f;
+        float   positionError = 0.001f;
+        float   scaleError = 0.0001f;
+
+        // 按节点名缩放误差，例如根骨骼、手指可以分别给更严格、更宽松的误差
+        std::unordered_map<std::string, float> boneErrorScales;
+    };
+
+    struct DVKAnimClipReport
+    {
+        std::string nodeName;
+
+        int32   rawKeys = 0;
+        int32   keptKeys = 0;
+        uint32  rawBytes = 0;
+        uint32  compressedBytes = 0;
+
+        // 在原始关键帧以及相邻关键帧中点处与原始数据比较得到的最大误差
+        float   rotationError = 0.0f;
+        float   positionError = 0.0f;
+        float   scaleError = 0.0f;
+    };
+
+    struct DVKAnimCompressionReport
+    {
+        int32   rawKeys = 0;
+        int32   keptKeys = 0;
+        uint32  rawBytes = 0;
+        uint32  compressedBytes = 0;
+
+        float   rotationError = 0.0f;
+        float   positionError = 0.0f;
+        float   scaleError = 0.0f;
+
+        std::vector<DVKAnimClipReport> clips;
+
+        void Append(const DVKAnimClipReport& clip);
+
+        FORCE_INLINE float GetRatio() const
+        {
+            return compressedBytes > 0 ? (float)rawBytes / compressedBytes : 0.0f;
+        }
+
+        // verbose时输出每个Clip
+        void Print(bool verbose = false) const;
+    };
+
+    // 压缩后的节点动画，所有数据存放在一块连续内存中：
+    // 每个轨道依次为关键帧时间(uint16，相对duration量化)以及关键帧数值，
+    // rotation使用smallest-three 48位编码，position/scale使用轨道范围内的16位定点数。
+    class DVKCompressedClip
+    {
+    public:
+        struct Track
+        {
+            uint32  numKeys = 0;
+            // data中的字节偏移
+            uint32  timesOffset = 0;
+            uint32  valuesOffset = 0;
+            // 反量化：value = q * scale + offset，rotation不使用
+            Vector3 scale;
+            Vector3 offset;
+        };
+
+        enum TrackType
+        {
+            RotationTrack = 0,
+            PositionTrack,
+            ScaleTrack,
+            TrackCount
+        };
+
+        DVKCompressedClip()
+        {
+
+        }
+
+        // keys/values为原始关键帧，errorScale为该节点误差的缩放，report不为空时写入误差统计
+        static DVKCompressedClip Compress(
+            float duration,
+            const std::vector<float>& rotationKeys, const std::vector<Quat>& rotations,
+            const std::vector<float>& positionKeys, const std::vector<Vector3>& positions,
+            const std::vector<float>& scaleKeys, const std::vector<Vector3>& scales,
+            const DVKAnimCompressionSettings& settings,
+            float errorScale = 1.0f,
+            DVKAnimClipReport* report = nullptr
+        );
+
+        void Sample(float time, Quat& outRotation, Vector3& outPosition, Vector3& outScale) const;
+
+        void Evaluate(float time, Matrix4x4& outMatrix) const;
+
+        FORCE_INLINE bool IsValid() const
+        {
+            return valid;
+        }
+
+        FORCE_INLINE uint32 GetNumKeys() const
+        {
+            return tracks[RotationTrack].numKeys + tracks[PositionTrack].numKeys + tracks[ScaleTrack].numKeys;
+        }
+
+        FORCE_INLINE uint32 GetDataSize() const
+        {
+            return (uint32)(data.size() + sizeof(tracks) + sizeof(duration));
+        }
+
+    private:
+
+        // 找到time所在的两个关键帧
+        void FindKeys(const Track& track, float time, uint32& outPrev, uint32& outNext, float& outAlpha) const;
+
+    public:
+        bool                valid = false;
+        float               duration = 0.0f;
+        Track               tracks[TrackCount];
+        std::vector<uint8>  data;
+    };
+
+}
@@ -0,0 +1,269 @@
+﻿#include "DVKAssetLoader.h"
+#include "FileManager.h"
+
+#include "Math/Math.h"
+#include "Loader/ImageLoader.h"
+
+namespace vk_demo
+{
+
+    DVKAssetLoader::~DVKAssetLoader()
+    {
+        // 先执行完已经提交的任务，保证不会有线程再访问资源
+        {
+            std::lock_guard<std::mutex> lockGuard(mutex);
+            running = false;
+        }
+        taskCV.notify_all();
+
+        for (int32 i = 0; i < workers.size(); ++i)
+        {
+            workers[i].join();
+        }
+        workers.clear();
+
+        // 没有上传的资源直接释放CPU数据
+        for (int32 i = 0; i < uploads.size(); ++i)
+        {
+            DVKAssetHandle& asset = uploads[i];
+            if (asset->model)
+            {
+                delete asset->model;
+                asset->model = nullptr;
+            }
+            if (asset->pixels)
+            {
+                StbImage::Free(asset->pixels);
+                asset->pixels = nullptr;
+            }
+            asset->state = DVKAssetState::Failed;
+        }
+        uploads.clear();
+
+        device = nullptr;
+    }
+
+    DVKAssetLoader* DVKAssetLoader::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, int32 numWorkers)
+    {
+        if (numWorkers <= 0)
+        {
+            numWorkers = MMath::Max((int32)std::thread::hardware_concurrency() - 1, 1);
+        }
+
+        DVKAssetLoader* loader = new DVKAssetLoader();
+        loader->device    = vulkanDevice;
+        loader->cmdBuffer = cmdBuffer;
+        loader->inFlight  = 0;
+
+        for (int32 i = 0; i < numWorkers; ++i)
+        {
+            loader->workers.push_back(std::thread(&DVKAssetLoader::WorkerLoop, loader));
+        }
+
+        return loader;
+    }
+
+    DVKAssetHandle DVKAssetLoader::LoadModel(const std::string& filename, const std::vector<VertexAttribute>& attributes, const DVKModelLoadOptions& options)
+    {
+        DVKAssetHandle asset = std::make_shared<DVKAsset>();
+        asset->filename = filename;
+
+        // 排队期间让内核先读取文件
+        FileManager::PrefetchFile(filename);
+
+        inFlight += 1;
+        PushTask([this, asset, attributes, options]() {
+            ImportModel(asset, attributes, options);
+        });
+
+        return asset;
+    }
+
+    DVKAssetHandle DVKAssetLoader::LoadTexture2D(const std::string& filename, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
+    {
+        DVKAssetHandle asset = std::make_shared<DVKAsset>();
+        asset->filename    = filename;
+        asset->imageUsage  = imageUsageFlags;
+        asset->imageLayout = imageLayout;
+
+        FileManager::PrefetchFile(filename);
+
+        inFlight += 1;
+        PushTask([this, asset]() {
+            DecodeTexture(asset);
+        });
+
+        return asset;
+    }
+
+    int32 DVKAssetLoader::Update(int32 maxUploads)
+    {
+        int32 uploaded = 0;
+
+        while (maxUploads < 0 || uploaded < maxUploads)
+        {
+            DVKAssetHandle asset;
+            {
+                std::lock_guard<std::mutex> lockGuard(uploadMutex);
+                if (uploads.empty())
+                {
+                    break;
+                }
+                asset = uploads.front();
+                uploads.pop_front();
+            }
+
+            if (asset->model)
+            {
+                asset->model->Upload(cmdBuffer);
+            }
+            else
+            {
+                asset->texture = DVKTexture::Create2D(asset->pixels, asset->width * asset->height * 4, VK_FORMAT_R8G8B8A8_UNORM, asset->width, asset->height, device, cmdBuffer, asset->imageUsage, asset->imageLayout);
+                StbImage::Free(asset->pixels);
+                asset->pixels = nullptr;
+            }
+
+            Complete(asset, DVKAssetState::Ready);
+            uploaded += 1;
+        }
+
+        return uploaded;
+    }
+
+    void DVKAssetLoader::Wait(const DVKAssetHandle& handle)
+    {
+        while (!handle->IsDone())
+        {
+            Update();
+
+            std::unique_lock<std::mutex> lock(uploadMutex);
+            uploadCV.wait(lock, [this, &handle] { return !uploads.empty() || handle->IsDone(); });
+        }
+    }
+
+    void DVKAssetLoader::Flush()
+    {
+        while (!IsIdle())
+        {
+            Update();
+
+            std::unique_lock<std::mutex> lock(uploadMutex);
+            uploadCV.wait(lock, [this] { return !uploads.empty() || IsIdle(); });
+        }
+    }
+
+    void DVKAssetLoader::WorkerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskCV.wait(lock, [this] { return !running || !tasks.empty(); });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    void DVKAssetLoader::PushTask(const std::function<void()>& task)
+    {
+        {
+            std::lock_guard<std::mutex> lockGuard(mutex);
+            tasks.push_back(task);
+        }
+        taskCV.notify_one();
+    }
+
+    void DVKAssetLoader::PushUpload(const DVKAssetHandle& asset)
+    {
+        asset->state = DVKAssetState::Decoded;
+        {
+            std::lock_guard<std::mutex> lockGuard(uploadMutex);
+            uploads.push_back(asset);
+        }
+        uploadCV.notify_all();
+    }
+
+    void DVKAssetLoader::Complete(const DVKAssetHandle& asset, DVKAssetState state)
+    {
+        {
+            // 在锁内修改，避免等待的线程错过唤醒
+            std::lock_guard<std::mutex> lockGuard(uploadMutex);
+            asset->state = state;
+            inFlight -= 1;
+        }
+        uploadCV.notify_all();
+    }
+
+    void DVKAssetLoader::ImportModel(DVKAssetHandle asset, std::vector<VertexAttribute> attributes, DVKModelLoadOptions options)
+    {
+        // Assimp导入以及节点、骨骼、动画的建立只能串行执行
+        asset->model = DVKModel::ImportFile(asset->filename, device, attributes, options);
+
+        int32 count = asset->model->GetNumPendingMeshes();
+        if (count == 0)
+        {
+            FinishModel(asset);
+            return;
+        }
+
+        // 每个Mesh一个任务，和其它资源的任务一起分摊到所有工作线程，最后完成的任务负责收尾
+        asset->pendingJobs = count;
+        for (int32 i = 0; i < count; ++i)
+        {
+            PushTask([this, asset, i]() {
+                asset->model->LoadPendingMeshes(i, i + 1);
+                if (asset->pendingJobs.fetch_sub(1) == 1)
+                {
+                    FinishModel(asset);
+                }
+            });
+        }
+    }
+
+    void DVKAssetLoader::FinishModel(const DVKAssetHandle& asset)
+    {
+        if (!asset->model->FinishImport())
+        {
+            delete asset->model;
+            asset->model = nullptr;
+            Complete(asset, DVKAssetState::Failed);
+            return;
+        }
+
+        PushUpload(asset);
+    }
+
+    void DVKAssetLoader::DecodeTexture(DVKAssetHandle asset)
+    {
+        FileMappingRef mapping = FileManager::MapFile(asset->filename);
+        if (!mapping)
+        {
+            MLOGE("Failed load image : %s", asset->filename.c_str());
+            Complete(asset, DVKAssetState::Failed);
+            return;
+        }
+
+        int32 comp = 0;
+        asset->pixels = StbImage::LoadFromMemory(mapping->GetData(), mapping->GetSize(), &asset->width, &asset->height, &comp, 4);
+
+        mapping = nullptr;
+
+        if (asset->pixels == nullptr)
+        {
+            MLOGE("Failed load image : %s", asset->filename.c_str());
+            Complete(asset, DVKAssetState::Failed);
+            return;
+        }
+
+        PushUpload(asset);
+    }
+
+}
@@ -0,0 +1,155 @@
+﻿#pragma once
+
+#include "DVKCommand.h"
+#include "DVKModel.h"
+#include "DVKTexture.h"
+
+#include "Common/Common.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace vk_demo
+{
+
+    enum class DVKAssetState
+    {
+        // 工作线程正在解码或者处理
+        Loading = 0,
+        // CPU数据已经就绪，等待上传
+        Decoded = 1,
+        // GPU资源已经创建，可以使用
+        Ready   = 2,
+        Failed  = 3,
+    };
+
+    // 一个异步加载的资源，Ready之后model或者texture可用，由调用者负责释放
+    struct DVKAsset
+    {
+        std::string                 filename;
+        std::atomic<DVKAssetState>  state;
+
+        DVKModel*                   model = nullptr;
+        DVKTexture*                 texture = nullptr;
+
+        // 纹理的解码结果，上传后释放
+        uint8*                      pixels = nullptr;
+        int32                       width = 0;
+        int32                       height = 0;
+        VkImageUsageFlags           imageUsage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        ImageLayoutBarrier          imageLayout = ImageLayoutBarrier::PixelShaderRead;
+
+        // 模型尚未处理完的Mesh任务数
+        std::atomic<int32>          pendingJobs;
+
+        DVKAsset()
+            : state(DVKAssetState::Loading)
+            , pendingJobs(0)
+        {
+
+        }
+
+        FORCE_INLINE bool IsReady() const
+        {
+            return state == DVKAssetState::Ready;
+        }
+
+        FORCE_INLINE bool IsFailed() const
+        {
+            return state == DVKAssetState::Failed;
+        }
+
+        FORCE_INLINE bool IsDone() const
+        {
+            return IsReady() || IsFailed();
+        }
+    };
+
+    typedef std::shared_ptr<DVKAsset> DVKAssetHandle;
+
+    // 异步资源加载：图片解码、Assimp导入以及每个Mesh的顶点交错、Primitive切分与优化都作为任务在工作线程上执行，
+    // 处理完成的CPU数据交给上传队列，由调用Update的线程统一创建GPU资源。Vulkan对象只在Update中访问。
+    class DVKAssetLoader
+    {
+    private:
+        DVKAssetLoader()
+        {
+
+        }
+
+    public:
+        ~DVKAssetLoader();
+
+        // numWorkers为0时使用hardware_concurrency - 1个工作线程，至少一个
+        static DVKAssetLoader* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, int32 numWorkers = 0);
+
+        DVKAssetHandle LoadModel(const std::string& filename, const std::vector<VertexAttribute>& attributes, const DVKModelLoadOptions& options = DVKModelLoadOptions());
+
+        DVKAssetHandle LoadTexture2D(const std::string& filename, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead);
+
+        // 上传已经解码完成的资源，maxUploads小于0时全部上传，返回本次上传的数量。需在提交cmdBuffer的线程每帧调用
+        int32 Update(int32 maxUploads = -1);
+
+        // 在调用线程上持续上传，直到handle完成
+        void Wait(const DVKAssetHandle& handle);
+
+        // 等待所有已提交的资源完成
+        void Flush();
+
+        FORCE_INLINE bool IsIdle() const
+        {
+            return inFlight == 0;
+        }
+
+        FORCE_INLINE int32 GetThreadCount() const
+        {
+            return (int32)workers.size();
+        }
+
+    private:
+
+        void WorkerLoop();
+
+        void PushTask(const std::function<void()>& task);
+
+        void PushUpload(const DVKAssetHandle& asset);
+
+        void ImportModel(DVKAssetHandle asset, std::vector<VertexAttribute> attributes, DVKModelLoadOptions options);
+
+        void DecodeTexture(DVKAssetHandle asset);
+
+        void FinishModel(const DVKAssetHandle& asset);
+
+        // 标记为Ready或者Failed并唤醒等待的线程
+        void Complete(const DVKAssetHandle& asset, DVKAssetState state);
+
+    public:
+
+        std::shared_ptr<VulkanDevice>       device;
+        DVKCommandBuffer*                   cmdBuffer = nullptr;
+        std::vector<std::thread>            workers;
+
+    private:
+
+        std::mutex                          mutex;
+        std::condition_variable             taskCV;
+        std::deque<std::function<void()>>   tasks;
+        bool                                running = true;
+
+        std::mutex                          uploadMutex;
+        std::condition_variable             uploadCV;
+        std::deque<DVKAssetHandle>          uploads;
+
+        // 已提交但还没有完成的资源数量
+        std::atomic<int32>                  inFlight;
+    };
+
+}
@@ -0,0 +1,298 @@
+﻿#include "DVKAsyncCompute.h"
+
+#include "Math/Math.h"
+
+namespace vk_demo
+{
+
+    DVKTimelineSemaphore::~DVKTimelineSemaphore()
+    {
+        for (int32 i = 0; i < semaphores.size(); ++i)
+        {
+            vkDestroySemaphore(device, semaphores[i], VULKAN_CPU_ALLOCATOR);
+        }
+        semaphores.clear();
+    }
+
+    DVKTimelineSemaphore* DVKTimelineSemaphore::Create(std::shared_ptr<VulkanDevice> vulkanDevice, int32 fallbackCount)
+    {
+        DVKTimelineSemaphore* semaphore = new DVKTimelineSemaphore();
+        semaphore->device   = vulkanDevice->GetInstanceHandle();
+        semaphore->timeline = vulkanDevice->SupportsTimelineSemaphore();
+
+        VkSemaphoreTypeCreateInfoKHR typeInfo;
+        ZeroVulkanStruct(typeInfo, VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR);
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        typeInfo.initialValue  = 0;
+
+        VkSemaphoreCreateInfo createInfo;
+        ZeroVulkanStruct(createInfo, VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO);
+        createInfo.pNext = semaphore->timeline ? &typeInfo : nullptr;
+
+        int32 count = semaphore->timeline ? 1 : MMath::Max(fallbackCount, 1);
+        semaphore->semaphores.resize(count);
+        for (int32 i = 0; i < count; ++i)
+        {
+            VERIFYVULKANRESULT(vkCreateSemaphore(semaphore->device, &createInfo, VULKAN_CPU_ALLOCATOR, &semaphore->semaphores[i]));
+        }
+
+        if (semaphore->timeline)
+        {
+            semaphore->m_WaitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(semaphore->device, "vkWaitSemaphoresKHR"));
+        }
+
+        return semaphore;
+    }
+
+    bool DVKTimelineSemaphore::Wait(uint64 value, uint64 timeout)
+    {
+        if (!timeline || !m_WaitSemaphores)
+        {
+            return false;
+        }
+
+        uint64_t waitValue = value;
+
+        VkSemaphoreWaitInfoKHR waitInfo;
+        ZeroVulkanStruct(waitInfo, VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR);
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores    = &semaphores[0];
+        waitInfo.pValues        = &waitValue;
+
+        return m_WaitSemaphores(device, &waitInfo, timeout) == VK_SUCCESS;
+    }
+
+    void DVKQueueSubmit::AddCommandBuffer(VkCommandBuffer commandBuffer)
+    {
+        commandBuffers.push_back(commandBuffer);
+    }
+
+    void DVKQueueSubmit::Wait(VkSemaphore semaphore, VkPipelineStageFlags waitStage)
+    {
+        waitSemaphores.push_back(semaphore);
+        waitValues.push_back(0);
+        waitStages.push_back(waitStage);
+    }
+
+    void DVKQueueSubmit::Wait(DVKTimelineSemaphore* semaphore, uint64 value, VkPipelineStageFlags waitStage)
+    {
+        waitSemaphores.push_back(semaphore->GetHandle(value));
+        waitValues.push_back(value);
+        waitStages.push_back(waitStage);
+        timeline = timeline || semaphore->timeline;
+    }
+
+    void DVKQueueSubmit::Signal(VkSemaphore semaphore)
+    {
+        signalSemaphores.push_back(semaphore);
+        signalValues.push_back(0);
+    }
+
+    void DVKQueueSubmit::Signal(DVKTimelineSemaphore* semaphore, uint64 value)
+    {
+        signalSemaphores.push_back(semaphore->GetHandle(value));
+        signalValues.push_back(value);
+        timeline = timeline || semaphore->timeline;
+    }
+
+    VkResult DVKQueueSubmit::Submit(VkQueue queue, VkFence fence) const
+    {
+        // binary semaphore对应的值会被忽略
+        VkTimelineSemaphoreSubmitInfoKHR timelineInfo;
+        ZeroVulkanStruct(timelineInfo, VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR);
+        timelineInfo.waitSemaphoreValueCount   = (uint32_t)waitValues.size();
+        timelineInfo.pWaitSemaphoreValues      = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = (uint32_t)signalValues.size();
+        timelineInfo.pSignalSemaphoreValues    = signalValues.data();
+
+        VkSubmitInfo submitInfo;
+        ZeroVulkanStruct(submitInfo, VK_STRUCTURE_TYPE_SUBMIT_INFO);
+        submitInfo.pNext                = timeline ? &timelineInfo : nullptr;
+        submitInfo.commandBufferCount   = (uint32_t)commandBuffers.size();
+        submitInfo.pCommandBuffers      = commandBuffers.data();
+        submitInfo.waitSemaphoreCount   = (uint32_t)waitSemaphores.size();
+        submitInfo.pWaitSemaphores      = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask    = waitStages.data();
+        submitInfo.signalSemaphoreCount = (uint32_t)signalSemaphores.size();
+        submitInfo.pSignalSemaphores    = signalSemaphores.data();
+
+        return vkQueueSubmit(queue, 1, &submitInfo, fence);
+    }
+
+    static void RecordBufferBarriers(VkCommandBuffer commandBuffer, const std::vector<DVKBufferRange>& ranges, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        std::vector<VkBufferMemoryBarrier> bufferBarriers(ranges.size());
+        for (int32 i = 0; i < ranges.size(); ++i)
+        {
+            ZeroVulkanStruct(bufferBarriers[i], VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
+            bufferBarriers[i].srcAccessMask       = srcAccess;
+            bufferBarriers[i].dstAccessMask       = dstAccess;
+            bufferBarriers[i].srcQueueFamilyIndex = srcFamily;
+            bufferBarriers[i].dstQueueFamilyIndex = dstFamily;
+            bufferBarriers[i].buffer              = ranges[i].buffer;
+            bufferBarriers[i].offset              = ranges[i].offset;
+            bufferBarriers[i].size                = ranges[i].size;
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, (uint32_t)bufferBarriers.size(), bufferBarriers.data(), 0, nullptr);
+    }
+
+    static void RecordImageBarrier(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        VkImageMemoryBarrier imageBarrier;
+        ZeroVulkanStruct(imageBarrier, VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER);
+        imageBarrier.srcAccessMask       = srcAccess;
+        imageBarrier.dstAccessMask       = dstAccess;
+        imageBarrier.oldLayout           = oldLayout;
+        imageBarrier.newLayout           = newLayout;
+        imageBarrier.srcQueueFamilyIndex = srcFamily;
+        imageBarrier.dstQueueFamilyIndex = dstFamily;
+        imageBarrier.image               = image;
+        imageBarrier.subresourceRange    = range;
+
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+    }
+
+    // Release的dstAccess与Acquire的srcAccess会被忽略，执行顺序由Semaphore保证
+    void DVKQueueOwnership::ReleaseBuffers(VkCommandBuffer commandBuffer, const std::vector<DVKBufferRange>& ranges, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess)
+    {
+        if (srcFamily == dstFamily || ranges.size() == 0)
+        {
+            return;
+        }
+        RecordBufferBarriers(commandBuffer, ranges, srcFamily, dstFamily, srcStage, srcAccess, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+    }
+
+    void DVKQueueOwnership::AcquireBuffers(VkCommandBuffer commandBuffer, const std::vector<DVKBufferRange>& ranges, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        if (srcFamily == dstFamily || ranges.size() == 0)
+        {
+            return;
+        }
+        RecordBufferBarriers(commandBuffer, ranges, srcFamily, dstFamily, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, dstStage, dstAccess);
+    }
+
+    void DVKQueueOwnership::ReleaseImage(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess)
+    {
+        if (srcFamily == dstFamily)
+        {
+            return;
+        }
+        RecordImageBarrier(commandBuffer, image, range, oldLayout, newLayout, srcFamily, dstFamily, srcStage, srcAccess, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+    }
+
+    void DVKQueueOwnership::AcquireImage(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        if (srcFamily == dstFamily)
+        {
+            return;
+        }
+        RecordImageBarrier(commandBuffer, image, range, oldLayout, newLayout, srcFamily, dstFamily, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, dstStage, dstAccess);
+    }
+
+    DVKAsyncCompute::~DVKAsyncCompute()
+    {
+        WaitIdle();
+
+        for (int32 i = 0; i < m_Commands.size(); ++i)
+        {
+            delete m_Commands[i];
+        }
+        m_Commands.clear();
+
+        delete semaphore;
+        semaphore = nullptr;
+
+        vkDestroyCommandPool(vulkanDevice->GetInstanceHandle(), commandPool, VULKAN_CPU_ALLOCATOR);
+        commandPool = VK_NULL_HANDLE;
+
+        queue = nullptr;
+        vulkanDevice = nullptr;
+    }
+
+    DVKAsyncCompute* DVKAsyncCompute::Create(std::shared_ptr<VulkanDevice> vulkanDevice, int32 frameCount)
+    {
+        frameCount = MMath::Max(frameCount, 1);
+
+        DVKAsyncCompute* compute = new DVKAsyncCompute();
+        compute->vulkanDevice = vulkanDevice;
+        compute->queue        = vulkanDevice->GetAsyncComputeQueue();
+
+        VkCommandPoolCreateInfo poolCreateInfo;
+        ZeroVulkanStruct(poolCreateInfo, VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO);
+        poolCreateInfo.queueFamilyIndex = compute->queue->GetFamilyIndex();
+        poolCreateInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        VERIFYVULKANRESULT(vkCreateCommandPool(vulkanDevice->GetInstanceHandle(), &poolCreateInfo, VULKAN_CPU_ALLOCATOR, &compute->commandPool));
+
+        // binary模式下等待方最多落后frameCount次提交
+        compute->semaphore = DVKTimelineSemaphore::Create(vulkanDevice, frameCount + 1);
+
+        compute->m_Commands.resize(frameCount);
+        compute->m_Pending.resize(frameCount, false);
+        for (int32 i = 0; i < frameCount; ++i)
+        {
+            compute->m_Commands[i] = compute->CreateCommandBuffer();
+        }
+
+        return compute;
+    }
+
+    DVKCommandBuffer* DVKAsyncCompute::CreateCommandBuffer()
+    {
+        return DVKCommandBuffer::Create(vulkanDevice, commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, queue);
+    }
+
+    VkCommandBuffer DVKAsyncCompute::Begin()
+    {
+        DVKCommandBuffer* command = m_Commands[m_Current];
+
+        if (m_Pending[m_Current])
+        {
+            vkWaitForFences(vulkanDevice->GetInstanceHandle(), 1, &(command->fence), VK_TRUE, MAX_uint64);
+            m_Pending[m_Current] = false;
+        }
+
+        command->Begin();
+        return command->cmdBuffer;
+    }
+
+    uint64 DVKAsyncCompute::Submit(const DVKQueueSubmit& submitInfo)
+    {
+        DVKCommandBuffer* command = m_Commands[m_Current];
+        command->End();
+
+        submitted += 1;
+
+        DVKQueueSubmit computeSubmit = submitInfo;
+        computeSubmit.AddCommandBuffer(command->cmdBuffer);
+        computeSubmit.Signal(semaphore, submitted);
+
+        vkResetFences(vulkanDevice->GetInstanceHandle(), 1, &(command->fence));
+        VERIFYVULKANRESULT(computeSubmit.Submit(queue->GetHandle(), command->fence));
+
+        m_Pending[m_Current] = true;
+        m_Current = (m_Current + 1) % m_Commands.size();
+
+        return submitted;
+    }
+
+    void DVKAsyncCompute::WaitFor(DVKQueueSubmit& submitInfo, uint64 value, VkPipelineStageFlags waitStage)
+    {
+        if (value == 0)
+        {
+            return;
+        }
+        submitInfo.Wait(semaphore, value, waitStage);
+    }
+
+    void DVKAsyncCompute::WaitIdle()
+    {
+        vkQueueWaitIdle(queue->GetHandle());
+
+        for (int32 i = 0; i < m_Pending.size(); ++i)
+        {
+            m_Pending[i] = false;
+        }
+    }
+
+}
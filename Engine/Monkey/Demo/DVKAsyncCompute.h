@@ -0,0 +1,153 @@
+﻿#pragma once
+
+#include "DVKCommand.h"
+
+#include "Common/Common.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <memory>
+#include <vector>
+
+namespace vk_demo
+{
+
+    // 跨队列的同步点，以递增的值表示。设备支持VK_KHR_timeline_semaphore时为一个timeline semaphore；
+    // 否则退化为一组轮流使用的binary semaphore，值N对应semaphores[N % count]，每个值必须且只能被等待一次。
+    class DVKTimelineSemaphore
+    {
+    private:
+        DVKTimelineSemaphore()
+        {
+
+        }
+
+    public:
+        ~DVKTimelineSemaphore();
+
+        // fallbackCount为binary模式下的semaphore数量，需大于同时未被等待的值的数量
+        static DVKTimelineSemaphore* Create(std::shared_ptr<VulkanDevice> vulkanDevice, int32 fallbackCount = 3);
+
+        VkSemaphore GetHandle(uint64 value) const
+        {
+            return timeline ? semaphores[0] : semaphores[value % semaphores.size()];
+        }
+
+        // CPU等待value完成，binary模式无法在CPU端等待，直接返回false
+        bool Wait(uint64 value, uint64 timeout = MAX_uint64);
+
+    public:
+        VkDevice                    device = VK_NULL_HANDLE;
+        bool                        timeline = false;
+        std::vector<VkSemaphore>    semaphores;
+
+    private:
+        PFN_vkWaitSemaphoresKHR     m_WaitSemaphores = nullptr;
+    };
+
+    // 一次vkQueueSubmit的描述，timeline与binary semaphore可以混用
+    class DVKQueueSubmit
+    {
+    public:
+        void AddCommandBuffer(VkCommandBuffer commandBuffer);
+
+        void Wait(VkSemaphore semaphore, VkPipelineStageFlags waitStage);
+
+        void Wait(DVKTimelineSemaphore* semaphore, uint64 value, VkPipelineStageFlags waitStage);
+
+        void Signal(VkSemaphore semaphore);
+
+        void Signal(DVKTimelineSemaphore* semaphore, uint64 value);
+
+        VkResult Submit(VkQueue queue, VkFence fence = VK_NULL_HANDLE) const;
+
+    public:
+        std::vector<VkCommandBuffer>        commandBuffers;
+        std::vector<VkSemaphore>            waitSemaphores;
+        std::vector<uint64_t>               waitValues;
+        std::vector<VkPipelineStageFlags>   waitStages;
+        std::vector<VkSemaphore>            signalSemaphores;
+        std::vector<uint64_t>               signalValues;
+        bool                                timeline = false;
+    };
+
+    struct DVKBufferRange
+    {
+        VkBuffer        buffer = VK_NULL_HANDLE;
+        VkDeviceSize    offset = 0;
+        VkDeviceSize    size = VK_WHOLE_SIZE;
+    };
+
+    // 队列族所有权转移：Release录制在srcFamily队列的CommandBuffer中，Acquire录制在dstFamily队列的CommandBuffer中，
+    // 两次提交之间由Semaphore保证顺序。队列族相同时不需要转移，不录制任何命令，可见性由Semaphore保证。
+    // 不需要保留原有内容时可以不做转移，直接在新的队列上整体写入。
+    class DVKQueueOwnership
+    {
+    public:
+        static void ReleaseBuffers(VkCommandBuffer commandBuffer, const std::vector<DVKBufferRange>& ranges, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess);
+
+        static void AcquireBuffers(VkCommandBuffer commandBuffer, const std::vector<DVKBufferRange>& ranges, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+        // 布局转换需要在Release与Acquire中填写相同的oldLayout与newLayout
+        static void ReleaseImage(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess);
+
+        static void AcquireImage(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout, uint32 srcFamily, uint32 dstFamily, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+    };
+
+    // 异步Compute：在VulkanDevice::GetAsyncComputeQueue上提交，第N次提交完成时semaphore到达值N(从1开始)。
+    // Graphics提交时通过WaitFor等待需要的值，CPU不等待Compute；CommandBuffer按frameCount轮流使用，
+    // 只有Compute落后frameCount帧时Begin才会在CPU端等待。
+    class DVKAsyncCompute
+    {
+    private:
+        DVKAsyncCompute()
+        {
+
+        }
+
+    public:
+        ~DVKAsyncCompute();
+
+        static DVKAsyncCompute* Create(std::shared_ptr<VulkanDevice> vulkanDevice, int32 frameCount = 2);
+
+        // 开始录制下一次提交
+        VkCommandBuffer Begin();
+
+        // 提交Begin之后录制的命令，submitInfo中可以额外等待其它队列，返回本次提交完成时的值
+        uint64 Submit(const DVKQueueSubmit& submitInfo = DVKQueueSubmit());
+
+        // 让submitInfo在waitStage等待第value次Compute提交完成，value为0时不等待
+        void WaitFor(DVKQueueSubmit& submitInfo, uint64 value, VkPipelineStageFlags waitStage);
+
+        // 录制在Compute队列上的一次性命令，例如初始化Compute使用的Buffer，避免所有权转移
+        DVKCommandBuffer* CreateCommandBuffer();
+
+        // Compute与Graphics在不同的队列上时才能并行执行
+        bool IsAsync() const
+        {
+            return queue->GetHandle() != vulkanDevice->GetGraphicsQueue()->GetHandle();
+        }
+
+        uint32 GetFamilyIndex() const
+        {
+            return queue->GetFamilyIndex();
+        }
+
+        void WaitIdle();
+
+    public:
+        std::shared_ptr<VulkanDevice>   vulkanDevice = nullptr;
+        std::shared_ptr<VulkanQueue>    queue = nullptr;
+
+        VkCommandPool                   commandPool = VK_NULL_HANDLE;
+        DVKTimelineSemaphore*           semaphore = nullptr;
+
+        // 已经提交的次数，即最后一次提交的值
+        uint64                          submitted = 0;
+
+    private:
+        std::vector<DVKCommandBuffer*>  m_Commands;
+        std::vector<bool>               m_Pending;
+        int32                           m_Current = 0;
+    };
+
+}
@@ -0,0 +1,305 @@
+﻿#include "DVKBindless.h"
+
+#include "Common/Log.h"
+
+namespace vk_demo
+{
+
+    DVKBindlessTable::~DVKBindlessTable()
+    {
+        VkDevice device = vulkanDevice->GetInstanceHandle();
+
+        if (descriptorPool != VK_NULL_HANDLE)
+        {
+            vkDestroyDescriptorPool(device, descriptorPool, VULKAN_CPU_ALLOCATOR);
+            descriptorPool = VK_NULL_HANDLE;
+            descriptorSet  = VK_NULL_HANDLE;
+        }
+
+        if (pipelineLayout != VK_NULL_HANDLE)
+        {
+            vkDestroyPipelineLayout(device, pipelineLayout, VULKAN_CPU_ALLOCATOR);
+            pipelineLayout = VK_NULL_HANDLE;
+        }
+
+        if (descriptorSetLayout != VK_NULL_HANDLE)
+        {
+            vkDestroyDescriptorSetLayout(device, descriptorSetLayout, VULKAN_CPU_ALLOCATOR);
+            descriptorSetLayout = VK_NULL_HANDLE;
+        }
+    }
+
+    void DVKBindlessTable::SetupFeatures(VkPhysicalDeviceDescriptorIndexingFeaturesEXT& indexingFeatures)
+    {
+        indexingFeatures.runtimeDescriptorArray                        = VK_TRUE;
+        indexingFeatures.descriptorBindingPartiallyBound               = VK_TRUE;
+        indexingFeatures.descriptorBindingUpdateUnusedWhilePending     = VK_TRUE;
+        indexingFeatures.descriptorBindingSampledImageUpdateAfterBind  = VK_TRUE;
+        indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing     = VK_TRUE;
+        indexingFeatures.shaderStorageBufferArrayNonUniformIndexing    = VK_TRUE;
+    }
+
+    DVKBindlessTable* DVKBindlessTable::Create(std::shared_ptr<VulkanDevice> vulkanDevice, uint32 maxTextures, uint32 maxBuffers, uint32 pushConstantSize)
+    {
+        VkDevice device = vulkanDevice->GetInstanceHandle();
+
+        if (maxTextures == 0 || maxBuffers == 0)
+        {
+            MLOGE("Bindless table needs at least one texture and one buffer slot.");
+            return nullptr;
+        }
+
+        VkDescriptorSetLayoutBinding bindings[2] = { };
+        bindings[0].binding         = TextureBinding;
+        bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = maxTextures;
+        bindings[0].stageFlags      = VK_SHADER_STAGE_ALL;
+        bindings[1].binding         = BufferBinding;
+        bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[1].descriptorCount = maxBuffers;
+        bindings[1].stageFlags      = VK_SHADER_STAGE_ALL;
+
+        // 未注册的下标不会被访问，已绑定的Set也可以继续写入未使用的下标
+        VkDescriptorBindingFlagsEXT bindingFlags[2];
+        bindingFlags[0] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+        bindingFlags[1] = bindingFlags[0];
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo;
+        ZeroVulkanStruct(bindingFlagsInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT);
+        bindingFlagsInfo.bindingCount  = 2;
+        bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo;
+        ZeroVulkanStruct(setLayoutInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO);
+        setLayoutInfo.pNext        = &bindingFlagsInfo;
+        setLayoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+        setLayoutInfo.bindingCount = 2;
+        setLayoutInfo.pBindings    = bindings;
+
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        if (vkCreateDescriptorSetLayout(device, &setLayoutInfo, VULKAN_CPU_ALLOCATOR, &descriptorSetLayout) != VK_SUCCESS)
+        {
+            MLOGE("Failed create bindless descriptor set layout, is VK_EXT_descriptor_indexing enabled?");
+            return nullptr;
+        }
+
+        DVKBindlessTable* table = new DVKBindlessTable();
+        table->vulkanDevice        = vulkanDevice;
+        table->maxTextures         = maxTextures;
+        table->maxBuffers          = maxBuffers;
+        table->pushConstantSize    = pushConstantSize;
+        table->descriptorSetLayout = descriptorSetLayout;
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_ALL;
+        pushConstantRange.offset     = 0;
+        pushConstantRange.size       = pushConstantSize;
+
+        VkPipelineLayoutCreateInfo pipeLayoutInfo;
+        ZeroVulkanStruct(pipeLayoutInfo, VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO);
+        pipeLayoutInfo.setLayoutCount         = 1;
+        pipeLayoutInfo.pSetLayouts            = &descriptorSetLayout;
+        pipeLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+        pipeLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+        VERIFYVULKANRESULT(vkCreatePipelineLayout(device, &pipeLayoutInfo, VULKAN_CPU_ALLOCATOR, &table->pipelineLayout));
+
+        VkDescriptorPoolSize poolSizes[2];
+        poolSizes[0].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[0].descriptorCount = maxTextures;
+        poolSizes[1].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[1].descriptorCount = maxBuffers;
+
+        VkDescriptorPoolCreateInfo descriptorPoolInfo;
+        ZeroVulkanStruct(descriptorPoolInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO);
+        descriptorPoolInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        descriptorPoolInfo.poolSizeCount = 2;
+        descriptorPoolInfo.pPoolSizes    = poolSizes;
+        descriptorPoolInfo.maxSets       = 1;
+        VERIFYVULKANRESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, VULKAN_CPU_ALLOCATOR, &table->descriptorPool));
+
+        VkDescriptorSetAllocateInfo allocInfo;
+        ZeroVulkanStruct(allocInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO);
+        allocInfo.descriptorPool     = table->descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts        = &descriptorSetLayout;
+        VERIFYVULKANRESULT(vkAllocateDescriptorSets(device, &allocInfo, &table->descriptorSet));
+
+        return table;
+    }
+
+    int32 DVKBindlessTable::AllocateIndex(std::vector<uint32>& freeIndices, uint32& usedCount, uint32 maxCount)
+    {
+        if (freeIndices.size() > 0)
+        {
+            uint32 index = freeIndices.back();
+            freeIndices.pop_back();
+            return index;
+        }
+
+        if (usedCount >= maxCount)
+        {
+            return -1;
+        }
+
+        return usedCount++;
+    }
+
+    void DVKBindlessTable::RemovePendingWrites(uint32 binding, uint32 index)
+    {
+        for (int32 i = (int32)m_PendingWrites.size() - 1; i >= 0; --i)
+        {
+            if (m_PendingWrites[i].binding == binding && m_PendingWrites[i].index == index)
+            {
+                m_PendingWrites.erase(m_PendingWrites.begin() + i);
+            }
+        }
+    }
+
+    int32 DVKBindlessTable::AddTexture(DVKTexture* texture)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (texture->bindlessIndex >= 0)
+        {
+            return texture->bindlessIndex;
+        }
+
+        int32 index = AllocateIndex(m_FreeTextures, m_NumTextures, maxTextures);
+        if (index < 0)
+        {
+            MLOGE("Bindless texture table is full : %d", maxTextures);
+            return -1;
+        }
+
+        PendingWrite write = {};
+        write.binding   = TextureBinding;
+        write.index     = index;
+        write.imageInfo = texture->descriptorInfo;
+        m_PendingWrites.push_back(write);
+
+        texture->bindlessIndex = index;
+
+        return index;
+    }
+
+    int32 DVKBindlessTable::AddBuffer(DVKBuffer* buffer)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (buffer->bindlessIndex >= 0)
+        {
+            return buffer->bindlessIndex;
+        }
+
+        int32 index = AllocateIndex(m_FreeBuffers, m_NumBuffers, maxBuffers);
+        if (index < 0)
+        {
+            MLOGE("Bindless buffer table is full : %d", maxBuffers);
+            return -1;
+        }
+
+        PendingWrite write = {};
+        write.binding    = BufferBinding;
+        write.index      = index;
+        write.bufferInfo = buffer->descriptor;
+        m_PendingWrites.push_back(write);
+
+        buffer->bindlessIndex = index;
+
+        return index;
+    }
+
+    void DVKBindlessTable::UpdateTexture(DVKTexture* texture)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (texture->bindlessIndex < 0)
+        {
+            return;
+        }
+
+        PendingWrite write = {};
+        write.binding   = TextureBinding;
+        write.index     = texture->bindlessIndex;
+        write.imageInfo = texture->descriptorInfo;
+        m_PendingWrites.push_back(write);
+    }
+
+    void DVKBindlessTable::RemoveTexture(DVKTexture* texture)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (texture->bindlessIndex < 0)
+        {
+            return;
+        }
+
+        RemovePendingWrites(TextureBinding, texture->bindlessIndex);
+        m_FreeTextures.push_back(texture->bindlessIndex);
+        texture->bindlessIndex = -1;
+    }
+
+    void DVKBindlessTable::RemoveBuffer(DVKBuffer* buffer)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (buffer->bindlessIndex < 0)
+        {
+            return;
+        }
+
+        RemovePendingWrites(BufferBinding, buffer->bindlessIndex);
+        m_FreeBuffers.push_back(buffer->bindlessIndex);
+        buffer->bindlessIndex = -1;
+    }
+
+    void DVKBindlessTable::UpdateDescriptors()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (m_PendingWrites.size() == 0)
+        {
+            return;
+        }
+
+        std::vector<VkWriteDescriptorSet> writes(m_PendingWrites.size());
+        for (int32 i = 0; i < m_PendingWrites.size(); ++i)
+        {
+            const PendingWrite& pending = m_PendingWrites[i];
+
+            VkWriteDescriptorSet& writeDescriptorSet = writes[i];
+            ZeroVulkanStruct(writeDescriptorSet, VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET);
+            writeDescriptorSet.dstSet          = descriptorSet;
+            writeDescriptorSet.dstBinding      = pending.binding;
+            writeDescriptorSet.dstArrayElement = pending.index;
+            writeDescriptorSet.descriptorCount = 1;
+
+            if (pending.binding == TextureBinding)
+            {
+                writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                writeDescriptorSet.pImageInfo     = &pending.imageInfo;
+            }
+            else
+            {
+                writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writeDescriptorSet.pBufferInfo    = &pending.bufferInfo;
+            }
+        }
+
+        vkUpdateDescriptorSets(vulkanDevice->GetInstanceHandle(), (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+        m_PendingWrites.clear();
+    }
+
+    void DVKBindlessTable::BindDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    }
+
+    void DVKBindlessTable::PushConstants(VkCommandBuffer commandBuffer, const void* data, uint32 size, uint32 offset)
+    {
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL, offset, size, data);
+    }
+
+}
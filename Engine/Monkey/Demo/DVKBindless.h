@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKTexture.h"
+
+#include "Common/Common.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vk_demo
+{
+
+    // 基于descriptor indexing的全局资源表：set 0中binding 0为sampler2D数组，binding 1为storage buffer数组。
+    // 数组为partially bound + update after bind，资源注册后得到稳定的下标，Shader通过push constant
+    // 或者storage buffer中的下标访问，整个场景只需要绑定一次DescriptorSet。
+    // 需要VK_EXT_descriptor_indexing，所需的特性见SetupFeatures。
+    class DVKBindlessTable
+    {
+    private:
+        typedef std::shared_ptr<VulkanDevice> VulkanDeviceRef;
+
+        struct PendingWrite
+        {
+            uint32                  binding;
+            uint32                  index;
+            VkDescriptorImageInfo   imageInfo;
+            VkDescriptorBufferInfo  bufferInfo;
+        };
+
+        DVKBindlessTable()
+        {
+
+        }
+
+    public:
+        static const uint32 TextureBinding = 0;
+        static const uint32 BufferBinding  = 1;
+
+        ~DVKBindlessTable();
+
+        // 填写创建Device时需要开启的descriptor indexing特性
+        static void SetupFeatures(VkPhysicalDeviceDescriptorIndexingFeaturesEXT& indexingFeatures);
+
+        // pipelineLayout的push constant范围为[0, pushConstantSize)，对所有Stage可见
+        static DVKBindlessTable* Create(std::shared_ptr<VulkanDevice> vulkanDevice, uint32 maxTextures, uint32 maxBuffers, uint32 pushConstantSize = 128);
+
+        // 注册后写入texture->bindlessIndex，失败返回-1
+        int32 AddTexture(DVKTexture* texture);
+
+        int32 AddBuffer(DVKBuffer* buffer);
+
+        // 已注册纹理的Image或者Sampler重建后重新写入表项，下标不变
+        void UpdateTexture(DVKTexture* texture);
+
+        // 下标立即回收，调用者需保证GPU已经不再访问该资源
+        void RemoveTexture(DVKTexture* texture);
+
+        void RemoveBuffer(DVKBuffer* buffer);
+
+        // 把Add产生的写入合并为一次vkUpdateDescriptorSets，需在提交使用这些资源的CommandBuffer之前调用
+        void UpdateDescriptors();
+
+        void BindDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint);
+
+        void PushConstants(VkCommandBuffer commandBuffer, const void* data, uint32 size, uint32 offset = 0);
+
+    private:
+
+        int32 AllocateIndex(std::vector<uint32>& freeIndices, uint32& usedCount, uint32 maxCount);
+
+        // 丢弃下标还未提交的写入，资源可能已经销毁，下标复用后也不能被旧的写入覆盖
+        void RemovePendingWrites(uint32 binding, uint32 index);
+
+    public:
+
+        VulkanDeviceRef         vulkanDevice = nullptr;
+
+        uint32                  maxTextures = 0;
+        uint32                  maxBuffers = 0;
+        uint32                  pushConstantSize = 0;
+
+        VkDescriptorSetLayout   descriptorSetLayout = VK_NULL_HANDLE;
+        VkPipelineLayout        pipelineLayout = VK_NULL_HANDLE;
+        VkDescriptorPool        descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet         descriptorSet = VK_NULL_HANDLE;
+
+    private:
+
+        std::mutex                  m_Mutex;
+        std::vector<PendingWrite>   m_PendingWrites;
+        std::vector<uint32>         m_FreeTextures;
+        std::vector<uint32>         m_FreeBuffers;
+        uint32                      m_NumTextures = 0;
+        uint32                      m_NumBuffers = 0;
+    };
+
+}
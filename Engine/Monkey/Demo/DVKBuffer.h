@@ -50,6 +50,9 @@ namespace vk_demo
 
         void*                   mapped = nullptr;
 
+        // DVKBindlessTable中的下标，未注册时为-1
+        int32                   bindlessIndex = -1;
+
         VkBufferUsageFlags      usageFlags;
         VkMemoryPropertyFlags   memoryPropertyFlags;
 
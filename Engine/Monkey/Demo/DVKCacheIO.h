@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace vk_demo
+{
+    // 各类二进制缓存(.meshcache/.reflect)共用的读写工具，数据均为平铺的POD
+    class CacheWriter
+    {
+    public:
+        template <class T>
+        void Write(const T& value)
+        {
+            WriteBytes(&value, sizeof(T));
+        }
+
+        template <class T>
+        void WriteArray(const std::vector<T>& values)
+        {
+            Write<uint32>((uint32)values.size());
+            WriteBytes(values.data(), (uint32)(values.size() * sizeof(T)));
+        }
+
+        void WriteString(const std::string& value)
+        {
+            Write<uint32>((uint32)value.size());
+            WriteBytes(value.data(), (uint32)value.size());
+        }
+
+        void WriteBytes(const void* data, uint32 size)
+        {
+            if (size == 0)
+            {
+                return;
+            }
+            const uint8* bytes = (const uint8*)data;
+            buffer.insert(buffer.end(), bytes, bytes + size);
+        }
+
+    public:
+        std::vector<uint8> buffer;
+    };
+
+    class CacheReader
+    {
+    public:
+        CacheReader(const uint8* inData, uint32 inSize)
+            : data(inData)
+            , size(inSize)
+            , offset(0)
+            , failed(false)
+        {
+
+        }
+
+        template <class T>
+        T Read()
+        {
+            T value = T();
+            ReadBytes(&value, sizeof(T));
+            return value;
+        }
+
+        template <class T>
+        void ReadArray(std::vector<T>& values)
+        {
+            uint32 count = Read<uint32>();
+            if (failed || count > (size - offset) / sizeof(T))
+            {
+                failed = true;
+                return;
+            }
+            values.resize(count);
+            ReadBytes(values.data(), (uint32)(count * sizeof(T)));
+        }
+
+        void ReadString(std::string& value)
+        {
+            uint32 count = Read<uint32>();
+            if (failed || count > size - offset)
+            {
+                failed = true;
+                return;
+            }
+            value.assign((const char*)(data + offset), count);
+            offset += count;
+        }
+
+        void ReadBytes(void* dst, uint32 count)
+        {
+            if (failed || count > size - offset)
+            {
+                failed = true;
+                return;
+            }
+            if (count > 0)
+            {
+                memcpy(dst, data + offset, count);
+                offset += count;
+            }
+        }
+
+    public:
+        const uint8*    data;
+        uint32          size;
+        uint32          offset;
+        bool            failed;
+    };
+
+}
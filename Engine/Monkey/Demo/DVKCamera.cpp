@@ -10,6 +10,56 @@ namespace vk_demo
         m_LastMouse = InputManager::GetMousePosition();
     }
 
+    void DVKCamera::GetFrustumPlanes(Vector4 planes[6])
+    {
+        const Matrix4x4& matrix = GetViewProjection();
+
+        // left
+        planes[0].x = matrix.m[0][3] + matrix.m[0][0];
+        planes[0].y = matrix.m[1][3] + matrix.m[1][0];
+        planes[0].z = matrix.m[2][3] + matrix.m[2][0];
+        planes[0].w = matrix.m[3][3] + matrix.m[3][0];
+
+        // right
+        planes[1].x = matrix.m[0][3] - matrix.m[0][0];
+        planes[1].y = matrix.m[1][3] - matrix.m[1][0];
+        planes[1].z = matrix.m[2][3] - matrix.m[2][0];
+        planes[1].w = matrix.m[3][3] - matrix.m[3][0];
+
+        // top
+        planes[2].x = matrix.m[0][3] + matrix.m[0][1];
+        planes[2].y = matrix.m[1][3] + matrix.m[1][1];
+        planes[2].z = matrix.m[2][3] + matrix.m[2][1];
+        planes[2].w = matrix.m[3][3] + matrix.m[3][1];
+
+        // bottom
+        planes[3].x = matrix.m[0][3] - matrix.m[0][1];
+        planes[3].y = matrix.m[1][3] - matrix.m[1][1];
+        planes[3].z = matrix.m[2][3] - matrix.m[2][1];
+        planes[3].w = matrix.m[3][3] - matrix.m[3][1];
+
+        // near，深度范围为[0, 1]
+        planes[4].x = matrix.m[0][2];
+        planes[4].y = matrix.m[1][2];
+        planes[4].z = matrix.m[2][2];
+        planes[4].w = matrix.m[3][2];
+
+        // far
+        planes[5].x = matrix.m[0][3] - matrix.m[0][2];
+        planes[5].y = matrix.m[1][3] - matrix.m[1][2];
+        planes[5].z = matrix.m[2][3] - matrix.m[2][2];
+        planes[5].w = matrix.m[3][3] - matrix.m[3][2];
+
+        for (int32 i = 0; i < 6; ++i)
+        {
+            float length = MMath::Sqrt(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+            planes[i].x /= length;
+            planes[i].y /= length;
+            planes[i].z /= length;
+            planes[i].w /= length;
+        }
+    }
+
     void DVKCamera::Update(float time, float delta)
     {
         float mouseSpeedX = InputManager::GetMousePosition().x - m_LastMouse.x;
@@ -186,6 +186,12 @@ namespace vk_demo
             return m_Aspect;
         }
 
+        // 距离为1处单位长度投影到屏幕上的像素数
+        FORCE_INLINE float GetProjectionScale(float viewportHeight) const
+        {
+            return viewportHeight * 0.5f / MMath::Tan(m_Fov * 0.5f);
+        }
+
         FORCE_INLINE float GetLeft() const
         {
             return m_Left;
@@ -206,6 +212,9 @@ namespace vk_demo
             return m_Top;
         }
 
+        // 从ViewProjection提取归一化的视锥平面，顺序为left/right/top/bottom/near/far，法线朝内
+        void GetFrustumPlanes(Vector4 planes[6]);
+
         void Update(float time, float delta);
 
     public:
@@ -0,0 +1,547 @@
+﻿#include "DVKClusteredLights.h"
+
+#include "Math/Math.h"
+
+#include <cstring>
+
+namespace vk_demo
+{
+
+    static void ClusterBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        VkMemoryBarrier barrier;
+        ZeroVulkanStruct(barrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER);
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // 与ClusterAssign.comp中一致，1D Dispatch超过maxComputeWorkGroupCount时拆到y方向
+    static void DispatchLinear(DVKCompute* processor, VkCommandBuffer commandBuffer, int32 count, int32 groupSize)
+    {
+        int32 groups  = MMath::Max(1, (count + groupSize - 1) / groupSize);
+        int32 groupsX = MMath::Min(groups, 65535);
+        int32 groupsY = (groups + groupsX - 1) / groupsX;
+        processor->BindDispatch(commandBuffer, groupsX, groupsY, 1);
+    }
+
+    static void TransformLight(const Matrix4x4& view, const DVKClusterLight& light, Vector3& outPos, Vector3& outDir)
+    {
+        Vector4 position  = view.TransformPosition(light.position);
+        Vector4 direction = view.TransformVector(light.direction);
+        outPos = Vector3(position.x, position.y, position.z);
+        outDir = Vector3(direction.x, direction.y, direction.z);
+        outDir.Normalize();
+    }
+
+    /******************************* DVKClusterGrid *******************************/
+
+    void DVKClusterGrid::Setup(DVKCamera& camera, int32 inWidth, int32 inHeight, int32 inTileSize, int32 inSlices)
+    {
+        width    = MMath::Max(1, inWidth);
+        height   = MMath::Max(1, inHeight);
+        tileSize = MMath::Max(1, inTileSize);
+        slices   = MMath::Max(1, inSlices);
+        tilesX   = (width  + tileSize - 1) / tileSize;
+        tilesY   = (height + tileSize - 1) / tileSize;
+
+        zNear = camera.GetNear();
+        zFar  = camera.GetFar();
+
+        const Matrix4x4& projection = camera.GetProjection();
+        projScaleX = projection.m[0][0];
+        projScaleY = projection.m[1][1];
+    }
+
+    int32 DVKClusterGrid::GetSlice(float viewZ) const
+    {
+        if (viewZ <= zNear)
+        {
+            return 0;
+        }
+
+        int32 slice = MMath::FloorToInt(MMath::Loge(viewZ / zNear) / MMath::Loge(zFar / zNear) * slices);
+        return MMath::Clamp(slice, 0, slices - 1);
+    }
+
+    float DVKClusterGrid::GetSliceDepth(int32 slice) const
+    {
+        return zNear * MMath::Pow(zFar / zNear, (float)slice / slices);
+    }
+
+    void DVKClusterGrid::GetClusterBounds(int32 x, int32 y, int32 z, Vector3& outMin, Vector3& outMax) const
+    {
+        // 最后一列/行的tile可能超出屏幕，按完整tile计算，结果偏保守
+        float ndcX0 = (float)(x * tileSize) / width  * 2.0f - 1.0f;
+        float ndcX1 = (float)((x + 1) * tileSize) / width  * 2.0f - 1.0f;
+        float ndcY0 = (float)(y * tileSize) / height * 2.0f - 1.0f;
+        float ndcY1 = (float)((y + 1) * tileSize) / height * 2.0f - 1.0f;
+
+        float depth0 = GetSliceDepth(z);
+        float depth1 = GetSliceDepth(z + 1);
+
+        outMin.x = MMath::Min(ndcX0 * depth0, ndcX0 * depth1) / projScaleX;
+        outMax.x = MMath::Max(ndcX1 * depth0, ndcX1 * depth1) / projScaleX;
+        outMin.y = MMath::Min(ndcY0 * depth0, ndcY0 * depth1) / projScaleY;
+        outMax.y = MMath::Max(ndcY1 * depth0, ndcY1 * depth1) / projScaleY;
+        outMin.z = depth0;
+        outMax.z = depth1;
+    }
+
+    bool DVKClusterGrid::GetLightRange(const Vector3& viewPos, float radius, int32 outMin[3], int32 outMax[3]) const
+    {
+        float zMin = viewPos.z - radius;
+        float zMax = viewPos.z + radius;
+        if (zMax < zNear || zMin > zFar)
+        {
+            return false;
+        }
+
+        zMin = MMath::Max(zMin, zNear);
+        zMax = MMath::Min(zMax, zFar);
+
+        // 包围盒的角点投影到NDC，z取可见部分的两端
+        float ndcMin[2] = {  MAX_FLT,  MAX_FLT };
+        float ndcMax[2] = { -MAX_FLT, -MAX_FLT };
+        float zs[2] = { zMin, zMax };
+        for (int32 i = 0; i < 2; ++i)
+        {
+            for (int32 s = -1; s <= 1; s += 2)
+            {
+                float ndcX = (viewPos.x + s * radius) * projScaleX / zs[i];
+                float ndcY = (viewPos.y + s * radius) * projScaleY / zs[i];
+                ndcMin[0] = MMath::Min(ndcMin[0], ndcX);
+                ndcMax[0] = MMath::Max(ndcMax[0], ndcX);
+                ndcMin[1] = MMath::Min(ndcMin[1], ndcY);
+                ndcMax[1] = MMath::Max(ndcMax[1], ndcY);
+            }
+        }
+
+        if (ndcMax[0] < -1.0f || ndcMin[0] > 1.0f || ndcMax[1] < -1.0f || ndcMin[1] > 1.0f)
+        {
+            return false;
+        }
+
+        outMin[0] = MMath::Clamp(MMath::FloorToInt((ndcMin[0] * 0.5f + 0.5f) * width  / tileSize), 0, tilesX - 1);
+        outMax[0] = MMath::Clamp(MMath::FloorToInt((ndcMax[0] * 0.5f + 0.5f) * width  / tileSize), 0, tilesX - 1);
+        outMin[1] = MMath::Clamp(MMath::FloorToInt((ndcMin[1] * 0.5f + 0.5f) * height / tileSize), 0, tilesY - 1);
+        outMax[1] = MMath::Clamp(MMath::FloorToInt((ndcMax[1] * 0.5f + 0.5f) * height / tileSize), 0, tilesY - 1);
+        outMin[2] = GetSlice(zMin);
+        outMax[2] = GetSlice(zMax);
+
+        return true;
+    }
+
+    bool DVKClusterGrid::Intersects(int32 x, int32 y, int32 z, const DVKClusterLight& light, const Vector3& viewPos, const Vector3& viewDir) const
+    {
+        Vector3 bmin;
+        Vector3 bmax;
+        GetClusterBounds(x, y, z, bmin, bmax);
+
+        // 球与AABB
+        float dx = MMath::Max(0.0f, MMath::Max(bmin.x - viewPos.x, viewPos.x - bmax.x));
+        float dy = MMath::Max(0.0f, MMath::Max(bmin.y - viewPos.y, viewPos.y - bmax.y));
+        float dz = MMath::Max(0.0f, MMath::Max(bmin.z - viewPos.z, viewPos.z - bmax.z));
+        if (dx * dx + dy * dy + dz * dz > light.radius * light.radius)
+        {
+            return false;
+        }
+
+        // 张角超过180度的聚光灯按点光源处理
+        if (light.type != (float)DVKClusterLightType::Spot || light.cosOuter <= 0.0f)
+        {
+            return true;
+        }
+
+        // 圆锥与簇的包围球
+        Vector3 center = (bmin + bmax) * 0.5f;
+        float sphereRadius = (bmax - bmin).Size() * 0.5f;
+
+        Vector3 v  = center - viewPos;
+        float lenSq = Vector3::DotProduct(v, v);
+        float v1Len = Vector3::DotProduct(v, viewDir);
+        float sinOuter = MMath::Sqrt(MMath::Max(0.0f, 1.0f - light.cosOuter * light.cosOuter));
+        float distanceClosestPoint = light.cosOuter * MMath::Sqrt(MMath::Max(0.0f, lenSq - v1Len * v1Len)) - v1Len * sinOuter;
+
+        bool angleCull = distanceClosestPoint > sphereRadius;
+        bool frontCull = v1Len > sphereRadius + light.radius;
+        bool backCull  = v1Len < -sphereRadius;
+
+        return !(angleCull || frontCull || backCull);
+    }
+
+    /******************************* DVKClusteredLights *******************************/
+
+    DVKClusteredLights::~DVKClusteredLights()
+    {
+        delete assignProcessor;
+        delete scanProcessor;
+
+        delete lightBuffer;
+        delete gridBuffer;
+        delete counterBuffer;
+        delete indexBuffer;
+        delete statsBuffer;
+
+        vulkanDevice = nullptr;
+    }
+
+    DVKClusteredLights* DVKClusteredLights::Create(
+        std::shared_ptr<VulkanDevice> vulkanDevice,
+        VkPipelineCache pipelineCache,
+        DVKShader* assignShader,
+        DVKShader* scanShader,
+        const DVKClusterGrid& grid,
+        int32 maxLights
+    )
+    {
+        if (assignShader == nullptr || scanShader == nullptr)
+        {
+            MLOGE("ClusteredLights need assign and scan shader.");
+            return nullptr;
+        }
+
+        if (grid.GetClusterCount() <= 0)
+        {
+            MLOGE("ClusteredLights invalid grid, call DVKClusterGrid::Setup first.");
+            return nullptr;
+        }
+
+        DVKClusteredLights* clustered = new DVKClusteredLights();
+        clustered->vulkanDevice  = vulkanDevice;
+        clustered->grid          = grid;
+        clustered->lightCapacity = MMath::Max(1, maxLights);
+
+        clustered->lightBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            clustered->lightCapacity * sizeof(DVKClusterLight)
+        );
+        clustered->lightBuffer->Map();
+
+        clustered->statsBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            sizeof(uint32) * 4
+        );
+        clustered->statsBuffer->Map();
+        memset(clustered->statsBuffer->mapped, 0, sizeof(uint32) * 4);
+
+        clustered->assignProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, assignShader);
+        clustered->assignProcessor->SetStorageBuffer("clusterLights", clustered->lightBuffer);
+
+        clustered->scanProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, scanShader);
+        clustered->scanProcessor->SetStorageBuffer("clusterStats", clustered->statsBuffer);
+
+        clustered->CreateGridBuffers();
+
+        return clustered;
+    }
+
+    void DVKClusteredLights::CreateGridBuffers()
+    {
+        int32 numClusters = grid.GetClusterCount();
+
+        // 先创建新的再销毁旧的，避免新对象复用旧句柄导致DescriptorSet没有更新
+        DVKBuffer* newGrid = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            numClusters * sizeof(uint32) * 2
+        );
+
+        // 前半部分为每个簇的光源数量，后半部分为写入游标
+        DVKBuffer* newCounter = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            numClusters * sizeof(uint32) * 2
+        );
+
+        assignProcessor->SetStorageBuffer("clusterGrid",    newGrid);
+        assignProcessor->SetStorageBuffer("clusterCounter", newCounter);
+        scanProcessor->SetStorageBuffer("clusterGrid",      newGrid);
+        scanProcessor->SetStorageBuffer("clusterCounter",   newCounter);
+
+        delete gridBuffer;
+        delete counterBuffer;
+        gridBuffer    = newGrid;
+        counterBuffer = newCounter;
+
+        // 平均每个簇32个光源作为初始容量，不够时Build中扩容
+        CreateIndexBuffer(numClusters * 32);
+    }
+
+    void DVKClusteredLights::CreateIndexBuffer(int32 capacity)
+    {
+        capacity = MMath::Max(capacity, 1);
+
+        DVKBuffer* newIndex = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            capacity * sizeof(uint32)
+        );
+
+        assignProcessor->SetStorageBuffer("clusterIndices", newIndex);
+
+        delete indexBuffer;
+        indexBuffer   = newIndex;
+        indexCapacity = capacity;
+    }
+
+    void DVKClusteredLights::SetGrid(const DVKClusterGrid& inGrid)
+    {
+        bool resize = inGrid.GetClusterCount() != grid.GetClusterCount();
+        grid = inGrid;
+
+        if (resize)
+        {
+            CreateGridBuffers();
+        }
+    }
+
+    void DVKClusteredLights::UpdateLights(const DVKClusterLight* lights, int32 count)
+    {
+        if (count > lightCapacity)
+        {
+            int32 capacity = count + count / 2;
+
+            DVKBuffer* newLight = DVKBuffer::CreateBuffer(
+                vulkanDevice,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                capacity * sizeof(DVKClusterLight)
+            );
+            newLight->Map();
+
+            assignProcessor->SetStorageBuffer("clusterLights", newLight);
+
+            delete lightBuffer;
+            lightBuffer   = newLight;
+            lightCapacity = capacity;
+        }
+
+        numLights = MMath::Max(0, count);
+        if (numLights > 0)
+        {
+            memcpy(lightBuffer->mapped, lights, numLights * sizeof(DVKClusterLight));
+        }
+    }
+
+    void DVKClusteredLights::GetParam(const Matrix4x4& view, DVKClusterParamBlock& outParam) const
+    {
+        outParam.view     = view;
+        outParam.grid.x   = (float)grid.tilesX;
+        outParam.grid.y   = (float)grid.tilesY;
+        outParam.grid.z   = (float)grid.slices;
+        outParam.grid.w   = (float)grid.tileSize;
+        outParam.screen.x = (float)grid.width;
+        outParam.screen.y = (float)grid.height;
+        outParam.screen.z = grid.projScaleX;
+        outParam.screen.w = grid.projScaleY;
+        outParam.depth.x  = grid.zNear;
+        outParam.depth.y  = grid.zFar;
+        outParam.depth.z  = MMath::Loge(grid.zFar / grid.zNear);
+        outParam.depth.w  = (float)numLights;
+        outParam.mode.x   = 0.0f;
+        outParam.mode.y   = (float)indexCapacity;
+        outParam.mode.z   = 0.0f;
+        outParam.mode.w   = 0.0f;
+    }
+
+    void DVKClusteredLights::Build(VkCommandBuffer commandBuffer, const Matrix4x4& view)
+    {
+        // 上一帧的总数超过容量时扩容，超出的部分在这一帧之前会被丢弃
+        uint32 lastCount = GetLastIndexCount();
+        if (lastCount > (uint32)indexCapacity)
+        {
+            CreateIndexBuffer(lastCount + lastCount / 2);
+        }
+
+        DVKClusterParamBlock countParam;
+        GetParam(view, countParam);
+
+        DVKClusterParamBlock writeParam = countParam;
+        writeParam.mode.x = 1.0f;
+
+        ScanParamBlock scanParam;
+        scanParam.count.x = (float)grid.GetClusterCount();
+        scanParam.count.y = (float)indexCapacity;
+        scanParam.count.z = 0.0f;
+        scanParam.count.w = 0.0f;
+
+        // 上一帧的FragmentShader仍在读取结果
+        ClusterBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0
+        );
+
+        vkCmdFillBuffer(commandBuffer, counterBuffer->buffer, 0, counterBuffer->size, 0);
+
+        ClusterBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,       VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+
+        // 统计每个簇的光源数量
+        assignProcessor->SetUniform("paramData", &countParam, sizeof(DVKClusterParamBlock));
+        DispatchLinear(assignProcessor, commandBuffer, numLights, 64);
+
+        ClusterBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+
+        // 前缀和得到每个簇的偏移
+        scanProcessor->SetUniform("paramData", &scanParam, sizeof(ScanParamBlock));
+        scanProcessor->BindDispatch(commandBuffer, 1, 1, 1);
+
+        ClusterBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+
+        // 写入光源索引
+        assignProcessor->SetUniform("paramData", &writeParam, sizeof(DVKClusterParamBlock));
+        DispatchLinear(assignProcessor, commandBuffer, numLights, 64);
+
+        ClusterBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_HOST_READ_BIT
+        );
+    }
+
+    void DVKClusteredLights::ReadBack(DVKCommandBuffer* cmdBuffer, std::vector<uint32>& outGrid, std::vector<uint32>& outIndices)
+    {
+        uint32 indexCount = MMath::Min(GetLastIndexCount(), (uint32)indexCapacity);
+
+        DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            gridBuffer->size + MMath::Max(indexCount, 1u) * sizeof(uint32)
+        );
+
+        cmdBuffer->Begin();
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.srcOffset = 0;
+        copyRegion.dstOffset = 0;
+        copyRegion.size      = gridBuffer->size;
+        vkCmdCopyBuffer(cmdBuffer->cmdBuffer, gridBuffer->buffer, stagingBuffer->buffer, 1, &copyRegion);
+
+        if (indexCount > 0)
+        {
+            copyRegion.dstOffset = gridBuffer->size;
+            copyRegion.size      = indexCount * sizeof(uint32);
+            vkCmdCopyBuffer(cmdBuffer->cmdBuffer, indexBuffer->buffer, stagingBuffer->buffer, 1, &copyRegion);
+        }
+
+        cmdBuffer->End();
+        cmdBuffer->Submit();
+
+        stagingBuffer->Map();
+        const uint32* data = (const uint32*)stagingBuffer->mapped;
+
+        outGrid.resize(gridBuffer->size / sizeof(uint32));
+        memcpy(outGrid.data(), data, gridBuffer->size);
+
+        outIndices.resize(indexCount);
+        if (indexCount > 0)
+        {
+            memcpy(outIndices.data(), data + outGrid.size(), indexCount * sizeof(uint32));
+        }
+
+        delete stagingBuffer;
+    }
+
+    void DVKClusteredLights::BindMaterial(DVKMaterial* material)
+    {
+        material->SetStorageBuffer("clusterLights",  lightBuffer);
+        material->SetStorageBuffer("clusterGrid",    gridBuffer);
+        material->SetStorageBuffer("clusterIndices", indexBuffer);
+    }
+
+    void DVKClusteredLights::BuildCPU(
+        const DVKClusterGrid& grid,
+        const Matrix4x4& view,
+        const DVKClusterLight* lights,
+        int32 count,
+        std::vector<uint32>& outGrid,
+        std::vector<uint32>& outIndices
+    )
+    {
+        int32 numClusters = grid.GetClusterCount();
+
+        outGrid.clear();
+        outGrid.resize(numClusters * 2, 0);
+
+        std::vector<Vector3> viewPositions(count);
+        std::vector<Vector3> viewDirections(count);
+        for (int32 i = 0; i < count; ++i)
+        {
+            TransformLight(view, lights[i], viewPositions[i], viewDirections[i]);
+        }
+
+        // 与GPU相同的两遍：先统计数量，前缀和之后再写入
+        for (int32 pass = 0; pass < 2; ++pass)
+        {
+            for (int32 i = 0; i < count; ++i)
+            {
+                int32 rangeMin[3];
+                int32 rangeMax[3];
+                if (!grid.GetLightRange(viewPositions[i], lights[i].radius, rangeMin, rangeMax))
+                {
+                    continue;
+                }
+
+                for (int32 z = rangeMin[2]; z <= rangeMax[2]; ++z)
+                {
+                    for (int32 y = rangeMin[1]; y <= rangeMax[1]; ++y)
+                    {
+                        for (int32 x = rangeMin[0]; x <= rangeMax[0]; ++x)
+                        {
+                            if (!grid.Intersects(x, y, z, lights[i], viewPositions[i], viewDirections[i]))
+                            {
+                                continue;
+                            }
+
+                            int32 cluster = grid.GetClusterIndex(x, y, z);
+                            if (pass == 0)
+                            {
+                                outGrid[cluster * 2 + 1] += 1;
+                            }
+                            else
+                            {
+                                outIndices[outGrid[cluster * 2 + 0] + outGrid[cluster * 2 + 1]] = i;
+                                outGrid[cluster * 2 + 1] += 1;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (pass == 0)
+            {
+                uint32 offset = 0;
+                for (int32 c = 0; c < numClusters; ++c)
+                {
+                    outGrid[c * 2 + 0] = offset;
+                    offset += outGrid[c * 2 + 1];
+                    outGrid[c * 2 + 1] = 0;
+                }
+                outIndices.resize(offset);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,187 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKCommand.h"
+#include "DVKShader.h"
+#include "DVKCompute.h"
+#include "DVKCamera.h"
+
+#include "Common/Common.h"
+#include "Math/Vector3.h"
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+
+    enum class DVKClusterLightType
+    {
+        Point = 0,
+        Spot,
+    };
+
+    // 与Shader中的std430布局一致
+    struct DVKClusterLight
+    {
+        Vector3     position;
+        float       radius = 1.0f;
+
+        Vector3     color = Vector3(1.0f, 1.0f, 1.0f);
+        float       type = 0.0f;
+
+        // 聚光灯
+        Vector3     direction = Vector3(0.0f, 0.0f, 1.0f);
+        float       cosOuter = 0.0f;
+
+        float       cosInner = 0.0f;
+        float       padding0 = 0.0f;
+        float       padding1 = 0.0f;
+        float       padding2 = 0.0f;
+    };
+
+    // 视空间下的簇划分：屏幕按tileSize像素切分，深度按指数切分为slices层
+    struct DVKClusterGrid
+    {
+        int32   width = 0;
+        int32   height = 0;
+        int32   tileSize = 64;
+        int32   tilesX = 0;
+        int32   tilesY = 0;
+        int32   slices = 24;
+
+        float   zNear = 1.0f;
+        float   zFar = 3000.0f;
+        // 投影矩阵的m[0][0]与m[1][1]
+        float   projScaleX = 1.0f;
+        float   projScaleY = 1.0f;
+
+        void Setup(DVKCamera& camera, int32 inWidth, int32 inHeight, int32 inTileSize = 64, int32 inSlices = 24);
+
+        FORCE_INLINE int32 GetClusterCount() const
+        {
+            return tilesX * tilesY * slices;
+        }
+
+        FORCE_INLINE int32 GetClusterIndex(int32 x, int32 y, int32 z) const
+        {
+            return (z * tilesY + y) * tilesX + x;
+        }
+
+        int32 GetSlice(float viewZ) const;
+
+        float GetSliceDepth(int32 slice) const;
+
+        // 簇在视空间下的包围盒
+        void GetClusterBounds(int32 x, int32 y, int32 z, Vector3& outMin, Vector3& outMax) const;
+
+        // 光源可能覆盖的簇范围(包含两端)，光源完全不可见时返回false
+        bool GetLightRange(const Vector3& viewPos, float radius, int32 outMin[3], int32 outMax[3]) const;
+
+        // viewDir为视空间下聚光灯的方向
+        bool Intersects(int32 x, int32 y, int32 z, const DVKClusterLight& light, const Vector3& viewPos, const Vector3& viewDir) const;
+    };
+
+    // 分簇参数，ClusterAssign.comp与片元着色器共用
+    struct DVKClusterParamBlock
+    {
+        Matrix4x4   view;
+        Vector4     grid;       // x:tilesX y:tilesY z:slices w:tileSize
+        Vector4     screen;     // x:width y:height z:projScaleX w:projScaleY
+        Vector4     depth;      // x:near y:far z:log(far/near) w:光源数量
+        Vector4     mode;       // x:0统计 1写入 y:索引容量
+    };
+
+    // 分簇光照：每个簇的光源列表长度不固定，全部紧凑存放在indexBuffer中，gridBuffer记录每个簇的(offset, count)。
+    // GPU上先以光源为单位统计每个簇的数量，前缀和得到偏移后再写入索引，开销与光源实际覆盖的簇数量成正比。
+    // BuildCPU为同样算法的CPU实现，可以在没有GPU的情况下验证结果。
+    class DVKClusteredLights
+    {
+    private:
+        typedef std::shared_ptr<VulkanDevice> VulkanDeviceRef;
+
+        struct ScanParamBlock
+        {
+            Vector4     count;
+        };
+
+        DVKClusteredLights()
+        {
+
+        }
+
+    public:
+        ~DVKClusteredLights();
+
+        // assignShader/scanShader参见69_TileBasedForwardRendering下的ClusterAssign.comp/ClusterScan.comp
+        static DVKClusteredLights* Create(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            VkPipelineCache pipelineCache,
+            DVKShader* assignShader,
+            DVKShader* scanShader,
+            const DVKClusterGrid& grid,
+            int32 maxLights = 1024
+        );
+
+        // 簇数量变化时重新创建相关Buffer
+        void SetGrid(const DVKClusterGrid& grid);
+
+        // 光源数量超过容量时自动扩容
+        void UpdateLights(const DVKClusterLight* lights, int32 count);
+
+        // 需在RenderPass之外录制，完成后可在FragmentShader中读取
+        void Build(VkCommandBuffer commandBuffer, const Matrix4x4& view);
+
+        void GetParam(const Matrix4x4& view, DVKClusterParamBlock& outParam) const;
+
+        // 阻塞读回GPU结果，仅用于验证
+        void ReadBack(DVKCommandBuffer* cmdBuffer, std::vector<uint32>& outGrid, std::vector<uint32>& outIndices);
+
+        // 把gridBuffer、indexBuffer、lightBuffer绑定到材质，Buffer重建后需要重新调用
+        void BindMaterial(DVKMaterial* material);
+
+        // 上一次Build得到的索引总数，可能超过indexCapacity
+        FORCE_INLINE uint32 GetLastIndexCount() const
+        {
+            return statsBuffer ? ((uint32*)statsBuffer->mapped)[0] : 0;
+        }
+
+        // outGrid为每个簇的(offset, count)，同一个簇内的顺序与GPU结果不一定相同
+        static void BuildCPU(
+            const DVKClusterGrid& grid,
+            const Matrix4x4& view,
+            const DVKClusterLight* lights,
+            int32 count,
+            std::vector<uint32>& outGrid,
+            std::vector<uint32>& outIndices
+        );
+
+    private:
+
+        void CreateGridBuffers();
+
+        void CreateIndexBuffer(int32 capacity);
+
+    public:
+
+        VulkanDeviceRef         vulkanDevice = nullptr;
+        DVKClusterGrid          grid;
+
+        int32                   numLights = 0;
+        int32                   lightCapacity = 0;
+        int32                   indexCapacity = 0;
+
+        DVKBuffer*              lightBuffer = nullptr;
+        DVKBuffer*              gridBuffer = nullptr;
+        DVKBuffer*              counterBuffer = nullptr;
+        DVKBuffer*              indexBuffer = nullptr;
+        DVKBuffer*              statsBuffer = nullptr;
+
+        DVKCompute*             assignProcessor = nullptr;
+        DVKCompute*             scanProcessor = nullptr;
+    };
+
+}
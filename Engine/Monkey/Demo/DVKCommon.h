@@ -3,6 +3,7 @@
 #include "DemoBase.h"
 #include "DVKBuffer.h"
 #include "DVKCommand.h"
+#include "DVKAsyncCompute.h"
 #include "DVKUtils.h"
 #include "DVKIndexBuffer.h"
 #include "DVKVertexBuffer.h"
@@ -10,10 +11,24 @@
 #include "DVKPipeline.h"
 #include "DVKTexture.h"
 #include "DVKShader.h"
+#include "DVKLayoutCache.h"
+#include "DVKBindless.h"
 #include "DVKDefaultRes.h"
 #include "DVKMaterial.h"
 #include "DVKCamera.h"
 #include "DVKRenderTarget.h"
 #include "DVKCompute.h"
+#include "DVKGPUCulling.h"
+#include "DVKClusteredLights.h"
+#include "DVKJobSystem.h"
+#include "DVKParticleSystem.h"
+#include "DVKGPUParticles.h"
+#include "DVKFont.h"
+#include "DVKImposter.h"
+#include "DVKSkinning.h"
+#include "DVKSkinCache.h"
+#include "DVKAnimCompression.h"
+#include "DVKAssetLoader.h"
+#include "DVKTextureStreaming.h"
 #include "FileManager.h"
 #include "ImageGUIContext.h"
\ No newline at end of file
@@ -166,6 +166,13 @@ namespace vk_demo
         vkCmdDispatch(commandBuffer, groupX, groupY, groupZ);
     }
 
+    void DVKCompute::BindDispatchIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+        vkCmdDispatchIndirect(commandBuffer, buffer, offset);
+    }
+
     void DVKCompute::BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint)
     {
         uint32* dynOffsets = dynamicOffsets.data();
@@ -40,6 +40,9 @@ namespace vk_demo
 
         void BindDispatch(VkCommandBuffer commandBuffer, int groupX, int groupY, int groupZ);
 
+        // Dispatch参数由GPU写入buffer的offset处(VkDispatchIndirectCommand)
+        void BindDispatchIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset);
+
         void SetUniform(const std::string& name, void* dataPtr, uint32 size);
 
         void SetTexture(const std::string& name, DVKTexture* texture);
@@ -0,0 +1,682 @@
+﻿#include "DVKFont.h"
+#include "DVKUtils.h"
+#include "FileManager.h"
+
+#include "Common/Log.h"
+
+// imgui中的stb_truetype为static，这里单独实例化一份
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "imstb_truetype.h"
+
+#include <cstring>
+
+namespace vk_demo
+{
+
+    static void DecodeUTF8(const std::string& text, std::vector<uint32>& outCodepoints)
+    {
+        const uint8* str = (const uint8*)text.c_str();
+        const uint8* end = str + text.size();
+
+        while (str < end)
+        {
+            uint32 c = *str;
+            int32 count = 0;
+
+            if (c < 0x80)
+            {
+                count = 0;
+            }
+            else if ((c & 0xE0) == 0xC0)
+            {
+                c &= 0x1F;
+                count = 1;
+            }
+            else if ((c & 0xF0) == 0xE0)
+            {
+                c &= 0x0F;
+                count = 2;
+            }
+            else if ((c & 0xF8) == 0xF0)
+            {
+                c &= 0x07;
+                count = 3;
+            }
+            else
+            {
+                // 非法的首字节
+                outCodepoints.push_back(0xFFFD);
+                str += 1;
+                continue;
+            }
+
+            str += 1;
+            for (int32 i = 0; i < count; ++i)
+            {
+                if (str >= end || (*str & 0xC0) != 0x80)
+                {
+                    c = 0xFFFD;
+                    break;
+                }
+                c = (c << 6) | (*str & 0x3F);
+                str += 1;
+            }
+
+            outCodepoints.push_back(c);
+        }
+    }
+
+    // ----------------------------------- DVKSDFFont -----------------------------------
+
+    DVKSDFFont::~DVKSDFFont()
+    {
+        if (texture)
+        {
+            delete texture;
+            texture = nullptr;
+        }
+
+        if (m_RetiredTexture)
+        {
+            delete m_RetiredTexture;
+            m_RetiredTexture = nullptr;
+        }
+
+        if (m_Staging)
+        {
+            delete m_Staging;
+            m_Staging = nullptr;
+        }
+
+        if (m_FontInfo)
+        {
+            delete m_FontInfo;
+            m_FontInfo = nullptr;
+        }
+    }
+
+    DVKSDFFont* DVKSDFFont::Create(std::shared_ptr<VulkanDevice> vulkanDevice, const std::string& filename, DVKJobSystem* jobSystem, int32 glyphSize, int32 spread, int32 atlasSize, int32 maxAtlasHeight)
+    {
+        uint8* dataPtr  = nullptr;
+        uint32 dataSize = 0;
+        if (!FileManager::ReadFile(filename, dataPtr, dataSize))
+        {
+            MLOGE("Failed load font : %s", filename.c_str());
+            return nullptr;
+        }
+
+        DVKSDFFont* font = new DVKSDFFont();
+        font->vulkanDevice = vulkanDevice;
+        font->jobSystem    = jobSystem;
+        font->glyphSize    = glyphSize;
+        font->spread       = spread;
+        font->m_FontData.assign(dataPtr, dataPtr + dataSize);
+        delete[] dataPtr;
+
+        const uint8* fontData = font->m_FontData.data();
+        font->m_FontInfo = new stbtt_fontinfo();
+        if (!stbtt_InitFont(font->m_FontInfo, fontData, stbtt_GetFontOffsetForIndex(fontData, 0)))
+        {
+            MLOGE("Invalid font : %s", filename.c_str());
+            delete font;
+            return nullptr;
+        }
+
+        font->scale = stbtt_ScaleForPixelHeight(font->m_FontInfo, (float)glyphSize);
+
+        int32 ascent  = 0;
+        int32 descent = 0;
+        int32 lineGap = 0;
+        stbtt_GetFontVMetrics(font->m_FontInfo, &ascent, &descent, &lineGap);
+        font->ascent  = ascent * font->scale;
+        font->descent = -descent * font->scale;
+        font->lineGap = lineGap * font->scale;
+
+        // 格子按字体包围盒计算，个别超大的字形会被裁剪
+        int32 x0, y0, x1, y1;
+        stbtt_GetFontBoundingBox(font->m_FontInfo, &x0, &y0, &x1, &y1);
+        int32 maxExtent = MMath::CeilToInt(MMath::Max(x1 - x0, y1 - y0) * font->scale);
+        maxExtent = MMath::Min(maxExtent, glyphSize * 2);
+
+        font->cellSize       = maxExtent + spread * 2;
+        font->cellColumns    = atlasSize / font->cellSize;
+        font->maxAtlasHeight = MMath::Max(maxAtlasHeight, atlasSize);
+
+        if (font->cellColumns == 0)
+        {
+            MLOGE("Atlas size %d is too small for glyph size %d", atlasSize, glyphSize);
+            delete font;
+            return nullptr;
+        }
+
+        font->CreateAtlas(atlasSize, atlasSize);
+
+        return font;
+    }
+
+    void DVKSDFFont::CreateAtlas(int32 width, int32 height)
+    {
+        DVKBuffer* staging = DVKBuffer::CreateBuffer(vulkanDevice, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, width * height);
+        staging->Map();
+        memset(staging->mapped, 0, width * height);
+
+        // 宽度不变，原有的行直接拷贝到新图集的开头
+        if (m_Staging)
+        {
+            memcpy(staging->mapped, m_Staging->mapped, atlasWidth * atlasHeight);
+            delete m_Staging;
+        }
+        m_Staging = staging;
+
+        // 旧的图集可能还被上一帧引用，下一帧再释放
+        if (texture)
+        {
+            if (m_RetiredTexture)
+            {
+                delete m_RetiredTexture;
+            }
+            m_RetiredTexture = texture;
+        }
+
+        texture = DVKTexture::Create2D(
+            vulkanDevice,
+            nullptr,
+            VK_FORMAT_R8_UNORM,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            width,
+            height,
+            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+        );
+        texture->UpdateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+        // 第一次Upload时整体上传并转换到ShaderRead
+        texture->descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        atlasWidth  = width;
+        atlasHeight = height;
+
+        // 新增的格子放在空闲列表的最前面，从小到大分配
+        int32 numCells = (height / cellSize) * cellColumns;
+        std::vector<int32> cells;
+        for (int32 cell = numCells - 1; cell >= m_NumCells; --cell)
+        {
+            cells.push_back(cell);
+        }
+        m_FreeCells.insert(m_FreeCells.begin(), cells.begin(), cells.end());
+        m_NumCells = numCells;
+
+        m_FullUpload = true;
+        m_DirtyCells.clear();
+        atlasVersion += 1;
+    }
+
+    bool DVKSDFFont::GrowAtlas()
+    {
+        if (atlasHeight >= maxAtlasHeight)
+        {
+            return false;
+        }
+
+        int32 height = MMath::Min(atlasHeight * 2, maxAtlasHeight);
+        if ((height / cellSize) * cellColumns <= m_NumCells)
+        {
+            return false;
+        }
+
+        MLOG("SDF font atlas grow to %dx%d", atlasWidth, height);
+        CreateAtlas(atlasWidth, height);
+
+        return true;
+    }
+
+    void DVKSDFFont::BeginFrame()
+    {
+        m_Frame += 1;
+
+        if (m_RetiredTexture)
+        {
+            delete m_RetiredTexture;
+            m_RetiredTexture = nullptr;
+        }
+    }
+
+    DVKGlyph* DVKSDFFont::FindOrCreateGlyph(uint32 codepoint)
+    {
+        auto it = m_Glyphs.find(codepoint);
+        if (it != m_Glyphs.end())
+        {
+            return &(it->second);
+        }
+
+        DVKGlyph& glyph = m_Glyphs[codepoint];
+        glyph.codepoint  = codepoint;
+        glyph.glyphIndex = stbtt_FindGlyphIndex(m_FontInfo, codepoint);
+        glyph.lruIter    = m_LRU.end();
+
+        int32 advance = 0;
+        int32 bearing = 0;
+        stbtt_GetGlyphHMetrics(m_FontInfo, glyph.glyphIndex, &advance, &bearing);
+        glyph.advance = advance * scale;
+
+        // 与stbtt_GetGlyphSDF生成的位图大小一致
+        int32 ix0, iy0, ix1, iy1;
+        stbtt_GetGlyphBitmapBox(m_FontInfo, glyph.glyphIndex, scale, scale, &ix0, &iy0, &ix1, &iy1);
+        glyph.empty = stbtt_IsGlyphEmpty(m_FontInfo, glyph.glyphIndex) || ix0 == ix1 || iy0 == iy1;
+
+        glyph.x0 = (float)(ix0 - spread);
+        glyph.y0 = (float)(iy0 - spread);
+        glyph.x1 = glyph.x0 + MMath::Min(ix1 - ix0 + spread * 2, cellSize);
+        glyph.y1 = glyph.y0 + MMath::Min(iy1 - iy0 + spread * 2, cellSize);
+
+        return &glyph;
+    }
+
+    int32 DVKSDFFont::AllocateCell()
+    {
+        if (!m_FreeCells.empty())
+        {
+            int32 cell = m_FreeCells.back();
+            m_FreeCells.pop_back();
+            return cell;
+        }
+
+        // 淘汰最久未使用的字形，本帧用到的字形不能淘汰
+        if (!m_LRU.empty())
+        {
+            DVKGlyph& lru = m_Glyphs[m_LRU.back()];
+            if (lru.lastUsed != m_Frame)
+            {
+                int32 cell  = lru.cell;
+                lru.cell    = -1;
+                lru.lruIter = m_LRU.end();
+                m_LRU.pop_back();
+                return cell;
+            }
+        }
+
+        if (GrowAtlas())
+        {
+            return AllocateCell();
+        }
+
+        return -1;
+    }
+
+    bool DVKSDFFont::Prepare(const std::vector<uint32>& codepoints)
+    {
+        bool result = true;
+        m_Pending.clear();
+
+        for (size_t i = 0; i < codepoints.size(); ++i)
+        {
+            DVKGlyph* glyph = FindOrCreateGlyph(codepoints[i]);
+            if (glyph->lastUsed == m_Frame)
+            {
+                continue;
+            }
+            glyph->lastUsed = m_Frame;
+
+            if (glyph->empty)
+            {
+                continue;
+            }
+
+            if (glyph->cell >= 0)
+            {
+                m_LRU.splice(m_LRU.begin(), m_LRU, glyph->lruIter);
+                continue;
+            }
+
+            int32 cell = AllocateCell();
+            if (cell < 0)
+            {
+                result = false;
+                continue;
+            }
+
+            glyph->cell = cell;
+            m_LRU.push_front(glyph->codepoint);
+            glyph->lruIter = m_LRU.begin();
+
+            m_Pending.push_back(glyph);
+            m_DirtyCells.push_back(cell);
+        }
+
+        if (!result)
+        {
+            MLOGE("SDF font atlas is full, %d glyphs used in this frame", (int32)m_LRU.size());
+        }
+
+        // 每个字形写入自己的格子，可以并行生成
+        if (jobSystem && m_Pending.size() > 1)
+        {
+            jobSystem->ParallelFor(
+                (int32)m_Pending.size(),
+                1,
+                [&](int32 begin, int32 end, int32 threadIndex)
+                {
+                    for (int32 i = begin; i < end; ++i)
+                    {
+                        GenerateGlyph(m_Pending[i]);
+                    }
+                }
+            );
+        }
+        else
+        {
+            for (size_t i = 0; i < m_Pending.size(); ++i)
+            {
+                GenerateGlyph(m_Pending[i]);
+            }
+        }
+
+        m_Pending.clear();
+
+        return result;
+    }
+
+    void DVKSDFFont::GenerateGlyph(DVKGlyph* glyph)
+    {
+        int32 cellX = 0;
+        int32 cellY = 0;
+        GetCellRect(glyph->cell, cellX, cellY);
+
+        // 整个格子都会被上传，先清除被淘汰的字形
+        uint8* atlas = (uint8*)m_Staging->mapped;
+        for (int32 row = 0; row < cellSize; ++row)
+        {
+            memset(atlas + (cellY + row) * atlasWidth + cellX, 0, cellSize);
+        }
+
+        int32 width   = 0;
+        int32 height  = 0;
+        int32 xoffset = 0;
+        int32 yoffset = 0;
+        uint8* sdf = stbtt_GetGlyphSDF(m_FontInfo, scale, glyph->glyphIndex, spread, 128, 128.0f / spread, &width, &height, &xoffset, &yoffset);
+        if (sdf == nullptr)
+        {
+            return;
+        }
+
+        int32 copyWidth  = MMath::Min(width, cellSize);
+        int32 copyHeight = MMath::Min(height, cellSize);
+        for (int32 row = 0; row < copyHeight; ++row)
+        {
+            memcpy(atlas + (cellY + row) * atlasWidth + cellX, sdf + row * width, copyWidth);
+        }
+
+        stbtt_FreeSDF(sdf, nullptr);
+    }
+
+    const DVKGlyph* DVKSDFFont::GetGlyph(uint32 codepoint) const
+    {
+        auto it = m_Glyphs.find(codepoint);
+        if (it == m_Glyphs.end())
+        {
+            return nullptr;
+        }
+
+        const DVKGlyph& glyph = it->second;
+        if (!glyph.empty && glyph.cell < 0)
+        {
+            return nullptr;
+        }
+
+        return &glyph;
+    }
+
+    float DVKSDFFont::GetKerning(const DVKGlyph* left, const DVKGlyph* right) const
+    {
+        return stbtt_GetGlyphKernAdvance(m_FontInfo, left->glyphIndex, right->glyphIndex) * scale;
+    }
+
+    void DVKSDFFont::Upload(VkCommandBuffer commandBuffer)
+    {
+        if (!m_FullUpload && m_DirtyCells.empty())
+        {
+            return;
+        }
+
+        std::vector<VkBufferImageCopy> regions;
+
+        if (m_FullUpload)
+        {
+            VkBufferImageCopy region = {};
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent.width  = atlasWidth;
+            region.imageExtent.height = atlasHeight;
+            region.imageExtent.depth  = 1;
+            regions.push_back(region);
+        }
+        else
+        {
+            regions.resize(m_DirtyCells.size());
+            for (size_t i = 0; i < m_DirtyCells.size(); ++i)
+            {
+                int32 cellX = 0;
+                int32 cellY = 0;
+                GetCellRect(m_DirtyCells[i], cellX, cellY);
+
+                VkBufferImageCopy& region = regions[i];
+                region = {};
+                region.bufferOffset      = cellY * atlasWidth + cellX;
+                region.bufferRowLength   = atlasWidth;
+                region.bufferImageHeight = atlasHeight;
+                region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.layerCount = 1;
+                region.imageOffset.x      = cellX;
+                region.imageOffset.y      = cellY;
+                region.imageExtent.width  = cellSize;
+                region.imageExtent.height = cellSize;
+                region.imageExtent.depth  = 1;
+            }
+        }
+
+        VkImageSubresourceRange subresourceRange = {};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.levelCount = 1;
+        subresourceRange.layerCount = 1;
+
+        ImagePipelineBarrier(commandBuffer, texture->image, m_FullUpload ? ImageLayoutBarrier::Undefined : ImageLayoutBarrier::PixelShaderRead, ImageLayoutBarrier::TransferDest, subresourceRange);
+        vkCmdCopyBufferToImage(commandBuffer, m_Staging->buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32)regions.size(), regions.data());
+        ImagePipelineBarrier(commandBuffer, texture->image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::PixelShaderRead, subresourceRange);
+
+        texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        m_FullUpload = false;
+        m_DirtyCells.clear();
+    }
+
+    // ----------------------------------- DVKTextBatch -----------------------------------
+
+    DVKTextBatch::~DVKTextBatch()
+    {
+        if (vertexBuffer)
+        {
+            delete vertexBuffer;
+            vertexBuffer = nullptr;
+        }
+
+        if (indexBuffer)
+        {
+            delete indexBuffer;
+            indexBuffer = nullptr;
+        }
+    }
+
+    DVKTextBatch* DVKTextBatch::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, DVKSDFFont* font, int32 maxGlyphs, int32 frameCount)
+    {
+        DVKTextBatch* batch = new DVKTextBatch();
+        batch->font      = font;
+        batch->maxGlyphs = maxGlyphs;
+
+        // 每帧整体重建，不需要保留CPU数据
+        batch->vertexBuffer = DVKDynamicVertexBuffer::Create(vulkanDevice, maxGlyphs * 4 * 5 * sizeof(float), frameCount, false);
+
+        // 所有字形共用一份四边形索引
+        if (maxGlyphs * 4 <= 65536)
+        {
+            std::vector<uint16> indices(maxGlyphs * 6);
+            for (int32 i = 0; i < maxGlyphs; ++i)
+            {
+                indices[i * 6 + 0] = i * 4 + 0;
+                indices[i * 6 + 1] = i * 4 + 1;
+                indices[i * 6 + 2] = i * 4 + 2;
+                indices[i * 6 + 3] = i * 4 + 0;
+                indices[i * 6 + 4] = i * 4 + 2;
+                indices[i * 6 + 5] = i * 4 + 3;
+            }
+            batch->indexBuffer = DVKIndexBuffer::Create(vulkanDevice, cmdBuffer, indices);
+        }
+        else
+        {
+            std::vector<uint32> indices(maxGlyphs * 6);
+            for (int32 i = 0; i < maxGlyphs; ++i)
+            {
+                indices[i * 6 + 0] = i * 4 + 0;
+                indices[i * 6 + 1] = i * 4 + 1;
+                indices[i * 6 + 2] = i * 4 + 2;
+                indices[i * 6 + 3] = i * 4 + 0;
+                indices[i * 6 + 4] = i * 4 + 2;
+                indices[i * 6 + 5] = i * 4 + 3;
+            }
+            batch->indexBuffer = DVKIndexBuffer::Create(vulkanDevice, cmdBuffer, indices);
+        }
+
+        return batch;
+    }
+
+    void DVKTextBatch::BindMaterial(DVKMaterial* material, const std::string& textureName)
+    {
+        m_Material     = material;
+        m_TextureName  = textureName;
+        m_AtlasVersion = font->atlasVersion;
+        m_Material->SetTexture(m_TextureName, font->texture);
+    }
+
+    void DVKTextBatch::Begin(int32 frameIndex)
+    {
+        vertexBuffer->BeginFrame(frameIndex);
+
+        m_Codepoints.clear();
+        m_Items.clear();
+        numGlyphs = 0;
+    }
+
+    void DVKTextBatch::AddText(const std::string& text, float x, float y, float size)
+    {
+        TextItem item;
+        item.begin = (int32)m_Codepoints.size();
+        item.x     = x;
+        item.y     = y;
+        item.size  = size;
+
+        DecodeUTF8(text, m_Codepoints);
+        item.count = (int32)m_Codepoints.size() - item.begin;
+
+        m_Items.push_back(item);
+    }
+
+    void DVKTextBatch::End(VkCommandBuffer commandBuffer)
+    {
+        font->Prepare(m_Codepoints);
+
+        // 图集重新创建过，上一帧已经执行完成，可以直接更新描述符
+        if (m_Material && m_AtlasVersion != font->atlasVersion)
+        {
+            m_AtlasVersion = font->atlasVersion;
+            m_Material->SetTexture(m_TextureName, font->texture);
+        }
+
+        int32 maxQuads = MMath::Min((int32)m_Codepoints.size(), maxGlyphs);
+        float* vertices = maxQuads > 0 ? (float*)vertexBuffer->Lock(maxQuads * 4 * 5 * sizeof(float)) : nullptr;
+
+        float invWidth  = 1.0f / font->atlasWidth;
+        float invHeight = 1.0f / font->atlasHeight;
+        float lineHeight = font->ascent + font->descent + font->lineGap;
+
+        for (size_t i = 0; i < m_Items.size() && numGlyphs < maxQuads; ++i)
+        {
+            const TextItem& item = m_Items[i];
+            float scale    = item.size / font->glyphSize;
+            float penX     = item.x;
+            float baseline = item.y + font->ascent * scale;
+
+            const DVKGlyph* prev = nullptr;
+            for (int32 j = item.begin; j < item.begin + item.count && numGlyphs < maxQuads; ++j)
+            {
+                uint32 codepoint = m_Codepoints[j];
+                if (codepoint == '\n')
+                {
+                    penX      = item.x;
+                    baseline += lineHeight * scale;
+                    prev      = nullptr;
+                    continue;
+                }
+
+                const DVKGlyph* glyph = font->GetGlyph(codepoint);
+                if (glyph == nullptr)
+                {
+                    prev = nullptr;
+                    continue;
+                }
+
+                if (prev)
+                {
+                    penX += font->GetKerning(prev, glyph) * scale;
+                }
+
+                if (!glyph->empty)
+                {
+                    int32 cellX = 0;
+                    int32 cellY = 0;
+                    font->GetCellRect(glyph->cell, cellX, cellY);
+
+                    float u0 = cellX * invWidth;
+                    float v0 = cellY * invHeight;
+                    float u1 = (cellX + glyph->x1 - glyph->x0) * invWidth;
+                    float v1 = (cellY + glyph->y1 - glyph->y0) * invHeight;
+
+                    float x0 = penX + glyph->x0 * scale;
+                    float y0 = baseline + glyph->y0 * scale;
+                    float x1 = penX + glyph->x1 * scale;
+                    float y1 = baseline + glyph->y1 * scale;
+
+                    float quad[20] = {
+                        x0, y0, 0.0f, u0, v0,
+                        x1, y0, 0.0f, u1, v0,
+                        x1, y1, 0.0f, u1, v1,
+                        x0, y1, 0.0f, u0, v1
+                    };
+                    memcpy(vertices + numGlyphs * 20, quad, sizeof(quad));
+                    numGlyphs += 1;
+                }
+
+                penX += glyph->advance * scale;
+                prev  = glyph;
+            }
+        }
+
+        if (numGlyphs == maxGlyphs && (int32)m_Codepoints.size() > maxGlyphs)
+        {
+            MLOGE("Text batch is full, max glyphs %d", maxGlyphs);
+        }
+
+        vertexBuffer->Upload(commandBuffer);
+        font->Upload(commandBuffer);
+    }
+
+    void DVKTextBatch::Draw(VkCommandBuffer commandBuffer)
+    {
+        if (numGlyphs == 0)
+        {
+            return;
+        }
+
+        vertexBuffer->Bind(commandBuffer, 0);
+        indexBuffer->Bind(commandBuffer);
+        vkCmdDrawIndexed(commandBuffer, numGlyphs * 6, 1, 0, 0, 0);
+    }
+
+}
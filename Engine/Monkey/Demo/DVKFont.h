@@ -0,0 +1,204 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKCommand.h"
+#include "DVKTexture.h"
+#include "DVKMaterial.h"
+#include "DVKIndexBuffer.h"
+#include "DVKVertexBuffer.h"
+#include "DVKJobSystem.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <list>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+struct stbtt_fontinfo;
+
+namespace vk_demo
+{
+
+    struct DVKGlyph
+    {
+        uint32  codepoint = 0;
+        int32   glyphIndex = 0;
+
+        // 相对于笔位置的包围盒，单位为生成SDF时的像素，y向下，包含spread
+        float   x0 = 0.0f;
+        float   y0 = 0.0f;
+        float   x1 = 0.0f;
+        float   y1 = 0.0f;
+        float   advance = 0.0f;
+
+        // 空白字符不占用图集
+        bool    empty = false;
+        // 图集中的格子，-1表示不在图集中
+        int32   cell = -1;
+        // 最后一次使用的帧，LRU淘汰时不会淘汰当前帧用到的字形
+        uint64  lastUsed = 0;
+
+        std::list<uint32>::iterator lruIter;
+    };
+
+    // 运行时从TTF生成单通道SDF的字形图集。字形按需生成，缺失的字形在DVKJobSystem上并行生成；
+    // 图集按固定大小的格子分配，满了之后淘汰最久未使用的字形，当前帧全部用到时增加图集高度；
+    // 只上传发生变化的格子。距离0.5对应字形边缘，与70_SDFFont的texture.frag一致。
+    class DVKSDFFont
+    {
+    private:
+        DVKSDFFont()
+        {
+
+        }
+
+    public:
+        ~DVKSDFFont();
+
+        // glyphSize为生成SDF时字体的像素高度，spread为边缘外扩的像素数，即SDF能表示的最大距离
+        static DVKSDFFont* Create(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            const std::string& filename,
+            DVKJobSystem* jobSystem = nullptr,
+            int32 glyphSize = 32,
+            int32 spread = 4,
+            int32 atlasSize = 512,
+            int32 maxAtlasHeight = 2048
+        );
+
+        // 开始新的一帧，之后Prepare用到的字形在本帧内不会被淘汰
+        void BeginFrame();
+
+        // 保证codepoints中的字形都在图集中，缺失的字形并行生成。图集已满且无法淘汰时跳过并返回false
+        bool Prepare(const std::vector<uint32>& codepoints);
+
+        // 未调用Prepare或者图集无法容纳时返回nullptr
+        const DVKGlyph* GetGlyph(uint32 codepoint) const;
+
+        // 单位为生成SDF时的像素
+        float GetKerning(const DVKGlyph* left, const DVKGlyph* right) const;
+
+        // 上传变化的格子，需在RenderPass之外调用。图集重新创建后会整体上传
+        void Upload(VkCommandBuffer commandBuffer);
+
+        FORCE_INLINE void GetCellRect(int32 cell, int32& x, int32& y) const
+        {
+            x = (cell % cellColumns) * cellSize;
+            y = (cell / cellColumns) * cellSize;
+        }
+
+    private:
+
+        DVKGlyph* FindOrCreateGlyph(uint32 codepoint);
+
+        int32 AllocateCell();
+
+        bool GrowAtlas();
+
+        void CreateAtlas(int32 width, int32 height);
+
+        void GenerateGlyph(DVKGlyph* glyph);
+
+    public:
+        std::shared_ptr<VulkanDevice>   vulkanDevice = nullptr;
+        DVKJobSystem*                   jobSystem = nullptr;
+
+        int32                           glyphSize = 32;
+        int32                           spread = 4;
+        float                           scale = 1.0f;
+        // 单位为生成SDF时的像素
+        float                           ascent = 0.0f;
+        float                           descent = 0.0f;
+        float                           lineGap = 0.0f;
+
+        int32                           cellSize = 0;
+        int32                           cellColumns = 0;
+        int32                           atlasWidth = 0;
+        int32                           atlasHeight = 0;
+        int32                           maxAtlasHeight = 0;
+
+        DVKTexture*                     texture = nullptr;
+        // 图集重新创建时递增，使用图集的Material需要重新设置纹理
+        uint32                          atlasVersion = 0;
+
+    private:
+        std::vector<uint8>                      m_FontData;
+        stbtt_fontinfo*                         m_FontInfo = nullptr;
+
+        std::unordered_map<uint32, DVKGlyph>    m_Glyphs;
+        // 在图集中的字形，最近使用的在前
+        std::list<uint32>                       m_LRU;
+        std::vector<int32>                      m_FreeCells;
+        int32                                   m_NumCells = 0;
+
+        // CPU端的图集，同时作为上传用的staging
+        DVKBuffer*                              m_Staging = nullptr;
+        std::vector<int32>                      m_DirtyCells;
+        bool                                    m_FullUpload = true;
+
+        DVKTexture*                             m_RetiredTexture = nullptr;
+        std::vector<DVKGlyph*>                  m_Pending;
+        uint64                                  m_Frame = 1;
+    };
+
+    // 文字批次：一帧内所有字符串排版到同一个顶点流中，使用一次DrawIndexed绘制。
+    // 顶点为position(xyz) + uv0，单位为像素，x向右y向下，配合正交投影使用。
+    class DVKTextBatch
+    {
+    private:
+        DVKTextBatch()
+        {
+
+        }
+
+    public:
+        ~DVKTextBatch();
+
+        static DVKTextBatch* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, DVKSDFFont* font, int32 maxGlyphs, int32 frameCount);
+
+        // material使用font的图集作为textureName，图集重新创建时自动更新
+        void BindMaterial(DVKMaterial* material, const std::string& textureName = "textureMap");
+
+        // frameIndex一般为backBufferIndex
+        void Begin(int32 frameIndex);
+
+        // (x, y)为第一行的左上角，size为字体像素高度，支持'\n'换行，text为UTF-8
+        void AddText(const std::string& text, float x, float y, float size);
+
+        // 生成缺失的字形并排版，上传图集与顶点，需在RenderPass之外调用
+        void End(VkCommandBuffer commandBuffer);
+
+        void Draw(VkCommandBuffer commandBuffer);
+
+    private:
+        struct TextItem
+        {
+            int32   begin = 0;
+            int32   count = 0;
+            float   x = 0.0f;
+            float   y = 0.0f;
+            float   size = 0.0f;
+        };
+
+    public:
+        DVKSDFFont*                 font = nullptr;
+        DVKDynamicVertexBuffer*     vertexBuffer = nullptr;
+        DVKIndexBuffer*             indexBuffer = nullptr;
+
+        int32                       maxGlyphs = 0;
+        int32                       numGlyphs = 0;
+
+    private:
+        std::vector<uint32>         m_Codepoints;
+        std::vector<TextItem>       m_Items;
+
+        DVKMaterial*                m_Material = nullptr;
+        std::string                 m_TextureName;
+        uint32                      m_AtlasVersion = 0;
+    };
+
+}
@@ -0,0 +1,472 @@
+﻿#include "DVKGPUCulling.h"
+#include "DVKUtils.h"
+
+#include "Math/Math.h"
+
+namespace vk_demo
+{
+
+    static DVKBuffer* CreateDeviceBuffer(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, VkBufferUsageFlags usage, VkDeviceSize size, const void* data)
+    {
+        DVKBuffer* buffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            size
+        );
+
+        if (data == nullptr)
+        {
+            return buffer;
+        }
+
+        DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            size,
+            (void*)data
+        );
+
+        cmdBuffer->Begin();
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.size = size;
+        vkCmdCopyBuffer(cmdBuffer->cmdBuffer, stagingBuffer->buffer, buffer->buffer, 1, &copyRegion);
+
+        cmdBuffer->End();
+        cmdBuffer->Submit();
+
+        delete stagingBuffer;
+
+        return buffer;
+    }
+
+    static void CullingBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        VkMemoryBarrier barrier;
+        ZeroVulkanStruct(barrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER);
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // 1D Dispatch超过maxComputeWorkGroupCount时拆到y方向
+    static void DispatchLinear(DVKCompute* processor, VkCommandBuffer commandBuffer, int32 count, int32 groupSize)
+    {
+        int32 groups  = MMath::Max(1, (count + groupSize - 1) / groupSize);
+        int32 groupsX = MMath::Min(groups, 65535);
+        int32 groupsY = (groups + groupsX - 1) / groupsX;
+        processor->BindDispatch(commandBuffer, groupsX, groupsY, 1);
+    }
+
+    static DVKTexture* CreateHiZTexture(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, int32 width, int32 height)
+    {
+        VkDevice device = vulkanDevice->GetInstanceHandle();
+        int32 mipLevels = (int32)MMath::FloorLog2((uint32)MMath::Max(width, height)) + 1;
+
+        VkImage         image = VK_NULL_HANDLE;
+        VkDeviceMemory  imageMemory = VK_NULL_HANDLE;
+        VkImageView     imageView = VK_NULL_HANDLE;
+        VkSampler       imageSampler = VK_NULL_HANDLE;
+
+        VkImageCreateInfo imageCreateInfo;
+        ZeroVulkanStruct(imageCreateInfo, VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO);
+        imageCreateInfo.imageType     = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format        = VK_FORMAT_R32_SFLOAT;
+        imageCreateInfo.mipLevels     = mipLevels;
+        imageCreateInfo.arrayLayers   = 1;
+        imageCreateInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageCreateInfo.extent        = { (uint32_t)width, (uint32_t)height, (uint32_t)1 };
+        imageCreateInfo.usage         = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        VERIFYVULKANRESULT(vkCreateImage(device, &imageCreateInfo, VULKAN_CPU_ALLOCATOR, &image));
+
+        uint32 memoryTypeIndex = 0;
+        VkMemoryRequirements memReqs = {};
+        vkGetImageMemoryRequirements(device, image, &memReqs);
+        vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
+
+        VkMemoryAllocateInfo memAllocInfo;
+        ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
+        memAllocInfo.allocationSize  = memReqs.size;
+        memAllocInfo.memoryTypeIndex = memoryTypeIndex;
+        VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
+        VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+
+        // 取最远深度，不能做插值
+        VkSamplerCreateInfo samplerInfo;
+        ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
+        samplerInfo.magFilter        = VK_FILTER_NEAREST;
+        samplerInfo.minFilter        = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode       = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU     = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV     = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW     = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.compareOp        = VK_COMPARE_OP_NEVER;
+        samplerInfo.borderColor      = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        samplerInfo.maxAnisotropy    = 1.0;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxLod           = (float)mipLevels;
+        samplerInfo.minLod           = 0.0f;
+        VERIFYVULKANRESULT(vkCreateSampler(device, &samplerInfo, VULKAN_CPU_ALLOCATOR, &imageSampler));
+
+        VkImageViewCreateInfo viewInfo;
+        ZeroVulkanStruct(viewInfo, VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO);
+        viewInfo.image      = image;
+        viewInfo.viewType   = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format     = VK_FORMAT_R32_SFLOAT;
+        viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+        viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.layerCount     = 1;
+        viewInfo.subresourceRange.levelCount     = mipLevels;
+        viewInfo.subresourceRange.baseMipLevel   = 0;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        VERIFYVULKANRESULT(vkCreateImageView(device, &viewInfo, VULKAN_CPU_ALLOCATOR, &imageView));
+
+        // 整个生命周期都保持GENERAL，Compute中既读又写
+        VkImageSubresourceRange subresourceRange = {};
+        subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.levelCount     = mipLevels;
+        subresourceRange.layerCount     = 1;
+        subresourceRange.baseArrayLayer = 0;
+        subresourceRange.baseMipLevel   = 0;
+
+        cmdBuffer->Begin();
+        ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::Undefined, ImageLayoutBarrier::ComputeGeneralRW, subresourceRange);
+        cmdBuffer->Submit();
+
+        DVKTexture* texture = new DVKTexture();
+        texture->descriptorInfo.sampler     = imageSampler;
+        texture->descriptorInfo.imageView   = imageView;
+        texture->descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        texture->format       = VK_FORMAT_R32_SFLOAT;
+        texture->width        = width;
+        texture->height       = height;
+        texture->depth        = 1;
+        texture->image        = image;
+        texture->imageLayout  = VK_IMAGE_LAYOUT_GENERAL;
+        texture->imageMemory  = imageMemory;
+        texture->imageSampler = imageSampler;
+        texture->imageView    = imageView;
+        texture->device       = device;
+        texture->mipLevels    = mipLevels;
+        texture->layerCount   = 1;
+
+        return texture;
+    }
+
+    DVKGPUCulling::~DVKGPUCulling()
+    {
+        DestroyHiZ();
+
+        delete cullProcessor;
+        delete compactProcessor;
+
+        delete boundsBuffer;
+        delete drawIndexBuffer;
+        delete drawArgsBuffer;
+        delete sourceInstanceBuffer;
+
+        delete instanceBuffer;
+        delete counterBuffer;
+        delete indirectBuffer;
+        delete drawCountBuffer;
+
+        vulkanDevice = nullptr;
+    }
+
+    void DVKGPUCulling::DestroyHiZ()
+    {
+        for (int32 i = 0; i < hizProcessors.size(); ++i)
+        {
+            delete hizProcessors[i];
+        }
+        hizProcessors.clear();
+
+        // mip view只持有imageView
+        for (int32 i = 0; i < hizMipViews.size(); ++i)
+        {
+            delete hizMipViews[i];
+        }
+        hizMipViews.clear();
+
+        delete hizTexture;
+        hizTexture = nullptr;
+        hizDepth   = nullptr;
+        hizReady   = false;
+    }
+
+    DVKGPUCulling* DVKGPUCulling::Create(
+        std::shared_ptr<VulkanDevice> vulkanDevice,
+        VkPipelineCache pipelineCache,
+        DVKCommandBuffer* cmdBuffer,
+        DVKShader* cullShader,
+        DVKShader* compactShader,
+        const std::vector<DVKCullingDraw>& draws,
+        const std::vector<Vector4>& bounds,
+        const std::vector<uint32>& drawIndices,
+        const std::vector<float>& instanceData,
+        int32 instanceStride
+    )
+    {
+        if (draws.size() == 0 || bounds.size() == 0)
+        {
+            MLOGE("GPUCulling need at least one draw and one instance.");
+            return nullptr;
+        }
+
+        if (drawIndices.size() != bounds.size() || instanceData.size() != bounds.size() * instanceStride)
+        {
+            MLOGE("GPUCulling instance count not match, bounds=%d drawIndices=%d instanceData=%d", (int32)bounds.size(), (int32)drawIndices.size(), (int32)instanceData.size());
+            return nullptr;
+        }
+
+        // 每个Draw在输出实例数据中占用一段连续区域，起点为实例数的前缀和
+        std::vector<uint32> instanceCounts(draws.size(), 0);
+        for (int32 i = 0; i < drawIndices.size(); ++i)
+        {
+            if (drawIndices[i] >= draws.size())
+            {
+                MLOGE("GPUCulling draw index out of range : %d", (int32)drawIndices[i]);
+                return nullptr;
+            }
+            instanceCounts[drawIndices[i]] += 1;
+        }
+
+        std::vector<uint32> drawArgs(draws.size() * 4);
+        uint32 instanceBase = 0;
+        for (int32 i = 0; i < draws.size(); ++i)
+        {
+            drawArgs[i * 4 + 0] = draws[i].indexCount;
+            drawArgs[i * 4 + 1] = draws[i].firstIndex;
+            drawArgs[i * 4 + 2] = (uint32)draws[i].vertexOffset;
+            drawArgs[i * 4 + 3] = instanceBase;
+            instanceBase += instanceCounts[i];
+        }
+
+        DVKGPUCulling* culling   = new DVKGPUCulling();
+        culling->vulkanDevice    = vulkanDevice;
+        culling->pipelineCache   = pipelineCache;
+        culling->numDraws        = (int32)draws.size();
+        culling->numInstances    = (int32)bounds.size();
+        culling->instanceStride  = instanceStride;
+
+        VkDeviceSize instanceSize = instanceData.size() * sizeof(float);
+
+        culling->boundsBuffer         = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, bounds.size() * sizeof(Vector4), bounds.data());
+        culling->drawIndexBuffer      = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, drawIndices.size() * sizeof(uint32), drawIndices.data());
+        culling->drawArgsBuffer       = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, drawArgs.size() * sizeof(uint32), drawArgs.data());
+        culling->sourceInstanceBuffer = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, instanceSize, instanceData.data());
+
+        culling->instanceBuffer  = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, instanceSize, nullptr);
+        culling->counterBuffer   = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, draws.size() * sizeof(uint32), nullptr);
+        culling->indirectBuffer  = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, draws.size() * sizeof(VkDrawIndexedIndirectCommand), nullptr);
+        culling->drawCountBuffer = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(uint32), nullptr);
+
+        // 需要在创建设备时开启VK_KHR_draw_indirect_count，否则回退到固定数量的Indirect
+        if (vulkanDevice->IsExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+        {
+            culling->cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(vulkanDevice->GetInstanceHandle(), "vkCmdDrawIndexedIndirectCountKHR"));
+        }
+        if (culling->cmdDrawIndexedIndirectCount == nullptr)
+        {
+            MLOG("VK_KHR_draw_indirect_count not enabled, fallback to vkCmdDrawIndexedIndirect.");
+        }
+
+        culling->cullProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, cullShader);
+        culling->cullProcessor->SetStorageBuffer("inBounds",    culling->boundsBuffer);
+        culling->cullProcessor->SetStorageBuffer("inDrawIndex", culling->drawIndexBuffer);
+        culling->cullProcessor->SetStorageBuffer("inDrawArgs",  culling->drawArgsBuffer);
+        culling->cullProcessor->SetStorageBuffer("inInstance",  culling->sourceInstanceBuffer);
+        culling->cullProcessor->SetStorageBuffer("outInstance", culling->instanceBuffer);
+        culling->cullProcessor->SetStorageBuffer("drawCounter", culling->counterBuffer);
+
+        // 未开启Hi-Z时也需要一张有效的贴图
+        culling->hizTexture = CreateHiZTexture(vulkanDevice, cmdBuffer, 1, 1);
+        culling->cullProcessor->SetTexture("hizTexture", culling->hizTexture);
+
+        culling->compactProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, compactShader);
+        culling->compactProcessor->SetStorageBuffer("inDrawArgs",   culling->drawArgsBuffer);
+        culling->compactProcessor->SetStorageBuffer("drawCounter",  culling->counterBuffer);
+        culling->compactProcessor->SetStorageBuffer("outIndirect",  culling->indirectBuffer);
+        culling->compactProcessor->SetStorageBuffer("outDrawCount", culling->drawCountBuffer);
+
+        return culling;
+    }
+
+    bool DVKGPUCulling::SetHiZ(DVKShader* hizShader, DVKTexture* depthTexture, DVKCommandBuffer* cmdBuffer)
+    {
+        if (depthTexture == nullptr || hizShader == nullptr)
+        {
+            MLOGE("GPUCulling Hi-Z need depth texture and shader.");
+            return false;
+        }
+
+        // 第0级为深度图的一半
+        int32 width  = MMath::Max(1, (depthTexture->width  + 1) / 2);
+        int32 height = MMath::Max(1, (depthTexture->height + 1) / 2);
+
+        // 先创建新的再销毁旧的，避免新对象复用旧地址导致DescriptorSet没有更新
+        DVKTexture* texture = CreateHiZTexture(vulkanDevice, cmdBuffer, width, height);
+        cullProcessor->SetTexture("hizTexture", texture);
+        DestroyHiZ();
+
+        hizTexture = texture;
+        hizDepth   = depthTexture;
+
+        VkDevice device = vulkanDevice->GetInstanceHandle();
+
+        for (int32 mip = 0; mip < hizTexture->mipLevels; ++mip)
+        {
+            VkImageView imageView = VK_NULL_HANDLE;
+
+            VkImageViewCreateInfo viewInfo;
+            ZeroVulkanStruct(viewInfo, VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO);
+            viewInfo.image      = hizTexture->image;
+            viewInfo.viewType   = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format     = hizTexture->format;
+            viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+            viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            viewInfo.subresourceRange.layerCount     = 1;
+            viewInfo.subresourceRange.levelCount     = 1;
+            viewInfo.subresourceRange.baseMipLevel   = mip;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            VERIFYVULKANRESULT(vkCreateImageView(device, &viewInfo, VULKAN_CPU_ALLOCATOR, &imageView));
+
+            DVKTexture* mipView = new DVKTexture();
+            mipView->device       = device;
+            mipView->imageView    = imageView;
+            mipView->imageLayout  = VK_IMAGE_LAYOUT_GENERAL;
+            mipView->format       = hizTexture->format;
+            // 和Vulkan的mip尺寸一致向下取整，奇数尺寸丢掉的边缘由HiZ.comp多采样一行或一列补上
+            mipView->width        = MMath::Max(1, width  >> mip);
+            mipView->height       = MMath::Max(1, height >> mip);
+            mipView->descriptorInfo.sampler     = hizTexture->imageSampler;
+            mipView->descriptorInfo.imageView   = imageView;
+            mipView->descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            hizMipViews.push_back(mipView);
+
+            DVKCompute* processor = DVKCompute::Create(vulkanDevice, pipelineCache, hizShader);
+            processor->SetTexture("inDepth", mip == 0 ? depthTexture : hizMipViews[mip - 1]);
+            processor->SetStorageTexture("outDepth", mipView);
+            hizProcessors.push_back(processor);
+        }
+
+        return true;
+    }
+
+    void DVKGPUCulling::BuildHiZ(VkCommandBuffer commandBuffer, const Matrix4x4& viewProjection)
+    {
+        if (hizProcessors.size() == 0)
+        {
+            return;
+        }
+
+        // 上一帧Cull仍在读取Hi-Z，同时等待深度写入完成
+        CullingBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT
+        );
+
+        for (int32 mip = 0; mip < hizProcessors.size(); ++mip)
+        {
+            DVKTexture* source = mip == 0 ? hizDepth : hizMipViews[mip - 1];
+            DVKTexture* dest   = hizMipViews[mip];
+
+            HiZParamBlock param;
+            param.size.x = (float)source->width;
+            param.size.y = (float)source->height;
+            param.size.z = (float)dest->width;
+            param.size.w = (float)dest->height;
+
+            hizProcessors[mip]->SetUniform("paramData", &param, sizeof(HiZParamBlock));
+            hizProcessors[mip]->BindDispatch(commandBuffer, (dest->width + 7) / 8, (dest->height + 7) / 8, 1);
+
+            CullingBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        }
+
+        hizViewProjection = viewProjection;
+        hizReady = true;
+    }
+
+    void DVKGPUCulling::Cull(VkCommandBuffer commandBuffer, DVKCamera& camera)
+    {
+        CullParamBlock cullParam;
+        cullParam.count.x = (float)numInstances;
+        cullParam.count.y = (float)numDraws;
+        cullParam.count.z = (float)instanceStride;
+        cullParam.count.w = 0.0f;
+        camera.GetFrustumPlanes(cullParam.frustumPlanes);
+        cullParam.viewProjection = hizViewProjection;
+        cullParam.hiz.x = (float)hizTexture->width;
+        cullParam.hiz.y = (float)hizTexture->height;
+        cullParam.hiz.z = (float)hizTexture->mipLevels;
+        cullParam.hiz.w = (hizOcclusion && hizReady) ? 1.0f : 0.0f;
+
+        CompactParamBlock compactParam;
+        compactParam.count.x = (float)numDraws;
+        compactParam.count.y = SupportDrawCount() ? 1.0f : 0.0f;
+        compactParam.count.z = 0.0f;
+        compactParam.count.w = 0.0f;
+
+        // 上一次的Draw还在读取输出
+        CullingBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0
+        );
+
+        vkCmdFillBuffer(commandBuffer, counterBuffer->buffer,   0, counterBuffer->size,   0);
+        vkCmdFillBuffer(commandBuffer, drawCountBuffer->buffer, 0, drawCountBuffer->size, 0);
+
+        CullingBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,       VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+
+        // 每个实例一个线程，剔除后追加到所属Draw的实例区域
+        cullProcessor->SetUniform("paramData", &cullParam, sizeof(CullParamBlock));
+        DispatchLinear(cullProcessor, commandBuffer, numInstances, 64);
+
+        CullingBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+
+        // 每个Draw一个线程，写出IndirectCommand
+        compactProcessor->SetUniform("paramData", &compactParam, sizeof(CompactParamBlock));
+        DispatchLinear(compactProcessor, commandBuffer, numDraws, 64);
+
+        CullingBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+        );
+    }
+
+    void DVKGPUCulling::Draw(VkCommandBuffer commandBuffer)
+    {
+        if (cmdDrawIndexedIndirectCount)
+        {
+            cmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer->buffer, 0, drawCountBuffer->buffer, 0, numDraws, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else if (vulkanDevice->GetPhysicalFeatures().multiDrawIndirect)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer->buffer, 0, numDraws, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else
+        {
+            for (int32 i = 0; i < numDraws; ++i)
+            {
+                vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer->buffer, i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+            }
+        }
+    }
+
+}
@@ -0,0 +1,137 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKCommand.h"
+#include "DVKTexture.h"
+#include "DVKShader.h"
+#include "DVKCompute.h"
+#include "DVKCamera.h"
+
+#include "Common/Common.h"
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+
+    // 一个Draw的模板，instanceCount与firstInstance由GPU填写
+    struct DVKCullingDraw
+    {
+        uint32  indexCount = 0;
+        uint32  firstIndex = 0;
+        int32   vertexOffset = 0;
+    };
+
+    // GPU剔除：Compute中完成视锥(可选Hi-Z)剔除，紧凑写出实例数据、VkDrawIndexedIndirectCommand以及Draw数量。
+    // CPU不回读任何结果，提交开销只与Draw模板数量有关，与物体数量无关。
+    // 实例数据写入instanceBuffer，作为binding 1的实例顶点数据使用，与38_IndirectDraw的布局一致。
+    class DVKGPUCulling
+    {
+    private:
+        typedef std::shared_ptr<VulkanDevice> VulkanDeviceRef;
+
+        struct CullParamBlock
+        {
+            Vector4     count;
+            Vector4     frustumPlanes[6];
+            Matrix4x4   viewProjection;
+            Vector4     hiz;
+        };
+
+        struct CompactParamBlock
+        {
+            Vector4     count;
+        };
+
+        struct HiZParamBlock
+        {
+            Vector4     size;
+        };
+
+        DVKGPUCulling()
+        {
+
+        }
+
+    public:
+        ~DVKGPUCulling();
+
+        // bounds为实例的世界空间包围球(xyz:球心 w:半径)，drawIndices为实例所属的Draw，
+        // instanceData为每个实例instanceStride个float的顶点数据。
+        // cullShader/compactShader参见45_ComputeFrustum下的Cull.comp/Compact.comp。
+        static DVKGPUCulling* Create(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            VkPipelineCache pipelineCache,
+            DVKCommandBuffer* cmdBuffer,
+            DVKShader* cullShader,
+            DVKShader* compactShader,
+            const std::vector<DVKCullingDraw>& draws,
+            const std::vector<Vector4>& bounds,
+            const std::vector<uint32>& drawIndices,
+            const std::vector<float>& instanceData,
+            int32 instanceStride
+        );
+
+        // 开启Hi-Z遮挡剔除。depthTexture需要可采样，并且在BuildHiZ时处于其descriptorInfo记录的layout。
+        // 尺寸变化后需要重新调用。
+        bool SetHiZ(DVKShader* hizShader, DVKTexture* depthTexture, DVKCommandBuffer* cmdBuffer);
+
+        // 由depthTexture生成最远深度的mip链，viewProjection为渲染该深度时使用的矩阵
+        void BuildHiZ(VkCommandBuffer commandBuffer, const Matrix4x4& viewProjection);
+
+        // 需在RenderPass之外录制
+        void Cull(VkCommandBuffer commandBuffer, DVKCamera& camera);
+
+        // 调用前需绑定Pipeline、顶点(binding 0)、instanceBuffer(binding 1)以及索引
+        void Draw(VkCommandBuffer commandBuffer);
+
+        FORCE_INLINE bool SupportDrawCount() const
+        {
+            return cmdDrawIndexedIndirectCount != nullptr;
+        }
+
+    private:
+
+        void DestroyHiZ();
+
+    public:
+
+        VulkanDeviceRef                 vulkanDevice = nullptr;
+        VkPipelineCache                 pipelineCache = VK_NULL_HANDLE;
+
+        int32                           numDraws = 0;
+        int32                           numInstances = 0;
+        int32                           instanceStride = 0;
+
+        // 输入
+        DVKBuffer*                      boundsBuffer = nullptr;
+        DVKBuffer*                      drawIndexBuffer = nullptr;
+        DVKBuffer*                      drawArgsBuffer = nullptr;
+        DVKBuffer*                      sourceInstanceBuffer = nullptr;
+
+        // 输出
+        DVKBuffer*                      instanceBuffer = nullptr;
+        DVKBuffer*                      counterBuffer = nullptr;
+        DVKBuffer*                      indirectBuffer = nullptr;
+        DVKBuffer*                      drawCountBuffer = nullptr;
+
+        DVKCompute*                     cullProcessor = nullptr;
+        DVKCompute*                     compactProcessor = nullptr;
+
+        // Hi-Z
+        bool                            hizOcclusion = true;
+        bool                            hizReady = false;
+        Matrix4x4                       hizViewProjection;
+        DVKTexture*                     hizTexture = nullptr;
+        DVKTexture*                     hizDepth = nullptr;
+        std::vector<DVKTexture*>        hizMipViews;
+        std::vector<DVKCompute*>        hizProcessors;
+
+        PFN_vkCmdDrawIndexedIndirectCountKHR    cmdDrawIndexedIndirectCount = nullptr;
+    };
+
+}
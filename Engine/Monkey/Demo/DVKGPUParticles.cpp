@@ -0,0 +1,343 @@
+﻿#include "DVKGPUParticles.h"
+#include "DVKUtils.h"
+
+#include "Math/Math.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+    // 与ParticleSort.comp中的块大小一致
+    static const int32 SORT_BLOCK_SIZE = 1024;
+    static const int32 GROUP_SIZE      = 64;
+
+    // counterBuffer的布局，参见ParticleArgs.comp
+    static const VkDeviceSize COUNTER_ALIVE_OFFSET    = 8;
+    static const VkDeviceSize COUNTER_EMIT_ARGS       = 32;
+    static const VkDeviceSize COUNTER_SIMULATE_ARGS   = 48;
+    static const VkDeviceSize COUNTER_SORT_ARGS       = 64;
+    static const VkDeviceSize COUNTER_COMPACT_ARGS    = 80;
+    static const VkDeviceSize COUNTER_SIZE            = 96;
+
+    static DVKBuffer* CreateDeviceBuffer(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, VkBufferUsageFlags usage, VkDeviceSize size, const void* data)
+    {
+        DVKBuffer* buffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            size
+        );
+
+        if (data == nullptr)
+        {
+            cmdBuffer->Begin();
+            vkCmdFillBuffer(cmdBuffer->cmdBuffer, buffer->buffer, 0, size, 0);
+            cmdBuffer->End();
+            cmdBuffer->Submit();
+            return buffer;
+        }
+
+        DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            size,
+            (void*)data
+        );
+
+        cmdBuffer->Begin();
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.size = size;
+        vkCmdCopyBuffer(cmdBuffer->cmdBuffer, stagingBuffer->buffer, buffer->buffer, 1, &copyRegion);
+
+        cmdBuffer->End();
+        cmdBuffer->Submit();
+
+        delete stagingBuffer;
+
+        return buffer;
+    }
+
+    static void ParticleBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        VkMemoryBarrier barrier;
+        ZeroVulkanStruct(barrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER);
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // 计算写出Indirect参数之后，后续的Dispatch既要读取参数也要读写计数
+    static void ArgsBarrier(VkCommandBuffer commandBuffer)
+    {
+        ParticleBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+    }
+
+    static void ComputeBarrier(VkCommandBuffer commandBuffer)
+    {
+        ParticleBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+    }
+
+    DVKGPUParticles::~DVKGPUParticles()
+    {
+        delete argsProcessor;
+        delete emitProcessor;
+        delete simulateProcessor;
+        delete sortProcessor;
+        delete compactProcessor;
+
+        delete particleBuffer;
+        delete deadBuffer;
+        delete aliveBuffer;
+        delete sortBuffer;
+        delete counterBuffer;
+        delete drawBuffer;
+        delete drawArgsBuffer;
+        delete statsBuffer;
+
+        vulkanDevice = nullptr;
+    }
+
+    DVKGPUParticles* DVKGPUParticles::Create(
+        std::shared_ptr<VulkanDevice> vulkanDevice,
+        VkPipelineCache pipelineCache,
+        DVKCommandBuffer* cmdBuffer,
+        DVKShader* argsShader,
+        DVKShader* emitShader,
+        DVKShader* simulateShader,
+        DVKShader* sortShader,
+        DVKShader* compactShader,
+        int32 capacity
+    )
+    {
+        // 发射、模拟、紧凑都是一维Dispatch
+        if (capacity <= 0 || capacity > 65535 * GROUP_SIZE)
+        {
+            MLOGE("GPUParticles capacity out of range : %d", capacity);
+            return nullptr;
+        }
+
+        int32 sortCapacity = SORT_BLOCK_SIZE;
+        while (sortCapacity < capacity)
+        {
+            sortCapacity <<= 1;
+        }
+
+        DVKGPUParticles* particles = new DVKGPUParticles();
+        particles->vulkanDevice   = vulkanDevice;
+        particles->capacity       = capacity;
+        particles->sortCapacity   = sortCapacity;
+        particles->computeFamily  = cmdBuffer->queue->GetFamilyIndex();
+        particles->graphicsFamily = vulkanDevice->GetGraphicsQueue()->GetFamilyIndex();
+
+        // 初始时全部粒子都在死亡列表中
+        std::vector<uint32> deadIndices(capacity);
+        for (int32 i = 0; i < capacity; ++i)
+        {
+            deadIndices[i] = i;
+        }
+
+        uint32 counters[COUNTER_SIZE / sizeof(uint32)] = { };
+        counters[0] = capacity;
+
+        particles->particleBuffer = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, capacity * sizeof(Vector4) * 2, nullptr);
+        particles->deadBuffer     = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, capacity * sizeof(uint32), deadIndices.data());
+        particles->aliveBuffer    = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, capacity * sizeof(uint32) * 2, nullptr);
+        particles->sortBuffer     = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sortCapacity * sizeof(uint32) * 2, nullptr);
+        particles->counterBuffer  = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, COUNTER_SIZE, counters);
+        particles->drawBuffer     = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, capacity * sizeof(Vector4) * 2, nullptr);
+        particles->drawArgsBuffer = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(VkDrawIndirectCommand) * 2, nullptr);
+
+        particles->statsBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            sizeof(uint32) * 2
+        );
+        particles->statsBuffer->Map();
+        memset(particles->statsBuffer->mapped, 0, sizeof(uint32) * 2);
+
+        particles->argsProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, argsShader);
+        particles->argsProcessor->SetStorageBuffer("counter",  particles->counterBuffer);
+        particles->argsProcessor->SetStorageBuffer("drawArgs", particles->drawArgsBuffer);
+
+        particles->emitProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, emitShader);
+        particles->emitProcessor->SetStorageBuffer("counter",   particles->counterBuffer);
+        particles->emitProcessor->SetStorageBuffer("particles", particles->particleBuffer);
+        particles->emitProcessor->SetStorageBuffer("deadList",  particles->deadBuffer);
+        particles->emitProcessor->SetStorageBuffer("aliveList", particles->aliveBuffer);
+
+        particles->simulateProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, simulateShader);
+        particles->simulateProcessor->SetStorageBuffer("counter",   particles->counterBuffer);
+        particles->simulateProcessor->SetStorageBuffer("particles", particles->particleBuffer);
+        particles->simulateProcessor->SetStorageBuffer("deadList",  particles->deadBuffer);
+        particles->simulateProcessor->SetStorageBuffer("aliveList", particles->aliveBuffer);
+        particles->simulateProcessor->SetStorageBuffer("sortList",  particles->sortBuffer);
+
+        particles->sortProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, sortShader);
+        particles->sortProcessor->SetStorageBuffer("counter",  particles->counterBuffer);
+        particles->sortProcessor->SetStorageBuffer("sortList", particles->sortBuffer);
+
+        particles->compactProcessor = DVKCompute::Create(vulkanDevice, pipelineCache, compactShader);
+        particles->compactProcessor->SetStorageBuffer("counter",   particles->counterBuffer);
+        particles->compactProcessor->SetStorageBuffer("particles", particles->particleBuffer);
+        particles->compactProcessor->SetStorageBuffer("sortList",  particles->sortBuffer);
+        particles->compactProcessor->SetStorageBuffer("drawList",  particles->drawBuffer);
+
+        return particles;
+    }
+
+    void DVKGPUParticles::DispatchSort(VkCommandBuffer commandBuffer, int32 mode, uint32 k, uint32 j, int32 slot)
+    {
+        SortParamBlock sortParam;
+        sortParam.data.x = (float)mode;
+        sortParam.data.y = (float)k;
+        sortParam.data.z = (float)j;
+        sortParam.data.w = (float)slot;
+
+        sortProcessor->SetUniform("sortParam", &sortParam, sizeof(SortParamBlock));
+        sortProcessor->BindDispatchIndirect(commandBuffer, counterBuffer->buffer, COUNTER_SORT_ARGS);
+
+        ComputeBarrier(commandBuffer);
+    }
+
+    void DVKGPUParticles::Simulate(VkCommandBuffer commandBuffer, float delta, const Vector3& cameraPosition)
+    {
+        int32 slot = (int32)(frameIndex & 1);
+
+        // 发射数量的小数部分累计到下一帧
+        emitAccumulator += MMath::Max(config.emitRate, 0.0f) * delta;
+        float emitCount  = MMath::Min(MMath::FloorToFloat(emitAccumulator), (float)capacity);
+        emitAccumulator  = MMath::Min(emitAccumulator - emitCount, 1.0f);
+
+        ParamBlock param;
+        param.emitter   = Vector4(config.emitterPosition, config.emitterRadius);
+        param.velocity  = Vector4(config.velocity, config.velocityRandom);
+        param.gravity   = Vector4(config.gravity, config.drag);
+        param.attractor = Vector4(config.attractorPosition, config.attractorStrength);
+        param.frame     = Vector4(delta, config.lifeMin, MMath::Max(config.lifeMin, config.lifeMax), (float)(frameIndex & 0xFFFFFF));
+        param.counts    = Vector4((float)capacity, emitCount, (float)slot, 0.0f);
+        param.camera    = Vector4(cameraPosition, 0.0f);
+
+        // 上一次的模拟与排序还可能在读写这些Buffer，Draw的读取由调用者通过Fence保证已经完成
+        ParticleBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+
+        // 限制发射数量，计算发射与模拟的Dispatch参数
+        argsProcessor->SetUniform("param", &param, sizeof(ParamBlock));
+        argsProcessor->BindDispatch(commandBuffer, 1, 1, 1);
+        ArgsBarrier(commandBuffer);
+
+        // 从死亡列表取出粒子追加到当前存活列表
+        emitProcessor->SetUniform("param", &param, sizeof(ParamBlock));
+        emitProcessor->BindDispatchIndirect(commandBuffer, counterBuffer->buffer, COUNTER_EMIT_ARGS);
+        ComputeBarrier(commandBuffer);
+
+        // 死亡的粒子归还死亡列表，存活的写入另一个slot的存活列表以及排序列表
+        simulateProcessor->SetUniform("param", &param, sizeof(ParamBlock));
+        simulateProcessor->BindDispatchIndirect(commandBuffer, counterBuffer->buffer, COUNTER_SIMULATE_ARGS);
+        ComputeBarrier(commandBuffer);
+
+        // 根据模拟后的存活数量计算排序、紧凑以及Draw的参数
+        param.counts.w = 1.0f;
+        argsProcessor->SetUniform("param", &param, sizeof(ParamBlock));
+        argsProcessor->BindDispatch(commandBuffer, 1, 1, 1);
+        ArgsBarrier(commandBuffer);
+
+        // Bitonic排序：先在块内完成排序，之后每一级先做跨块的比较，剩余的步长在块内完成。
+        // 录制的级数按容量计算，超过实际排序长度的级在Shader中直接返回。
+        if (config.sort)
+        {
+            DispatchSort(commandBuffer, 0, SORT_BLOCK_SIZE, 0, slot);
+            for (uint32 k = SORT_BLOCK_SIZE * 2; k <= (uint32)sortCapacity; k <<= 1)
+            {
+                for (uint32 j = k >> 1; j >= (uint32)SORT_BLOCK_SIZE; j >>= 1)
+                {
+                    DispatchSort(commandBuffer, 1, k, j, slot);
+                }
+                DispatchSort(commandBuffer, 2, k, 0, slot);
+            }
+        }
+
+        // 按排序结果把绘制数据紧凑写入当前slot的drawBuffer
+        compactProcessor->SetUniform("param", &param, sizeof(ParamBlock));
+        compactProcessor->BindDispatchIndirect(commandBuffer, counterBuffer->buffer, COUNTER_COMPACT_ARGS);
+
+        ParticleBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,       VK_ACCESS_TRANSFER_READ_BIT
+        );
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.srcOffset = COUNTER_ALIVE_OFFSET + (1 - slot) * sizeof(uint32);
+        copyRegion.dstOffset = slot * sizeof(uint32);
+        copyRegion.size      = sizeof(uint32);
+        vkCmdCopyBuffer(commandBuffer, counterBuffer->buffer, statsBuffer->buffer, 1, &copyRegion);
+
+        // 结果对Graphics的可见性由提交时的Semaphore保证，这里不再插入Barrier，以免同一队列上之后的Graphics提交等待本次Compute。
+        // 不同队列族时释放当前slot的所有权，Graphics队列在AcquireDrawBuffers中获取。
+        DVKQueueOwnership::ReleaseBuffers(commandBuffer, GetDrawRanges(slot), computeFamily, graphicsFamily, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+        // 本次的结果在下一次Simulate之后才会被绘制
+        drawSlot        = 1 - slot;
+        pendingRelease  = frameIndex > 0 && computeFamily != graphicsFamily;
+        frameIndex     += 1;
+    }
+
+    void DVKGPUParticles::AcquireDrawBuffers(VkCommandBuffer commandBuffer)
+    {
+        if (!pendingRelease)
+        {
+            return;
+        }
+
+        DVKQueueOwnership::AcquireBuffers(
+            commandBuffer,
+            GetDrawRanges(drawSlot),
+            computeFamily,
+            graphicsFamily,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+        );
+
+        pendingRelease = false;
+    }
+
+    std::vector<DVKBufferRange> DVKGPUParticles::GetDrawRanges(int32 slot)
+    {
+        std::vector<DVKBufferRange> ranges(2);
+        ranges[0].buffer = drawBuffer->buffer;
+        ranges[0].offset = slot * capacity * sizeof(Vector4);
+        ranges[0].size   = capacity * sizeof(Vector4);
+        ranges[1].buffer = drawArgsBuffer->buffer;
+        ranges[1].offset = slot * sizeof(VkDrawIndirectCommand);
+        ranges[1].size   = sizeof(VkDrawIndirectCommand);
+        return ranges;
+    }
+
+    void DVKGPUParticles::BindMaterial(DVKMaterial* material)
+    {
+        material->SetStorageBuffer("drawList", drawBuffer);
+    }
+
+    void DVKGPUParticles::Draw(VkCommandBuffer commandBuffer)
+    {
+        // firstVertex为slot * capacity，顶点数量为存活数量
+        vkCmdDrawIndirect(commandBuffer, drawArgsBuffer->buffer, drawSlot * sizeof(VkDrawIndirectCommand), 1, sizeof(VkDrawIndirectCommand));
+    }
+
+}
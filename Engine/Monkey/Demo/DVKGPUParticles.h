@@ -0,0 +1,155 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKCommand.h"
+#include "DVKShader.h"
+#include "DVKCompute.h"
+#include "DVKMaterial.h"
+#include "DVKAsyncCompute.h"
+
+#include "Common/Common.h"
+#include "Math/Vector3.h"
+#include "Math/Vector4.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <memory>
+
+namespace vk_demo
+{
+
+    // 发射与模拟参数
+    struct DVKGPUParticleConfig
+    {
+        Vector3     emitterPosition = Vector3(0.0f, 0.0f, 0.0f);
+        float       emitterRadius = 0.1f;
+
+        // 初速度以及每个方向上的随机范围
+        Vector3     velocity = Vector3(0.0f, 5.0f, 0.0f);
+        float       velocityRandom = 1.5f;
+
+        Vector3     gravity = Vector3(0.0f, -9.8f, 0.0f);
+        float       drag = 0.2f;
+
+        // 吸引点，attractorStrength为0时关闭
+        Vector3     attractorPosition = Vector3(0.0f, 0.0f, 0.0f);
+        float       attractorStrength = 0.0f;
+
+        float       lifeMin = 1.0f;
+        float       lifeMax = 3.0f;
+        // 每秒发射的数量，存活数量达到容量后不再发射
+        float       emitRate = 100000.0f;
+        bool        sort = true;
+    };
+
+    // GPU粒子：死亡列表与存活列表由原子计数维护，发射、模拟、排序、紧凑的Dispatch以及最终的Draw
+    // 全部由GPU根据存活数量写出的Indirect参数驱动，开销与存活数量成正比，与容量无关。
+    // 存活粒子按到相机的距离做Bitonic排序，由远及近紧凑写入drawBuffer，可以直接做Alpha混合。
+    // Simulate写出的结果在下一次Simulate之后才被Draw使用，当前帧的Compute可以与Graphics并行。
+    class DVKGPUParticles
+    {
+    private:
+        typedef std::shared_ptr<VulkanDevice> VulkanDeviceRef;
+
+        struct ParamBlock
+        {
+            Vector4     emitter;    // xyz:位置 w:半径
+            Vector4     velocity;   // xyz:初速度 w:随机范围
+            Vector4     gravity;    // xyz:重力 w:阻尼
+            Vector4     attractor;  // xyz:位置 w:强度
+            Vector4     frame;      // x:delta y:寿命下限 z:寿命上限 w:随机种子
+            Vector4     counts;     // x:容量 y:请求发射数量 z:slot w:0发射前 1模拟后
+            Vector4     camera;     // xyz:相机位置
+        };
+
+        struct SortParamBlock
+        {
+            Vector4     data;       // x:0块内排序 1全局合并 2块内合并 y:k z:j w:slot
+        };
+
+        DVKGPUParticles()
+        {
+
+        }
+
+    public:
+        ~DVKGPUParticles();
+
+        // 参见43_ComputeParticles下的ParticleArgs/ParticleEmit/ParticleSimulate/ParticleSort/ParticleCompact.comp
+        // cmdBuffer需要属于之后执行Simulate的队列，初始数据直接在该队列族上写入，不需要转移所有权
+        static DVKGPUParticles* Create(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            VkPipelineCache pipelineCache,
+            DVKCommandBuffer* cmdBuffer,
+            DVKShader* argsShader,
+            DVKShader* emitShader,
+            DVKShader* simulateShader,
+            DVKShader* sortShader,
+            DVKShader* compactShader,
+            int32 capacity
+        );
+
+        // 录制一帧的发射、模拟、排序与紧凑，需录制在Compute队列的CommandBuffer中。
+        // 下一帧的Graphics提交需等待本次提交发出的Semaphore；本次提交前上一帧的Draw需已完成。
+        void Simulate(VkCommandBuffer commandBuffer, float delta, const Vector3& cameraPosition);
+
+        // Compute与Graphics不是同一个队列族时获取drawBuffer的所有权，需在RenderPass之外录制
+        void AcquireDrawBuffers(VkCommandBuffer commandBuffer);
+
+        // drawBuffer作为storage buffer "drawList"绑定到材质，顶点数据由gl_VertexIndex读取
+        void BindMaterial(DVKMaterial* material);
+
+        // 以点的形式绘制上一次Simulate之前的结果
+        void Draw(VkCommandBuffer commandBuffer);
+
+        // 最近完成的一次模拟后的存活数量，仅用于显示
+        FORCE_INLINE uint32 GetAliveCount() const
+        {
+            return statsBuffer ? ((uint32*)statsBuffer->mapped)[drawSlot] : 0;
+        }
+
+    private:
+
+        void DispatchSort(VkCommandBuffer commandBuffer, int32 mode, uint32 k, uint32 j, int32 slot);
+
+        // slot对应的drawBuffer与drawArgsBuffer区间，用于队列族所有权转移
+        std::vector<DVKBufferRange> GetDrawRanges(int32 slot);
+
+    public:
+
+        VulkanDeviceRef         vulkanDevice = nullptr;
+
+        int32                   capacity = 0;
+        // 排序长度补齐到2的幂，至少为一个块的大小
+        int32                   sortCapacity = 0;
+
+        DVKGPUParticleConfig    config;
+
+        DVKBuffer*              particleBuffer = nullptr;
+        DVKBuffer*              deadBuffer = nullptr;
+        // 两个slot的存活列表，每帧交替读写
+        DVKBuffer*              aliveBuffer = nullptr;
+        DVKBuffer*              sortBuffer = nullptr;
+        DVKBuffer*              counterBuffer = nullptr;
+        // 两个slot的绘制数据与VkDrawIndirectCommand
+        DVKBuffer*              drawBuffer = nullptr;
+        DVKBuffer*              drawArgsBuffer = nullptr;
+        DVKBuffer*              statsBuffer = nullptr;
+
+        DVKCompute*             argsProcessor = nullptr;
+        DVKCompute*             emitProcessor = nullptr;
+        DVKCompute*             simulateProcessor = nullptr;
+        DVKCompute*             sortProcessor = nullptr;
+        DVKCompute*             compactProcessor = nullptr;
+
+    private:
+
+        uint32                  computeFamily = 0;
+        uint32                  graphicsFamily = 0;
+
+        int64                   frameIndex = 0;
+        int32                   drawSlot = 1;
+        bool                    pendingRelease = false;
+        float                   emitAccumulator = 0.0f;
+    };
+
+}
@@ -0,0 +1,501 @@
+﻿#include "DVKImposter.h"
+#include "DVKMaterial.h"
+#include "DVKRenderTarget.h"
+#include "DVKCamera.h"
+#include "DVKUtils.h"
+#include "FileManager.h"
+
+#include "Common/Log.h"
+#include "Utils/Crc.h"
+#include "Vulkan/VulkanRHI.h"
+
+#include <cstdio>
+
+namespace vk_demo
+{
+
+    static FORCE_INLINE float SignNotZero(float value)
+    {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    // 深度附件使用设备支持的PF_DepthStencil格式，回读时深度部分的每像素字节数与格式有关
+    static uint32 GetDepthCopySize(VkFormat format)
+    {
+        return format == VK_FORMAT_D16_UNORM_S8_UINT ? 2 : 4;
+    }
+
+    static float ReadDepth(VkFormat format, const uint8* data, int32 index)
+    {
+        if (format == VK_FORMAT_D32_SFLOAT_S8_UINT)
+        {
+            return ((const float*)data)[index];
+        }
+        else if (format == VK_FORMAT_D24_UNORM_S8_UINT)
+        {
+            return (((const uint32*)data)[index] & 0x00FFFFFF) / (float)0x00FFFFFF;
+        }
+        return ((const uint16*)data)[index] / (float)MAX_uint16;
+    }
+
+    static void BindBakeTextures(DVKMaterial* material, const DVKImposterBakeInfo& bakeInfo)
+    {
+        for (auto it = bakeInfo.textures.begin(); it != bakeInfo.textures.end(); ++it)
+        {
+            if (material->textures.find(it->first) != material->textures.end())
+            {
+                material->SetTexture(it->first, it->second);
+            }
+        }
+    }
+
+    static void DrawBakeFrames(VkCommandBuffer commandBuffer, DVKRenderTarget* renderTarget, DVKMaterial* material, const DVKImposterBakeInfo& bakeInfo, const DVKImposterInfo& info, const Vector3& center, float radius)
+    {
+        struct ModelViewProjectionBlock
+        {
+            Matrix4x4 model;
+            Matrix4x4 view;
+            Matrix4x4 proj;
+        };
+
+        DVKModel* model = bakeInfo.model;
+
+        // 相机放在包围球外，近远平面紧贴包围球，深度在球内线性分布
+        float distance = radius * 2.0f;
+
+        DVKCamera camera;
+        camera.Orthographic(-radius, radius, -radius, radius, distance - radius, distance + radius);
+
+        VkViewport viewport = {};
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor = {};
+        scissor.extent.width  = info.frameSize;
+        scissor.extent.height = info.frameSize;
+
+        ModelViewProjectionBlock mvpData;
+
+        renderTarget->BeginRenderPass(commandBuffer);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material->GetPipeline());
+
+        // 所有视角的Uniform都在同一帧内分配，提交之前不会被覆盖
+        material->BeginFrame();
+
+        int32 objIndex = 0;
+        for (int32 y = 0; y < info.frames; ++y)
+        {
+            for (int32 x = 0; x < info.frames; ++x)
+            {
+                Vector2 uv((x + 0.5f) / info.frames, (y + 0.5f) / info.frames);
+                Vector3 dir = DVKImposter::OctahedronToDirection(uv, info.hemi);
+
+                camera.SetPosition(center + dir * distance);
+                camera.LookAt(center);
+
+                float tx = (float)(x * info.frameSize);
+                float ty = (float)(y * info.frameSize);
+
+                viewport.x       = tx;
+                viewport.y       = ty + info.frameSize;
+                viewport.width   = (float)info.frameSize;
+                viewport.height  = -(float)info.frameSize;
+                scissor.offset.x = (int32)tx;
+                scissor.offset.y = (int32)ty;
+
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
+
+                mvpData.view = camera.GetView();
+                mvpData.proj = camera.GetProjection();
+
+                for (int32 i = 0; i < model->meshes.size(); ++i)
+                {
+                    DVKMesh* mesh = model->meshes[i];
+                    mvpData.model = mesh->linkNode->GetGlobalMatrix();
+
+                    material->BeginObject();
+                    material->SetLocalUniform("uboMVP", &mvpData, sizeof(ModelViewProjectionBlock));
+                    material->EndObject();
+
+                    material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, objIndex);
+                    mesh->BindDrawCmd(commandBuffer);
+
+                    objIndex += 1;
+                }
+            }
+        }
+
+        material->EndFrame();
+        renderTarget->EndRenderPass(commandBuffer);
+    }
+
+    static void CopyImageToBuffer(VkCommandBuffer commandBuffer, DVKTexture* texture, VkImageAspectFlags aspect, VkBuffer buffer, VkDeviceSize offset)
+    {
+        VkBufferImageCopy copyRegion = {};
+        copyRegion.bufferOffset                    = offset;
+        copyRegion.imageSubresource.aspectMask     = aspect;
+        copyRegion.imageSubresource.mipLevel       = 0;
+        copyRegion.imageSubresource.baseArrayLayer = 0;
+        copyRegion.imageSubresource.layerCount     = 1;
+        copyRegion.imageExtent.width               = texture->width;
+        copyRegion.imageExtent.height              = texture->height;
+        copyRegion.imageExtent.depth               = 1;
+
+        vkCmdCopyImageToBuffer(commandBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &copyRegion);
+    }
+
+    uint32 DVKImposter::ComputeKey(const std::vector<std::string>& sourceFiles, const DVKImposterInfo& info)
+    {
+        uint32 key = 0;
+
+        for (int32 i = 0; i < sourceFiles.size(); ++i)
+        {
+            FileMappingRef mapping = FileManager::MapFile(sourceFiles[i]);
+            if (!mapping)
+            {
+                MLOGE("Imposter source not found : %s", sourceFiles[i].c_str());
+                continue;
+            }
+            key = Crc::MemCrc32(mapping->GetData(), mapping->GetSize(), key);
+        }
+
+        int32 params[3] = { info.frames, info.frameSize, info.hemi ? 1 : 0 };
+        key = Crc::MemCrc32(params, sizeof(params), key);
+        key = Crc::MemCrc32(&Version, sizeof(Version), key);
+
+        return key;
+    }
+
+    std::string DVKImposter::GetCachePath(const std::string& filename, uint32 key)
+    {
+        char hashStr[16];
+        sprintf(hashStr, "%08x", key);
+        return filename + "." + hashStr + ".imposter";
+    }
+
+    Vector2 DVKImposter::DirectionToOctahedron(const Vector3& dir, bool hemi)
+    {
+        Vector3 d = dir;
+        if (hemi)
+        {
+            d.y = MMath::Max(d.y, 0.0f);
+        }
+
+        float sum = MMath::Abs(d.x) + MMath::Abs(d.y) + MMath::Abs(d.z);
+        if (sum <= 0.0f)
+        {
+            return Vector2(0.5f, 0.5f);
+        }
+        d = d / sum;
+
+        Vector2 p;
+        if (hemi)
+        {
+            // 上半球的八面体旋转45度后铺满正方形
+            p.x = d.x + d.z;
+            p.y = d.x - d.z;
+        }
+        else
+        {
+            p.x = d.x;
+            p.y = d.z;
+            // 下半球沿对角线翻折到四个角
+            if (d.y < 0.0f)
+            {
+                p.x = (1.0f - MMath::Abs(d.z)) * SignNotZero(d.x);
+                p.y = (1.0f - MMath::Abs(d.x)) * SignNotZero(d.z);
+            }
+        }
+
+        return Vector2(p.x * 0.5f + 0.5f, p.y * 0.5f + 0.5f);
+    }
+
+    Vector3 DVKImposter::OctahedronToDirection(const Vector2& uv, bool hemi)
+    {
+        float px = uv.x * 2.0f - 1.0f;
+        float py = uv.y * 2.0f - 1.0f;
+
+        Vector3 d;
+        if (hemi)
+        {
+            d.x = (px + py) * 0.5f;
+            d.z = (px - py) * 0.5f;
+            d.y = 1.0f - MMath::Abs(d.x) - MMath::Abs(d.z);
+        }
+        else
+        {
+            d.x = px;
+            d.z = py;
+            d.y = 1.0f - MMath::Abs(px) - MMath::Abs(py);
+            if (d.y < 0.0f)
+            {
+                d.x = (1.0f - MMath::Abs(py)) * SignNotZero(px);
+                d.z = (1.0f - MMath::Abs(px)) * SignNotZero(py);
+            }
+        }
+
+        d.Normalize();
+        return d;
+    }
+
+    void DVKImposter::GetFrame(const Vector3& dir, int32& x, int32& y) const
+    {
+        Vector2 uv = DirectionToOctahedron(dir, hemi);
+        x = MMath::Clamp(MMath::FloorToInt(uv.x * frames), 0, frames - 1);
+        y = MMath::Clamp(MMath::FloorToInt(uv.y * frames), 0, frames - 1);
+    }
+
+    Vector4 DVKImposter::GetFrameUVScale(const Vector3& dir) const
+    {
+        int32 x = 0;
+        int32 y = 0;
+        GetFrame(dir, x, y);
+
+        float scale = 1.0f / frames;
+        return Vector4(scale, scale, x * scale, y * scale);
+    }
+
+    Matrix4x4 DVKImposter::GetBillboardMatrix(const Vector3& position, const Vector3& viewPosition) const
+    {
+        Vector3 origin = position + center;
+
+        Vector3 dir = viewPosition - origin;
+        dir.Normalize();
+
+        // 与烘焙时DVKCamera::LookAt的朝向一致，保证图集中的上方向与公告板的上方向相同
+        Vector3 forward = -dir;
+        Vector3 up = Vector3::UpVector;
+        if (forward.x == 0.0f && MMath::Abs(forward.y) == 1.0f && forward.z == 0.0f)
+        {
+            up = Vector3::ForwardVector;
+        }
+
+        Vector3 right = Vector3::CrossProduct(up, forward);
+        right.Normalize();
+        up = Vector3::CrossProduct(forward, right);
+
+        Vector3 axis0 = right   * radius;
+        Vector3 axis1 = up      * radius;
+        Vector3 axis2 = forward * radius;
+
+        Matrix4x4 matrix;
+        matrix.SetIdentity();
+        matrix.SetAxes(&axis0, &axis1, &axis2, &origin);
+        return matrix;
+    }
+
+    DVKImposter* DVKImposter::CreateFromPixels(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const Header& header, const uint8* albedo, const uint8* normal)
+    {
+        int32  size     = header.frames * header.frameSize;
+        uint32 dataSize = size * size * 4;
+
+        DVKImposter* imposter = new DVKImposter();
+        imposter->frames    = header.frames;
+        imposter->frameSize = header.frameSize;
+        imposter->hemi      = header.hemi != 0;
+        imposter->center    = header.center;
+        imposter->radius    = header.radius;
+
+        imposter->albedoTexture = DVKTexture::Create2D(albedo, dataSize, VK_FORMAT_R8G8B8A8_UNORM, size, size, vulkanDevice, cmdBuffer);
+        imposter->normalTexture = DVKTexture::Create2D(normal, dataSize, VK_FORMAT_R8G8B8A8_UNORM, size, size, vulkanDevice, cmdBuffer);
+
+        // 视角之间不能环绕采样
+        imposter->albedoTexture->UpdateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+        imposter->normalTexture->UpdateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+        return imposter;
+    }
+
+    DVKImposter* DVKImposter::LoadFromFile(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::string& cachePath, uint32 key)
+    {
+        if (!FileManager::FileExists(cachePath))
+        {
+            return nullptr;
+        }
+
+        FileMappingRef mapping = FileManager::MapFile(cachePath);
+        if (!mapping || mapping->GetSize() < sizeof(Header))
+        {
+            return nullptr;
+        }
+
+        Header header;
+        memcpy(&header, mapping->GetData(), sizeof(Header));
+        if (header.magic != Magic || header.version != Version || header.key != key)
+        {
+            MLOG("Imposter cache out of date : %s", cachePath.c_str());
+            return nullptr;
+        }
+
+        uint64 size = header.frames * header.frameSize;
+        if (header.frames <= 0 || header.frameSize <= 0 || header.dataSize != size * size * 4 * 2 || header.dataSize != mapping->GetSize() - sizeof(Header))
+        {
+            MLOGE("Imposter cache corrupted : %s", cachePath.c_str());
+            return nullptr;
+        }
+
+        const uint8* albedo = mapping->GetData() + sizeof(Header);
+        const uint8* normal = albedo + header.dataSize / 2;
+
+        return CreateFromPixels(vulkanDevice, cmdBuffer, header, albedo, normal);
+    }
+
+    DVKImposter* DVKImposter::Bake(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const DVKImposterBakeInfo& bakeInfo, const DVKImposterInfo& info, const std::string& cachePath, uint32 key)
+    {
+        int32 size = info.frames * info.frameSize;
+        if (info.frames <= 0 || info.frameSize <= 0 || size > (int32)vulkanDevice->GetLimits().maxImageDimension2D)
+        {
+            MLOGE("Imposter size not supported : %d x %d", info.frames, info.frameSize);
+            return nullptr;
+        }
+
+        DVKBoundingBox bounds = bakeInfo.model->rootNode->GetBounds();
+        Vector3 boundSize = bounds.max - bounds.min;
+
+        Header header;
+        header.key       = key;
+        header.frames    = info.frames;
+        header.frameSize = info.frameSize;
+        header.hemi      = info.hemi ? 1 : 0;
+        header.center    = bounds.min + boundSize * 0.5f;
+        header.radius    = MMath::Max(boundSize.Size() * 0.5f, KINDA_SMALL_NUMBER);
+        header.dataSize  = size * size * 4 * 2;
+
+        // render targets
+        VkFormat depthFormat = PixelFormatToVkFormat(PF_DepthStencil, false);
+        DVKTexture* depthTexture = DVKTexture::CreateRenderTarget(
+            vulkanDevice,
+            depthFormat,
+            VK_IMAGE_ASPECT_DEPTH_BIT,
+            size,
+            size,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+        );
+
+        DVKTexture* albedoTexture = DVKTexture::CreateRenderTarget(
+            vulkanDevice,
+            VK_FORMAT_R8G8B8A8_UNORM,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            size,
+            size,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+        );
+
+        DVKTexture* normalTexture = DVKTexture::CreateRenderTarget(
+            vulkanDevice,
+            VK_FORMAT_R8G8B8A8_UNORM,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            size,
+            size,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+        );
+
+        DVKRenderPassInfo albedoPassInfo(
+            albedoTexture, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
+            depthTexture, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE
+        );
+        DVKRenderTarget* albedoTarget = DVKRenderTarget::Create(vulkanDevice, albedoPassInfo, Vector4(0, 0, 0, 0));
+        albedoTarget->colorLayout = ImageLayoutBarrier::TransferSource;
+        albedoTarget->depthLayout = ImageLayoutBarrier::TransferSource;
+
+        // 深度只取第二个Pass的结果
+        DVKRenderPassInfo normalPassInfo(
+            normalTexture, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
+            depthTexture, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE
+        );
+        DVKRenderTarget* normalTarget = DVKRenderTarget::Create(vulkanDevice, normalPassInfo, Vector4(0, 0, 0, 0));
+        normalTarget->colorLayout = ImageLayoutBarrier::TransferSource;
+        normalTarget->depthLayout = ImageLayoutBarrier::TransferSource;
+
+        // materials
+        DVKMaterial* albedoMaterial = DVKMaterial::Create(vulkanDevice, albedoTarget->GetRenderPass(), bakeInfo.pipelineCache, bakeInfo.albedoShader);
+        albedoMaterial->PreparePipeline();
+        BindBakeTextures(albedoMaterial, bakeInfo);
+
+        DVKMaterial* normalMaterial = DVKMaterial::Create(vulkanDevice, normalTarget->GetRenderPass(), bakeInfo.pipelineCache, bakeInfo.normalShader);
+        normalMaterial->PreparePipeline();
+        BindBakeTextures(normalMaterial, bakeInfo);
+
+        // 回读：albedo、normal各4字节，depth与格式有关
+        VkDeviceSize colorSize = (VkDeviceSize)size * size * 4;
+        VkDeviceSize depthSize = (VkDeviceSize)size * size * GetDepthCopySize(depthFormat);
+        DVKBuffer* readback = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            colorSize * 2 + depthSize
+        );
+
+        // 所有视角与回读录制在同一个CommandBuffer中，只提交一次
+        cmdBuffer->Begin();
+
+        DrawBakeFrames(cmdBuffer->cmdBuffer, albedoTarget, albedoMaterial, bakeInfo, info, header.center, header.radius);
+        DrawBakeFrames(cmdBuffer->cmdBuffer, normalTarget, normalMaterial, bakeInfo, info, header.center, header.radius);
+
+        CopyImageToBuffer(cmdBuffer->cmdBuffer, albedoTexture, VK_IMAGE_ASPECT_COLOR_BIT, readback->buffer, 0);
+        CopyImageToBuffer(cmdBuffer->cmdBuffer, normalTexture, VK_IMAGE_ASPECT_COLOR_BIT, readback->buffer, colorSize);
+        CopyImageToBuffer(cmdBuffer->cmdBuffer, depthTexture,  VK_IMAGE_ASPECT_DEPTH_BIT, readback->buffer, colorSize * 2);
+
+        VkBufferMemoryBarrier bufferBarrier;
+        ZeroVulkanStruct(bufferBarrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
+        bufferBarrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask       = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer              = readback->buffer;
+        bufferBarrier.offset              = 0;
+        bufferBarrier.size                = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(cmdBuffer->cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+        cmdBuffer->Submit();
+
+        // 覆盖写入albedo的a通道，深度写入normal的a通道，未覆盖的像素深度为1
+        std::vector<uint8> pixels(sizeof(Header) + header.dataSize);
+        memcpy(pixels.data(), &header, sizeof(Header));
+
+        readback->Map();
+        {
+            const uint8* srcAlbedo = (const uint8*)readback->mapped;
+            const uint8* srcNormal = srcAlbedo + colorSize;
+            const uint8* srcDepth  = srcAlbedo + colorSize * 2;
+
+            uint8* dstAlbedo = pixels.data() + sizeof(Header);
+            uint8* dstNormal = dstAlbedo + colorSize;
+
+            memcpy(dstAlbedo, srcAlbedo, colorSize);
+            memcpy(dstNormal, srcNormal, colorSize);
+
+            for (int32 i = 0; i < size * size; ++i)
+            {
+                float depth  = ReadDepth(depthFormat, srcDepth, i);
+                bool covered = depth < 1.0f;
+                dstAlbedo[i * 4 + 3] = covered ? 255 : 0;
+                dstNormal[i * 4 + 3] = covered ? (uint8)(MMath::Clamp(depth, 0.0f, 1.0f) * 255.0f) : 255;
+            }
+        }
+        readback->UnMap();
+
+        DVKImposter* imposter = CreateFromPixels(vulkanDevice, cmdBuffer, header, pixels.data() + sizeof(Header), pixels.data() + sizeof(Header) + colorSize);
+
+        if (cachePath.size() > 0 && !FileManager::WriteFile(cachePath, pixels.data(), (uint32)pixels.size()))
+        {
+            MLOGE("Failed write imposter cache : %s", cachePath.c_str());
+        }
+
+        delete readback;
+
+        delete albedoMaterial;
+        delete normalMaterial;
+
+        delete albedoTarget;
+        delete normalTarget;
+
+        delete albedoTexture;
+        delete normalTexture;
+        delete depthTexture;
+
+        return imposter;
+    }
+
+}
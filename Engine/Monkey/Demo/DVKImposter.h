@@ -0,0 +1,151 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKCommand.h"
+#include "DVKTexture.h"
+#include "DVKShader.h"
+#include "DVKModel.h"
+
+#include "Common/Common.h"
+#include "Math/Vector2.h"
+#include "Math/Vector3.h"
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+namespace vk_demo
+{
+
+    struct DVKImposterInfo
+    {
+        // 每个方向上的视角数量，图集共frames x frames个视角
+        int32   frames = 16;
+        // 每个视角的像素尺寸
+        int32   frameSize = 128;
+        // 只烘焙上半球，适合放在地面上的植被、道具
+        bool    hemi = true;
+    };
+
+    struct DVKImposterBakeInfo
+    {
+        DVKModel*       model = nullptr;
+        VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+        // albedoShader输出颜色，normalShader输出[0, 1]的世界空间法线，两者顶点属性需与model一致
+        DVKShader*      albedoShader = nullptr;
+        DVKShader*      normalShader = nullptr;
+
+        // 两个Shader用到的纹理
+        std::unordered_map<std::string, DVKTexture*> textures;
+    };
+
+    // 八面体Imposter：按八面体(或半八面体)映射均匀分布的方向，从包围球外用正交相机拍摄模型，
+    // 所有视角录制在同一个CommandBuffer中一次提交。结果回读后打包成两张RGBA8图集：
+    // albedoTexture(rgb:颜色 a:覆盖)、normalTexture(rgb:法线 a:深度，0为包围球前端，1为后端)。
+    // 图集以源文件内容与参数的Hash为Key写入缓存，之后直接加载，不再需要烘焙。
+    class DVKImposter
+    {
+    private:
+        DVKImposter()
+        {
+
+        }
+
+    public:
+        static const uint32 Magic   = 0x49564B44; // 'DVKI'
+        static const uint32 Version = 1;
+
+        struct Header
+        {
+            uint32  magic = Magic;
+            uint32  version = Version;
+            uint32  key = 0;
+            int32   frames = 0;
+            int32   frameSize = 0;
+            int32   hemi = 0;
+            Vector3 center;
+            float   radius = 0.0f;
+            uint32  dataSize = 0;
+        };
+
+        ~DVKImposter()
+        {
+            if (albedoTexture)
+            {
+                delete albedoTexture;
+                albedoTexture = nullptr;
+            }
+
+            if (normalTexture)
+            {
+                delete normalTexture;
+                normalTexture = nullptr;
+            }
+        }
+
+        // sourceFiles一般为模型、纹理以及烘焙用的Shader，任一文件内容或者参数变化都会得到不同的Key
+        static uint32 ComputeKey(const std::vector<std::string>& sourceFiles, const DVKImposterInfo& info);
+
+        static std::string GetCachePath(const std::string& filename, uint32 key);
+
+        // 缓存不存在或者Key不匹配时返回nullptr
+        static DVKImposter* LoadFromFile(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            DVKCommandBuffer* cmdBuffer,
+            const std::string& cachePath,
+            uint32 key
+        );
+
+        // cachePath不为空时将结果写入缓存
+        static DVKImposter* Bake(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            DVKCommandBuffer* cmdBuffer,
+            const DVKImposterBakeInfo& bakeInfo,
+            const DVKImposterInfo& info,
+            const std::string& cachePath = "",
+            uint32 key = 0
+        );
+
+        // 单位方向与[0, 1]图集坐标之间的八面体映射，hemi时只使用y >= 0的方向
+        static Vector2 DirectionToOctahedron(const Vector3& dir, bool hemi);
+
+        static Vector3 OctahedronToDirection(const Vector2& uv, bool hemi);
+
+        // 从模型中心指向观察点的方向所在视角
+        void GetFrame(const Vector3& dir, int32& x, int32& y) const;
+
+        // 用于58_Imposter中imposter.vert的uboUVScale：xy为缩放，zw为偏移
+        Vector4 GetFrameUVScale(const Vector3& dir) const;
+
+        // 面向观察点的公告板矩阵，配合DVKDefaultRes::fullQuad使用。position为模型的世界坐标
+        Matrix4x4 GetBillboardMatrix(const Vector3& position, const Vector3& viewPosition) const;
+
+    private:
+
+        static DVKImposter* CreateFromPixels(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            DVKCommandBuffer* cmdBuffer,
+            const Header& header,
+            const uint8* albedo,
+            const uint8* normal
+        );
+
+    public:
+        int32           frames = 0;
+        int32           frameSize = 0;
+        bool            hemi = true;
+
+        // 模型空间的包围球
+        Vector3         center;
+        float           radius = 0.0f;
+
+        DVKTexture*     albedoTexture = nullptr;
+        DVKTexture*     normalTexture = nullptr;
+    };
+
+}
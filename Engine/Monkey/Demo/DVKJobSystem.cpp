@@ -0,0 +1,150 @@
+﻿#include "DVKJobSystem.h"
+
+#include "Math/Math.h"
+
+namespace vk_demo
+{
+
+    DVKJobSystem::~DVKJobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lockGuard(mutex);
+            running = false;
+        }
+        startCV.notify_all();
+
+        for (int32 i = 0; i < workers.size(); ++i)
+        {
+            workers[i].join();
+        }
+        workers.clear();
+    }
+
+    DVKJobSystem* DVKJobSystem::Create(int32 numWorkers)
+    {
+        if (numWorkers <= 0)
+        {
+            numWorkers = MMath::Max((int32)std::thread::hardware_concurrency() - 1, 0);
+        }
+
+        DVKJobSystem* jobSystem = new DVKJobSystem();
+        jobSystem->nextBatch   = 0;
+        jobSystem->doneBatches = 0;
+
+        for (int32 i = 0; i < numWorkers; ++i)
+        {
+            jobSystem->workers.push_back(std::thread(&DVKJobSystem::WorkerLoop, jobSystem, i + 1));
+        }
+
+        return jobSystem;
+    }
+
+    void DVKJobSystem::ParallelFor(int32 inCount, int32 inBatchSize, const RangeFunc& inFunc)
+    {
+        if (inCount <= 0)
+        {
+            return;
+        }
+
+        inBatchSize = MMath::Max(inBatchSize, 1);
+        int32 batches = (inCount + inBatchSize - 1) / inBatchSize;
+
+        // 只有一个批次或者没有工作线程时直接执行，省去唤醒的开销
+        if (batches == 1 || workers.size() == 0)
+        {
+            for (int32 begin = 0; begin < inCount; begin += inBatchSize)
+            {
+                inFunc(begin, MMath::Min(begin + inBatchSize, inCount), 0);
+            }
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lockGuard(mutex);
+
+            // 迟到的工作线程可能还在上一次任务中，等它退出后再修改任务参数
+            while (busyWorkers != 0)
+            {
+                doneCV.wait(lockGuard);
+            }
+
+            func        = &inFunc;
+            count       = inCount;
+            batchSize   = inBatchSize;
+            numBatches  = batches;
+            nextBatch   = 0;
+            doneBatches = 0;
+            generation += 1;
+        }
+        startCV.notify_all();
+
+        RunBatches(0);
+
+        {
+            std::unique_lock<std::mutex> lockGuard(mutex);
+            while (doneBatches.load() != numBatches || busyWorkers != 0)
+            {
+                doneCV.wait(lockGuard);
+            }
+            func = nullptr;
+        }
+    }
+
+    void DVKJobSystem::RunBatches(int32 threadIndex)
+    {
+        while (true)
+        {
+            int32 batch = nextBatch.fetch_add(1);
+            if (batch >= numBatches)
+            {
+                break;
+            }
+
+            int32 begin = batch * batchSize;
+            int32 end   = MMath::Min(begin + batchSize, count);
+            (*func)(begin, end, threadIndex);
+
+            if (doneBatches.fetch_add(1) + 1 == numBatches)
+            {
+                std::lock_guard<std::mutex> lockGuard(mutex);
+                doneCV.notify_all();
+            }
+        }
+    }
+
+    void DVKJobSystem::WorkerLoop(int32 threadIndex)
+    {
+        uint64 seenGeneration = 0;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lockGuard(mutex);
+                while (running && generation == seenGeneration)
+                {
+                    startCV.wait(lockGuard);
+                }
+
+                if (!running)
+                {
+                    break;
+                }
+
+                seenGeneration = generation;
+                busyWorkers   += 1;
+            }
+
+            RunBatches(threadIndex);
+
+            {
+                std::lock_guard<std::mutex> lockGuard(mutex);
+                busyWorkers -= 1;
+                if (busyWorkers == 0)
+                {
+                    doneCV.notify_all();
+                }
+            }
+        }
+    }
+
+}
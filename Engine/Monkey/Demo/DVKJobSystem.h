@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace vk_demo
+{
+
+    // 简单的并行任务系统：常驻的工作线程加上调用线程一起执行ParallelFor切分出的批次。
+    // 同一时间只能有一个ParallelFor在执行，不可在任务内部嵌套调用。
+    class DVKJobSystem
+    {
+    public:
+        // threadIndex范围为[0, GetThreadCount())，0为调用ParallelFor的线程
+        typedef std::function<void(int32 begin, int32 end, int32 threadIndex)> RangeFunc;
+
+    private:
+        DVKJobSystem()
+        {
+
+        }
+
+    public:
+        ~DVKJobSystem();
+
+        // numWorkers为0时使用hardware_concurrency - 1个工作线程
+        static DVKJobSystem* Create(int32 numWorkers = 0);
+
+        // 把[0, count)按batchSize切分后并行执行，全部完成后返回
+        void ParallelFor(int32 count, int32 batchSize, const RangeFunc& func);
+
+        FORCE_INLINE int32 GetThreadCount() const
+        {
+            return (int32)workers.size() + 1;
+        }
+
+    private:
+
+        void WorkerLoop(int32 threadIndex);
+
+        void RunBatches(int32 threadIndex);
+
+    public:
+
+        std::vector<std::thread>    workers;
+
+    private:
+
+        std::mutex                  mutex;
+        std::condition_variable     startCV;
+        std::condition_variable     doneCV;
+
+        bool                        running = true;
+        uint64                      generation = 0;
+        int32                       busyWorkers = 0;
+
+        const RangeFunc*            func = nullptr;
+        int32                       count = 0;
+        int32                       batchSize = 1;
+        int32                       numBatches = 0;
+        std::atomic<int32>          nextBatch;
+        std::atomic<int32>          doneBatches;
+    };
+
+}
@@ -0,0 +1,231 @@
+﻿#include "DVKLayoutCache.h"
+
+#include "Utils/Crc.h"
+
+#include <unordered_map>
+
+namespace vk_demo
+{
+
+    // 描述信息展开成uint64序列，Hash只用于查找，相等以完整序列比较为准
+    struct LayoutKey
+    {
+        VkDevice            device = VK_NULL_HANDLE;
+        std::vector<uint64> words;
+        uint32              hash = 0;
+
+        void Finish()
+        {
+            hash = Crc::MemCrc32(words.data(), (int32)(words.size() * sizeof(uint64)), Crc::MemCrc32(&device, sizeof(VkDevice)));
+        }
+
+        bool operator==(const LayoutKey& other) const
+        {
+            return device == other.device && hash == other.hash && words == other.words;
+        }
+    };
+
+    struct LayoutKeyHash
+    {
+        size_t operator()(const LayoutKey& key) const
+        {
+            return key.hash;
+        }
+    };
+
+    template <class T>
+    using LayoutMap = std::unordered_map<LayoutKey, std::weak_ptr<T>, LayoutKeyHash>;
+
+    static std::mutex                           g_LayoutMutex;
+    static LayoutMap<DVKSharedSetLayout>        g_SetLayouts;
+    static LayoutMap<DVKSharedPipelineLayout>   g_PipelineLayouts;
+    static LayoutMap<DVKDescriptorPoolChain>    g_DescriptorPools;
+    static DVKLayoutCacheStats                  g_LayoutStats;
+
+    template <class T>
+    static std::shared_ptr<T> FindLayout(LayoutMap<T>& layoutMap, const LayoutKey& key)
+    {
+        auto it = layoutMap.find(key);
+        if (it == layoutMap.end())
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<T> result = it->second.lock();
+        if (!result)
+        {
+            layoutMap.erase(it);
+        }
+
+        return result;
+    }
+
+    static void PushSetLayoutWords(LayoutKey& key, const std::vector<DVKSetLayoutRef>& setLayouts)
+    {
+        key.words.push_back(setLayouts.size());
+        for (int32 i = 0; i < setLayouts.size(); ++i)
+        {
+            key.words.push_back((uint64)setLayouts[i]->handle);
+        }
+    }
+
+    void DVKDescriptorPoolChain::AllocateDescriptorSet(VkDescriptorSet* descriptorSets)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        int32 numSets = (int32)descriptorSetLayouts.size();
+        if (freeSets.size() >= numSets)
+        {
+            memcpy(descriptorSets, freeSets.data() + freeSets.size() - numSets, sizeof(VkDescriptorSet) * numSets);
+            freeSets.resize(freeSets.size() - numSets);
+
+            std::lock_guard<std::mutex> statsLock(g_LayoutMutex);
+            g_LayoutStats.descriptorSetsRecycled += 1;
+            return;
+        }
+
+        for (int32 i = (int32)pools.size() - 1; i >= 0; --i)
+        {
+            if (pools[i]->AllocateDescriptorSet(descriptorSets))
+            {
+                return;
+            }
+        }
+
+        DVKDescriptorSetPool* setPool = new DVKDescriptorSetPool(device, maxSet, setLayoutsInfo, descriptorSetLayouts);
+        pools.push_back(setPool);
+        setPool->AllocateDescriptorSet(descriptorSets);
+
+        {
+            std::lock_guard<std::mutex> statsLock(g_LayoutMutex);
+            g_LayoutStats.descriptorPoolsCreated += 1;
+        }
+    }
+
+    void DVKDescriptorPoolChain::ReleaseDescriptorSet(const VkDescriptorSet* descriptorSets)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeSets.insert(freeSets.end(), descriptorSets, descriptorSets + descriptorSetLayouts.size());
+    }
+
+    DVKSetLayoutRef DVKLayoutCache::GetSetLayout(VkDevice device, const DVKDescriptorSetLayoutInfo& setLayoutInfo)
+    {
+        LayoutKey key;
+        key.device = device;
+        for (int32 i = 0; i < setLayoutInfo.bindings.size(); ++i)
+        {
+            const VkDescriptorSetLayoutBinding& binding = setLayoutInfo.bindings[i];
+            key.words.push_back(((uint64)binding.binding << 32) | binding.descriptorType);
+            key.words.push_back(((uint64)binding.descriptorCount << 32) | binding.stageFlags);
+            key.words.push_back((uint64)binding.pImmutableSamplers);
+        }
+        key.Finish();
+
+        std::lock_guard<std::mutex> lock(g_LayoutMutex);
+        g_LayoutStats.setLayoutRequests += 1;
+
+        DVKSetLayoutRef setLayout = FindLayout(g_SetLayouts, key);
+        if (setLayout)
+        {
+            return setLayout;
+        }
+
+        setLayout = std::make_shared<DVKSharedSetLayout>();
+        setLayout->device = device;
+
+        VkDescriptorSetLayoutCreateInfo descSetLayoutInfo;
+        ZeroVulkanStruct(descSetLayoutInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO);
+        descSetLayoutInfo.bindingCount = (uint32_t)setLayoutInfo.bindings.size();
+        descSetLayoutInfo.pBindings    = setLayoutInfo.bindings.data();
+        VERIFYVULKANRESULT(vkCreateDescriptorSetLayout(device, &descSetLayoutInfo, VULKAN_CPU_ALLOCATOR, &setLayout->handle));
+
+        g_SetLayouts[key] = setLayout;
+        g_LayoutStats.setLayoutsCreated += 1;
+
+        return setLayout;
+    }
+
+    DVKPipelineLayoutRef DVKLayoutCache::GetPipelineLayout(VkDevice device, const std::vector<DVKSetLayoutRef>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
+    {
+        LayoutKey key;
+        key.device = device;
+        PushSetLayoutWords(key, setLayouts);
+        for (int32 i = 0; i < pushConstantRanges.size(); ++i)
+        {
+            const VkPushConstantRange& range = pushConstantRanges[i];
+            key.words.push_back(((uint64)range.offset << 32) | range.size);
+            key.words.push_back(range.stageFlags);
+        }
+        key.Finish();
+
+        std::lock_guard<std::mutex> lock(g_LayoutMutex);
+        g_LayoutStats.pipelineLayoutRequests += 1;
+
+        DVKPipelineLayoutRef pipelineLayout = FindLayout(g_PipelineLayouts, key);
+        if (pipelineLayout)
+        {
+            return pipelineLayout;
+        }
+
+        std::vector<VkDescriptorSetLayout> handles(setLayouts.size());
+        for (int32 i = 0; i < setLayouts.size(); ++i)
+        {
+            handles[i] = setLayouts[i]->handle;
+        }
+
+        pipelineLayout = std::make_shared<DVKSharedPipelineLayout>();
+        pipelineLayout->device     = device;
+        pipelineLayout->setLayouts = setLayouts;
+
+        VkPipelineLayoutCreateInfo pipeLayoutInfo;
+        ZeroVulkanStruct(pipeLayoutInfo, VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO);
+        pipeLayoutInfo.setLayoutCount         = (uint32_t)handles.size();
+        pipeLayoutInfo.pSetLayouts            = handles.data();
+        pipeLayoutInfo.pushConstantRangeCount = (uint32_t)pushConstantRanges.size();
+        pipeLayoutInfo.pPushConstantRanges    = pushConstantRanges.data();
+        VERIFYVULKANRESULT(vkCreatePipelineLayout(device, &pipeLayoutInfo, VULKAN_CPU_ALLOCATOR, &pipelineLayout->handle));
+
+        g_PipelineLayouts[key] = pipelineLayout;
+        g_LayoutStats.pipelineLayoutsCreated += 1;
+
+        return pipelineLayout;
+    }
+
+    DVKDescriptorPoolChainRef DVKLayoutCache::GetDescriptorPools(VkDevice device, const DVKDescriptorSetLayoutsInfo& setLayoutsInfo, const std::vector<DVKSetLayoutRef>& setLayouts)
+    {
+        // set layout已经去重，相同的handle序列意味着相同的Pool大小
+        LayoutKey key;
+        key.device = device;
+        PushSetLayoutWords(key, setLayouts);
+        key.Finish();
+
+        std::lock_guard<std::mutex> lock(g_LayoutMutex);
+
+        DVKDescriptorPoolChainRef descriptorPools = FindLayout(g_DescriptorPools, key);
+        if (descriptorPools)
+        {
+            return descriptorPools;
+        }
+
+        descriptorPools = std::make_shared<DVKDescriptorPoolChain>();
+        descriptorPools->device         = device;
+        descriptorPools->setLayoutsInfo = setLayoutsInfo;
+        descriptorPools->setLayouts     = setLayouts;
+        descriptorPools->descriptorSetLayouts.resize(setLayouts.size());
+        for (int32 i = 0; i < setLayouts.size(); ++i)
+        {
+            descriptorPools->descriptorSetLayouts[i] = setLayouts[i]->handle;
+        }
+
+        g_DescriptorPools[key] = descriptorPools;
+
+        return descriptorPools;
+    }
+
+    DVKLayoutCacheStats DVKLayoutCache::GetStats()
+    {
+        std::lock_guard<std::mutex> lock(g_LayoutMutex);
+        return g_LayoutStats;
+    }
+
+}
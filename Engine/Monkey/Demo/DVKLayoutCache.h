@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include "DVKShader.h"
+
+#include "Common/Common.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vk_demo
+{
+
+    struct DVKLayoutCacheStats
+    {
+        int32   setLayoutRequests = 0;
+        int32   setLayoutsCreated = 0;
+        int32   pipelineLayoutRequests = 0;
+        int32   pipelineLayoutsCreated = 0;
+        int32   descriptorPoolsCreated = 0;
+        int32   descriptorSetsRecycled = 0;
+    };
+
+    class DVKSharedSetLayout
+    {
+    public:
+        ~DVKSharedSetLayout()
+        {
+            if (handle != VK_NULL_HANDLE)
+            {
+                vkDestroyDescriptorSetLayout(device, handle, VULKAN_CPU_ALLOCATOR);
+                handle = VK_NULL_HANDLE;
+            }
+        }
+
+    public:
+        VkDevice                device = VK_NULL_HANDLE;
+        VkDescriptorSetLayout   handle = VK_NULL_HANDLE;
+    };
+
+    class DVKSharedPipelineLayout
+    {
+    public:
+        ~DVKSharedPipelineLayout()
+        {
+            if (handle != VK_NULL_HANDLE)
+            {
+                vkDestroyPipelineLayout(device, handle, VULKAN_CPU_ALLOCATOR);
+                handle = VK_NULL_HANDLE;
+            }
+            setLayouts.clear();
+        }
+
+    public:
+        VkDevice                        device = VK_NULL_HANDLE;
+        VkPipelineLayout                handle = VK_NULL_HANDLE;
+        std::vector<DVKSetLayoutRef>    setLayouts;
+    };
+
+    // 相同set layout组合的DVKShader共用一条DescriptorPool链，当前的Pool满了之后追加新的Pool。
+    // DVKDescriptorSet析构时归还到freeSets，之后的分配优先复用，链的大小只与同时存活的Set数量有关。
+    class DVKDescriptorPoolChain
+    {
+    public:
+        ~DVKDescriptorPoolChain()
+        {
+            for (int32 i = 0; i < pools.size(); ++i)
+            {
+                delete pools[i];
+            }
+            pools.clear();
+            setLayouts.clear();
+        }
+
+        // 一次分配descriptorSetLayouts.size()个VkDescriptorSet，线程安全
+        void AllocateDescriptorSet(VkDescriptorSet* descriptorSets);
+
+        // 归还一组VkDescriptorSet，调用者需保证GPU不再使用它们
+        void ReleaseDescriptorSet(const VkDescriptorSet* descriptorSets);
+
+    public:
+        VkDevice                            device = VK_NULL_HANDLE;
+        int32                               maxSet = 64;
+        DVKDescriptorSetLayoutsInfo         setLayoutsInfo;
+        std::vector<VkDescriptorSetLayout>  descriptorSetLayouts;
+        std::vector<DVKSetLayoutRef>        setLayouts;
+        std::vector<DVKDescriptorSetPool*>  pools;
+        std::vector<VkDescriptorSet>        freeSets;
+        std::mutex                          mutex;
+    };
+
+    // Device范围内的Layout缓存：以binding描述的Hash查找，接口相同的Shader拿到同一个
+    // VkDescriptorSetLayout/VkPipelineLayout，Pipeline切换时已绑定的DescriptorSet保持兼容。
+    // 缓存只持有弱引用，最后一个使用者释放时对象随之销毁。
+    class DVKLayoutCache
+    {
+    public:
+        static DVKSetLayoutRef GetSetLayout(VkDevice device, const DVKDescriptorSetLayoutInfo& setLayoutInfo);
+
+        static DVKPipelineLayoutRef GetPipelineLayout(VkDevice device, const std::vector<DVKSetLayoutRef>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+        static DVKDescriptorPoolChainRef GetDescriptorPools(VkDevice device, const DVKDescriptorSetLayoutsInfo& setLayoutsInfo, const std::vector<DVKSetLayoutRef>& setLayouts);
+
+        static DVKLayoutCacheStats GetStats();
+    };
+
+}
@@ -1,9 +1,125 @@
 ﻿#include "DVKMaterial.h"
 #include "DVKDefaultRes.h"
 
+#include <vector>
+
 namespace vk_demo
 {
 
+    struct DVKThreadSlot
+    {
+        int32   index = -1;
+        uint32  generation = 0;
+        bool    failed = false;
+
+        ~DVKThreadSlot();
+    };
+
+    static std::mutex                   g_ThreadSlotMutex;
+    static std::vector<int32>           g_FreeThreadSlots;
+    static int32                        g_NumThreadSlots = 0;
+    static uint32                       g_ThreadSlotGeneration = 0;
+    static thread_local DVKThreadSlot   g_ThreadSlot;
+
+    DVKThreadSlot::~DVKThreadSlot()
+    {
+        if (index >= 0)
+        {
+            std::lock_guard<std::mutex> lockGuard(g_ThreadSlotMutex);
+            g_FreeThreadSlots.push_back(index);
+        }
+    }
+
+    // 为当前线程分配一个独占的槽位，材质的Context和RingBuffer的chunk都按槽位索引。
+    // 每次分配槽位generation都会增加，复用槽位的线程据此重置之前线程留下的数据
+    static int32 AcquireThreadSlot(uint32& generation)
+    {
+        if (g_ThreadSlot.index < 0 && !g_ThreadSlot.failed)
+        {
+            std::lock_guard<std::mutex> lockGuard(g_ThreadSlotMutex);
+            if (g_FreeThreadSlots.size() > 0)
+            {
+                g_ThreadSlot.index = g_FreeThreadSlots.back();
+                g_FreeThreadSlots.pop_back();
+            }
+            else if (g_NumThreadSlots < DVK_MAX_MATERIAL_THREADS)
+            {
+                g_ThreadSlot.index = g_NumThreadSlots;
+                g_NumThreadSlots  += 1;
+            }
+            else
+            {
+                MLOGE("Too many threads recording materials, max=%d", DVK_MAX_MATERIAL_THREADS);
+                g_ThreadSlot.failed = true;
+            }
+
+            if (g_ThreadSlot.index >= 0)
+            {
+                g_ThreadSlotGeneration += 1;
+                g_ThreadSlot.generation = g_ThreadSlotGeneration;
+            }
+        }
+
+        generation = g_ThreadSlot.generation;
+        return g_ThreadSlot.index;
+    }
+
+    DVKRingBuffer::DVKRingBuffer()
+        : bufferOffset(0)
+    {
+
+    }
+
+    uint64 DVKRingBuffer::AllocateRange(uint64 size)
+    {
+        uint64 current = bufferOffset.load(std::memory_order_relaxed);
+        uint64 begin   = 0;
+
+        do
+        {
+            begin = Align<uint64>(current, minAlignment);
+            // 剩余空间不足，从下一圈的起点开始分配
+            if (begin % bufferSize + size > bufferSize)
+            {
+                begin = (begin / bufferSize + 1) * bufferSize;
+            }
+        } while (!bufferOffset.compare_exchange_weak(current, begin + size, std::memory_order_relaxed));
+
+        return begin;
+    }
+
+    uint64 DVKRingBuffer::AllocateMemory(uint64 size)
+    {
+        uint64 alignedSize = Align<uint64>(size, minAlignment);
+        uint32 generation  = 0;
+        int32 slot         = AcquireThreadSlot(generation);
+
+        // 大块数据或者没有槽位的线程直接从RingBuffer分配
+        if (alignedSize > chunkSize / 2 || slot < 0)
+        {
+            return AllocateRange(alignedSize) % bufferSize;
+        }
+
+        DVKRingBufferChunk& chunk = *chunks.Get(slot);
+
+        // 槽位被新线程复用或者RingBuffer已经前进了半圈的chunk不再使用，防止和其它线程新分配的区域重叠
+        if (chunk.generation != generation ||
+            chunk.offset + alignedSize > chunk.end ||
+            bufferOffset.load(std::memory_order_relaxed) - chunk.begin > bufferSize / 2
+        )
+        {
+            chunk.begin  = AllocateRange(chunkSize);
+            chunk.offset = chunk.begin;
+            chunk.end    = chunk.begin + chunkSize;
+            chunk.generation = generation;
+        }
+
+        uint64 offset = chunk.offset;
+        chunk.offset += alignedSize;
+
+        return offset % bufferSize;
+    }
+
     DVKRingBuffer*  DVKMaterial::ringBuffer = nullptr;
     int32           DVKMaterial::ringBufferRefCount = 0;
 
@@ -12,7 +128,7 @@ namespace vk_demo
         ringBuffer = new DVKRingBuffer();
         ringBuffer->device       = vulkanDevice->GetInstanceHandle();
         ringBuffer->bufferSize   = 32 * 1024 * 1024; // 32MB
-        ringBuffer->bufferOffset = ringBuffer->bufferSize;
+        ringBuffer->bufferOffset = 0;
         ringBuffer->minAlignment = (uint32)vulkanDevice->GetLimits().minUniformBufferOffsetAlignment;
         ringBuffer->realBuffer   = vk_demo::DVKBuffer::CreateBuffer(
             vulkanDevice,
@@ -32,6 +148,31 @@ namespace vk_demo
         ringBufferRefCount = 0;
     }
 
+    int32 DVKMaterial::GetThreadSlot(uint32& generation)
+    {
+        return AcquireThreadSlot(generation);
+    }
+
+    DVKMaterialContext* DVKMaterial::GetContext()
+    {
+        // 槽位只会被当前线程访问，首次使用或者被新线程复用时重置
+        uint32 generation = 0;
+        int32 slot = GetThreadSlot(generation);
+        if (slot < 0)
+        {
+            return nullptr;
+        }
+
+        DVKMaterialContext* context = contexts.Get(slot);
+        if (context->generation != generation)
+        {
+            *context = DVKMaterialContext();
+            context->generation = generation;
+            context->globalOffsets.resize(dynamicOffsetCount);
+        }
+        return context;
+    }
+
     DVKMaterial::~DVKMaterial()
     {
         shader = nullptr;
@@ -157,7 +298,6 @@ namespace vk_demo
                 }
             }
         }
-        globalOffsets.resize(dynamicOffsetCount);
 
         // 从Shader中获取Texture信息，包含attachment信息
         for (auto it = shader->imageParams.begin(); it != shader->imageParams.end(); ++it)
@@ -195,14 +335,16 @@ namespace vk_demo
 
     void DVKMaterial::BeginFrame()
     {
-        if (actived)
+        DVKMaterialContext* context = GetContext();
+        if (context == nullptr || context->actived)
         {
             return;
         }
-        actived = true;
-        perObjectIndexes.clear();
+        context->actived = true;
+        context->perObjectIndexes.clear();
 
         // 重置GlobalOffsets数据
+        std::vector<uint32>& globalOffsets = context->globalOffsets;
         memset(globalOffsets.data(), MAX_uint32, sizeof(uint32) * globalOffsets.size());
 
         // 拷贝UniformBuffer
@@ -225,52 +367,64 @@ namespace vk_demo
 
     void DVKMaterial::EndFrame()
     {
-        actived = false;
+        DVKMaterialContext* context = GetContext();
+        if (context != nullptr)
+        {
+            context->actived = false;
+        }
     }
 
     void DVKMaterial::BeginObject()
     {
-        int32 index = (int32)perObjectIndexes.size();
-        perObjectIndexes.push_back(index);
+        DVKMaterialContext* context = GetContext();
+        if (context == nullptr)
+        {
+            return;
+        }
+
+        int32 index = (int32)context->perObjectIndexes.size();
+        context->perObjectIndexes.push_back(index);
 
         int32 offsetStart = index * dynamicOffsetCount;
 
         // 扩充dynamicOffsets尺寸以便能够保持每个Object的参数
-        if (offsetStart + dynamicOffsetCount > dynamicOffsets.size())
+        if (offsetStart + dynamicOffsetCount > context->dynamicOffsets.size())
         {
-            for (uint32 i = 0; i < dynamicOffsetCount; ++i)
-            {
-                dynamicOffsets.push_back(0);
-            }
+            context->dynamicOffsets.resize(offsetStart + dynamicOffsetCount);
         }
 
         // 拷贝GlobalOffsets
-        for (uint32 offsetIndex = offsetStart; offsetIndex < dynamicOffsetCount; ++offsetIndex)
+        for (uint32 i = 0; i < dynamicOffsetCount; ++i)
         {
-            dynamicOffsets[offsetIndex] = globalOffsets[offsetIndex - offsetStart];
+            context->dynamicOffsets[offsetStart + i] = context->globalOffsets[i];
         }
     }
 
     void DVKMaterial::EndObject()
     {
-        // 检查是否所有的Uniform数据都设置完成
-        for (int32 i = 0; i < perObjectIndexes.size(); ++i)
+        DVKMaterialContext* context = GetContext();
+        if (context == nullptr)
+        {
+            return;
+        }
+
+        // 检查当前Object的Uniform数据是否都设置完成
+        if (context->perObjectIndexes.size() > 0)
         {
-            int32 offsetStart = i * dynamicOffsetCount;
-            for (uint32 offsetIndex = offsetStart; offsetIndex < dynamicOffsetCount; ++offsetIndex)
+            int32 offsetStart = context->perObjectIndexes.back() * dynamicOffsetCount;
+            for (uint32 i = 0; i < dynamicOffsetCount; ++i)
             {
-                if (dynamicOffsets[offsetIndex] == MAX_uint32)
+                if (context->dynamicOffsets[offsetStart + i] == MAX_uint32)
                 {
                     MLOGE("Uniform not set\n");
                 }
             }
         }
-
-        if (perObjectIndexes.size() == 0)
+        else
         {
             for (uint32 i = 0; i < dynamicOffsetCount; ++i)
             {
-                if (globalOffsets[i] == MAX_uint32)
+                if (context->globalOffsets[i] == MAX_uint32)
                 {
                     MLOGE("Uniform not set\n");
                 }
@@ -280,14 +434,20 @@ namespace vk_demo
 
     void DVKMaterial::BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, int32 objIndex)
     {
+        DVKMaterialContext* context = GetContext();
+        if (context == nullptr)
+        {
+            return;
+        }
+
         uint32* dynOffsets = nullptr;
-        if (objIndex < perObjectIndexes.size())
+        if (objIndex < context->perObjectIndexes.size())
         {
-            dynOffsets  = dynamicOffsets.data() + perObjectIndexes[objIndex] * dynamicOffsetCount;
+            dynOffsets  = context->dynamicOffsets.data() + context->perObjectIndexes[objIndex] * dynamicOffsetCount;
         }
-        else if (globalOffsets.size() > 0)
+        else if (context->globalOffsets.size() > 0)
         {
-            dynOffsets  = globalOffsets.data();
+            dynOffsets  = context->globalOffsets.data();
         }
 
         vkCmdBindDescriptorSets(
@@ -317,10 +477,16 @@ namespace vk_demo
             return;
         }
 
+        DVKMaterialContext* context = GetContext();
+        if (context == nullptr)
+        {
+            return;
+        }
+
         // 获取Object的起始位置以及DynamicOffset的起始位置
-        int32 objIndex     = perObjectIndexes.back();
+        int32 objIndex     = context->perObjectIndexes.back();
         int32 offsetStart  = objIndex * dynamicOffsetCount;
-        uint32* dynOffsets = dynamicOffsets.data() + offsetStart;
+        uint32* dynOffsets = context->dynamicOffsets.data() + offsetStart;
 
         // 拷贝数据至ringbuffer
         uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
@@ -3,6 +3,8 @@
 #include <string>
 #include <cstring>
 #include <memory>
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
 
 #include "DVKUtils.h"
@@ -17,6 +19,11 @@
 #include "Utils/Alignment.h"
 #include "Vulkan/VulkanCommon.h"
 
+// 线程槽位按页增长，每页64个。线程退出后槽位会被回收，同时录制的线程超过上限时不再分配槽位
+#define DVK_MATERIAL_SLOTS_PER_PAGE     64
+#define DVK_MAX_MATERIAL_SLOT_PAGES     64
+#define DVK_MAX_MATERIAL_THREADS        (DVK_MATERIAL_SLOTS_PER_PAGE * DVK_MAX_MATERIAL_SLOT_PAGES)
+
 namespace vk_demo
 {
 
@@ -42,14 +49,70 @@ namespace vk_demo
         DVKTexture*         texture = nullptr;
     };
 
-    class DVKRingBuffer
+    // 按线程槽位索引的数据。页在首次访问时加锁分配，之后地址不会改变，读取不需要加锁
+    template<typename T>
+    class DVKThreadSlotArray
     {
     public:
-        DVKRingBuffer()
+        DVKThreadSlotArray()
         {
+            for (int32 i = 0; i < DVK_MAX_MATERIAL_SLOT_PAGES; ++i)
+            {
+                pages[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
 
+        virtual ~DVKThreadSlotArray()
+        {
+            for (int32 i = 0; i < DVK_MAX_MATERIAL_SLOT_PAGES; ++i)
+            {
+                delete[] pages[i].load(std::memory_order_relaxed);
+            }
         }
 
+        T* Get(int32 slot)
+        {
+            std::atomic<T*>& page = pages[slot / DVK_MATERIAL_SLOTS_PER_PAGE];
+            T* data = page.load(std::memory_order_acquire);
+            if (data == nullptr)
+            {
+                std::lock_guard<std::mutex> lockGuard(mutex);
+                data = page.load(std::memory_order_relaxed);
+                if (data == nullptr)
+                {
+                    data = new T[DVK_MATERIAL_SLOTS_PER_PAGE]();
+                    page.store(data, std::memory_order_release);
+                }
+            }
+            return data + slot % DVK_MATERIAL_SLOTS_PER_PAGE;
+        }
+
+    private:
+        std::atomic<T*>     pages[DVK_MAX_MATERIAL_SLOT_PAGES];
+        std::mutex          mutex;
+    };
+
+    // 线程在某个RingBuffer中当前使用的chunk，只被对应槽位的线程访问。补齐到64字节避免伪共享。
+    // generation和槽位当前持有者不一致时说明槽位被新线程复用，chunk需要重新分配
+    struct DVKRingBufferChunk
+    {
+        uint64  begin = 0;
+        uint64  offset = 0;
+        uint64  end = 0;
+        uint32  generation = 0;
+        uint8   padding[36];
+    };
+
+    // 多线程共享的RingBuffer，AllocateMemory可以在任意线程并发调用。
+    // 每个线程通过一次原子操作从RingBuffer中切出一块chunk，之后在chunk内部分配不需要任何同步；
+    // chunk按线程槽位保存在RingBuffer内部，不同的RingBuffer互不影响；
+    // 超过半个chunk的大块数据直接从RingBuffer分配。
+    // bufferOffset为单调递增的位置，对bufferSize取模得到实际偏移，一段分配不会跨越Buffer末尾。
+    class DVKRingBuffer
+    {
+    public:
+        DVKRingBuffer();
+
         virtual ~DVKRingBuffer()
         {
             realBuffer->UnMap();
@@ -62,28 +125,40 @@ namespace vk_demo
             return realBuffer->mapped;
         }
 
-        uint64 AllocateMemory(uint64 size)
-        {
-            uint64 allocationOffset = Align<uint64>(bufferOffset, minAlignment);
-
-            if (allocationOffset + size <= bufferSize)
-            {
-                bufferOffset = allocationOffset + size;
-                return allocationOffset;
-            }
+        uint64 AllocateMemory(uint64 size);
 
-            bufferOffset = 0;
-            return bufferOffset;
-        }
+    private:
+        uint64 AllocateRange(uint64 size);
 
     public:
-        VkDevice        device = VK_NULL_HANDLE;
-        uint64          bufferSize = 0;
-        uint64          bufferOffset = 0;
-        uint32          minAlignment = 0;
-        DVKBuffer*      realBuffer = nullptr;
+        VkDevice                device = VK_NULL_HANDLE;
+        uint64                  bufferSize = 0;
+        std::atomic<uint64>     bufferOffset;
+        uint64                  chunkSize = 256 * 1024;
+        uint32                  minAlignment = 0;
+        DVKBuffer*              realBuffer = nullptr;
+
+    private:
+        DVKThreadSlotArray<DVKRingBufferChunk>  chunks;
+    };
+
+    // 每个录制线程独立的DynamicOffset数据，槽位被新线程复用时重置
+    struct DVKMaterialContext
+    {
+        uint32                  generation = 0;
+        bool                    actived = false;
+        std::vector<uint32>     globalOffsets;
+        std::vector<uint32>     dynamicOffsets;
+        std::vector<uint32>     perObjectIndexes;
     };
 
+    // 多线程录制约定：
+    // 1. BeginFrame/BeginObject/SetLocalUniform/EndObject/EndFrame/BindDescriptorSets只访问当前线程的DVKMaterialContext，
+    //    多个线程可以同时录制同一个材质而无需加锁。objIndex为当前线程内BeginObject的序号，
+    //    一个Object从BeginObject到BindDescriptorSets必须在同一个线程完成。
+    // 2. SetGlobalUniform/SetTexture/SetStorageBuffer/SetInputAttachment/PreparePipeline以及Create/delete修改的是共享状态，
+    //    只能在并行录制开始之前或结束之后由单个线程调用。
+    // 3. 所有线程共用一个RingBuffer，GPU尚未使用完的Uniform数据总量不能超过RingBuffer大小(32MB)。
     class DVKMaterial
     {
     private:
@@ -146,6 +221,11 @@ namespace vk_demo
 
         static void DestroyRingBuffer();
 
+        // 槽位用完时返回-1，generation为当前线程持有槽位的序号
+        static int32 GetThreadSlot(uint32& generation);
+
+        DVKMaterialContext* GetContext();
+
         void Prepare();
 
     private:
@@ -166,15 +246,13 @@ namespace vk_demo
         DVKDescriptorSet*       descriptorSet = nullptr;
 
         uint32                  dynamicOffsetCount;
-        std::vector<uint32>     globalOffsets;
-        std::vector<uint32>     dynamicOffsets;
-        std::vector<uint32>     perObjectIndexes;
 
         BuffersMap              uniformBuffers;
         BuffersMap              storageBuffers;
         TexturesMap             textures;
 
-        bool                    actived = false;
+    private:
+        DVKThreadSlotArray<DVKMaterialContext>  contexts;
     };
 
 }
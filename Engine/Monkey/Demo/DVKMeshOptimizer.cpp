@@ -0,0 +1,266 @@
+﻿#include "DVKMeshOptimizer.h"
+#include "DVKModel.h"
+
+#include "meshoptimizer.h"
+
+#include <cstring>
+
+namespace vk_demo
+{
+    void DVKMeshStatistics::Accumulate(const DVKMeshStatistics& other)
+    {
+        int32 triangles = triangleCount + other.triangleCount;
+        int32 vertices  = vertexCount + other.vertexCount;
+
+        if (triangles > 0)
+        {
+            acmr     = (acmr * triangleCount + other.acmr * other.triangleCount) / triangles;
+            overdraw = (overdraw * triangleCount + other.overdraw * other.triangleCount) / triangles;
+        }
+
+        if (vertices > 0)
+        {
+            atvr      = (atvr * vertexCount + other.atvr * other.vertexCount) / vertices;
+            overfetch = (overfetch * vertexCount + other.overfetch * other.vertexCount) / vertices;
+        }
+
+        triangleCount = triangles;
+        vertexCount   = vertices;
+    }
+
+    int32 DVKMeshOptimizer::GetVertexStride(const std::vector<VertexAttribute>& attributes)
+    {
+        int32 stride = 0;
+        for (int32 i = 0; i < attributes.size(); ++i)
+        {
+            stride += VertexAttributeToSize(attributes[i]);
+        }
+        return stride;
+    }
+
+    int32 DVKMeshOptimizer::GetAttributeOffset(const std::vector<VertexAttribute>& attributes, VertexAttribute attribute)
+    {
+        int32 offset = 0;
+        for (int32 i = 0; i < attributes.size(); ++i)
+        {
+            if (attributes[i] == attribute)
+            {
+                return offset;
+            }
+            offset += VertexAttributeToSize(attributes[i]);
+        }
+        return -1;
+    }
+
+    int32 DVKMeshOptimizer::WeldVertices(std::vector<float>& vertices, std::vector<uint32>& indices, int32 vertexCount, int32 stride)
+    {
+        if (indices.size() == 0 || vertexCount == 0)
+        {
+            return vertexCount;
+        }
+
+        std::vector<uint32> remap(vertexCount);
+        size_t uniqueCount = meshopt_generateVertexRemap(remap.data(), indices.data(), indices.size(), vertices.data(), vertexCount, stride);
+        if (uniqueCount == vertexCount)
+        {
+            return vertexCount;
+        }
+
+        std::vector<float> uniqueVertices(uniqueCount * stride / sizeof(float));
+        meshopt_remapVertexBuffer(uniqueVertices.data(), vertices.data(), vertexCount, stride, remap.data());
+        meshopt_remapIndexBuffer(indices.data(), indices.data(), indices.size(), remap.data());
+        vertices.swap(uniqueVertices);
+
+        return (int32)uniqueCount;
+    }
+
+    void DVKMeshOptimizer::OptimizeVertexCache(DVKPrimitive* primitive)
+    {
+        if (primitive->indices.size() == 0)
+        {
+            return;
+        }
+
+        meshopt_optimizeVertexCache(primitive->indices.data(), primitive->indices.data(), primitive->indices.size(), primitive->vertexCount);
+    }
+
+    void DVKMeshOptimizer::OptimizeOverdraw(DVKPrimitive* primitive, int32 stride, int32 positionOffset, float threshold)
+    {
+        if (primitive->indices.size() == 0 || positionOffset < 0)
+        {
+            return;
+        }
+
+        const float* positions = (const float*)((const uint8*)primitive->vertices.data() + positionOffset);
+        meshopt_optimizeOverdraw(primitive->indices.data(), primitive->indices.data(), primitive->indices.size(), positions, primitive->vertexCount, stride, threshold);
+    }
+
+    void DVKMeshOptimizer::OptimizeVertexFetch(DVKPrimitive* primitive, int32 stride)
+    {
+        // meshoptimizer限制顶点大小不超过256字节
+        if (primitive->indices.size() == 0 || stride > 256)
+        {
+            return;
+        }
+
+        size_t vertexCount = meshopt_optimizeVertexFetch(primitive->vertices.data(), primitive->indices.data(), primitive->indices.size(), primitive->vertices.data(), primitive->vertexCount, stride);
+
+        // 未被引用的顶点会被移除
+        primitive->vertexCount = (int32)vertexCount;
+        primitive->vertices.resize(vertexCount * stride / sizeof(float));
+    }
+
+    void DVKMeshOptimizer::GenerateLods(DVKPrimitive* primitive, int32 stride, int32 positionOffset, int32 maxLods, float targetError)
+    {
+        primitive->lods.clear();
+        primitive->lodIndices.clear();
+        primitive->lodIndex = 0;
+
+        if (primitive->indices.size() == 0 || positionOffset < 0 || maxLods <= 1)
+        {
+            return;
+        }
+
+        const uint8* positions = (const uint8*)primitive->vertices.data() + positionOffset;
+
+        // meshopt_simplify的误差相对于包围盒最大边长，换算回模型空间
+        Vector3 mmin( MAX_FLT,  MAX_FLT,  MAX_FLT);
+        Vector3 mmax(-MAX_FLT, -MAX_FLT, -MAX_FLT);
+        for (int32 i = 0; i < primitive->vertexCount; ++i)
+        {
+            const float* position = (const float*)(positions + i * stride);
+            mmin = Vector3::Min(mmin, Vector3(position[0], position[1], position[2]));
+            mmax = Vector3::Max(mmax, Vector3(position[0], position[1], position[2]));
+        }
+        Vector3 size  = mmax - mmin;
+        float extent  = MMath::Max(size.x, MMath::Max(size.y, size.z));
+
+        DVKPrimitiveLod lod0;
+        lod0.firstIndex = 0;
+        lod0.indexCount = (uint32)primitive->indices.size();
+        lod0.error      = 0.0f;
+        primitive->lods.push_back(lod0);
+
+        std::vector<uint32> lodIndices(primitive->indices.size());
+        uint32 lastCount = lod0.indexCount;
+
+        for (float error = targetError; error <= 1.0f && primitive->lods.size() < maxLods; error *= 2.0f)
+        {
+            size_t targetCount = lastCount / 2 / 3 * 3;
+            size_t indexCount  = meshopt_simplify(lodIndices.data(), primitive->indices.data(), primitive->indices.size(), (const float*)positions, primitive->vertexCount, stride, targetCount, error);
+            if (indexCount == 0)
+            {
+                break;
+            }
+
+            // 误差限制内简化不动，放宽误差再试
+            if (indexCount > lastCount * 9 / 10)
+            {
+                continue;
+            }
+
+            meshopt_optimizeVertexCache(lodIndices.data(), lodIndices.data(), indexCount, primitive->vertexCount);
+
+            DVKPrimitiveLod lod;
+            lod.firstIndex = (uint32)(primitive->indices.size() + primitive->lodIndices.size());
+            lod.indexCount = (uint32)indexCount;
+            lod.error      = error * extent;
+            primitive->lods.push_back(lod);
+            primitive->lodIndices.insert(primitive->lodIndices.end(), lodIndices.begin(), lodIndices.begin() + indexCount);
+
+            lastCount = (uint32)indexCount;
+        }
+
+        // 没能生成任何一级LOD
+        if (primitive->lods.size() == 1)
+        {
+            primitive->lods.clear();
+        }
+    }
+
+    void DVKMeshOptimizer::QuantizeVertices(DVKPrimitive* primitive, const std::vector<VertexAttribute>& attributes)
+    {
+        int32 quantizedStride = 0;
+        for (int32 i = 0; i < attributes.size(); ++i)
+        {
+            quantizedStride += VertexAttributeToQuantizedSize(attributes[i]);
+        }
+
+        std::vector<float> quantized(primitive->vertexCount * quantizedStride / sizeof(float));
+
+        const float* src = primitive->vertices.data();
+        uint8* dst = (uint8*)quantized.data();
+
+        for (int32 v = 0; v < primitive->vertexCount; ++v)
+        {
+            for (int32 i = 0; i < attributes.size(); ++i)
+            {
+                VertexAttribute attribute = attributes[i];
+
+                if (attribute == VertexAttribute::VA_Position)
+                {
+                    uint16 half[4] = { meshopt_quantizeHalf(src[0]), meshopt_quantizeHalf(src[1]), meshopt_quantizeHalf(src[2]), meshopt_quantizeHalf(1.0f) };
+                    memcpy(dst, half, sizeof(half));
+                }
+                else if (attribute == VertexAttribute::VA_UV0 || attribute == VertexAttribute::VA_UV1)
+                {
+                    uint16 half[2] = { meshopt_quantizeHalf(src[0]), meshopt_quantizeHalf(src[1]) };
+                    memcpy(dst, half, sizeof(half));
+                }
+                else if (attribute == VertexAttribute::VA_Normal)
+                {
+                    int8 snorm[4] = { (int8)meshopt_quantizeSnorm(src[0], 8), (int8)meshopt_quantizeSnorm(src[1], 8), (int8)meshopt_quantizeSnorm(src[2], 8), 0 };
+                    memcpy(dst, snorm, sizeof(snorm));
+                }
+                else if (attribute == VertexAttribute::VA_Tangent)
+                {
+                    int8 snorm[4] = { (int8)meshopt_quantizeSnorm(src[0], 8), (int8)meshopt_quantizeSnorm(src[1], 8), (int8)meshopt_quantizeSnorm(src[2], 8), (int8)meshopt_quantizeSnorm(src[3], 8) };
+                    memcpy(dst, snorm, sizeof(snorm));
+                }
+                else if (attribute == VertexAttribute::VA_Color)
+                {
+                    uint8 unorm[4] = { (uint8)meshopt_quantizeUnorm(src[0], 8), (uint8)meshopt_quantizeUnorm(src[1], 8), (uint8)meshopt_quantizeUnorm(src[2], 8), 255 };
+                    memcpy(dst, unorm, sizeof(unorm));
+                }
+                else
+                {
+                    memcpy(dst, src, VertexAttributeToSize(attribute));
+                }
+
+                src += VertexAttributeToSize(attribute) / sizeof(float);
+                dst += VertexAttributeToQuantizedSize(attribute);
+            }
+        }
+
+        primitive->vertices.swap(quantized);
+    }
+
+    DVKMeshStatistics DVKMeshOptimizer::Analyze(const std::vector<float>& vertices, const std::vector<uint32>& indices, int32 vertexCount, int32 stride, int32 positionOffset, bool analyzeOverdraw)
+    {
+        DVKMeshStatistics stats;
+        stats.triangleCount = (int32)indices.size() / 3;
+        stats.vertexCount   = vertexCount;
+
+        if (indices.size() == 0)
+        {
+            return stats;
+        }
+
+        meshopt_VertexCacheStatistics vcache = meshopt_analyzeVertexCache(indices.data(), indices.size(), vertexCount, 16, 0, 0);
+        stats.acmr = vcache.acmr;
+        stats.atvr = vcache.atvr;
+
+        meshopt_VertexFetchStatistics vfetch = meshopt_analyzeVertexFetch(indices.data(), indices.size(), vertexCount, stride);
+        stats.overfetch = vfetch.overfetch;
+
+        if (analyzeOverdraw && positionOffset >= 0)
+        {
+            const float* positions = (const float*)((const uint8*)vertices.data() + positionOffset);
+            meshopt_OverdrawStatistics overdraw = meshopt_analyzeOverdraw(indices.data(), indices.size(), positions, vertexCount, stride);
+            stats.overdraw = overdraw.overdraw;
+        }
+
+        return stats;
+    }
+
+}
@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include "DVKVertexBuffer.h"
+
+#include "Common/Common.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+    struct DVKPrimitive;
+
+    struct DVKMeshStatistics
+    {
+        int32   triangleCount = 0;
+        int32   vertexCount = 0;
+
+        // 平均每个三角形需要变换的顶点数，越接近0.5越好
+        float   acmr = 0.0f;
+        // 变换的顶点数/顶点总数，理想值为1
+        float   atvr = 0.0f;
+        // 每个像素平均被着色的次数，理想值为1
+        float   overdraw = 0.0f;
+        // 实际读取的顶点数据/顶点数据总量，理想值为1
+        float   overfetch = 0.0f;
+
+        // 按三角形数、顶点数加权合并
+        void Accumulate(const DVKMeshStatistics& other);
+    };
+
+    // meshoptimizer的封装，stride/offset均以字节为单位，顶点数据为DVKPrimitive中交错的float数据
+    class DVKMeshOptimizer
+    {
+    public:
+        static int32 GetVertexStride(const std::vector<VertexAttribute>& attributes);
+
+        static int32 GetAttributeOffset(const std::vector<VertexAttribute>& attributes, VertexAttribute attribute);
+
+        // 合并完全相同的顶点，返回合并后的顶点数
+        static int32 WeldVertices(std::vector<float>& vertices, std::vector<uint32>& indices, int32 vertexCount, int32 stride);
+
+        static void OptimizeVertexCache(DVKPrimitive* primitive);
+
+        static void OptimizeOverdraw(DVKPrimitive* primitive, int32 stride, int32 positionOffset, float threshold);
+
+        static void OptimizeVertexFetch(DVKPrimitive* primitive, int32 stride);
+
+        // LOD链写入primitive->lods/lodIndices，LOD0为原始索引
+        static void GenerateLods(DVKPrimitive* primitive, int32 stride, int32 positionOffset, int32 maxLods, float targetError);
+
+        static void QuantizeVertices(DVKPrimitive* primitive, const std::vector<VertexAttribute>& attributes);
+
+        static DVKMeshStatistics Analyze(const std::vector<float>& vertices, const std::vector<uint32>& indices, int32 vertexCount, int32 stride, int32 positionOffset, bool analyzeOverdraw);
+    };
+
+}
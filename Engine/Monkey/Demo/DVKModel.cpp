@@ -1,15 +1,40 @@
 ﻿#include "DVKModel.h"
 
+#include "DVKModelCache.h"
+#include "DVKCamera.h"
 #include "FileManager.h"
 #include "Math/Matrix4x4.h"
+#include "Utils/Crc.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/cimport.h>
 
+#include <mutex>
+
 namespace vk_demo
 {
+    struct DVKModelImport
+    {
+        Assimp::Importer            importer;
+        const aiScene*              scene = nullptr;
+        // 与DVKModel::meshes一一对应
+        std::vector<const aiMesh*>  meshes;
+
+        std::string                 filename;
+        std::string                 cachePath;
+        uint32                      sourceSize = 0;
+        uint32                      sourceHash = 0;
+        uint32                      attributesHash = 0;
+
+        bool                        succeeded = false;
+        bool                        fromCache = false;
+
+        // 多个线程同时处理Mesh时保护统计数据
+        std::mutex                  mutex;
+    };
+
     void SimplifyTexturePath(std::string& path)
     {
         const size_t lastSlashIdx = path.find_last_of("\\/");
@@ -73,7 +98,31 @@ namespace vk_demo
         matrix.SetTransposed();
     }
 
+    uint32 HashLoadOptions(const DVKModelLoadOptions& options, uint32 crc)
+    {
+        uint8 flags[7] = {
+            options.use32BitIndices,
+            options.weldVertices,
+            options.optimizeVertexCache,
+            options.optimizeOverdraw,
+            options.optimizeVertexFetch,
+            options.quantizeVertices,
+            options.generateLods
+        };
+        crc = Crc::MemCrc32(flags, sizeof(flags), crc);
+        crc = Crc::MemCrc32(&options.overdrawThreshold, sizeof(options.overdrawThreshold), crc);
+        crc = Crc::MemCrc32(&options.maxLods, sizeof(options.maxLods), crc);
+        crc = Crc::MemCrc32(&options.lodTargetError, sizeof(options.lodTargetError), crc);
+        return crc;
+    }
+
     DVKModel* DVKModel::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, const std::vector<uint16>& indices, const std::vector<VertexAttribute>& attributes)
+    {
+        std::vector<uint32> indices32(indices.begin(), indices.end());
+        return DVKModel::Create(vulkanDevice, cmdBuffer, vertices, indices32, attributes);
+    }
+
+    DVKModel* DVKModel::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, const std::vector<uint32>& indices, const std::vector<VertexAttribute>& attributes)
     {
         DVKModel* model   = new DVKModel();
         model->device     = vulkanDevice;
@@ -90,18 +139,9 @@ namespace vk_demo
         primitive->vertices     = vertices;
         primitive->indices      = indices;
         primitive->vertexCount  = (int32)vertices.size() / stride * 4;
+        primitive->indexType    = primitive->vertexCount > 65536 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
 
-        if (cmdBuffer)
-        {
-            if (vertices.size() > 0)
-            {
-                primitive->vertexBuffer = DVKVertexBuffer::Create(vulkanDevice, cmdBuffer, primitive->vertices, attributes);
-            }
-            if (indices.size() > 0)
-            {
-                primitive->indexBuffer = DVKIndexBuffer::Create(vulkanDevice, cmdBuffer, primitive->indices);
-            }
-        }
+        model->CreateBuffers(primitive);
 
         DVKMesh* mesh = new DVKMesh();
         mesh->primitives.push_back(primitive);
@@ -120,12 +160,25 @@ namespace vk_demo
         return model;
     }
 
-    DVKModel* DVKModel::LoadFromFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes)
+    DVKModel* DVKModel::LoadFromFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes, const DVKModelLoadOptions& options)
+    {
+        DVKModel* model = ImportFile(filename, vulkanDevice, attributes, options);
+        model->LoadPendingMeshes(0, model->GetNumPendingMeshes());
+        model->FinishImport();
+        model->Upload(cmdBuffer);
+        return model;
+    }
+
+    DVKModel* DVKModel::ImportFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, const std::vector<VertexAttribute>& attributes, const DVKModelLoadOptions& options)
     {
         DVKModel* model   = new DVKModel();
         model->device     = vulkanDevice;
         model->attributes = attributes;
-        model->cmdBuffer  = cmdBuffer;
+        model->options    = options;
+        model->import     = std::make_shared<DVKModelImport>();
+
+        DVKModelImport* import = model->import.get();
+        import->filename = filename;
 
         int assimpFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
 
@@ -157,25 +210,230 @@ namespace vk_demo
             }
         }
 
-        uint32 dataSize = 0;
-        uint8* dataPtr  = nullptr;
-        if (!FileManager::ReadFile(filename, dataPtr, dataSize))
+        // Assimp直接解析映射的文件数据，不再额外拷贝一份
+        FileMappingRef mapping = FileManager::MapFile(filename);
+        if (!mapping)
+        {
+            return model;
+        }
+
+        // 源文件以及顶点属性都没有变化时直接加载缓存
+        import->sourceSize     = mapping->GetSize();
+        import->sourceHash     = Crc::MemCrc32(mapping->GetData(), mapping->GetSize());
+        import->attributesHash = Crc::MemCrc32(attributes.data(), (int32)(attributes.size() * sizeof(VertexAttribute)));
+        import->attributesHash = HashLoadOptions(options, import->attributesHash);
+        import->cachePath      = DVKModelCache::GetCachePath(filename, import->attributesHash);
+
+        if (!options.statistics && DVKModelCache::Load(model, import->cachePath, import->sourceSize, import->sourceHash, import->attributesHash))
         {
+            import->succeeded = true;
+            import->fromCache = true;
             return model;
         }
 
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFileFromMemory(dataPtr, dataSize, assimpFlags);
+        import->scene = import->importer.ReadFileFromMemory(mapping->GetData(), mapping->GetSize(), assimpFlags);
+        if (!import->scene)
+        {
+            MLOGE("Failed import model : %s", filename.c_str());
+            return model;
+        }
 
-        model->LoadBones(scene);
-        model->LoadNode(scene->mRootNode, scene);
-        model->LoadAnim(scene);
+        // 节点、骨骼与动画需要按顺序建立，Mesh只创建空壳，之后由LoadPendingMeshes填充
+        model->LoadBones(import->scene);
+        model->LoadNode(import->scene->mRootNode, import->scene);
+        model->LoadAnim(import->scene);
 
-        delete[] dataPtr;
+        import->succeeded = true;
 
         return model;
     }
 
+    int32 DVKModel::GetNumPendingMeshes() const
+    {
+        return import ? (int32)import->meshes.size() : 0;
+    }
+
+    void DVKModel::LoadPendingMeshes(int32 begin, int32 end)
+    {
+        for (int32 i = begin; i < end; ++i)
+        {
+            LoadMesh(meshes[i], import->meshes[i], import->scene);
+        }
+    }
+
+    bool DVKModel::FinishImport()
+    {
+        if (!import)
+        {
+            return true;
+        }
+
+        bool succeeded = import->succeeded;
+
+        if (succeeded && !import->fromCache)
+        {
+            if (options.statistics)
+            {
+                const DVKMeshStatistics& raw = rawStatistics;
+                const DVKMeshStatistics& opt = optimizedStatistics;
+                MLOG("%s : ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, Overdraw %.3f -> %.3f, Overfetch %.3f -> %.3f", import->filename.c_str(), raw.acmr, opt.acmr, raw.atvr, opt.atvr, raw.overdraw, opt.overdraw, raw.overfetch, opt.overfetch);
+            }
+
+            DVKModelCache::Save(this, import->cachePath, import->sourceSize, import->sourceHash, import->attributesHash);
+        }
+
+        import = nullptr;
+
+        return succeeded;
+    }
+
+    void DVKModel::Upload(DVKCommandBuffer* uploadCmdBuffer)
+    {
+        cmdBuffer = uploadCmdBuffer;
+        CreateBuffers();
+        ReleaseCPUData();
+    }
+
+    void DVKModel::ReleaseCPUData()
+    {
+        if (options.keepCPUData)
+        {
+            return;
+        }
+
+        for (int32 i = 0; i < meshes.size(); ++i)
+        {
+            DVKMesh* mesh = meshes[i];
+            for (int32 j = 0; j < mesh->primitives.size(); ++j)
+            {
+                mesh->primitives[j]->ReleaseCPUData();
+            }
+        }
+    }
+
+    void DVKModel::CreateBuffers()
+    {
+        if (!cmdBuffer)
+        {
+            return;
+        }
+
+        for (int32 i = 0; i < meshes.size(); ++i)
+        {
+            DVKMesh* mesh = meshes[i];
+            for (int32 j = 0; j < mesh->primitives.size(); ++j)
+            {
+                CreateBuffers(mesh->primitives[j]);
+            }
+        }
+    }
+
+    void DVKModel::CreateBuffers(DVKPrimitive* primitive)
+    {
+        if (!cmdBuffer)
+        {
+            return;
+        }
+
+        if (!primitive->vertexBuffer && primitive->vertices.size() > 0)
+        {
+            primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
+        }
+
+        if (!primitive->indexBuffer && primitive->indices.size() > 0)
+        {
+            std::vector<uint32> indices = primitive->indices;
+            indices.insert(indices.end(), primitive->lodIndices.begin(), primitive->lodIndices.end());
+
+            if (primitive->indexType == VK_INDEX_TYPE_UINT16)
+            {
+                std::vector<uint16> indices16(indices.begin(), indices.end());
+                primitive->indexBuffer = DVKIndexBuffer::Create(device, cmdBuffer, indices16);
+            }
+            else
+            {
+                primitive->indexBuffer = DVKIndexBuffer::Create(device, cmdBuffer, indices);
+            }
+
+            // indexCount保持为LOD0的索引数
+            primitive->indexBuffer->indexCount = (int32)primitive->indices.size();
+        }
+    }
+
+    void DVKModel::OptimizePrimitive(DVKPrimitive* primitive)
+    {
+        int32 stride = DVKMeshOptimizer::GetVertexStride(attributes);
+        int32 positionOffset = DVKMeshOptimizer::GetAttributeOffset(attributes, VertexAttribute::VA_Position);
+
+        // 顺序不能调换：overdraw优化依赖vertex cache优化的结果，vertex fetch优化最后根据三角形顺序重排顶点
+        if (options.optimizeVertexCache)
+        {
+            DVKMeshOptimizer::OptimizeVertexCache(primitive);
+        }
+
+        if (options.optimizeVertexCache && options.optimizeOverdraw)
+        {
+            DVKMeshOptimizer::OptimizeOverdraw(primitive, stride, positionOffset, options.overdrawThreshold);
+        }
+
+        if (options.optimizeVertexFetch)
+        {
+            DVKMeshOptimizer::OptimizeVertexFetch(primitive, stride);
+        }
+
+        if (options.statistics)
+        {
+            DVKMeshStatistics statistics = DVKMeshOptimizer::Analyze(primitive->vertices, primitive->indices, primitive->vertexCount, stride, positionOffset, true);
+            std::lock_guard<std::mutex> lock(import->mutex);
+            optimizedStatistics.Accumulate(statistics);
+        }
+
+        // LOD引用的顶点是LOD0的子集，放在vertex fetch优化之后
+        if (options.generateLods)
+        {
+            DVKMeshOptimizer::GenerateLods(primitive, stride, positionOffset, options.maxLods, options.lodTargetError);
+        }
+
+        if (options.quantizeVertices)
+        {
+            DVKMeshOptimizer::QuantizeVertices(primitive, attributes);
+        }
+    }
+
+    float DVKMesh::GetLodErrorScale(const Matrix4x4& world, DVKCamera& camera, float viewportHeight)
+    {
+        Vector3 center = world.TransformPosition((bounding.min + bounding.max) * 0.5f);
+        float maxScale = world.GetMaximumAxisScale();
+        float radius   = (bounding.max - bounding.min).Size() * 0.5f * maxScale;
+
+        // 取包围球上离相机最近的点，保证误差估计偏保守
+        float distance = (center - camera.GetTransform().GetOrigin()).Size() - radius;
+        distance = MMath::Max(distance, camera.GetNear());
+
+        return maxScale * camera.GetProjectionScale(viewportHeight) / distance;
+    }
+
+    void DVKMesh::SelectLod(const Matrix4x4& world, DVKCamera& camera, float viewportHeight, float threshold, float hysteresis)
+    {
+        float errorScale = GetLodErrorScale(world, camera, viewportHeight);
+        for (int32 i = 0; i < primitives.size(); ++i)
+        {
+            DVKPrimitive* primitive = primitives[i];
+            primitive->lodIndex = primitive->SelectLod(errorScale, threshold, hysteresis, primitive->lodIndex);
+        }
+    }
+
+    void DVKModel::SelectLods(const Matrix4x4& world, DVKCamera& camera, float viewportHeight, float threshold, float hysteresis)
+    {
+        for (int32 i = 0; i < meshes.size(); ++i)
+        {
+            DVKMesh* mesh = meshes[i];
+            Matrix4x4 meshWorld = mesh->linkNode->GetGlobalMatrix();
+            meshWorld.Append(world);
+            mesh->SelectLod(meshWorld, camera, viewportHeight, threshold, hysteresis);
+        }
+    }
+
     void DVKModel::LoadBones(const aiScene* aiScene)
     {
         std::unordered_map<std::string, int32> boneIndexMap;
@@ -215,7 +473,8 @@ namespace vk_demo
         {
             aiBone* boneInfo = aiMesh->mBones[i];
             std::string boneName(boneInfo->mName.C_Str());
-            int32 boneIndex = bonesMap[boneName]->index;
+            // 可能有多个线程同时处理Mesh，只读访问bonesMap
+            int32 boneIndex = bonesMap.find(boneName)->second->index;
 
             // bone在mesh中的索引
             int32 meshBoneIndex = 0;
@@ -443,71 +702,82 @@ namespace vk_demo
 
     void DVKModel::LoadPrimitives(std::vector<float>& vertices, std::vector<uint32>& indices, DVKMesh* mesh, const aiMesh* aiMesh, const aiScene* aiScene)
     {
-        int32 stride = (int32)vertices.size() / aiMesh->mNumVertices;
+        const uint32 maxVertices16 = 65536;
+
+        int32 vertexCount = aiMesh->mNumVertices;
+        int32 stride = (int32)vertices.size() / vertexCount;
+
+        if (options.statistics)
+        {
+            int32 positionOffset = DVKMeshOptimizer::GetAttributeOffset(attributes, VertexAttribute::VA_Position);
+            DVKMeshStatistics statistics = DVKMeshOptimizer::Analyze(vertices, indices, vertexCount, stride * sizeof(float), positionOffset, true);
+            std::lock_guard<std::mutex> lock(import->mutex);
+            rawStatistics.Accumulate(statistics);
+        }
 
-        if (indices.size() > 65535)
+        // 先合并顶点再切分，切分后的Primitive数量也会减少
+        if (options.weldVertices)
         {
-            std::unordered_map<uint32, uint32> indicesMap;
+            vertexCount = DVKMeshOptimizer::WeldVertices(vertices, indices, vertexCount, stride * sizeof(float));
+        }
+
+        if (options.use32BitIndices || vertexCount <= maxVertices16)
+        {
+            DVKPrimitive* primitive = new DVKPrimitive();
+            primitive->vertices.swap(vertices);
+            primitive->indices.swap(indices);
+            primitive->indexType = vertexCount > maxVertices16 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+            mesh->primitives.push_back(primitive);
+        }
+        else
+        {
+            // 按引用到的顶点数切分，remap记录原始顶点在当前Primitive中的新索引
+            std::vector<uint32> remap(vertexCount, MAX_uint32);
+            std::vector<uint32> usedVertices;
+            usedVertices.reserve(maxVertices16);
+
             DVKPrimitive* primitive = nullptr;
 
-            for (int32 i = 0; i < indices.size(); ++i)
+            for (int32 i = 0; i + 2 < indices.size(); i += 3)
             {
-                uint32 idx = indices[i];
-                if (primitive == nullptr)
+                uint32 newVertices = 0;
+                for (int32 k = 0; k < 3; ++k)
                 {
-                    primitive = new DVKPrimitive();
-                    indicesMap.clear();
-                    mesh->primitives.push_back(primitive);
+                    if (remap[indices[i + k]] == MAX_uint32)
+                    {
+                        newVertices += 1;
+                    }
                 }
 
-                uint32 newIdx = 0;
-                auto it = indicesMap.find(idx);
-                if (it == indicesMap.end())
-                {
-                    uint32 start = idx * stride;
-                    newIdx = (uint32)primitive->vertices.size() / stride;
-                    primitive->vertices.insert(primitive->vertices.end(), vertices.begin() + start, vertices.begin() + start + stride);
-                    indicesMap.insert(std::make_pair(idx, newIdx));
-                }
-                else
+                // 三角形不能跨Primitive，放不下就开始新的Primitive
+                if (primitive == nullptr || usedVertices.size() + newVertices > maxVertices16)
                 {
-                    newIdx = it->second;
-                }
-
-                primitive->indices.push_back(newIdx);
+                    for (int32 k = 0; k < usedVertices.size(); ++k)
+                    {
+                        remap[usedVertices[k]] = MAX_uint32;
+                    }
+                    usedVertices.clear();
 
-                if (primitive->indices.size() == 65535)
-                {
-                    primitive = nullptr;
+                    primitive = new DVKPrimitive();
+                    primitive->indexType = VK_INDEX_TYPE_UINT16;
+                    primitive->vertices.reserve(maxVertices16 * stride);
+                    mesh->primitives.push_back(primitive);
                 }
-            }
 
-            if (cmdBuffer)
-            {
-                for (int32 i = 0; i < mesh->primitives.size(); ++i)
+                for (int32 k = 0; k < 3; ++k)
                 {
-                    primitive = mesh->primitives[i];
-                    primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
-                    primitive->indexBuffer  = DVKIndexBuffer::Create(device, cmdBuffer, primitive->indices);
+                    uint32 idx = indices[i + k];
+                    if (remap[idx] == MAX_uint32)
+                    {
+                        uint32 start = idx * stride;
+                        remap[idx] = (uint32)usedVertices.size();
+                        usedVertices.push_back(idx);
+                        primitive->vertices.insert(primitive->vertices.end(), vertices.begin() + start, vertices.begin() + start + stride);
+                    }
+                    primitive->indices.push_back(remap[idx]);
                 }
             }
         }
-        else
-        {
-            DVKPrimitive* primitive = new DVKPrimitive();
-            primitive->vertices = vertices;
-            for (uint16 i = 0; i < indices.size(); ++i)
-            {
-                primitive->indices.push_back(indices[i]);
-            }
-            mesh->primitives.push_back(primitive);
-
-            if (cmdBuffer)
-            {
-                primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
-                primitive->indexBuffer  = DVKIndexBuffer::Create(device, cmdBuffer, primitive->indices);
-            }
-        }
 
         for (int32 i = 0; i < mesh->primitives.size(); ++i)
         {
@@ -515,15 +785,15 @@ namespace vk_demo
             primitive->vertexCount  = (int32)primitive->vertices.size() / stride;
             primitive->triangleNum  = (int32)primitive->indices.size() / 3;
 
+            OptimizePrimitive(primitive);
+
             mesh->vertexCount   += primitive->vertexCount;
             mesh->triangleCount += primitive->triangleNum;
         }
     }
 
-    DVKMesh* DVKModel::LoadMesh(const aiMesh* aiMesh, const aiScene* aiScene)
+    void DVKModel::LoadMesh(DVKMesh* mesh, const aiMesh* aiMesh, const aiScene* aiScene)
     {
-        DVKMesh* mesh = new DVKMesh();
-
         // load material
         aiMaterial* material = aiScene->mMaterials[aiMesh->mMaterialIndex];
         if (material)
@@ -554,8 +824,6 @@ namespace vk_demo
         mesh->bounding.min = mmin;
         mesh->bounding.max = mmax;
         mesh->bounding.UpdateCorners();
-
-        return mesh;
     }
 
     DVKNode* DVKModel::LoadNode(const aiNode* aiNode, const aiScene* aiScene)
@@ -576,10 +844,11 @@ namespace vk_demo
         {
             for (uint32 i = 0; i < aiNode->mNumMeshes; ++i)
             {
-                DVKMesh* vkMesh  = LoadMesh(aiScene->mMeshes[aiNode->mMeshes[i]], aiScene);
+                DVKMesh* vkMesh  = new DVKMesh();
                 vkMesh->linkNode = vkNode;
                 vkNode->meshes.push_back(vkMesh);
                 meshes.push_back(vkMesh);
+                import->meshes.push_back(aiScene->mMeshes[aiNode->mMeshes[i]]);
             }
         }
 
@@ -670,6 +939,50 @@ namespace vk_demo
         }
     }
 
+    void DVKModel::CompressAnimations(const DVKAnimCompressionSettings& settings, DVKAnimCompressionReport* report)
+    {
+        for (int32 i = 0; i < animations.size(); ++i)
+        {
+            DVKAnimation& animation = animations[i];
+            for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+            {
+                DVKAnimationClip& clip = it->second;
+                if (clip.compressed.IsValid())
+                {
+                    continue;
+                }
+
+                auto scaleIt = settings.boneErrorScales.find(clip.nodeName);
+                float errorScale = scaleIt != settings.boneErrorScales.end() ? scaleIt->second : 1.0f;
+
+                DVKAnimClipReport clipReport;
+                clipReport.nodeName = clip.nodeName;
+
+                clip.compressed = DVKCompressedClip::Compress(
+                    clip.duration,
+                    clip.rotations.keys, clip.rotations.values,
+                    clip.positions.keys, clip.positions.values,
+                    clip.scales.keys,    clip.scales.values,
+                    settings,
+                    errorScale,
+                    report ? &clipReport : nullptr
+                );
+
+                if (report)
+                {
+                    report->Append(clipReport);
+                }
+
+                std::vector<float>().swap(clip.rotations.keys);
+                std::vector<Quat>().swap(clip.rotations.values);
+                std::vector<float>().swap(clip.positions.keys);
+                std::vector<Vector3>().swap(clip.positions.values);
+                std::vector<float>().swap(clip.scales.keys);
+                std::vector<Vector3>().swap(clip.scales.values);
+            }
+        }
+    }
+
     void DVKModel::GotoAnimation(float time)
     {
         if (animIndex == -1)
@@ -685,31 +998,7 @@ namespace vk_demo
         {
             vk_demo::DVKAnimationClip& clip = it->second;
             vk_demo::DVKNode* node = nodesMap[clip.nodeName];
-
-            float alpha = 0.0f;
-
-            // rotation
-            Quat prevRot(0, 0, 0, 1);
-            Quat nextRot(0, 0, 0, 1);
-            clip.rotations.GetValue(animation.time, prevRot, nextRot, alpha);
-            Quat retRot = MMath::Lerp(prevRot, nextRot, alpha);
-
-            // position
-            Vector3 prevPos(0, 0, 0);
-            Vector3 nextPos(0, 0, 0);
-            clip.positions.GetValue(animation.time, prevPos, nextPos, alpha);
-            Vector3 retPos = MMath::Lerp(prevPos, nextPos, alpha);
-
-            // scale
-            Vector3 prevScale(1, 1, 1);
-            Vector3 nextScale(1, 1, 1);
-            clip.scales.GetValue(animation.time, prevScale, nextScale, alpha);
-            Vector3 retScale = MMath::Lerp(prevScale, nextScale, alpha);
-
-            node->localMatrix.SetIdentity();
-            node->localMatrix.AppendScale(retScale);
-            node->localMatrix.Append(retRot.ToMatrix());
-            node->localMatrix.AppendTranslation(retPos);
+            clip.Evaluate(animation.time, node->localMatrix);
         }
 
         // update bones
@@ -768,7 +1057,7 @@ namespace vk_demo
         int32 stride = 0;
         for (int32 i = 0; i < attributes.size(); ++i)
         {
-            stride += VertexAttributeToSize(attributes[i]);
+            stride += options.quantizeVertices ? VertexAttributeToQuantizedSize(attributes[i]) : VertexAttributeToSize(attributes[i]);
         }
 
         VkVertexInputBindingDescription vertexInputBinding = {};
@@ -789,9 +1078,9 @@ namespace vk_demo
             VkVertexInputAttributeDescription inputAttribute = {};
             inputAttribute.binding  = 0;
             inputAttribute.location = i;
-            inputAttribute.format   = VertexAttributeToVkFormat(attributes[i]);
+            inputAttribute.format   = options.quantizeVertices ? VertexAttributeToQuantizedVkFormat(attributes[i]) : VertexAttributeToVkFormat(attributes[i]);
             inputAttribute.offset   = offset;
-            offset += VertexAttributeToSize(attributes[i]);
+            offset += options.quantizeVertices ? VertexAttributeToQuantizedSize(attributes[i]) : VertexAttributeToSize(attributes[i]);
             vertexInputAttributs.push_back(inputAttribute);
         }
 
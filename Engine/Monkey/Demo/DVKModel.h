@@ -6,6 +6,8 @@
 #include "DVKBuffer.h"
 #include "DVKIndexBuffer.h"
 #include "DVKVertexBuffer.h"
+#include "DVKMeshOptimizer.h"
+#include "DVKAnimCompression.h"
 
 #include "Common/Common.h"
 #include "Math/Math.h"
@@ -19,6 +21,7 @@
 #include <cstring>
 #include <vector>
 #include <memory>
+#include <initializer_list>
 #include <unordered_map>
 
 struct aiMesh;
@@ -28,6 +31,8 @@ struct aiNode;
 namespace vk_demo
 {
     struct DVKNode;
+    struct DVKModelImport;
+    class DVKCamera;
 
     struct DVKBoundingBox
     {
@@ -63,6 +68,14 @@ namespace vk_demo
         }
     };
 
+    struct DVKPrimitiveLod
+    {
+        uint32  firstIndex = 0;
+        uint32  indexCount = 0;
+        // 模型空间下的几何误差，LOD0为0
+        float   error = 0.0f;
+    };
+
     struct DVKPrimitive
     {
         DVKIndexBuffer*     indexBuffer = nullptr;
@@ -71,7 +84,15 @@ namespace vk_demo
 
         std::vector<float>  vertices;
         std::vector<float>  instanceDatas;
-        std::vector<uint16> indices;
+        std::vector<uint32> indices;
+
+        // GPU端索引格式，顶点数不超过65536时使用16位
+        VkIndexType         indexType = VK_INDEX_TYPE_UINT16;
+
+        // LOD1之后的索引追加在indices之后，和LOD0共用一个IndexBuffer
+        std::vector<uint32>             lodIndices;
+        std::vector<DVKPrimitiveLod>    lods;
+        int32                           lodIndex = 0;
 
         int32               vertexCount = 0;
         int32               triangleNum = 0;
@@ -102,18 +123,71 @@ namespace vk_demo
             vertexBuffer = nullptr;
         }
 
+        // GPU Buffer创建之后释放CPU端的副本，释放后无法再做拾取、网格优化或者写入缓存
+        void ReleaseCPUData()
+        {
+            if (vertexBuffer)
+            {
+                std::vector<float>().swap(vertices);
+            }
+
+            if (instanceBuffer)
+            {
+                std::vector<float>().swap(instanceDatas);
+            }
+
+            if (indexBuffer)
+            {
+                std::vector<uint32>().swap(indices);
+                std::vector<uint32>().swap(lodIndices);
+            }
+        }
+
         void DrawOnly(VkCommandBuffer cmdBuffer)
         {
             if (vertexBuffer && !indexBuffer)
             {
                 vkCmdDraw(cmdBuffer, vertexCount, 1, 0, 0);
             }
+            else if (lods.size() > 0)
+            {
+                vkCmdDrawIndexed(cmdBuffer, lods[lodIndex].indexCount, indexBuffer->instanceCount, lods[lodIndex].firstIndex, 0, 0);
+            }
             else
             {
                 vkCmdDrawIndexed(cmdBuffer, indexBuffer->indexCount, indexBuffer->instanceCount, 0, 0, 0);
             }
         }
 
+        int32 GetLodTriangleNum() const
+        {
+            return lods.size() > 0 ? (int32)lods[lodIndex].indexCount / 3 : triangleNum;
+        }
+
+        // errorScale将模型空间误差换算为像素，选出误差不超过threshold的最粗一级。
+        // 变粗时要求误差低于threshold * (1 - hysteresis)，避免在阈值附近来回切换。
+        int32 SelectLod(float errorScale, float threshold, float hysteresis, int32 currentLod) const
+        {
+            if (lods.size() == 0)
+            {
+                return 0;
+            }
+
+            int32 level = MMath::Clamp(currentLod, 0, (int32)lods.size() - 1);
+            while (level > 0 && lods[level].error * errorScale > threshold)
+            {
+                level -= 1;
+            }
+
+            float coarserThreshold = threshold * (1.0f - hysteresis);
+            while (level + 1 < lods.size() && lods[level + 1].error * errorScale <= coarserThreshold)
+            {
+                level += 1;
+            }
+
+            return level;
+        }
+
         void BindOnly(VkCommandBuffer cmdBuffer)
         {
             if (vertexBuffer)
@@ -153,6 +227,10 @@ namespace vk_demo
             {
                 vkCmdDraw(cmdBuffer, vertexCount, 1, 0, 0);
             }
+            else if (lods.size() > 0)
+            {
+                vkCmdDrawIndexed(cmdBuffer, lods[lodIndex].indexCount, indexBuffer->instanceCount, lods[lodIndex].firstIndex, 0, 0);
+            }
             else
             {
                 vkCmdDrawIndexed(cmdBuffer, indexBuffer->indexCount, indexBuffer->instanceCount, 0, 0, 0);
@@ -240,6 +318,53 @@ namespace vk_demo
         DVKAnimChannel<Vector3>     positions;
         DVKAnimChannel<Vector3>     scales;
         DVKAnimChannel<Quat>        rotations;
+
+        // 压缩之后原始关键帧会被释放
+        DVKCompressedClip           compressed;
+
+        // 插值出time时刻节点的旋转、位移以及缩放
+        void Sample(float time, Quat& outRotation, Vector3& outPosition, Vector3& outScale)
+        {
+            if (compressed.IsValid())
+            {
+                compressed.Sample(time, outRotation, outPosition, outScale);
+                return;
+            }
+
+            float alpha = 0.0f;
+
+            // rotation
+            Quat prevRot(0, 0, 0, 1);
+            Quat nextRot(0, 0, 0, 1);
+            rotations.GetValue(time, prevRot, nextRot, alpha);
+            outRotation = MMath::Lerp(prevRot, nextRot, alpha);
+
+            // position
+            Vector3 prevPos(0, 0, 0);
+            Vector3 nextPos(0, 0, 0);
+            positions.GetValue(time, prevPos, nextPos, alpha);
+            outPosition = MMath::Lerp(prevPos, nextPos, alpha);
+
+            // scale
+            Vector3 prevScale(1, 1, 1);
+            Vector3 nextScale(1, 1, 1);
+            scales.GetValue(time, prevScale, nextScale, alpha);
+            outScale = MMath::Lerp(prevScale, nextScale, alpha);
+        }
+
+        // 插值出time时刻节点的局部矩阵
+        void Evaluate(float time, Matrix4x4& outMatrix)
+        {
+            Quat retRot;
+            Vector3 retPos;
+            Vector3 retScale;
+            Sample(time, retRot, retPos, retScale);
+
+            outMatrix.SetIdentity();
+            outMatrix.AppendScale(retScale);
+            outMatrix.Append(retRot.ToMatrix());
+            outMatrix.AppendTranslation(retPos);
+        }
     };
 
     struct DVKAnimation
@@ -299,6 +424,11 @@ namespace vk_demo
             }
         }
 
+        // 每像素对应的模型空间误差倒数，用于DVKPrimitive::SelectLod
+        float GetLodErrorScale(const Matrix4x4& world, DVKCamera& camera, float viewportHeight);
+
+        void SelectLod(const Matrix4x4& world, DVKCamera& camera, float viewportHeight, float threshold = 1.0f, float hysteresis = 0.25f);
+
         ~DVKMesh()
         {
             for (int i = 0; i < primitives.size(); ++i)
@@ -394,6 +524,39 @@ namespace vk_demo
         }
     };
 
+    struct DVKModelLoadOptions
+    {
+        // 为false时只使用16位索引，顶点数超过65536的Mesh会被切分成多个Primitive
+        bool    use32BitIndices = true;
+
+        // 合并Assimp输出的重复顶点，其余优化都依赖顶点共享
+        bool    weldVertices = true;
+
+        // 重排三角形提高Post-Transform Cache命中率
+        bool    optimizeVertexCache = true;
+
+        // 在不明显降低Cache命中率的前提下重排三角形减少overdraw，threshold为允许的ACMR增长比例
+        bool    optimizeOverdraw = true;
+        float   overdrawThreshold = 1.05f;
+
+        // 按索引的访问顺序重排顶点，提高顶点读取的局部性
+        bool    optimizeVertexFetch = true;
+
+        // 量化顶点数据，管线需要使用DVKModel::GetInputBinding/GetInputAttributes
+        bool    quantizeVertices = false;
+
+        // 统计优化前后的ACMR/ATVR/overdraw，需要原始数据，开启时不读取缓存
+        bool    statistics = false;
+
+        // 使用meshopt_simplify生成LOD链，第一级误差为lodTargetError(相对包围盒大小)，之后每级翻倍
+        bool    generateLods = false;
+        int32   maxLods = 8;
+        float   lodTargetError = 0.005f;
+
+        // 为false时上传GPU之后释放DVKPrimitive中的顶点和索引，需要CPU数据做拾取时保持为true
+        bool    keepCPUData = true;
+    };
+
     class DVKModel
     {
     private:
@@ -421,6 +584,7 @@ namespace vk_demo
             bones.clear();
         }
 
+        // 单个动画直接写入节点，多个角色共享模型时使用DVKSkeleton与DVKSkinInstance
         void Update(float time, float delta);
 
         void SetAnimation(int32 index);
@@ -429,19 +593,48 @@ namespace vk_demo
 
         void GotoAnimation(float time);
 
+        // 压缩所有动画并释放原始关键帧，report不为空时写入误差与内存统计
+        void CompressAnimations(const DVKAnimCompressionSettings& settings = DVKAnimCompressionSettings(), DVKAnimCompressionReport* report = nullptr);
+
+        // 按屏幕空间误差为所有Mesh选择LOD，threshold单位为像素
+        void SelectLods(const Matrix4x4& world, DVKCamera& camera, float viewportHeight, float threshold = 1.0f, float hysteresis = 0.25f);
+
         VkVertexInputBindingDescription GetInputBinding();
 
         std::vector<VkVertexInputAttributeDescription> GetInputAttributes();
 
-        static DVKModel* LoadFromFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes);
+        static DVKModel* LoadFromFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes, const DVKModelLoadOptions& options = DVKModelLoadOptions());
+
+        // 分阶段加载：ImportFile、LoadPendingMeshes、FinishImport不访问Vulkan，可以在工作线程执行，LoadPendingMeshes的不同区间可以并行。
+        // 最后在提交CommandBuffer的线程调用Upload创建GPU资源。LoadFromFile即依次执行这几步。
+        static DVKModel* ImportFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, const std::vector<VertexAttribute>& attributes, const DVKModelLoadOptions& options = DVKModelLoadOptions());
+
+        // 等待处理的Mesh数量，命中缓存或者导入失败时为0
+        int32 GetNumPendingMeshes() const;
+
+        // 处理[begin, end)之间的Mesh：顶点交错、切分Primitive以及优化
+        void LoadPendingMeshes(int32 begin, int32 end);
+
+        // 输出统计、写入缓存并释放Assimp数据，返回是否导入成功
+        bool FinishImport();
+
+        void Upload(DVKCommandBuffer* cmdBuffer);
 
         static DVKModel* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, const std::vector<uint16>& indices, const std::vector<VertexAttribute>& attributes);
 
+        static DVKModel* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, const std::vector<uint32>& indices, const std::vector<VertexAttribute>& attributes);
+
+        // 花括号写出的索引列表按16位处理，避免与上面两个版本产生二义性
+        static DVKModel* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, std::initializer_list<uint16> indices, const std::vector<VertexAttribute>& attributes)
+        {
+            return Create(vulkanDevice, cmdBuffer, vertices, std::vector<uint16>(indices), attributes);
+        }
+
     protected:
 
         DVKNode* LoadNode(const aiNode* node, const aiScene* scene);
 
-        DVKMesh* LoadMesh(const aiMesh* mesh, const aiScene* scene);
+        void LoadMesh(DVKMesh* mesh, const aiMesh* aiMesh, const aiScene* aiScene);
 
         void LoadBones(const aiScene* aiScene);
 
@@ -455,6 +648,14 @@ namespace vk_demo
 
         void LoadAnim(const aiScene* aiScene);
 
+        void CreateBuffers();
+
+        void CreateBuffers(DVKPrimitive* primitive);
+
+        void ReleaseCPUData();
+
+        void OptimizePrimitive(DVKPrimitive* primitive);
+
     public:
         typedef std::unordered_map<std::string, DVKNode*> NodesMap;
         typedef std::unordered_map<std::string, DVKBone*> BonesMap;
@@ -474,10 +675,17 @@ namespace vk_demo
         std::vector<DVKAnimation>       animations;
         int32                           animIndex = -1;
 
+        DVKMeshStatistics               rawStatistics;
+        DVKMeshStatistics               optimizedStatistics;
+
     private:
 
         DVKCommandBuffer*               cmdBuffer = nullptr;
         bool                            loadSkin = false;
+        DVKModelLoadOptions             options;
+
+        // 导入过程中的Assimp数据，FinishImport之后为空
+        std::shared_ptr<DVKModelImport> import;
     };
 
 }
@@ -0,0 +1,338 @@
+﻿#include "DVKModelCache.h"
+#include "DVKCacheIO.h"
+#include "DVKModel.h"
+#include "FileManager.h"
+
+#include "Common/Log.h"
+
+#include <cstdio>
+#include <unordered_map>
+
+namespace vk_demo
+{
+    bool DVKModelCache::enabled = true;
+
+    template <class ValueType>
+    static void WriteChannel(CacheWriter& writer, const DVKAnimChannel<ValueType>& channel)
+    {
+        writer.WriteArray(channel.keys);
+        writer.WriteArray(channel.values);
+    }
+
+    template <class ValueType>
+    static void ReadChannel(CacheReader& reader, DVKAnimChannel<ValueType>& channel)
+    {
+        reader.ReadArray(channel.keys);
+        reader.ReadArray(channel.values);
+    }
+
+    std::string DVKModelCache::GetCachePath(const std::string& filename, uint32 attributesHash)
+    {
+        char hashStr[16];
+        sprintf(hashStr, "%08x", attributesHash);
+        return filename + "." + hashStr + ".meshcache";
+    }
+
+    bool DVKModelCache::Save(DVKModel* model, const std::string& cachePath, uint32 sourceSize, uint32 sourceHash, uint32 attributesHash)
+    {
+        if (!enabled || model->rootNode == nullptr)
+        {
+            return false;
+        }
+
+        // mesh索引
+        std::unordered_map<DVKMesh*, int32> meshIndexMap;
+        for (int32 i = 0; i < model->meshes.size(); ++i)
+        {
+            meshIndexMap.insert(std::make_pair(model->meshes[i], i));
+        }
+
+        // node索引，linearNodes为先序遍历顺序，父节点总是在子节点之前
+        std::unordered_map<DVKNode*, int32> nodeIndexMap;
+        for (int32 i = 0; i < model->linearNodes.size(); ++i)
+        {
+            nodeIndexMap.insert(std::make_pair(model->linearNodes[i], i));
+        }
+
+        CacheWriter writer;
+
+        // meshes
+        writer.Write<uint32>((uint32)model->meshes.size());
+        for (int32 i = 0; i < model->meshes.size(); ++i)
+        {
+            DVKMesh* mesh = model->meshes[i];
+            writer.WriteString(mesh->material.diffuse);
+            writer.WriteString(mesh->material.normalmap);
+            writer.WriteString(mesh->material.specular);
+            writer.Write(mesh->bounding.min);
+            writer.Write(mesh->bounding.max);
+            writer.Write<uint8>(mesh->isSkin ? 1 : 0);
+            writer.WriteArray(mesh->bones);
+
+            writer.Write<uint32>((uint32)mesh->primitives.size());
+            for (int32 j = 0; j < mesh->primitives.size(); ++j)
+            {
+                DVKPrimitive* primitive = mesh->primitives[j];
+                writer.Write<int32>(primitive->vertexCount);
+                writer.Write<uint32>((uint32)primitive->indexType);
+                writer.WriteArray(primitive->vertices);
+                writer.WriteArray(primitive->indices);
+                writer.WriteArray(primitive->lodIndices);
+                writer.WriteArray(primitive->lods);
+            }
+        }
+
+        // nodes
+        writer.Write<uint32>((uint32)model->linearNodes.size());
+        for (int32 i = 0; i < model->linearNodes.size(); ++i)
+        {
+            DVKNode* node = model->linearNodes[i];
+            writer.WriteString(node->name);
+            writer.Write<int32>(node->parent ? nodeIndexMap[node->parent] : -1);
+            writer.Write(node->localMatrix.m);
+
+            std::vector<int32> meshIndices(node->meshes.size());
+            for (int32 j = 0; j < node->meshes.size(); ++j)
+            {
+                meshIndices[j] = meshIndexMap[node->meshes[j]];
+            }
+            writer.WriteArray(meshIndices);
+        }
+
+        // bones
+        writer.Write<uint32>((uint32)model->bones.size());
+        for (int32 i = 0; i < model->bones.size(); ++i)
+        {
+            DVKBone* bone = model->bones[i];
+            writer.WriteString(bone->name);
+            writer.Write<int32>(bone->index);
+            writer.Write<int32>(bone->parent);
+            writer.Write(bone->inverseBindPose.m);
+        }
+
+        // animations
+        writer.Write<uint32>((uint32)model->animations.size());
+        for (int32 i = 0; i < model->animations.size(); ++i)
+        {
+            DVKAnimation& animation = model->animations[i];
+            writer.WriteString(animation.name);
+            writer.Write<float>(animation.duration);
+            writer.Write<float>(animation.speed);
+            writer.Write<uint32>((uint32)animation.clips.size());
+            for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+            {
+                DVKAnimationClip& clip = it->second;
+                writer.WriteString(clip.nodeName);
+                writer.Write<float>(clip.duration);
+                WriteChannel(writer, clip.positions);
+                WriteChannel(writer, clip.scales);
+                WriteChannel(writer, clip.rotations);
+            }
+        }
+
+        Header header;
+        header.sourceSize     = sourceSize;
+        header.sourceHash     = sourceHash;
+        header.attributesHash = attributesHash;
+        header.dataSize       = (uint32)writer.buffer.size();
+
+        std::vector<uint8> fileData(sizeof(Header) + writer.buffer.size());
+        memcpy(fileData.data(), &header, sizeof(Header));
+        memcpy(fileData.data() + sizeof(Header), writer.buffer.data(), writer.buffer.size());
+
+        return FileManager::WriteFile(cachePath, fileData.data(), (uint32)fileData.size());
+    }
+
+    bool DVKModelCache::Load(DVKModel* model, const std::string& cachePath, uint32 sourceSize, uint32 sourceHash, uint32 attributesHash)
+    {
+        if (!enabled)
+        {
+            return false;
+        }
+
+        if (!FileManager::FileExists(cachePath))
+        {
+            return false;
+        }
+
+        FileMappingRef mapping = FileManager::MapFile(cachePath);
+        if (!mapping || mapping->GetSize() < sizeof(Header))
+        {
+            return false;
+        }
+
+        Header header;
+        memcpy(&header, mapping->GetData(), sizeof(Header));
+        if (header.magic != Magic || header.version != Version || header.sourceSize != sourceSize || header.sourceHash != sourceHash || header.attributesHash != attributesHash)
+        {
+            MLOG("Mesh cache out of date : %s", cachePath.c_str());
+            return false;
+        }
+
+        if (header.dataSize != mapping->GetSize() - sizeof(Header))
+        {
+            MLOGE("Mesh cache corrupted : %s", cachePath.c_str());
+            return false;
+        }
+
+        mapping->Prefetch();
+
+        CacheReader reader(mapping->GetData() + sizeof(Header), header.dataSize);
+
+        std::vector<DVKMesh*> meshes;
+        std::vector<DVKNode*> nodes;
+        std::vector<DVKBone*> bones;
+        std::vector<DVKAnimation> animations;
+
+        // meshes
+        uint32 meshCount = reader.Read<uint32>();
+        for (uint32 i = 0; i < meshCount && !reader.failed; ++i)
+        {
+            DVKMesh* mesh = new DVKMesh();
+            meshes.push_back(mesh);
+
+            reader.ReadString(mesh->material.diffuse);
+            reader.ReadString(mesh->material.normalmap);
+            reader.ReadString(mesh->material.specular);
+            mesh->bounding.min = reader.Read<Vector3>();
+            mesh->bounding.max = reader.Read<Vector3>();
+            mesh->bounding.UpdateCorners();
+            mesh->isSkin = reader.Read<uint8>() != 0;
+            reader.ReadArray(mesh->bones);
+
+            uint32 primitiveCount = reader.Read<uint32>();
+            for (uint32 j = 0; j < primitiveCount && !reader.failed; ++j)
+            {
+                DVKPrimitive* primitive = new DVKPrimitive();
+                mesh->primitives.push_back(primitive);
+
+                primitive->vertexCount = reader.Read<int32>();
+                primitive->indexType   = (VkIndexType)reader.Read<uint32>();
+                reader.ReadArray(primitive->vertices);
+                reader.ReadArray(primitive->indices);
+                reader.ReadArray(primitive->lodIndices);
+                reader.ReadArray(primitive->lods);
+                primitive->triangleNum = (int32)primitive->indices.size() / 3;
+
+                mesh->vertexCount   += primitive->vertexCount;
+                mesh->triangleCount += primitive->triangleNum;
+            }
+        }
+
+        // nodes
+        uint32 nodeCount = reader.Read<uint32>();
+        for (uint32 i = 0; i < nodeCount && !reader.failed; ++i)
+        {
+            DVKNode* node = new DVKNode();
+            reader.ReadString(node->name);
+            int32 parentIndex = reader.Read<int32>();
+            reader.ReadBytes(node->localMatrix.m, sizeof(node->localMatrix.m));
+
+            std::vector<int32> meshIndices;
+            reader.ReadArray(meshIndices);
+
+            if (parentIndex >= (int32)nodes.size() || (parentIndex < 0 && i != 0))
+            {
+                delete node;
+                reader.failed = true;
+                break;
+            }
+
+            if (parentIndex >= 0)
+            {
+                node->parent = nodes[parentIndex];
+                node->parent->children.push_back(node);
+            }
+            nodes.push_back(node);
+
+            for (int32 j = 0; j < meshIndices.size(); ++j)
+            {
+                if (meshIndices[j] < 0 || meshIndices[j] >= (int32)meshes.size())
+                {
+                    reader.failed = true;
+                    break;
+                }
+                DVKMesh* mesh  = meshes[meshIndices[j]];
+                mesh->linkNode = node;
+                node->meshes.push_back(mesh);
+            }
+        }
+
+        // bones
+        uint32 boneCount = reader.Read<uint32>();
+        for (uint32 i = 0; i < boneCount && !reader.failed; ++i)
+        {
+            DVKBone* bone = new DVKBone();
+            reader.ReadString(bone->name);
+            bone->index  = reader.Read<int32>();
+            bone->parent = reader.Read<int32>();
+            reader.ReadBytes(bone->inverseBindPose.m, sizeof(bone->inverseBindPose.m));
+            bones.push_back(bone);
+        }
+
+        // animations
+        uint32 animCount = reader.Read<uint32>();
+        for (uint32 i = 0; i < animCount && !reader.failed; ++i)
+        {
+            animations.push_back(DVKAnimation());
+            DVKAnimation& animation = animations.back();
+            reader.ReadString(animation.name);
+            animation.duration = reader.Read<float>();
+            animation.speed    = reader.Read<float>();
+
+            uint32 clipCount = reader.Read<uint32>();
+            for (uint32 j = 0; j < clipCount && !reader.failed; ++j)
+            {
+                DVKAnimationClip clip;
+                reader.ReadString(clip.nodeName);
+                clip.duration = reader.Read<float>();
+                ReadChannel(reader, clip.positions);
+                ReadChannel(reader, clip.scales);
+                ReadChannel(reader, clip.rotations);
+                animation.clips.insert(std::make_pair(clip.nodeName, clip));
+            }
+        }
+
+        // 任何一步失败都丢弃，回退到Assimp导入
+        if (reader.failed || nodes.size() == 0)
+        {
+            MLOGE("Mesh cache corrupted : %s", cachePath.c_str());
+            if (nodes.size() > 0)
+            {
+                // 根节点析构时会释放整棵树以及挂接的mesh
+                delete nodes[0];
+            }
+            for (int32 i = 0; i < meshes.size(); ++i)
+            {
+                if (meshes[i]->linkNode == nullptr)
+                {
+                    delete meshes[i];
+                }
+            }
+            for (int32 i = 0; i < bones.size(); ++i)
+            {
+                delete bones[i];
+            }
+            return false;
+        }
+
+        model->rootNode    = nodes[0];
+        model->linearNodes = nodes;
+        model->meshes      = meshes;
+        model->bones       = bones;
+        model->animations  = animations;
+
+        for (int32 i = 0; i < nodes.size(); ++i)
+        {
+            model->nodesMap.insert(std::make_pair(nodes[i]->name, nodes[i]));
+        }
+
+        for (int32 i = 0; i < bones.size(); ++i)
+        {
+            model->bonesMap.insert(std::make_pair(bones[i]->name, bones[i]));
+        }
+
+        return true;
+    }
+
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include <string>
+#include <vector>
+
+namespace vk_demo
+{
+    class DVKModel;
+
+    // 预处理好的模型二进制格式，跳过Assimp导入、顶点交错、Primitive切分等步骤。
+    // 缓存以源文件内容Hash和顶点属性Hash作为Key，任一变化都会重新生成。
+    class DVKModelCache
+    {
+    public:
+        static const uint32 Magic   = 0x4D4B5644; // 'DVKM'
+        static const uint32 Version = 3;
+
+        struct Header
+        {
+            uint32  magic = Magic;
+            uint32  version = Version;
+            uint32  sourceSize = 0;
+            uint32  sourceHash = 0;
+            uint32  attributesHash = 0;
+            uint32  dataSize = 0;
+        };
+
+        static std::string GetCachePath(const std::string& filename, uint32 attributesHash);
+
+        static bool Load(DVKModel* model, const std::string& cachePath, uint32 sourceSize, uint32 sourceHash, uint32 attributesHash);
+
+        static bool Save(DVKModel* model, const std::string& cachePath, uint32 sourceSize, uint32 sourceHash, uint32 attributesHash);
+
+        static bool enabled;
+    };
+
+}
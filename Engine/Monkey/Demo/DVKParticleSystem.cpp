@@ -0,0 +1,195 @@
+﻿#include "DVKParticleSystem.h"
+
+#include "Common/Log.h"
+#include "Math/Math.h"
+#include "Utils/Alignment.h"
+
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    #include <emmintrin.h>
+    #define DVK_PARTICLE_SSE 1
+#else
+    #define DVK_PARTICLE_SSE 0
+#endif
+
+namespace vk_demo
+{
+
+    // 积分[begin, end)范围内的粒子，写出存活标记并返回存活数量
+    static int32 IntegrateParticles(DVKParticleStreams& streams, uint8* aliveMasks, int32 begin, int32 end, float delta)
+    {
+        float* positionX = streams.positionX.data();
+        float* positionY = streams.positionY.data();
+        float* positionZ = streams.positionZ.data();
+        float* velocityX = streams.velocityX.data();
+        float* velocityY = streams.velocityY.data();
+        float* velocityZ = streams.velocityZ.data();
+        float* gravity   = streams.gravity.data();
+        float* age       = streams.age.data();
+        float* lifeTime  = streams.lifeTime.data();
+
+        int32 alive = 0;
+        int32 index = begin;
+
+#if DVK_PARTICLE_SSE
+        __m128 dt = _mm_set1_ps(delta);
+
+        for (; index + 4 <= end; index += 4)
+        {
+            __m128 vx = _mm_loadu_ps(velocityX + index);
+            __m128 vy = _mm_loadu_ps(velocityY + index);
+            __m128 vz = _mm_loadu_ps(velocityZ + index);
+
+            vy = _mm_add_ps(vy, _mm_mul_ps(_mm_loadu_ps(gravity + index), dt));
+
+            _mm_storeu_ps(positionX + index, _mm_add_ps(_mm_loadu_ps(positionX + index), _mm_mul_ps(vx, dt)));
+            _mm_storeu_ps(positionY + index, _mm_add_ps(_mm_loadu_ps(positionY + index), _mm_mul_ps(vy, dt)));
+            _mm_storeu_ps(positionZ + index, _mm_add_ps(_mm_loadu_ps(positionZ + index), _mm_mul_ps(vz, dt)));
+            _mm_storeu_ps(velocityY + index, vy);
+
+            __m128 t = _mm_add_ps(_mm_loadu_ps(age + index), dt);
+            _mm_storeu_ps(age + index, t);
+
+            int32 mask = _mm_movemask_ps(_mm_cmplt_ps(t, _mm_loadu_ps(lifeTime + index)));
+            aliveMasks[index + 0] = (mask >> 0) & 1;
+            aliveMasks[index + 1] = (mask >> 1) & 1;
+            aliveMasks[index + 2] = (mask >> 2) & 1;
+            aliveMasks[index + 3] = (mask >> 3) & 1;
+            alive += aliveMasks[index + 0] + aliveMasks[index + 1] + aliveMasks[index + 2] + aliveMasks[index + 3];
+        }
+#endif
+
+        for (; index < end; ++index)
+        {
+            velocityY[index] += gravity[index] * delta;
+            positionX[index] += velocityX[index] * delta;
+            positionY[index] += velocityY[index] * delta;
+            positionZ[index] += velocityZ[index] * delta;
+            age[index]       += delta;
+
+            aliveMasks[index] = age[index] < lifeTime[index] ? 1 : 0;
+            alive += aliveMasks[index];
+        }
+
+        return alive;
+    }
+
+    // 把[begin, end)中存活的粒子依次拷贝到dst的offset处
+    static void CompactParticles(const DVKParticleStreams& src, DVKParticleStreams& dst, const uint8* aliveMasks, int32 begin, int32 end, int32 offset, DVKParticleInstance* outInstances)
+    {
+        for (int32 index = begin; index < end; ++index)
+        {
+            if (aliveMasks[index] == 0)
+            {
+                continue;
+            }
+
+            dst.positionX[offset] = src.positionX[index];
+            dst.positionY[offset] = src.positionY[index];
+            dst.positionZ[offset] = src.positionZ[index];
+            dst.velocityX[offset] = src.velocityX[index];
+            dst.velocityY[offset] = src.velocityY[index];
+            dst.velocityZ[offset] = src.velocityZ[index];
+            dst.gravity[offset]   = src.gravity[index];
+            dst.age[offset]       = src.age[index];
+            dst.lifeTime[offset]  = src.lifeTime[index];
+            dst.color[offset]     = src.color[index];
+
+            if (outInstances)
+            {
+                DVKParticleInstance& instance = outInstances[offset];
+                instance.x    = src.positionX[index];
+                instance.y    = src.positionY[index];
+                instance.z    = src.positionZ[index];
+                instance.data = src.color[index] + MMath::Min(src.age[index] / src.lifeTime[index], 0.999f);
+            }
+
+            offset += 1;
+        }
+    }
+
+    void DVKParticleStreams::Resize(int32 size)
+    {
+        positionX.resize(size);
+        positionY.resize(size);
+        positionZ.resize(size);
+        velocityX.resize(size);
+        velocityY.resize(size);
+        velocityZ.resize(size);
+        gravity.resize(size);
+        age.resize(size);
+        lifeTime.resize(size);
+        color.resize(size);
+    }
+
+    DVKParticleSystem::~DVKParticleSystem()
+    {
+
+    }
+
+    DVKParticleSystem* DVKParticleSystem::Create(int32 capacity)
+    {
+        if (capacity <= 0)
+        {
+            MLOGE("ParticleSystem capacity must be greater than zero : %d", capacity);
+            return nullptr;
+        }
+
+        DVKParticleSystem* particleSystem = new DVKParticleSystem();
+        particleSystem->capacity = capacity;
+        particleSystem->particles.Resize(capacity);
+        particleSystem->compacted.Resize(capacity);
+        particleSystem->aliveMasks.resize(capacity);
+
+        return particleSystem;
+    }
+
+    int32 DVKParticleSystem::Spawn(int32 count)
+    {
+        count = MMath::Clamp(count, 0, capacity - numParticles);
+        numParticles += count;
+        return count;
+    }
+
+    void DVKParticleSystem::Simulate(float delta, DVKJobSystem* jobSystem, DVKParticleInstance* outInstances)
+    {
+        if (numParticles == 0)
+        {
+            return;
+        }
+
+        // chunk为4的倍数，保证每个chunk的SIMD部分对齐到同样的位置
+        int32 batchSize = Align(MMath::Max(chunkSize, 4), 4);
+        int32 numChunks = (numParticles + batchSize - 1) / batchSize;
+        chunkOffsets.resize(numChunks + 1);
+
+        jobSystem->ParallelFor(
+            numParticles,
+            batchSize,
+            [&](int32 begin, int32 end, int32 threadIndex)
+            {
+                chunkOffsets[begin / batchSize + 1] = IntegrateParticles(particles, aliveMasks.data(), begin, end, delta);
+            }
+        );
+
+        chunkOffsets[0] = 0;
+        for (int32 i = 1; i <= numChunks; ++i)
+        {
+            chunkOffsets[i] += chunkOffsets[i - 1];
+        }
+
+        jobSystem->ParallelFor(
+            numParticles,
+            batchSize,
+            [&](int32 begin, int32 end, int32 threadIndex)
+            {
+                CompactParticles(particles, compacted, aliveMasks.data(), begin, end, chunkOffsets[begin / batchSize], outInstances);
+            }
+        );
+
+        std::swap(particles, compacted);
+        numParticles = chunkOffsets[numChunks];
+    }
+
+}
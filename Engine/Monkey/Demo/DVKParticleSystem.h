@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include "DVKJobSystem.h"
+
+#include "Common/Common.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+    // 每个粒子的实例数据，朝向相机的面片在VertexShader中展开。
+    // data的整数部分为颜色索引，小数部分为生命进度[0, 1)。
+    struct DVKParticleInstance
+    {
+        float   x;
+        float   y;
+        float   z;
+        float   data;
+    };
+
+    // SoA存储，每个属性一个连续数组，方便SIMD一次处理4个粒子
+    struct DVKParticleStreams
+    {
+        std::vector<float>  positionX;
+        std::vector<float>  positionY;
+        std::vector<float>  positionZ;
+        std::vector<float>  velocityX;
+        std::vector<float>  velocityY;
+        std::vector<float>  velocityZ;
+        std::vector<float>  gravity;
+        std::vector<float>  age;
+        std::vector<float>  lifeTime;
+        std::vector<float>  color;
+
+        void Resize(int32 size);
+    };
+
+    // CPU粒子模拟：SIMD积分位置、速度、重力以及生命周期，死亡的粒子在同一遍中被压缩掉。
+    // 模拟与实例数据的写出按chunk切分后在DVKJobSystem上并行执行。
+    class DVKParticleSystem
+    {
+    private:
+        DVKParticleSystem()
+        {
+
+        }
+
+    public:
+        ~DVKParticleSystem();
+
+        static DVKParticleSystem* Create(int32 capacity);
+
+        // 在末尾分配count个粒子，返回实际分配的数量，起始下标为调用前的numParticles。
+        // 新粒子的属性由调用者直接写入particles。
+        int32 Spawn(int32 count);
+
+        // outInstances不为空时写出存活粒子的实例数据，数量为模拟后的numParticles
+        void Simulate(float delta, DVKJobSystem* jobSystem, DVKParticleInstance* outInstances);
+
+    public:
+
+        int32               capacity = 0;
+        int32               numParticles = 0;
+        int32               chunkSize = 16 * 1024;
+
+        DVKParticleStreams  particles;
+
+    private:
+
+        DVKParticleStreams  compacted;
+        std::vector<uint8>  aliveMasks;
+        std::vector<int32>  chunkOffsets;
+    };
+
+}
@@ -1,6 +1,8 @@
 ﻿#include "DVKShader.h"
+#include "DVKLayoutCache.h"
 #include "DVKVertexBuffer.h"
-#include "spirv_cross.hpp"
+
+#include <algorithm>
 
 namespace vk_demo
 {
@@ -8,28 +10,22 @@ namespace vk_demo
     {
         VkDevice device = vulkanDevice->GetInstanceHandle();
 
-        uint8* dataPtr  = nullptr;
-        uint32 dataSize = 0;
-        if (!FileManager::ReadFile(filename, dataPtr, dataSize))
+        // 相同内容的模块只创建和反射一次
+        DVKShaderBinaryRef binary = DVKShaderCache::Acquire(device, filename);
+        if (!binary)
         {
-            MLOGE("Failed load file:%s", filename);
             return nullptr;
         }
 
-        VkShaderModuleCreateInfo moduleCreateInfo;
-        ZeroVulkanStruct(moduleCreateInfo, VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO);
-        moduleCreateInfo.codeSize = dataSize;
-        moduleCreateInfo.pCode    = (uint32_t*)dataPtr;
-
-        VkShaderModule shaderModule = VK_NULL_HANDLE;
-        VERIFYVULKANRESULT(vkCreateShaderModule(device, &moduleCreateInfo, VULKAN_CPU_ALLOCATOR, &shaderModule));
-
         DVKShaderModule* dvkModule = new DVKShaderModule();
-        dvkModule->data   = dataPtr;
-        dvkModule->size   = dataSize;
-        dvkModule->device = device;
-        dvkModule->handle = shaderModule;
-        dvkModule->stage  = stage;
+        dvkModule->data       = binary->mapping->GetData();
+        dvkModule->size       = binary->mapping->GetSize();
+        dvkModule->mapping    = binary->mapping;
+        dvkModule->device     = device;
+        dvkModule->handle     = binary->handle;
+        dvkModule->stage      = stage;
+        dvkModule->reflection = &(binary->reflection);
+        dvkModule->binary     = binary;
 
         return dvkModule;
     }
@@ -69,130 +65,110 @@ namespace vk_demo
         return Create(vulkanDevice, false, vert, frag, geom, comp, tesc, tese);
     }
 
-    void DVKShader::ProcessAttachments(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkPipelineStageFlags stageFlags)
+    void DVKShader::ProcessAttachments(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags)
     {
         // 获取attachment信息
-        for (int32 i = 0; i < resources.subpass_inputs.size(); ++i)
-        {
-            spirv_cross::Resource& res      = resources.subpass_inputs[i];
-            spirv_cross::SPIRType type      = compiler.get_type(res.type_id);
-            spirv_cross::SPIRType base_type = compiler.get_type(res.base_type_id);
-            const std::string &varName      = compiler.get_name(res.id);
+        const std::string& varName = resource.name;
 
-            int32 set     = compiler.get_decoration(res.id, spv::DecorationDescriptorSet);
-            int32 binding = compiler.get_decoration(res.id, spv::DecorationBinding);
+        int32 set     = resource.set;
+        int32 binding = resource.binding;
 
-            VkDescriptorSetLayoutBinding setLayoutBinding = {};
-            setLayoutBinding.binding             = binding;
-            setLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-            setLayoutBinding.descriptorCount    = 1;
-            setLayoutBinding.stageFlags         = stageFlags;
-            setLayoutBinding.pImmutableSamplers = nullptr;
+        VkDescriptorSetLayoutBinding setLayoutBinding = {};
+        setLayoutBinding.binding             = binding;
+        setLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        setLayoutBinding.descriptorCount    = 1;
+        setLayoutBinding.stageFlags         = stageFlags;
+        setLayoutBinding.pImmutableSamplers = nullptr;
 
-            setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
-
-            auto it = imageParams.find(varName);
-            if (it == imageParams.end())
-            {
-                ImageInfo imageInfo = {};
-                imageInfo.set            = set;
-                imageInfo.binding        = binding;
-                imageInfo.stageFlags     = stageFlags;
-                imageInfo.descriptorType = setLayoutBinding.descriptorType;
-                imageParams.insert(std::make_pair(varName, imageInfo));
-            }
-            else
-            {
-                it->second.stageFlags |= stageFlags;
-            }
+        setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
 
+        auto it = imageParams.find(varName);
+        if (it == imageParams.end())
+        {
+            ImageInfo imageInfo = {};
+            imageInfo.set            = set;
+            imageInfo.binding        = binding;
+            imageInfo.stageFlags     = stageFlags;
+            imageInfo.descriptorType = setLayoutBinding.descriptorType;
+            imageParams.insert(std::make_pair(varName, imageInfo));
+        }
+        else
+        {
+            it->second.stageFlags |= stageFlags;
         }
     }
 
-    void DVKShader::ProcessUniformBuffers(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags)
+    void DVKShader::ProcessUniformBuffers(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags)
     {
         // 获取Uniform Buffer信息
-        for (int32 i = 0; i < resources.uniform_buffers.size(); ++i)
+        const std::string& varName     = resource.name;
+        uint32 uniformBufferStructSize = resource.blockSize;
+
+        int32 set     = resource.set;
+        int32 binding = resource.binding;
+
+        // [layout (binding = 0) uniform MVPDynamicBlock] 标记为Dynamic的buffer
+        VkDescriptorSetLayoutBinding setLayoutBinding = {};
+        setLayoutBinding.binding             = binding;
+        setLayoutBinding.descriptorType     = (resource.dynamic || dynamicUBO) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        setLayoutBinding.descriptorCount    = 1;
+        setLayoutBinding.stageFlags         = stageFlags;
+        setLayoutBinding.pImmutableSamplers = nullptr;
+
+        setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
+
+        // 保存UBO变量信息
+        auto it = bufferParams.find(varName);
+        if (it == bufferParams.end())
         {
-            spirv_cross::Resource& res      = resources.uniform_buffers[i];
-            spirv_cross::SPIRType type      = compiler.get_type(res.type_id);
-            spirv_cross::SPIRType base_type = compiler.get_type(res.base_type_id);
-            const std::string &varName      = compiler.get_name(res.id);
-            const std::string &typeName     = compiler.get_name(res.base_type_id);
-            uint32 uniformBufferStructSize  = (uint32)compiler.get_declared_struct_size(type);
-
-            int32 set     = compiler.get_decoration(res.id, spv::DecorationDescriptorSet);
-            int32 binding = compiler.get_decoration(res.id, spv::DecorationBinding);
-
-            // [layout (binding = 0) uniform MVPDynamicBlock] 标记为Dynamic的buffer
-            VkDescriptorSetLayoutBinding setLayoutBinding = {};
-            setLayoutBinding.binding             = binding;
-            setLayoutBinding.descriptorType     = (typeName.find("Dynamic") != std::string::npos || dynamicUBO) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            setLayoutBinding.descriptorCount    = 1;
-            setLayoutBinding.stageFlags         = stageFlags;
-            setLayoutBinding.pImmutableSamplers = nullptr;
-
-            setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
-
-            // 保存UBO变量信息
-            auto it = bufferParams.find(varName);
-            if (it == bufferParams.end())
-            {
-                BufferInfo bufferInfo = {};
-                bufferInfo.set            = set;
-                bufferInfo.binding        = binding;
-                bufferInfo.bufferSize     = uniformBufferStructSize;
-                bufferInfo.stageFlags     = stageFlags;
-                bufferInfo.descriptorType = setLayoutBinding.descriptorType;
-                bufferParams.insert(std::make_pair(varName, bufferInfo));
-            }
-            else
-            {
-                it->second.stageFlags |= setLayoutBinding.stageFlags;
-            }
+            BufferInfo bufferInfo = {};
+            bufferInfo.set            = set;
+            bufferInfo.binding        = binding;
+            bufferInfo.bufferSize     = uniformBufferStructSize;
+            bufferInfo.stageFlags     = stageFlags;
+            bufferInfo.descriptorType = setLayoutBinding.descriptorType;
+            bufferParams.insert(std::make_pair(varName, bufferInfo));
+        }
+        else
+        {
+            it->second.stageFlags |= setLayoutBinding.stageFlags;
         }
     }
 
-    void DVKShader::ProcessTextures(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags)
+    void DVKShader::ProcessTextures(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags)
     {
         // 获取Texture
-        for (int32 i = 0; i < resources.sampled_images.size(); ++i)
-        {
-            spirv_cross::Resource& res      = resources.sampled_images[i];
-            spirv_cross::SPIRType type      = compiler.get_type(res.type_id);
-            spirv_cross::SPIRType base_type = compiler.get_type(res.base_type_id);
-            const std::string&      varName = compiler.get_name(res.id);
+        const std::string& varName = resource.name;
 
-            int32 set     = compiler.get_decoration(res.id, spv::DecorationDescriptorSet);
-            int32 binding = compiler.get_decoration(res.id, spv::DecorationBinding);
+        int32 set     = resource.set;
+        int32 binding = resource.binding;
 
-            VkDescriptorSetLayoutBinding setLayoutBinding = {};
-            setLayoutBinding.binding             = binding;
-            setLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            setLayoutBinding.descriptorCount    = 1;
-            setLayoutBinding.stageFlags         = stageFlags;
-            setLayoutBinding.pImmutableSamplers = nullptr;
+        VkDescriptorSetLayoutBinding setLayoutBinding = {};
+        setLayoutBinding.binding             = binding;
+        setLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        setLayoutBinding.descriptorCount    = 1;
+        setLayoutBinding.stageFlags         = stageFlags;
+        setLayoutBinding.pImmutableSamplers = nullptr;
 
-            setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
+        setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
 
-            auto it = imageParams.find(varName);
-            if (it == imageParams.end())
-            {
-                ImageInfo imageInfo = {};
-                imageInfo.set            = set;
-                imageInfo.binding        = binding;
-                imageInfo.stageFlags     = stageFlags;
-                imageInfo.descriptorType = setLayoutBinding.descriptorType;
-                imageParams.insert(std::make_pair(varName, imageInfo));
-            }
-            else
-            {
-                it->second.stageFlags |= stageFlags;
-            }
+        auto it = imageParams.find(varName);
+        if (it == imageParams.end())
+        {
+            ImageInfo imageInfo = {};
+            imageInfo.set            = set;
+            imageInfo.binding        = binding;
+            imageInfo.stageFlags     = stageFlags;
+            imageInfo.descriptorType = setLayoutBinding.descriptorType;
+            imageParams.insert(std::make_pair(varName, imageInfo));
+        }
+        else
+        {
+            it->second.stageFlags |= stageFlags;
         }
     }
 
-    void DVKShader::ProcessInput(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags)
+    void DVKShader::ProcessInput(const DVKShaderReflection& reflection, VkShaderStageFlags stageFlags)
     {
         if (stageFlags != VK_SHADER_STAGE_VERTEX_BIT)
         {
@@ -200,12 +176,11 @@ namespace vk_demo
         }
 
         // 获取input信息
-        for (int32 i = 0; i < resources.stage_inputs.size(); ++i)
+        for (int32 i = 0; i < reflection.inputs.size(); ++i)
         {
-            spirv_cross::Resource& res = resources.stage_inputs[i];
-            spirv_cross::SPIRType type = compiler.get_type(res.type_id);
-            const std::string &varName = compiler.get_name(res.id);
-            int32 inputAttributeSize   = type.vecsize;
+            const DVKShaderReflection::Input& input = reflection.inputs[i];
+            const std::string& varName = input.name;
+            int32 inputAttributeSize   = input.vecSize;
 
             VertexAttribute attribute  = StringToVertexAttribute(varName.c_str());
             if (attribute == VertexAttribute::VA_None)
@@ -230,7 +205,7 @@ namespace vk_demo
             }
 
             // location必须连续
-            int32 location = compiler.get_decoration(res.id, spv::DecorationLocation);
+            int32 location = input.location;
             DVKAttribute dvkAttribute = {};
             dvkAttribute.location  = location;
             dvkAttribute.attribute = attribute;
@@ -238,82 +213,99 @@ namespace vk_demo
         }
     }
 
-    void DVKShader::ProcessStorageBuffers(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags)
+    void DVKShader::ProcessStorageBuffers(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags)
     {
-        for (int32 i = 0; i < resources.storage_buffers.size(); ++i)
+        const std::string& varName = resource.name;
+
+        int32 set     = resource.set;
+        int32 binding = resource.binding;
+
+        VkDescriptorSetLayoutBinding setLayoutBinding = {};
+        setLayoutBinding.binding            = binding;
+        setLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        setLayoutBinding.descriptorCount    = 1;
+        setLayoutBinding.stageFlags         = stageFlags;
+        setLayoutBinding.pImmutableSamplers = nullptr;
+
+        setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
+
+        // 保存UBO变量信息
+        auto it = bufferParams.find(varName);
+        if (it == bufferParams.end())
         {
-            spirv_cross::Resource& res      = resources.storage_buffers[i];
-            spirv_cross::SPIRType type      = compiler.get_type(res.type_id);
-            spirv_cross::SPIRType base_type = compiler.get_type(res.base_type_id);
-            const std::string &varName      = compiler.get_name(res.id);
-
-            int32 set     = compiler.get_decoration(res.id, spv::DecorationDescriptorSet);
-            int32 binding = compiler.get_decoration(res.id, spv::DecorationBinding);
-
-            VkDescriptorSetLayoutBinding setLayoutBinding = {};
-            setLayoutBinding.binding            = binding;
-            setLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            setLayoutBinding.descriptorCount    = 1;
-            setLayoutBinding.stageFlags         = stageFlags;
-            setLayoutBinding.pImmutableSamplers = nullptr;
-
-            setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
-
-            // 保存UBO变量信息
-            auto it = bufferParams.find(varName);
-            if (it == bufferParams.end())
-            {
-                BufferInfo bufferInfo = {};
-                bufferInfo.set            = set;
-                bufferInfo.binding        = binding;
-                bufferInfo.bufferSize     = 0;
-                bufferInfo.stageFlags     = stageFlags;
-                bufferInfo.descriptorType = setLayoutBinding.descriptorType;
-                bufferParams.insert(std::make_pair(varName, bufferInfo));
-            }
-            else
-            {
-                it->second.stageFlags = it->second.stageFlags | setLayoutBinding.stageFlags;
-            }
+            BufferInfo bufferInfo = {};
+            bufferInfo.set            = set;
+            bufferInfo.binding        = binding;
+            bufferInfo.bufferSize     = 0;
+            bufferInfo.stageFlags     = stageFlags;
+            bufferInfo.descriptorType = setLayoutBinding.descriptorType;
+            bufferParams.insert(std::make_pair(varName, bufferInfo));
+        }
+        else
+        {
+            it->second.stageFlags = it->second.stageFlags | setLayoutBinding.stageFlags;
         }
     }
 
-    void DVKShader::ProcessStorageImages(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags)
+    void DVKShader::ProcessStorageImages(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags)
     {
-        for (int32 i = 0; i < resources.storage_images.size(); ++i)
-        {
-            spirv_cross::Resource& res      = resources.storage_images[i];
-            spirv_cross::SPIRType type      = compiler.get_type(res.type_id);
-            spirv_cross::SPIRType base_type = compiler.get_type(res.base_type_id);
-            const std::string&      varName = compiler.get_name(res.id);
+        const std::string& varName = resource.name;
 
-            int32 set     = compiler.get_decoration(res.id, spv::DecorationDescriptorSet);
-            int32 binding = compiler.get_decoration(res.id, spv::DecorationBinding);
+        int32 set     = resource.set;
+        int32 binding = resource.binding;
 
-            VkDescriptorSetLayoutBinding setLayoutBinding = {};
-            setLayoutBinding.binding             = binding;
-            setLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            setLayoutBinding.descriptorCount    = 1;
-            setLayoutBinding.stageFlags         = stageFlags;
-            setLayoutBinding.pImmutableSamplers = nullptr;
+        VkDescriptorSetLayoutBinding setLayoutBinding = {};
+        setLayoutBinding.binding             = binding;
+        setLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        setLayoutBinding.descriptorCount    = 1;
+        setLayoutBinding.stageFlags         = stageFlags;
+        setLayoutBinding.pImmutableSamplers = nullptr;
 
-            setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
+        setLayoutsInfo.AddDescriptorSetLayoutBinding(varName, set, setLayoutBinding);
 
-            auto it = imageParams.find(varName);
-            if (it == imageParams.end())
+        auto it = imageParams.find(varName);
+        if (it == imageParams.end())
+        {
+            ImageInfo imageInfo = {};
+            imageInfo.set            = set;
+            imageInfo.binding        = binding;
+            imageInfo.stageFlags     = stageFlags;
+            imageInfo.descriptorType = setLayoutBinding.descriptorType;
+            imageParams.insert(std::make_pair(varName, imageInfo));
+        }
+        else
+        {
+            it->second.stageFlags |= stageFlags;
+        }
+    }
+
+    void DVKShader::ProcessPushConstants(const DVKShaderReflection& reflection, VkShaderStageFlags stageFlags)
+    {
+        // 多个Stage声明了相同范围的push constant时合并stageFlags
+        for (int32 i = 0; i < reflection.pushConstants.size(); ++i)
+        {
+            const DVKShaderReflection::PushConstant& pushConstant = reflection.pushConstants[i];
+
+            bool found = false;
+            for (int32 j = 0; j < pushConstantRanges.size(); ++j)
             {
-                ImageInfo imageInfo = {};
-                imageInfo.set            = set;
-                imageInfo.binding        = binding;
-                imageInfo.stageFlags     = stageFlags;
-                imageInfo.descriptorType = setLayoutBinding.descriptorType;
-                imageParams.insert(std::make_pair(varName, imageInfo));
+                VkPushConstantRange& range = pushConstantRanges[j];
+                if (range.offset == pushConstant.offset && range.size == pushConstant.size)
+                {
+                    range.stageFlags |= stageFlags;
+                    found = true;
+                    break;
+                }
             }
-            else
+
+            if (!found)
             {
-                it->second.stageFlags |= stageFlags;
+                VkPushConstantRange range = {};
+                range.stageFlags = stageFlags;
+                range.offset     = pushConstant.offset;
+                range.size       = pushConstant.size;
+                pushConstantRanges.push_back(range);
             }
-
         }
     }
 
@@ -332,16 +324,57 @@ namespace vk_demo
         shaderCreateInfo.pName  = "main";
         shaderStageCreateInfos.push_back(shaderCreateInfo);
 
-        // 反编译Shader获取相关信息
-        spirv_cross::Compiler compiler((uint32*)shaderModule->data, shaderModule->size / sizeof(uint32));
-        spirv_cross::ShaderResources resources = compiler.get_shader_resources();
+        // 反射信息来自.reflect缓存或者加载时的SPIRV-Cross，按类型分别处理以保持原有的顺序
+        const DVKShaderReflection& reflection = *(shaderModule->reflection);
+        VkShaderStageFlags stageFlags = shaderModule->stage;
+
+        static const uint32 resourceOrder[] = {
+            DVKShaderReflection::RT_Attachment,
+            DVKShaderReflection::RT_UniformBuffer,
+            DVKShaderReflection::RT_Texture,
+            DVKShaderReflection::RT_StorageImage,
+        };
+
+        for (int32 i = 0; i < 4; ++i)
+        {
+            for (int32 j = 0; j < reflection.resources.size(); ++j)
+            {
+                const DVKShaderReflection::Resource& resource = reflection.resources[j];
+                if (resource.type != resourceOrder[i])
+                {
+                    continue;
+                }
+
+                if (resource.type == DVKShaderReflection::RT_Attachment)
+                {
+                    ProcessAttachments(resource, stageFlags);
+                }
+                else if (resource.type == DVKShaderReflection::RT_UniformBuffer)
+                {
+                    ProcessUniformBuffers(resource, stageFlags);
+                }
+                else if (resource.type == DVKShaderReflection::RT_Texture)
+                {
+                    ProcessTextures(resource, stageFlags);
+                }
+                else
+                {
+                    ProcessStorageImages(resource, stageFlags);
+                }
+            }
+        }
+
+        ProcessInput(reflection, stageFlags);
+
+        for (int32 i = 0; i < reflection.resources.size(); ++i)
+        {
+            if (reflection.resources[i].type == DVKShaderReflection::RT_StorageBuffer)
+            {
+                ProcessStorageBuffers(reflection.resources[i], stageFlags);
+            }
+        }
 
-        ProcessAttachments(compiler, resources, shaderModule->stage);
-        ProcessUniformBuffers(compiler, resources, shaderModule->stage);
-        ProcessTextures(compiler, resources, shaderModule->stage);
-        ProcessStorageImages(compiler, resources, shaderModule->stage);
-        ProcessInput(compiler, resources, shaderModule->stage);
-        ProcessStorageBuffers(compiler, resources, shaderModule->stage);
+        ProcessPushConstants(reflection, stageFlags);
 
     }
 
@@ -479,25 +512,48 @@ namespace vk_demo
             );
         }
 
+        // 接口相同的Shader共享Layout以及DescriptorPool
         for (int32 i = 0; i < setLayoutsInfo.setLayouts.size(); ++i)
         {
-            VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
-            DVKDescriptorSetLayoutInfo& setLayoutInfo = setLayoutsInfo.setLayouts[i];
+            DVKSetLayoutRef setLayout = DVKLayoutCache::GetSetLayout(device, setLayoutsInfo.setLayouts[i]);
+            m_SetLayoutRefs.push_back(setLayout);
+            descriptorSetLayouts.push_back(setLayout->handle);
+        }
+
+        m_PipelineLayoutRef = DVKLayoutCache::GetPipelineLayout(device, m_SetLayoutRefs, pushConstantRanges);
+        pipelineLayout      = m_PipelineLayoutRef->handle;
+
+        if (m_SetLayoutRefs.size() > 0)
+        {
+            m_DescriptorPools = DVKLayoutCache::GetDescriptorPools(device, setLayoutsInfo, m_SetLayoutRefs);
+        }
+    }
 
-            VkDescriptorSetLayoutCreateInfo descSetLayoutInfo;
-            ZeroVulkanStruct(descSetLayoutInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO);
-            descSetLayoutInfo.bindingCount = (uint32_t)setLayoutInfo.bindings.size();
-            descSetLayoutInfo.pBindings    = setLayoutInfo.bindings.data();
-            VERIFYVULKANRESULT(vkCreateDescriptorSetLayout(device, &descSetLayoutInfo, VULKAN_CPU_ALLOCATOR, &descriptorSetLayout));
+    DVKDescriptorSet::~DVKDescriptorSet()
+    {
+        // Pool链由Shader共享，Set只能归还，不能随Shader一起销毁
+        if (descriptorPools && descriptorSets.size() > 0)
+        {
+            descriptorPools->ReleaseDescriptorSet(descriptorSets.data());
+        }
+    }
 
-            descriptorSetLayouts.push_back(descriptorSetLayout);
+    DVKDescriptorSet* DVKShader::AllocateDescriptorSet()
+    {
+        if (setLayoutsInfo.setLayouts.size() == 0)
+        {
+            return nullptr;
         }
 
-        VkPipelineLayoutCreateInfo pipeLayoutInfo;
-        ZeroVulkanStruct(pipeLayoutInfo, VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO);
-        pipeLayoutInfo.setLayoutCount = (uint32_t)descriptorSetLayouts.size();
-        pipeLayoutInfo.pSetLayouts    = descriptorSetLayouts.data();
-        VERIFYVULKANRESULT(vkCreatePipelineLayout(device, &pipeLayoutInfo, VULKAN_CPU_ALLOCATOR, &pipelineLayout));
+        DVKDescriptorSet* dvkSet = new DVKDescriptorSet();
+        dvkSet->device = device;
+        dvkSet->setLayoutsInfo = setLayoutsInfo;
+        dvkSet->descriptorSets.resize(setLayoutsInfo.setLayouts.size());
+
+        dvkSet->descriptorPools = m_DescriptorPools;
+        m_DescriptorPools->AllocateDescriptorSet(dvkSet->descriptorSets.data());
+
+        return dvkSet;
     }
 
 }
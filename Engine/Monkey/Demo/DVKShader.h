@@ -10,18 +10,21 @@
 #include "DVKUtils.h"
 #include "DVKBuffer.h"
 #include "DVKTexture.h"
+#include "DVKShaderCache.h"
 
 #include "FileManager.h"
+#include "Math/Math.h"
 #include "Vulkan/VulkanCommon.h"
 
-namespace spirv_cross
-{
-    class Compiler;
-    struct ShaderResources;
-}
-
 namespace vk_demo
 {
+    class DVKSharedSetLayout;
+    class DVKSharedPipelineLayout;
+    class DVKDescriptorPoolChain;
+
+    typedef std::shared_ptr<DVKSharedSetLayout>         DVKSetLayoutRef;
+    typedef std::shared_ptr<DVKSharedPipelineLayout>    DVKPipelineLayoutRef;
+    typedef std::shared_ptr<DVKDescriptorPoolChain>     DVKDescriptorPoolChainRef;
 
     class DVKDescriptorSetLayoutInfo
     {
@@ -142,10 +145,7 @@ namespace vk_demo
 
         }
 
-        ~DVKDescriptorSet()
-        {
-
-        }
+        ~DVKDescriptorSet();
 
         void WriteImage(const std::string& name, DVKTexture* texture)
         {
@@ -217,6 +217,7 @@ namespace vk_demo
 
         DVKDescriptorSetLayoutsInfo     setLayoutsInfo;
         std::vector<VkDescriptorSet>    descriptorSets;
+        DVKDescriptorPoolChainRef       descriptorPools;
     };
 
     class DVKDescriptorSetPool
@@ -229,6 +230,9 @@ namespace vk_demo
             usedSet = 0;
             descriptorSetLayouts = inDescriptorSetLayouts;
 
+            // 每次分配descriptorSetLayouts.size()个set，Pool需要容纳maxSet/size组
+            int32 numGroups = maxSet / MMath::Max((int32)descriptorSetLayouts.size(), 1);
+
             std::vector<VkDescriptorPoolSize> poolSizes;
             for (int32 i = 0; i < setLayoutsInfo.setLayouts.size(); ++i)
             {
@@ -237,7 +241,7 @@ namespace vk_demo
                 {
                     VkDescriptorPoolSize poolSize = {};
                     poolSize.type            = setLayoutInfo.bindings[j].descriptorType;
-                    poolSize.descriptorCount = setLayoutInfo.bindings[j].descriptorCount;
+                    poolSize.descriptorCount = setLayoutInfo.bindings[j].descriptorCount * numGroups;
                     poolSizes.push_back(poolSize);
                 }
             }
@@ -311,30 +315,28 @@ namespace vk_demo
 
     public:
 
+        // VkShaderModule由binary持有，最后一个引用释放时销毁
         ~DVKShaderModule()
         {
-            if (handle != VK_NULL_HANDLE)
-            {
-                vkDestroyShaderModule(device, handle, VULKAN_CPU_ALLOCATOR);
-                handle = VK_NULL_HANDLE;
-            }
-
-            if (data)
-            {
-                delete[] data;
-                data = nullptr;
-            }
+            handle     = VK_NULL_HANDLE;
+            data       = nullptr;
+            mapping    = nullptr;
+            reflection = nullptr;
+            binary     = nullptr;
         }
 
         static DVKShaderModule* Create(std::shared_ptr<VulkanDevice> vulkanDevice, const char* filename, VkShaderStageFlagBits stage);
 
     public:
 
-        VkDevice                device;
-        VkShaderStageFlagBits   stage;
-        VkShaderModule          handle;
-        uint8*                  data;
-        uint32                  size;
+        VkDevice                    device;
+        VkShaderStageFlagBits       stage;
+        VkShaderModule              handle;
+        const uint8*                data;
+        uint32                      size;
+        FileMappingRef              mapping;
+        const DVKShaderReflection*  reflection;
+        DVKShaderBinaryRef          binary;
     };
 
     class DVKShader
@@ -359,7 +361,6 @@ namespace vk_demo
     private:
         typedef std::vector<VkPipelineShaderStageCreateInfo>    ShaderStageInfoArray;
         typedef std::vector<VkDescriptorSetLayout>              DescriptorSetLayouts;
-        typedef std::vector<DVKDescriptorSetPool*>              DVKDescriptorSetPools;
 
         DVKShader()
         {
@@ -405,24 +406,13 @@ namespace vk_demo
                 teseShaderModule = nullptr;
             }
 
-            for (int32 i = 0; i < descriptorSetLayouts.size(); ++i)
-            {
-                vkDestroyDescriptorSetLayout(device, descriptorSetLayouts[i], VULKAN_CPU_ALLOCATOR);
-            }
+            // Layout与DescriptorPool由DVKLayoutCache共享，引用全部释放后才会销毁
             descriptorSetLayouts.clear();
+            pipelineLayout = VK_NULL_HANDLE;
 
-            if (pipelineLayout != VK_NULL_HANDLE)
-            {
-                vkDestroyPipelineLayout(device, pipelineLayout, VULKAN_CPU_ALLOCATOR);
-                pipelineLayout = VK_NULL_HANDLE;
-            }
-
-            for (int32 i = 0; i < descriptorSetPools.size(); ++i)
-            {
-                delete descriptorSetPools[i];
-            }
-            descriptorSetPools.clear();
-
+            m_SetLayoutRefs.clear();
+            m_PipelineLayoutRef = nullptr;
+            m_DescriptorPools   = nullptr;
         }
 
         static DVKShader* Create(std::shared_ptr<VulkanDevice> vulkanDevice, const char* comp);
@@ -431,32 +421,7 @@ namespace vk_demo
 
         static DVKShader* Create(std::shared_ptr<VulkanDevice> vulkanDevice, bool dynamicUBO, const char* vert, const char* frag, const char* geom = nullptr, const char* comp = nullptr, const char* tesc = nullptr, const char* tese = nullptr);
 
-        DVKDescriptorSet* AllocateDescriptorSet()
-        {
-            if (setLayoutsInfo.setLayouts.size() == 0)
-            {
-                return nullptr;
-            }
-
-            DVKDescriptorSet* dvkSet = new DVKDescriptorSet();
-            dvkSet->device = device;
-            dvkSet->setLayoutsInfo = setLayoutsInfo;
-            dvkSet->descriptorSets.resize(setLayoutsInfo.setLayouts.size());
-
-            for (int32 i = (int32)descriptorSetPools.size() - 1; i >= 0; --i)
-            {
-                if (descriptorSetPools[i]->AllocateDescriptorSet(dvkSet->descriptorSets.data()))
-                {
-                    return dvkSet;
-                }
-            }
-
-            DVKDescriptorSetPool* setPool = new DVKDescriptorSetPool(device, 64, setLayoutsInfo, descriptorSetLayouts);
-            descriptorSetPools.push_back(setPool);
-            setPool->AllocateDescriptorSet(dvkSet->descriptorSets.data());
-
-            return dvkSet;
-        }
+        DVKDescriptorSet* AllocateDescriptorSet();
 
     private:
 
@@ -466,22 +431,27 @@ namespace vk_demo
 
         void GenerateInputInfo();
 
-        void ProcessStorageBuffers(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags);
+        void ProcessStorageBuffers(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags);
+
+        void ProcessStorageImages(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags);
 
-        void ProcessStorageImages(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags);
+        void ProcessInput(const DVKShaderReflection& reflection, VkShaderStageFlags stageFlags);
 
-        void ProcessInput(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags);
+        void ProcessTextures(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags);
 
-        void ProcessTextures(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags);
+        void ProcessAttachments(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags);
 
-        void ProcessAttachments(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkPipelineStageFlags stageFlags);
+        void ProcessUniformBuffers(const DVKShaderReflection::Resource& resource, VkShaderStageFlags stageFlags);
 
-        void ProcessUniformBuffers(spirv_cross::Compiler& compiler, spirv_cross::ShaderResources& resources, VkShaderStageFlags stageFlags);
+        void ProcessPushConstants(const DVKShaderReflection& reflection, VkShaderStageFlags stageFlags);
 
         void ProcessShaderModule(DVKShaderModule* shaderModule);
 
     private:
-        std::vector<DVKAttribute> m_InputAttributes;
+        std::vector<DVKAttribute>       m_InputAttributes;
+        std::vector<DVKSetLayoutRef>    m_SetLayoutRefs;
+        DVKPipelineLayoutRef            m_PipelineLayoutRef;
+        DVKDescriptorPoolChainRef       m_DescriptorPools;
 
     public:
 
@@ -506,8 +476,8 @@ namespace vk_demo
         InputAttributesVector           inputAttributes;
 
         DescriptorSetLayouts            descriptorSetLayouts;
+        std::vector<VkPushConstantRange> pushConstantRanges;
         VkPipelineLayout                pipelineLayout = VK_NULL_HANDLE;
-        DVKDescriptorSetPools           descriptorSetPools;
 
         std::unordered_map<std::string, BufferInfo> bufferParams;
         std::unordered_map<std::string, ImageInfo>  imageParams;
@@ -0,0 +1,301 @@
+﻿#include "DVKShaderCache.h"
+#include "DVKCacheIO.h"
+
+#include "Common/Log.h"
+#include "Math/Math.h"
+#include "Utils/Crc.h"
+
+#include "spirv_cross.hpp"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace vk_demo
+{
+    bool DVKShaderCache::enabled = true;
+
+    struct ShaderBinaryKey
+    {
+        VkDevice    device;
+        uint32      hash;
+        uint32      size;
+
+        bool operator==(const ShaderBinaryKey& other) const
+        {
+            return device == other.device && hash == other.hash && size == other.size;
+        }
+    };
+
+    struct ShaderBinaryKeyHash
+    {
+        size_t operator()(const ShaderBinaryKey& key) const
+        {
+            return std::hash<uint64>()(((uint64)key.hash << 32) | key.size) ^ std::hash<VkDevice>()(key.device);
+        }
+    };
+
+    // 只持有弱引用，最后一个DVKShaderModule释放时VkShaderModule随之销毁
+    static std::mutex g_ShaderBinariesMutex;
+    static std::unordered_map<ShaderBinaryKey, std::weak_ptr<DVKShaderBinary>, ShaderBinaryKeyHash> g_ShaderBinaries;
+
+    static void ReflectResources(spirv_cross::Compiler& compiler, const spirv_cross::SmallVector<spirv_cross::Resource>& resources, uint32 type, DVKShaderReflection& reflection)
+    {
+        for (int32 i = 0; i < resources.size(); ++i)
+        {
+            const spirv_cross::Resource& res = resources[i];
+
+            DVKShaderReflection::Resource resource;
+            resource.name    = compiler.get_name(res.id);
+            resource.type    = type;
+            resource.set     = compiler.get_decoration(res.id, spv::DecorationDescriptorSet);
+            resource.binding = compiler.get_decoration(res.id, spv::DecorationBinding);
+
+            if (type == DVKShaderReflection::RT_UniformBuffer)
+            {
+                // [layout (binding = 0) uniform MVPDynamicBlock] 标记为Dynamic的buffer
+                const std::string& typeName = compiler.get_name(res.base_type_id);
+                resource.blockSize = (uint32)compiler.get_declared_struct_size(compiler.get_type(res.type_id));
+                resource.dynamic   = typeName.find("Dynamic") != std::string::npos;
+            }
+
+            reflection.resources.push_back(resource);
+        }
+    }
+
+    std::string DVKShaderCache::GetCachePath(const std::string& filename)
+    {
+        return filename + ".reflect";
+    }
+
+    bool DVKShaderCache::Reflect(const uint8* code, uint32 size, DVKShaderReflection& reflection)
+    {
+        if (size < sizeof(uint32) || size % sizeof(uint32) != 0)
+        {
+            return false;
+        }
+
+        spirv_cross::Compiler compiler((const uint32*)code, size / sizeof(uint32));
+        spirv_cross::ShaderResources resources = compiler.get_shader_resources();
+
+        reflection.resources.clear();
+        reflection.inputs.clear();
+        reflection.pushConstants.clear();
+
+        ReflectResources(compiler, resources.subpass_inputs,  DVKShaderReflection::RT_Attachment,    reflection);
+        ReflectResources(compiler, resources.uniform_buffers, DVKShaderReflection::RT_UniformBuffer, reflection);
+        ReflectResources(compiler, resources.sampled_images,  DVKShaderReflection::RT_Texture,       reflection);
+        ReflectResources(compiler, resources.storage_images,  DVKShaderReflection::RT_StorageImage,  reflection);
+        ReflectResources(compiler, resources.storage_buffers, DVKShaderReflection::RT_StorageBuffer, reflection);
+
+        for (int32 i = 0; i < resources.stage_inputs.size(); ++i)
+        {
+            const spirv_cross::Resource& res = resources.stage_inputs[i];
+
+            DVKShaderReflection::Input input;
+            input.name     = compiler.get_name(res.id);
+            input.location = compiler.get_decoration(res.id, spv::DecorationLocation);
+            input.vecSize  = compiler.get_type(res.type_id).vecsize;
+            reflection.inputs.push_back(input);
+        }
+
+        // push constant的范围从第一个成员的offset开始
+        for (int32 i = 0; i < resources.push_constant_buffers.size(); ++i)
+        {
+            const spirv_cross::Resource& res = resources.push_constant_buffers[i];
+            const spirv_cross::SPIRType& type = compiler.get_type(res.base_type_id);
+
+            uint32 offset = 0xFFFFFFFF;
+            for (uint32 j = 0; j < (uint32)type.member_types.size(); ++j)
+            {
+                offset = MMath::Min(offset, compiler.type_struct_member_offset(type, j));
+            }
+            if (offset == 0xFFFFFFFF)
+            {
+                continue;
+            }
+
+            DVKShaderReflection::PushConstant pushConstant;
+            pushConstant.offset = offset;
+            pushConstant.size   = (uint32)compiler.get_declared_struct_size(type) - offset;
+            reflection.pushConstants.push_back(pushConstant);
+        }
+
+        return true;
+    }
+
+    bool DVKShaderCache::Save(const DVKShaderReflection& reflection, const std::string& cachePath, uint32 sourceSize, uint32 sourceHash)
+    {
+        if (!enabled)
+        {
+            return false;
+        }
+
+        CacheWriter writer;
+
+        writer.Write<uint32>((uint32)reflection.resources.size());
+        for (int32 i = 0; i < reflection.resources.size(); ++i)
+        {
+            const DVKShaderReflection::Resource& resource = reflection.resources[i];
+            writer.WriteString(resource.name);
+            writer.Write<uint32>(resource.type);
+            writer.Write<uint32>(resource.set);
+            writer.Write<uint32>(resource.binding);
+            writer.Write<uint32>(resource.blockSize);
+            writer.Write<uint8>(resource.dynamic ? 1 : 0);
+        }
+
+        writer.Write<uint32>((uint32)reflection.inputs.size());
+        for (int32 i = 0; i < reflection.inputs.size(); ++i)
+        {
+            const DVKShaderReflection::Input& input = reflection.inputs[i];
+            writer.WriteString(input.name);
+            writer.Write<uint32>(input.location);
+            writer.Write<uint32>(input.vecSize);
+        }
+
+        writer.WriteArray(reflection.pushConstants);
+
+        Header header;
+        header.sourceSize = sourceSize;
+        header.sourceHash = sourceHash;
+        header.dataSize   = (uint32)writer.buffer.size();
+
+        std::vector<uint8> fileData(sizeof(Header) + writer.buffer.size());
+        memcpy(fileData.data(), &header, sizeof(Header));
+        memcpy(fileData.data() + sizeof(Header), writer.buffer.data(), writer.buffer.size());
+
+        return FileManager::WriteFile(cachePath, fileData.data(), (uint32)fileData.size());
+    }
+
+    bool DVKShaderCache::Load(DVKShaderReflection& reflection, const std::string& cachePath, uint32 sourceSize, uint32 sourceHash)
+    {
+        if (!enabled)
+        {
+            return false;
+        }
+
+        if (!FileManager::FileExists(cachePath))
+        {
+            return false;
+        }
+
+        FileMappingRef mapping = FileManager::MapFile(cachePath);
+        if (!mapping || mapping->GetSize() < sizeof(Header))
+        {
+            return false;
+        }
+
+        Header header;
+        memcpy(&header, mapping->GetData(), sizeof(Header));
+        if (header.magic != Magic || header.version != Version || header.sourceSize != sourceSize || header.sourceHash != sourceHash)
+        {
+            MLOG("Shader reflection out of date : %s", cachePath.c_str());
+            return false;
+        }
+
+        if (header.dataSize != mapping->GetSize() - sizeof(Header))
+        {
+            MLOGE("Shader reflection corrupted : %s", cachePath.c_str());
+            return false;
+        }
+
+        CacheReader reader(mapping->GetData() + sizeof(Header), header.dataSize);
+
+        DVKShaderReflection result;
+
+        uint32 resourceCount = reader.Read<uint32>();
+        for (uint32 i = 0; i < resourceCount && !reader.failed; ++i)
+        {
+            DVKShaderReflection::Resource resource;
+            reader.ReadString(resource.name);
+            resource.type      = reader.Read<uint32>();
+            resource.set       = reader.Read<uint32>();
+            resource.binding   = reader.Read<uint32>();
+            resource.blockSize = reader.Read<uint32>();
+            resource.dynamic   = reader.Read<uint8>() != 0;
+            result.resources.push_back(resource);
+        }
+
+        uint32 inputCount = reader.Read<uint32>();
+        for (uint32 i = 0; i < inputCount && !reader.failed; ++i)
+        {
+            DVKShaderReflection::Input input;
+            reader.ReadString(input.name);
+            input.location = reader.Read<uint32>();
+            input.vecSize  = reader.Read<uint32>();
+            result.inputs.push_back(input);
+        }
+
+        reader.ReadArray(result.pushConstants);
+
+        if (reader.failed || reader.offset != reader.size)
+        {
+            MLOGE("Shader reflection corrupted : %s", cachePath.c_str());
+            return false;
+        }
+
+        reflection = std::move(result);
+
+        return true;
+    }
+
+    DVKShaderBinaryRef DVKShaderCache::Acquire(VkDevice device, const std::string& filename)
+    {
+        // 映射的起始地址按页对齐，满足pCode的4字节对齐要求
+        FileMappingRef mapping = FileManager::MapFile(filename);
+        if (!mapping)
+        {
+            MLOGE("Failed load file:%s", filename.c_str());
+            return nullptr;
+        }
+
+        ShaderBinaryKey key;
+        key.device = device;
+        key.size   = mapping->GetSize();
+        key.hash   = Crc::MemCrc32(mapping->GetData(), mapping->GetSize());
+
+        {
+            std::lock_guard<std::mutex> lock(g_ShaderBinariesMutex);
+            auto it = g_ShaderBinaries.find(key);
+            if (it != g_ShaderBinaries.end())
+            {
+                DVKShaderBinaryRef binary = it->second.lock();
+                if (binary && memcmp(binary->mapping->GetData(), mapping->GetData(), key.size) == 0)
+                {
+                    return binary;
+                }
+            }
+        }
+
+        VkShaderModuleCreateInfo moduleCreateInfo;
+        ZeroVulkanStruct(moduleCreateInfo, VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO);
+        moduleCreateInfo.codeSize = mapping->GetSize();
+        moduleCreateInfo.pCode    = (const uint32_t*)mapping->GetData();
+
+        DVKShaderBinaryRef binary = std::make_shared<DVKShaderBinary>();
+        binary->device  = device;
+        binary->mapping = mapping;
+        binary->hash    = key.hash;
+        VERIFYVULKANRESULT(vkCreateShaderModule(device, &moduleCreateInfo, VULKAN_CPU_ALLOCATOR, &binary->handle));
+
+        std::string cachePath = GetCachePath(filename);
+        if (!Load(binary->reflection, cachePath, key.size, key.hash))
+        {
+            if (!Reflect(mapping->GetData(), key.size, binary->reflection))
+            {
+                MLOGE("Failed reflect shader:%s", filename.c_str());
+                return nullptr;
+            }
+            Save(binary->reflection, cachePath, key.size, key.hash);
+        }
+
+        // 并发加载同一个模块时后写入的覆盖先写入的，两者都有效
+        {
+            std::lock_guard<std::mutex> lock(g_ShaderBinariesMutex);
+            g_ShaderBinaries[key] = binary;
+        }
+
+        return binary;
+    }
+
+}
@@ -0,0 +1,117 @@
+﻿#pragma once
+
+#include "FileManager.h"
+
+#include "Common/Common.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vk_demo
+{
+
+    // 单个SPIR-V模块的反射结果，资源按SPIRV-Cross枚举的顺序保存
+    struct DVKShaderReflection
+    {
+        enum ResourceType
+        {
+            RT_Attachment = 0,
+            RT_UniformBuffer,
+            RT_Texture,
+            RT_StorageImage,
+            RT_StorageBuffer,
+        };
+
+        struct Resource
+        {
+            std::string     name;
+            uint32          type = RT_UniformBuffer;
+            uint32          set = 0;
+            uint32          binding = 0;
+            // 仅UniformBuffer有效
+            uint32          blockSize = 0;
+            // Block类型名包含"Dynamic"
+            bool            dynamic = false;
+        };
+
+        struct Input
+        {
+            std::string     name;
+            uint32          location = 0;
+            uint32          vecSize = 0;
+        };
+
+        struct PushConstant
+        {
+            uint32          offset = 0;
+            uint32          size = 0;
+        };
+
+        std::vector<Resource>       resources;
+        std::vector<Input>          inputs;
+        std::vector<PushConstant>   pushConstants;
+    };
+
+    // 内容相同的SPIR-V在同一个Device上只创建一次VkShaderModule、只反射一次，由所有引用者共享
+    class DVKShaderBinary
+    {
+    public:
+        DVKShaderBinary()
+        {
+
+        }
+
+        ~DVKShaderBinary()
+        {
+            if (handle != VK_NULL_HANDLE)
+            {
+                vkDestroyShaderModule(device, handle, VULKAN_CPU_ALLOCATOR);
+                handle = VK_NULL_HANDLE;
+            }
+            mapping = nullptr;
+        }
+
+    public:
+        VkDevice                device = VK_NULL_HANDLE;
+        VkShaderModule          handle = VK_NULL_HANDLE;
+        FileMappingRef          mapping;
+        uint32                  hash = 0;
+        DVKShaderReflection     reflection;
+    };
+
+    typedef std::shared_ptr<DVKShaderBinary> DVKShaderBinaryRef;
+
+    // 反射结果以二进制形式保存在.spv旁边(xxx.spv.reflect)，以.spv的大小和Hash作为Key。
+    // 缓存缺失或过期时用SPIRV-Cross重新反射并写回，之后的加载不再构造spirv_cross::Compiler。
+    class DVKShaderCache
+    {
+    public:
+        static const uint32 Magic   = 0x524B5644; // 'DVKR'
+        static const uint32 Version = 1;
+
+        struct Header
+        {
+            uint32  magic = Magic;
+            uint32  version = Version;
+            uint32  sourceSize = 0;
+            uint32  sourceHash = 0;
+            uint32  dataSize = 0;
+        };
+
+        static std::string GetCachePath(const std::string& filename);
+
+        // 获取filename对应的共享模块，失败返回nullptr，线程安全
+        static DVKShaderBinaryRef Acquire(VkDevice device, const std::string& filename);
+
+        static bool Reflect(const uint8* code, uint32 size, DVKShaderReflection& reflection);
+
+        static bool Load(DVKShaderReflection& reflection, const std::string& cachePath, uint32 sourceSize, uint32 sourceHash);
+
+        static bool Save(const DVKShaderReflection& reflection, const std::string& cachePath, uint32 sourceSize, uint32 sourceHash);
+
+        static bool enabled;
+    };
+
+}
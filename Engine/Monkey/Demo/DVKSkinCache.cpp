@@ -0,0 +1,337 @@
+﻿#include "DVKSkinCache.h"
+#include "DVKUtils.h"
+
+#include "Common/Log.h"
+#include "Math/Math.h"
+#include "Math/Vector4.h"
+
+namespace vk_demo
+{
+
+    static DVKBuffer* CreateDeviceBuffer(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, VkBufferUsageFlags usage, VkDeviceSize size, const void* data)
+    {
+        DVKBuffer* buffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            size
+        );
+
+        if (data == nullptr)
+        {
+            return buffer;
+        }
+
+        DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            size,
+            (void*)data
+        );
+
+        cmdBuffer->Begin();
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.size = size;
+        vkCmdCopyBuffer(cmdBuffer->cmdBuffer, stagingBuffer->buffer, buffer->buffer, 1, &copyRegion);
+
+        cmdBuffer->End();
+        cmdBuffer->Submit();
+
+        delete stagingBuffer;
+
+        return buffer;
+    }
+
+    // 与PreSkin.comp中的计算一致
+    static FORCE_INLINE Vector3 TransformPosition3x4(const Vector4* rows, const Vector3& v)
+    {
+        return Vector3(
+            rows[0].x * v.x + rows[0].y * v.y + rows[0].z * v.z + rows[0].w,
+            rows[1].x * v.x + rows[1].y * v.y + rows[1].z * v.z + rows[1].w,
+            rows[2].x * v.x + rows[2].y * v.y + rows[2].z * v.z + rows[2].w
+        );
+    }
+
+    static FORCE_INLINE Vector3 SkinPosition(const Vector4* bones, DVKSkinPacking packing, const float* skinPack, const Vector3& position)
+    {
+        uint32 packIndex  = (uint32)skinPack[0];
+        uint32 packWeight0 = (uint32)skinPack[1];
+        uint32 packWeight1 = (uint32)skinPack[2];
+
+        int32 indices[4] = {
+            (int32)((packIndex >> 24) & 0xFF),
+            (int32)((packIndex >> 16) & 0xFF),
+            (int32)((packIndex >> 8)  & 0xFF),
+            (int32)((packIndex >> 0)  & 0xFF)
+        };
+        float weights[4] = {
+            ((packWeight0 >> 16) & 0xFFFF) / 65535.0f,
+            ((packWeight0 >> 0)  & 0xFFFF) / 65535.0f,
+            ((packWeight1 >> 16) & 0xFFFF) / 65535.0f,
+            ((packWeight1 >> 0)  & 0xFFFF) / 65535.0f
+        };
+
+        if (packing == DVKSkinPacking::Matrix3x4)
+        {
+            Vector4 rows[3] = { Vector4(0, 0, 0, 0), Vector4(0, 0, 0, 0), Vector4(0, 0, 0, 0) };
+            for (int32 i = 0; i < 4; ++i)
+            {
+                const Vector4* bone = bones + indices[i] * 3;
+                rows[0] += bone[0] * weights[i];
+                rows[1] += bone[1] * weights[i];
+                rows[2] += bone[2] * weights[i];
+            }
+            return TransformPosition3x4(rows, position);
+        }
+
+        Vector4 real = bones[indices[0] * 2 + 0] * weights[0];
+        Vector4 dual = bones[indices[0] * 2 + 1] * weights[0];
+        for (int32 i = 1; i < 4; ++i)
+        {
+            const Vector4* bone = bones + indices[i] * 2;
+            float sign = Dot4(bones[indices[0] * 2], bone[0]) < 0.0f ? -1.0f : 1.0f;
+            real += bone[0] * (weights[i] * sign);
+            dual += bone[1] * (weights[i] * sign);
+        }
+
+        float len = MMath::Sqrt(Dot4(real, real));
+        real *= 1.0f / len;
+        dual *= 1.0f / len;
+
+        Vector3 qv(real.x, real.y, real.z);
+        Vector3 dv(dual.x, dual.y, dual.z);
+        Vector3 result = position + 2.0f * Vector3::CrossProduct(qv, Vector3::CrossProduct(qv, position) + real.w * position);
+        result += 2.0f * (real.w * dv - dual.w * qv + Vector3::CrossProduct(qv, dv));
+        return result;
+    }
+
+    DVKSkinCache::~DVKSkinCache()
+    {
+        if (processor)
+        {
+            delete processor;
+            processor = nullptr;
+        }
+
+        if (sourceBuffer)
+        {
+            delete sourceBuffer;
+            sourceBuffer = nullptr;
+        }
+
+        if (cacheBuffer)
+        {
+            delete cacheBuffer;
+            cacheBuffer = nullptr;
+        }
+
+        palette = nullptr;
+    }
+
+    DVKSkinCache* DVKSkinCache::Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkPipelineCache pipelineCache, DVKCommandBuffer* cmdBuffer, DVKShader* skinShader, DVKSkinPalette* palette, const std::vector<VertexAttribute>& attributes, int32 maxInstances)
+    {
+        DVKModel* model = palette->skeleton->model;
+
+        DVKSkinCache* skinCache  = new DVKSkinCache();
+        skinCache->vulkanDevice  = vulkanDevice;
+        skinCache->palette       = palette;
+        skinCache->attributes    = attributes;
+        skinCache->maxInstances  = MMath::Min(maxInstances, palette->maxInstances);
+
+        // 属性在顶点中的位置
+        int32 offset = 0;
+        for (int32 i = 0; i < attributes.size(); ++i)
+        {
+            int32 size = VertexAttributeToSize(attributes[i]) / sizeof(float);
+            if (attributes[i] == VertexAttribute::VA_Position)
+            {
+                skinCache->positionOffset = offset;
+            }
+            else if (attributes[i] == VertexAttribute::VA_Normal)
+            {
+                skinCache->normalOffset = offset;
+            }
+            else if (attributes[i] == VertexAttribute::VA_Tangent)
+            {
+                skinCache->tangentOffset = offset;
+            }
+
+            if (attributes[i] == VertexAttribute::VA_SkinPack)
+            {
+                skinCache->skinOffset = offset;
+            }
+            else
+            {
+                skinCache->cacheAttributes.push_back(attributes[i]);
+            }
+
+            offset += size;
+        }
+        skinCache->sourceStride = offset;
+        skinCache->cacheStride  = offset - 3;
+
+        if (skinCache->positionOffset < 0 || skinCache->skinOffset < 0)
+        {
+            MLOGE("PreSkin needs VA_Position and VA_SkinPack.");
+            delete skinCache;
+            return nullptr;
+        }
+
+        // 所有Primitive的顶点合并到一个StorageBuffer中
+        std::vector<float> sourceData;
+        int32 cacheOffset = 0;
+        for (int32 i = 0; i < model->meshes.size(); ++i)
+        {
+            DVKMesh* mesh = model->meshes[i];
+            for (int32 j = 0; j < mesh->primitives.size(); ++j)
+            {
+                DVKPrimitive* primitive = mesh->primitives[j];
+                if (primitive->vertices.size() != primitive->vertexCount * skinCache->sourceStride)
+                {
+                    MLOGE("PreSkin needs unquantized CPU vertices, load model with keepCPUData.");
+                    delete skinCache;
+                    return nullptr;
+                }
+
+                PrimitiveInfo info;
+                info.mesh         = i;
+                info.primitive    = primitive;
+                info.sourceOffset = (int32)sourceData.size();
+                info.cacheOffset  = cacheOffset;
+                skinCache->primitives.push_back(info);
+
+                sourceData.insert(sourceData.end(), primitive->vertices.begin(), primitive->vertices.end());
+                cacheOffset += primitive->vertexCount * skinCache->cacheStride;
+            }
+        }
+        skinCache->instanceFloats = cacheOffset;
+
+        VkDeviceSize cacheSize = (VkDeviceSize)palette->frameCount * skinCache->maxInstances * skinCache->instanceFloats * sizeof(float);
+        skinCache->sourceBuffer = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sourceData.size() * sizeof(float), sourceData.data());
+        skinCache->cacheBuffer  = CreateDeviceBuffer(vulkanDevice, cmdBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, cacheSize, nullptr);
+
+        skinCache->processor = DVKCompute::Create(vulkanDevice, pipelineCache, skinShader);
+        skinCache->processor->SetStorageBuffer("palette",     palette->buffer);
+        skinCache->processor->SetStorageBuffer("inVertices",  skinCache->sourceBuffer);
+        skinCache->processor->SetStorageBuffer("outVertices", skinCache->cacheBuffer);
+
+        return skinCache;
+    }
+
+    void DVKSkinCache::Dispatch(VkCommandBuffer commandBuffer)
+    {
+        frameIndex   = palette->frameIndex;
+        numInstances = MMath::Min(palette->numInstances, maxInstances);
+        if (numInstances == 0)
+        {
+            return;
+        }
+
+        // 上一次使用该区域的Draw读取完成
+        VkMemoryBarrier barrier;
+        ZeroVulkanStruct(barrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER);
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        // 每个Primitive一次Dispatch，y方向为角色
+        for (int32 i = 0; i < primitives.size(); ++i)
+        {
+            const PrimitiveInfo& info = primitives[i];
+            DVKSkinMeshParam skinParam = palette->GetMeshParam(info.mesh);
+
+            PreSkinParamBlock param;
+            param.skin[0]   = (int32)skinParam.offset;
+            param.skin[1]   = (int32)skinParam.stride;
+            param.skin[2]   = (int32)skinParam.packing;
+            param.skin[3]   = 0;
+            param.vertex[0] = info.primitive->vertexCount;
+            param.vertex[1] = sourceStride;
+            param.vertex[2] = cacheStride;
+            param.vertex[3] = skinOffset;
+            param.attrib[0] = positionOffset;
+            param.attrib[1] = normalOffset;
+            param.attrib[2] = tangentOffset;
+            param.attrib[3] = info.sourceOffset;
+            param.cache[0]  = frameIndex * maxInstances * instanceFloats + info.cacheOffset;
+            param.cache[1]  = instanceFloats;
+            param.cache[2]  = 0;
+            param.cache[3]  = 0;
+
+            processor->SetUniform("paramData", &param, sizeof(PreSkinParamBlock));
+            processor->BindDispatch(commandBuffer, (info.primitive->vertexCount + 63) / 64, numInstances, 1);
+        }
+
+        ZeroVulkanStruct(barrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER);
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    void DVKSkinCache::BindDrawCmd(VkCommandBuffer commandBuffer, int32 instance, int32 meshIndex)
+    {
+        for (int32 i = 0; i < primitives.size(); ++i)
+        {
+            if (primitives[i].mesh != meshIndex)
+            {
+                continue;
+            }
+
+            DVKPrimitive* primitive = primitives[i].primitive;
+            VkDeviceSize vertexOffset = GetVertexOffset(instance, i);
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(cacheBuffer->buffer), &vertexOffset);
+
+            if (!primitive->indexBuffer)
+            {
+                vkCmdDraw(commandBuffer, primitive->vertexCount, 1, 0, 0);
+                continue;
+            }
+
+            vkCmdBindIndexBuffer(commandBuffer, primitive->indexBuffer->dvkBuffer->buffer, 0, primitive->indexBuffer->indexType);
+            if (primitive->lods.size() > 0)
+            {
+                const DVKPrimitiveLod& lod = primitive->lods[primitive->lodIndex];
+                vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, lod.firstIndex, 0, 0);
+            }
+            else
+            {
+                vkCmdDrawIndexed(commandBuffer, primitive->indexBuffer->indexCount, 1, 0, 0, 0);
+            }
+        }
+    }
+
+    void DVKSkinCache::BindDrawCmd(VkCommandBuffer commandBuffer, int32 instance)
+    {
+        for (int32 i = 0; i < palette->skeleton->meshes.size(); ++i)
+        {
+            BindDrawCmd(commandBuffer, instance, i);
+        }
+    }
+
+    void DVKSkinCache::ComputePositions(int32 instance, int32 meshIndex, int32 primitiveIndex, std::vector<Vector3>& outPositions) const
+    {
+        DVKPrimitive* primitive = palette->skeleton->model->meshes[meshIndex]->primitives[primitiveIndex];
+        if (primitive->vertices.size() == 0)
+        {
+            MLOGE("SkinCache compute positions need model cpu data.");
+            outPositions.clear();
+            return;
+        }
+        outPositions.resize(primitive->vertexCount);
+
+        DVKSkinMeshParam skinParam = palette->GetMeshParam(meshIndex);
+        const Vector4* meshWorld = (const Vector4*)palette->buffer->mapped + skinParam.offset + instance * skinParam.stride;
+        const Vector4* bones     = meshWorld + 3;
+
+        for (int32 i = 0; i < primitive->vertexCount; ++i)
+        {
+            const float* vertex = primitive->vertices.data() + i * sourceStride;
+            Vector3 position(vertex[positionOffset + 0], vertex[positionOffset + 1], vertex[positionOffset + 2]);
+            position = SkinPosition(bones, palette->packing, vertex + skinOffset, position);
+            outPositions[i] = TransformPosition3x4(meshWorld, position);
+        }
+    }
+
+}
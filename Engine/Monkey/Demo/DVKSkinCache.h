@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKCommand.h"
+#include "DVKShader.h"
+#include "DVKCompute.h"
+#include "DVKModel.h"
+#include "DVKSkinning.h"
+
+#include "Common/Common.h"
+#include "Math/Vector3.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+
+    // 预蒙皮：Compute中按DVKSkinPalette本帧的调色板计算每个角色蒙皮后的世界空间顶点，写入顶点缓存。
+    // 之后的阴影、深度预渲染、主Pass等都把缓存当作静态模型绘制，每帧每个顶点只蒙皮一次。
+    // 缓存的顶点格式为模型的顶点格式去掉VA_SkinPack，其余属性原样拷贝，Position/Normal/Tangent变换到世界空间。
+    // 缓存按palette的frameCount切分为多个区域，每帧使用palette->frameIndex对应的区域。
+    class DVKSkinCache
+    {
+    private:
+        typedef std::shared_ptr<VulkanDevice> VulkanDeviceRef;
+
+        struct PreSkinParamBlock
+        {
+            int32   skin[4];
+            int32   vertex[4];
+            int32   attrib[4];
+            int32   cache[4];
+        };
+
+        struct PrimitiveInfo
+        {
+            int32           mesh = 0;
+            DVKPrimitive*   primitive = nullptr;
+            // 单位为float
+            int32           sourceOffset = 0;
+            int32           cacheOffset = 0;
+        };
+
+        DVKSkinCache()
+        {
+
+        }
+
+    public:
+        ~DVKSkinCache();
+
+        // attributes为加载model时使用的顶点属性，需要包含VA_Position、VA_SkinPack，不支持量化后的顶点。
+        // model需要保留CPU端顶点数据(keepCPUData)。maxInstances为缓存的角色数量，超出的角色不做预蒙皮。
+        // skinShader参见28_SkeletonQuat下的PreSkin.comp。
+        static DVKSkinCache* Create(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            VkPipelineCache pipelineCache,
+            DVKCommandBuffer* cmdBuffer,
+            DVKShader* skinShader,
+            DVKSkinPalette* palette,
+            const std::vector<VertexAttribute>& attributes,
+            int32 maxInstances
+        );
+
+        // palette->Update之后、RenderPass之外录制，完成后缓存可以作为顶点数据读取
+        void Dispatch(VkCommandBuffer commandBuffer);
+
+        // 调用前需绑定Pipeline以及DescriptorSets，Pipeline的顶点输入为cacheAttributes
+        void BindDrawCmd(VkCommandBuffer commandBuffer, int32 instance, int32 meshIndex);
+
+        void BindDrawCmd(VkCommandBuffer commandBuffer, int32 instance);
+
+        // CPU端按palette本帧的数据计算蒙皮后的世界空间位置，与Compute结果一致，用于拾取等射线检测。
+        // 不需要等待GPU，可以在palette->Update之后随时调用。
+        void ComputePositions(int32 instance, int32 meshIndex, int32 primitiveIndex, std::vector<Vector3>& outPositions) const;
+
+        FORCE_INLINE VkDeviceSize GetVertexOffset(int32 instance, int32 primitive) const
+        {
+            int32 offset = frameIndex * maxInstances * instanceFloats + instance * instanceFloats + primitives[primitive].cacheOffset;
+            return (VkDeviceSize)offset * sizeof(float);
+        }
+
+    public:
+        VulkanDeviceRef                 vulkanDevice = nullptr;
+        DVKSkinPalette*                 palette = nullptr;
+
+        std::vector<VertexAttribute>    attributes;
+        std::vector<VertexAttribute>    cacheAttributes;
+
+        // 单位为float，-1表示没有该属性
+        int32                           sourceStride = 0;
+        int32                           cacheStride = 0;
+        int32                           skinOffset = -1;
+        int32                           positionOffset = -1;
+        int32                           normalOffset = -1;
+        int32                           tangentOffset = -1;
+
+        int32                           maxInstances = 0;
+        int32                           numInstances = 0;
+        int32                           frameIndex = 0;
+        // 每个角色所有Primitive的float数
+        int32                           instanceFloats = 0;
+
+        std::vector<PrimitiveInfo>      primitives;
+
+        DVKBuffer*                      sourceBuffer = nullptr;
+        DVKBuffer*                      cacheBuffer = nullptr;
+        DVKCompute*                     processor = nullptr;
+    };
+
+}
@@ -0,0 +1,537 @@
+﻿#include "DVKSkinning.h"
+
+#include "Common/Log.h"
+#include "Math/Quat.h"
+
+#include <unordered_map>
+
+namespace vk_demo
+{
+
+    static FORCE_INLINE void PackMatrix3x4(const Matrix4x4& matrix, Vector4* dst)
+    {
+        // 行向量约定下v' = v * M，存储M的前三列，Shader中dot(row, vec4(v, 1))即可
+        dst[0].Set(matrix.m[0][0], matrix.m[1][0], matrix.m[2][0], matrix.m[3][0]);
+        dst[1].Set(matrix.m[0][1], matrix.m[1][1], matrix.m[2][1], matrix.m[3][1]);
+        dst[2].Set(matrix.m[0][2], matrix.m[1][2], matrix.m[2][2], matrix.m[3][2]);
+    }
+
+    static FORCE_INLINE void PackDualQuat(const Matrix4x4& matrix, Vector4* dst)
+    {
+        Quat quat   = matrix.ToQuat();
+        Vector3 pos = matrix.GetOrigin();
+
+        float dx = (+0.5f) * ( pos.x * quat.w + pos.y * quat.z - pos.z * quat.y);
+        float dy = (+0.5f) * (-pos.x * quat.z + pos.y * quat.w + pos.z * quat.x);
+        float dz = (+0.5f) * ( pos.x * quat.y - pos.y * quat.x + pos.z * quat.w);
+        float dw = (-0.5f) * ( pos.x * quat.x + pos.y * quat.y + pos.z * quat.z);
+
+        dst[0].Set(quat.x, quat.y, quat.z, quat.w);
+        dst[1].Set(dx, dy, dz, dw);
+    }
+
+    static FORCE_INLINE Quat NLerp(const Quat& a, const Quat& b, float alpha)
+    {
+        Quat result = Quat::FastLerp(a, b, alpha);
+        result.Normalize();
+        return result;
+    }
+
+    static FORCE_INLINE Quat ScaleRotation(const Quat& delta, float weight)
+    {
+        return NLerp(Quat::Identity, delta, weight);
+    }
+
+    // -------------------- DVKAnimLayer --------------------
+    void DVKAnimLayer::Play(int32 newAnimation, float newFadeDuration, float startTime)
+    {
+        if (newFadeDuration > 0.0f && animation >= 0)
+        {
+            fadeAnimation = animation;
+            fadeTime      = time;
+            fadeSpeed     = speed;
+            fadeDuration  = newFadeDuration;
+            fadeElapsed   = 0.0f;
+        }
+        else
+        {
+            fadeAnimation = -1;
+        }
+
+        animation = newAnimation;
+        time      = startTime;
+    }
+
+    static FORCE_INLINE float AdvanceTime(float time, float delta, float duration, bool loop)
+    {
+        if (duration <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        if (!loop)
+        {
+            return MMath::Clamp(time + delta, 0.0f, duration);
+        }
+
+        time = MMath::Fmod(time + delta, duration);
+        if (time < 0.0f)
+        {
+            time += duration;
+        }
+        return time;
+    }
+
+    void DVKAnimLayer::Advance(const DVKSkeleton* skeleton, float delta)
+    {
+        time = AdvanceTime(time, delta * speed, skeleton->GetDuration(animation), loop);
+
+        if (fadeAnimation >= 0)
+        {
+            fadeTime     = AdvanceTime(fadeTime, delta * fadeSpeed, skeleton->GetDuration(fadeAnimation), loop);
+            fadeElapsed += delta;
+            if (fadeElapsed >= fadeDuration)
+            {
+                fadeAnimation = -1;
+            }
+        }
+    }
+
+    // -------------------- DVKSkeleton --------------------
+    DVKSkeleton* DVKSkeleton::Create(DVKModel* model)
+    {
+        DVKSkeleton* skeleton = new DVKSkeleton();
+        skeleton->model = model;
+
+        std::unordered_map<DVKNode*, int32> nodeIndexMap;
+        for (int32 i = 0; i < model->linearNodes.size(); ++i)
+        {
+            nodeIndexMap.insert(std::make_pair(model->linearNodes[i], i));
+        }
+
+        // nodes
+        int32 numNodes = (int32)model->linearNodes.size();
+        skeleton->parents.resize(numNodes);
+        skeleton->restPose.resize(numNodes);
+        skeleton->restTransforms.resize(numNodes);
+        for (int32 i = 0; i < numNodes; ++i)
+        {
+            DVKNode* node = model->linearNodes[i];
+            skeleton->parents[i]  = node->parent ? nodeIndexMap[node->parent] : -1;
+            skeleton->restPose[i] = node->localMatrix;
+
+            // 分解为TRS用于混合
+            DVKTransform& transform = skeleton->restTransforms[i];
+            transform.scale    = node->localMatrix.GetScaleVector();
+            transform.position = node->localMatrix.GetOrigin();
+            transform.rotation = node->localMatrix.GetMatrixWithoutScale().ToQuat();
+        }
+
+        // bones
+        skeleton->boneNodes.resize(model->bones.size());
+        skeleton->inverseBindPoses.resize(model->bones.size());
+        for (int32 i = 0; i < model->bones.size(); ++i)
+        {
+            DVKBone* bone = model->bones[i];
+            auto it = model->nodesMap.find(bone->name);
+            skeleton->boneNodes[i]        = it != model->nodesMap.end() ? nodeIndexMap[it->second] : -1;
+            skeleton->inverseBindPoses[i] = bone->inverseBindPose;
+        }
+
+        // meshes
+        skeleton->meshes.resize(model->meshes.size());
+        for (int32 i = 0; i < model->meshes.size(); ++i)
+        {
+            DVKMesh* mesh = model->meshes[i];
+            skeleton->meshes[i].node  = nodeIndexMap[mesh->linkNode];
+            skeleton->meshes[i].bones = mesh->bones;
+        }
+
+        // animations
+        skeleton->animationClips.resize(model->animations.size());
+        for (int32 i = 0; i < model->animations.size(); ++i)
+        {
+            DVKAnimation& animation = model->animations[i];
+            std::vector<DVKAnimationClip*>& clips = skeleton->animationClips[i];
+            clips.resize(numNodes, nullptr);
+
+            for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+            {
+                auto nodeIt = model->nodesMap.find(it->second.nodeName);
+                if (nodeIt == model->nodesMap.end())
+                {
+                    continue;
+                }
+                clips[nodeIndexMap[nodeIt->second]] = &(it->second);
+            }
+        }
+
+        return skeleton;
+    }
+
+    void DVKSkeleton::EvaluateGlobals(int32 animation, float time, Matrix4x4* outGlobals) const
+    {
+        const std::vector<DVKAnimationClip*>* clips = nullptr;
+        if (animation >= 0 && animation < animationClips.size())
+        {
+            clips = &animationClips[animation];
+            time  = MMath::Clamp(time, 0.0f, model->animations[animation].duration);
+        }
+
+        for (int32 i = 0; i < parents.size(); ++i)
+        {
+            DVKAnimationClip* clip = clips ? (*clips)[i] : nullptr;
+            if (clip)
+            {
+                clip->Evaluate(time, outGlobals[i]);
+            }
+            else
+            {
+                outGlobals[i] = restPose[i];
+            }
+
+            if (parents[i] >= 0)
+            {
+                outGlobals[i].Append(outGlobals[parents[i]]);
+            }
+        }
+    }
+
+    void DVKSkeleton::SampleLocalPose(int32 animation, float time, DVKTransform* outPose) const
+    {
+        const std::vector<DVKAnimationClip*>* clips = nullptr;
+        if (animation >= 0 && animation < animationClips.size())
+        {
+            clips = &animationClips[animation];
+            time  = MMath::Clamp(time, 0.0f, model->animations[animation].duration);
+        }
+
+        for (int32 i = 0; i < parents.size(); ++i)
+        {
+            DVKAnimationClip* clip = clips ? (*clips)[i] : nullptr;
+            if (clip)
+            {
+                DVKTransform& transform = outPose[i];
+                clip->Sample(time, transform.rotation, transform.position, transform.scale);
+                transform.rotation.Normalize();
+            }
+            else
+            {
+                outPose[i] = restTransforms[i];
+            }
+        }
+    }
+
+    void DVKSkeleton::EvaluateLocalPose(const DVKSkinInstance& instance, DVKPoseScratch& scratch) const
+    {
+        int32 numNodes = GetNumNodes();
+        scratch.pose.resize(numNodes);
+        scratch.layer.resize(numNodes);
+        scratch.fade.resize(numNodes);
+        scratch.reference.resize(numNodes);
+
+        DVKTransform* pose = scratch.pose.data();
+        for (int32 i = 0; i < numNodes; ++i)
+        {
+            pose[i] = restTransforms[i];
+        }
+
+        for (int32 i = 0; i < instance.layers.size(); ++i)
+        {
+            const DVKAnimLayer& layer = instance.layers[i];
+            if (layer.animation < 0 || layer.weight <= 0.0f)
+            {
+                continue;
+            }
+
+            const float* mask = layer.mask >= 0 && layer.mask < masks.size() ? masks[layer.mask].data() : nullptr;
+
+            // 不需要混合的基础层直接写入
+            bool direct = layer.mode == DVKAnimBlendMode::Override && layer.weight >= 1.0f && mask == nullptr;
+            DVKTransform* layerPose = direct ? pose : scratch.layer.data();
+
+            SampleLocalPose(layer.animation, layer.time, layerPose);
+
+            // 淡入淡出
+            if (layer.IsFading())
+            {
+                SampleLocalPose(layer.fadeAnimation, layer.fadeTime, scratch.fade.data());
+                BlendPoses(scratch.fade.data(), layerPose, nullptr, layer.GetFadeAlpha(), numNodes, layerPose);
+            }
+
+            if (direct)
+            {
+                continue;
+            }
+
+            if (layer.mode == DVKAnimBlendMode::Override)
+            {
+                BlendPoses(pose, layerPose, mask, layer.weight, numNodes, pose);
+            }
+            else
+            {
+                int32 referenceAnimation = layer.referenceAnimation >= 0 ? layer.referenceAnimation : layer.animation;
+                SampleLocalPose(referenceAnimation, layer.referenceTime, scratch.reference.data());
+                AddPose(pose, layerPose, scratch.reference.data(), mask, layer.weight, numNodes);
+            }
+        }
+    }
+
+    void DVKSkeleton::LocalPoseToGlobals(const DVKTransform* pose, Matrix4x4* outGlobals) const
+    {
+        for (int32 i = 0; i < parents.size(); ++i)
+        {
+            pose[i].ToMatrix(outGlobals[i]);
+            if (parents[i] >= 0)
+            {
+                outGlobals[i].Append(outGlobals[parents[i]]);
+            }
+        }
+    }
+
+    int32 DVKSkeleton::CreateMask(const std::string& root, float weight)
+    {
+        auto it = model->nodesMap.find(root);
+        if (it == model->nodesMap.end())
+        {
+            MLOGE("Mask root %s not found.", root.c_str());
+            return -1;
+        }
+
+        int32 rootIndex = -1;
+        for (int32 i = 0; i < model->linearNodes.size(); ++i)
+        {
+            if (model->linearNodes[i] == it->second)
+            {
+                rootIndex = i;
+                break;
+            }
+        }
+
+        // 先序排列，父节点在遮罩内则子节点也在遮罩内
+        std::vector<float> mask(GetNumNodes(), 0.0f);
+        for (int32 i = 0; i < mask.size(); ++i)
+        {
+            if (i == rootIndex || (i > rootIndex && parents[i] >= 0 && mask[parents[i]] > 0.0f))
+            {
+                mask[i] = weight;
+            }
+        }
+
+        masks.push_back(mask);
+        return (int32)masks.size() - 1;
+    }
+
+    void DVKSkeleton::BlendPoses(const DVKTransform* a, const DVKTransform* b, const float* mask, float weight, int32 count, DVKTransform* out)
+    {
+        for (int32 i = 0; i < count; ++i)
+        {
+            float alpha = mask ? weight * mask[i] : weight;
+            if (alpha <= 0.0f)
+            {
+                out[i] = a[i];
+                continue;
+            }
+            if (alpha >= 1.0f)
+            {
+                out[i] = b[i];
+                continue;
+            }
+
+            DVKTransform result;
+            result.rotation = NLerp(a[i].rotation, b[i].rotation, alpha);
+            result.position = MMath::Lerp(a[i].position, b[i].position, alpha);
+            result.scale    = MMath::Lerp(a[i].scale,    b[i].scale,    alpha);
+            out[i] = result;
+        }
+    }
+
+    void DVKSkeleton::AddPose(DVKTransform* base, const DVKTransform* additive, const DVKTransform* reference, const float* mask, float weight, int32 count)
+    {
+        for (int32 i = 0; i < count; ++i)
+        {
+            float alpha = mask ? weight * mask[i] : weight;
+            if (alpha <= 0.0f)
+            {
+                continue;
+            }
+
+            // 相对参考姿势的差值按权重叠加
+            Quat deltaRotation = additive[i].rotation * reference[i].rotation.Inverse();
+            Vector3 deltaScale(
+                reference[i].scale.x != 0.0f ? additive[i].scale.x / reference[i].scale.x : 1.0f,
+                reference[i].scale.y != 0.0f ? additive[i].scale.y / reference[i].scale.y : 1.0f,
+                reference[i].scale.z != 0.0f ? additive[i].scale.z / reference[i].scale.z : 1.0f
+            );
+
+            base[i].rotation  = ScaleRotation(deltaRotation, alpha) * base[i].rotation;
+            base[i].rotation.Normalize();
+            base[i].position += (additive[i].position - reference[i].position) * alpha;
+            base[i].scale    *= MMath::Lerp(Vector3(1, 1, 1), deltaScale, alpha);
+        }
+    }
+
+    // -------------------- DVKSkinPalette --------------------
+    DVKSkinPalette::~DVKSkinPalette()
+    {
+        if (buffer)
+        {
+            buffer->UnMap();
+            delete buffer;
+            buffer = nullptr;
+        }
+
+        skeleton = nullptr;
+    }
+
+    DVKSkinPalette* DVKSkinPalette::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKSkeleton* skeleton, int32 maxInstances, int32 frameCount, DVKSkinPacking packing)
+    {
+        DVKSkinPalette* palette = new DVKSkinPalette();
+        palette->skeleton     = skeleton;
+        palette->packing      = packing;
+        palette->maxInstances = maxInstances;
+        palette->frameCount   = frameCount;
+        palette->entrySize    = packing == DVKSkinPacking::Matrix3x4 ? 3 : 2;
+
+        // 每个Mesh：世界矩阵 + 骨骼调色板，没有骨骼的Mesh保留一项单位变换
+        int32 offset = 0;
+        palette->meshOffsets.resize(skeleton->meshes.size());
+        for (int32 i = 0; i < skeleton->meshes.size(); ++i)
+        {
+            palette->meshOffsets[i] = offset;
+            offset += 3 + MMath::Max(1, (int32)skeleton->meshes[i].bones.size()) * palette->entrySize;
+        }
+        palette->instanceStride = offset;
+
+        VkDeviceSize bufferSize = (VkDeviceSize)frameCount * maxInstances * palette->instanceStride * sizeof(Vector4);
+        if (bufferSize > vulkanDevice->GetLimits().maxStorageBufferRange)
+        {
+            MLOGE("Skin palette too large : %llu > %u", (unsigned long long)bufferSize, vulkanDevice->GetLimits().maxStorageBufferRange);
+            delete palette;
+            return nullptr;
+        }
+
+        palette->buffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            bufferSize
+        );
+        palette->buffer->Map();
+
+        return palette;
+    }
+
+    void DVKSkinPalette::WriteInstance(const DVKSkinInstance& instance, Matrix4x4* globals, DVKPoseScratch& scratch, Vector4* dst) const
+    {
+        // 只有一个完整覆盖的层时直接求矩阵，省去TRS的混合
+        if (instance.layers.size() == 0)
+        {
+            skeleton->EvaluateGlobals(-1, 0.0f, globals);
+        }
+        else if (instance.layers.size() == 1 && instance.layers[0].mode == DVKAnimBlendMode::Override && instance.layers[0].weight >= 1.0f && instance.layers[0].mask < 0 && !instance.layers[0].IsFading())
+        {
+            skeleton->EvaluateGlobals(instance.layers[0].animation, instance.layers[0].time, globals);
+        }
+        else
+        {
+            skeleton->EvaluateLocalPose(instance, scratch);
+            skeleton->LocalPoseToGlobals(scratch.pose.data(), globals);
+        }
+
+        for (int32 i = 0; i < skeleton->meshes.size(); ++i)
+        {
+            const DVKSkeleton::MeshInfo& mesh = skeleton->meshes[i];
+            const Matrix4x4& meshGlobal = globals[mesh.node];
+
+            Vector4* block = dst + meshOffsets[i];
+
+            Matrix4x4 meshWorld = meshGlobal;
+            meshWorld.Append(instance.world);
+            PackMatrix3x4(meshWorld, block);
+            block += 3;
+
+            if (mesh.bones.size() == 0)
+            {
+                Matrix4x4 identity;
+                identity.SetIdentity();
+                if (packing == DVKSkinPacking::Matrix3x4)
+                {
+                    PackMatrix3x4(identity, block);
+                }
+                else
+                {
+                    PackDualQuat(identity, block);
+                }
+                continue;
+            }
+
+            // 骨骼变换到Mesh所在节点的空间，逆矩阵每个Mesh只求一次
+            Matrix4x4 meshInverse = meshGlobal.Inverse();
+
+            for (int32 j = 0; j < mesh.bones.size(); ++j)
+            {
+                int32 boneIndex = mesh.bones[j];
+                int32 boneNode  = skeleton->boneNodes[boneIndex];
+
+                Matrix4x4 boneTransform = skeleton->inverseBindPoses[boneIndex];
+                if (boneNode >= 0)
+                {
+                    boneTransform.Append(globals[boneNode]);
+                }
+                boneTransform.Append(meshInverse);
+
+                if (packing == DVKSkinPacking::Matrix3x4)
+                {
+                    PackMatrix3x4(boneTransform, block + j * 3);
+                }
+                else
+                {
+                    PackDualQuat(boneTransform, block + j * 2);
+                }
+            }
+        }
+    }
+
+    void DVKSkinPalette::Update(int32 inFrameIndex, const std::vector<DVKSkinInstance>& instances, DVKJobSystem* jobSystem)
+    {
+        frameIndex   = inFrameIndex % frameCount;
+        numInstances = MMath::Min((int32)instances.size(), maxInstances);
+
+        if (instances.size() > maxInstances)
+        {
+            MLOGE("Too many skin instances : %d > %d", (int32)instances.size(), maxInstances);
+        }
+
+        int32 numThreads = jobSystem ? jobSystem->GetThreadCount() : 1;
+        if (m_Globals.size() < numThreads)
+        {
+            m_Globals.resize(numThreads);
+            m_Scratches.resize(numThreads);
+        }
+        for (int32 i = 0; i < numThreads; ++i)
+        {
+            m_Globals[i].resize(skeleton->GetNumNodes());
+        }
+
+        Vector4* frameData = (Vector4*)buffer->mapped + frameIndex * maxInstances * instanceStride;
+
+        auto writeRange = [&](int32 begin, int32 end, int32 threadIndex) {
+            Matrix4x4* globals = m_Globals[threadIndex].data();
+            for (int32 i = begin; i < end; ++i)
+            {
+                WriteInstance(instances[i], globals, m_Scratches[threadIndex], frameData + i * instanceStride);
+            }
+        };
+
+        if (jobSystem)
+        {
+            jobSystem->ParallelFor(numInstances, 8, writeRange);
+        }
+        else
+        {
+            writeRange(0, numInstances, 0);
+        }
+    }
+
+}
@@ -0,0 +1,291 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKModel.h"
+#include "DVKJobSystem.h"
+
+#include "Common/Common.h"
+#include "Math/Vector3.h"
+#include "Math/Vector4.h"
+#include "Math/Quat.h"
+#include "Math/Matrix4x4.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+
+    enum class DVKSkinPacking
+    {
+        // 3个vec4，矩阵的前三列，支持缩放
+        Matrix3x4 = 0,
+        // 2个vec4，对偶四元数(实部, 对偶部)，不支持缩放
+        DualQuat  = 1,
+    };
+
+    class DVKSkeleton;
+
+    // 节点的局部变换，混合在TRS上进行
+    struct DVKTransform
+    {
+        Quat        rotation;
+        Vector3     position;
+        Vector3     scale;
+
+        DVKTransform()
+            : rotation(0, 0, 0, 1)
+            , position(0, 0, 0)
+            , scale(1, 1, 1)
+        {
+
+        }
+
+        void ToMatrix(Matrix4x4& outMatrix) const
+        {
+            outMatrix.SetIdentity();
+            outMatrix.AppendScale(scale);
+            outMatrix.Append(rotation.ToMatrix());
+            outMatrix.AppendTranslation(position);
+        }
+    };
+
+    enum class DVKAnimBlendMode
+    {
+        // 按权重覆盖下面的层
+        Override = 0,
+        // 叠加相对参考姿势的差值
+        Additive = 1,
+    };
+
+    // 一个动画层的播放状态，切换动画时可以淡入淡出
+    struct DVKAnimLayer
+    {
+        int32               animation = -1;
+        float               time = 0.0f;
+        float               speed = 1.0f;
+        float               weight = 1.0f;
+        bool                loop = true;
+
+        DVKAnimBlendMode    mode = DVKAnimBlendMode::Override;
+        // DVKSkeleton::masks中的序号，-1为所有节点
+        int32               mask = -1;
+
+        // Additive的参考姿势，referenceAnimation为-1时使用当前动画
+        int32               referenceAnimation = -1;
+        float               referenceTime = 0.0f;
+
+        // 正在淡出的动画
+        int32               fadeAnimation = -1;
+        float               fadeTime = 0.0f;
+        float               fadeSpeed = 1.0f;
+        float               fadeDuration = 0.0f;
+        float               fadeElapsed = 0.0f;
+
+        // fadeDuration大于0时从当前动画过渡到新的动画
+        void Play(int32 newAnimation, float newFadeDuration = 0.0f, float startTime = 0.0f);
+
+        void Advance(const DVKSkeleton* skeleton, float delta);
+
+        FORCE_INLINE bool IsFading() const
+        {
+            return fadeAnimation >= 0 && fadeElapsed < fadeDuration;
+        }
+
+        // 新动画所占的权重
+        FORCE_INLINE float GetFadeAlpha() const
+        {
+            return IsFading() ? fadeElapsed / fadeDuration : 1.0f;
+        }
+    };
+
+    // 一个角色的动画状态，layers[0]为基础层，之后的层依次叠加
+    struct DVKSkinInstance
+    {
+        Matrix4x4                   world;
+        std::vector<DVKAnimLayer>   layers;
+
+        DVKSkinInstance()
+        {
+            world.SetIdentity();
+            layers.resize(1);
+            layers[0].animation = 0;
+        }
+
+        FORCE_INLINE DVKAnimLayer& GetLayer(int32 index)
+        {
+            if (index >= layers.size())
+            {
+                layers.resize(index + 1);
+            }
+            return layers[index];
+        }
+
+        void Advance(const DVKSkeleton* skeleton, float delta)
+        {
+            for (int32 i = 0; i < layers.size(); ++i)
+            {
+                layers[i].Advance(skeleton, delta);
+            }
+        }
+    };
+
+    // 求值姿势时使用的临时数据，每个线程一份
+    struct DVKPoseScratch
+    {
+        std::vector<DVKTransform>   pose;
+        std::vector<DVKTransform>   layer;
+        std::vector<DVKTransform>   fade;
+        std::vector<DVKTransform>   reference;
+    };
+
+    // 从DVKModel中提取的只读骨架与动画，多个角色共享。求值结果写入调用者提供的数组，不修改DVKModel的状态，可以多线程同时求值。
+    class DVKSkeleton
+    {
+    private:
+        DVKSkeleton()
+        {
+
+        }
+
+    public:
+        struct MeshInfo
+        {
+            // 所在节点
+            int32               node = -1;
+            // 调色板中第i项对应的骨骼，与DVKMesh::bones一致
+            std::vector<int32>  bones;
+        };
+
+        ~DVKSkeleton()
+        {
+
+        }
+
+        // 以model当前的节点矩阵作为没有动画的节点的局部矩阵
+        static DVKSkeleton* Create(DVKModel* model);
+
+        // 计算所有节点的全局矩阵，outGlobals至少需要GetNumNodes()个，animation为-1时使用静止姿势
+        void EvaluateGlobals(int32 animation, float time, Matrix4x4* outGlobals) const;
+
+        // 采样单个动画的局部姿势，没有动画的节点使用静止姿势
+        void SampleLocalPose(int32 animation, float time, DVKTransform* outPose) const;
+
+        // 按instance的所有层混合出局部姿势，结果在scratch.pose中
+        void EvaluateLocalPose(const DVKSkinInstance& instance, DVKPoseScratch& scratch) const;
+
+        void LocalPoseToGlobals(const DVKTransform* pose, Matrix4x4* outGlobals) const;
+
+        // 节点root及其所有子节点的权重为weight，其余为0，返回遮罩序号，用于上半身这类局部的层
+        int32 CreateMask(const std::string& root, float weight = 1.0f);
+
+        // out = lerp(a, b, weight * mask)，out可以与a或者b相同
+        static void BlendPoses(const DVKTransform* a, const DVKTransform* b, const float* mask, float weight, int32 count, DVKTransform* out);
+
+        // base叠加additive相对reference的差值
+        static void AddPose(DVKTransform* base, const DVKTransform* additive, const DVKTransform* reference, const float* mask, float weight, int32 count);
+
+        FORCE_INLINE int32 GetNumNodes() const
+        {
+            return (int32)parents.size();
+        }
+
+        FORCE_INLINE float GetDuration(int32 animation) const
+        {
+            return animation >= 0 ? model->animations[animation].duration : 0.0f;
+        }
+
+    public:
+        DVKModel*                                   model = nullptr;
+
+        // 先序排列，父节点总在子节点之前
+        std::vector<int32>                          parents;
+        std::vector<Matrix4x4>                      restPose;
+        std::vector<DVKTransform>                   restTransforms;
+
+        std::vector<int32>                          boneNodes;
+        std::vector<Matrix4x4>                      inverseBindPoses;
+
+        std::vector<MeshInfo>                       meshes;
+
+        // 每个动画中每个节点对应的Clip，没有动画的节点为nullptr
+        std::vector<std::vector<DVKAnimationClip*>> animationClips;
+
+        // 每个节点的层权重
+        std::vector<std::vector<float>>             masks;
+    };
+
+    // 蒙皮调色板：所有角色的调色板写入同一个StorageBuffer，以实例索引访问，没有骨骼数量限制。
+    // 每个角色依次存放每个Mesh的数据块：Mesh的世界矩阵(3个vec4)，之后是该Mesh的骨骼调色板。
+    // Buffer按frameCount切分为多个区域并常驻映射，每帧写入frameIndex对应的区域。
+    // Shader中第i个实例的Mesh数据块起始位置为GetMeshParam(mesh).offset + i * GetMeshParam(mesh).stride，单位为vec4。
+    // 总大小超过maxStorageBufferRange时创建失败。
+    // 对应Shader中的uvec4，偏移超过2^24个vec4时float无法精确表示，使用整数传递
+    struct DVKSkinMeshParam
+    {
+        uint32  offset = 0;
+        uint32  stride = 0;
+        uint32  packing = 0;
+        uint32  padding = 0;
+    };
+
+    class DVKSkinPalette
+    {
+    private:
+        DVKSkinPalette()
+        {
+
+        }
+
+    public:
+        ~DVKSkinPalette();
+
+        static DVKSkinPalette* Create(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            DVKSkeleton* skeleton,
+            int32 maxInstances,
+            int32 frameCount,
+            DVKSkinPacking packing = DVKSkinPacking::DualQuat
+        );
+
+        // 计算instances的调色板并写入frameIndex对应的区域，jobSystem不为空时按角色并行计算
+        void Update(int32 frameIndex, const std::vector<DVKSkinInstance>& instances, DVKJobSystem* jobSystem = nullptr);
+
+        // offset:本帧第一个实例中该Mesh数据块的起始位置 stride:每个实例占用的vec4数量 packing:DVKSkinPacking
+        FORCE_INLINE DVKSkinMeshParam GetMeshParam(int32 meshIndex) const
+        {
+            DVKSkinMeshParam param;
+            param.offset  = (uint32)frameIndex * maxInstances * instanceStride + meshOffsets[meshIndex];
+            param.stride  = (uint32)instanceStride;
+            param.packing = (uint32)packing;
+            return param;
+        }
+
+    private:
+
+        void WriteInstance(const DVKSkinInstance& instance, Matrix4x4* globals, DVKPoseScratch& scratch, Vector4* dst) const;
+
+    public:
+        DVKSkeleton*        skeleton = nullptr;
+        DVKBuffer*          buffer = nullptr;
+        DVKSkinPacking      packing = DVKSkinPacking::DualQuat;
+
+        int32               maxInstances = 0;
+        int32               frameCount = 0;
+        int32               frameIndex = 0;
+        int32               numInstances = 0;
+
+        // 每根骨骼占用的vec4数量
+        int32               entrySize = 0;
+        // 每个实例占用的vec4数量
+        int32               instanceStride = 0;
+        std::vector<int32>  meshOffsets;
+
+    private:
+        // 每个线程一份节点矩阵以及姿势
+        std::vector<std::vector<Matrix4x4>> m_Globals;
+        std::vector<DVKPoseScratch>         m_Scratches;
+    };
+
+}
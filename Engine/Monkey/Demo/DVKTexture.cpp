@@ -193,9 +193,8 @@ namespace vk_demo
 
     DVKTexture* DVKTexture::Create2D(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
     {
-        uint32 dataSize = 0;
-        uint8* dataPtr  = nullptr;
-        if (!FileManager::ReadFile(filename, dataPtr, dataSize))
+        FileMappingRef mapping = FileManager::MapFile(filename);
+        if (!mapping)
         {
             MLOGE("Failed load image : %s", filename.c_str());
             return nullptr;
@@ -204,10 +203,9 @@ namespace vk_demo
         int32 comp   = 0;
         int32 width  = 0;
         int32 height = 0;
-        uint8* rgbaData = StbImage::LoadFromMemory(dataPtr, dataSize, &width, &height, &comp, 4);
+        uint8* rgbaData = StbImage::LoadFromMemory(mapping->GetData(), mapping->GetSize(), &width, &height, &comp, 4);
 
-        delete[] dataPtr;
-        dataPtr = nullptr;
+        mapping = nullptr;
 
         if (rgbaData == nullptr)
         {
@@ -648,21 +646,19 @@ namespace vk_demo
         std::vector<ImageInfo> images(filenames.size());
         for (int32 i = 0; i < filenames.size(); ++i)
         {
-            uint32 dataSize = 0;
-            uint8* dataPtr  = nullptr;
-            if (!FileManager::ReadFile(filenames[i], dataPtr, dataSize))
+            FileMappingRef mapping = FileManager::MapFile(filenames[i]);
+            if (!mapping)
             {
                 MLOGE("Failed load image : %s", filenames[i].c_str());
                 return nullptr;
             }
 
             ImageInfo& imageInfo = images[i];
-            imageInfo.data = (uint8*)StbImage::LoadFloatFromMemory(dataPtr, dataSize, &imageInfo.width, &imageInfo.height, &imageInfo.comp, 4);
+            imageInfo.data = (uint8*)StbImage::LoadFloatFromMemory(mapping->GetData(), mapping->GetSize(), &imageInfo.width, &imageInfo.height, &imageInfo.comp, 4);
             imageInfo.comp = 4;
             imageInfo.size = imageInfo.width * imageInfo.height * imageInfo.comp * 4;
 
-            delete[] dataPtr;
-            dataPtr = nullptr;
+            mapping = nullptr;
 
             if (!imageInfo.data)
             {
@@ -873,21 +869,19 @@ namespace vk_demo
         std::vector<ImageInfo> images(filenames.size());
         for (int32 i = 0; i < filenames.size(); ++i)
         {
-            uint32 dataSize = 0;
-            uint8* dataPtr  = nullptr;
-            if (!FileManager::ReadFile(filenames[i], dataPtr, dataSize))
+            FileMappingRef mapping = FileManager::MapFile(filenames[i]);
+            if (!mapping)
             {
                 MLOGE("Failed load image : %s", filenames[i].c_str());
                 return nullptr;
             }
 
             ImageInfo& imageInfo = images[i];
-            imageInfo.data = StbImage::LoadFromMemory(dataPtr, dataSize, &imageInfo.width, &imageInfo.height, &imageInfo.comp, 4);
+            imageInfo.data = StbImage::LoadFromMemory(mapping->GetData(), mapping->GetSize(), &imageInfo.width, &imageInfo.height, &imageInfo.comp, 4);
             imageInfo.comp = 4;
             imageInfo.size = imageInfo.width * imageInfo.height * imageInfo.comp;
 
-            delete[] dataPtr;
-            dataPtr = nullptr;
+            mapping = nullptr;
 
             if (!imageInfo.data)
             {
@@ -189,6 +189,9 @@ namespace vk_demo
         VkFormat                        format = VK_FORMAT_R8G8B8A8_UNORM;
 
         bool                            isCubeMap = false;
+
+        // DVKBindlessTable中的下标，未注册时为-1
+        int32                           bindlessIndex = -1;
     };
 
 }
@@ -0,0 +1,812 @@
+﻿#include "DVKTextureStreaming.h"
+#include "DVKUtils.h"
+
+#include "Math/Vector4.h"
+#include "Utils/Crc.h"
+#include "Loader/ImageLoader.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vk_demo
+{
+
+    // 2x2盒式滤波，奇数尺寸时重复使用边缘像素
+    static void DownsampleRGBA8(const uint8* src, int32 srcWidth, int32 srcHeight, uint8* dst, int32 dstWidth, int32 dstHeight)
+    {
+        for (int32 y = 0; y < dstHeight; ++y)
+        {
+            int32 y0 = MMath::Min(y * 2 + 0, srcHeight - 1);
+            int32 y1 = MMath::Min(y * 2 + 1, srcHeight - 1);
+
+            for (int32 x = 0; x < dstWidth; ++x)
+            {
+                int32 x0 = MMath::Min(x * 2 + 0, srcWidth - 1);
+                int32 x1 = MMath::Min(x * 2 + 1, srcWidth - 1);
+
+                const uint8* p00 = src + (y0 * srcWidth + x0) * 4;
+                const uint8* p01 = src + (y0 * srcWidth + x1) * 4;
+                const uint8* p10 = src + (y1 * srcWidth + x0) * 4;
+                const uint8* p11 = src + (y1 * srcWidth + x1) * 4;
+
+                uint8* out = dst + (y * dstWidth + x) * 4;
+                for (int32 c = 0; c < 4; ++c)
+                {
+                    out[c] = (uint8)((p00[c] + p01[c] + p10[c] + p11[c] + 2) >> 2);
+                }
+            }
+        }
+    }
+
+    // 数据紧跟在Header之后，从mip 0开始依次存放，返回数据总大小
+    static uint32 SetupMips(DVKStreamingTexture* texture, int32 width, int32 height)
+    {
+        texture->width    = width;
+        texture->height   = height;
+        texture->mipCount = MMath::FloorToInt(MMath::Log2((float)MMath::Max(width, height))) + 1;
+        texture->mips.resize(texture->mipCount);
+
+        uint32 offset = sizeof(DVKTextureStreamer::Header);
+        for (int32 i = 0; i < texture->mipCount; ++i)
+        {
+            DVKStreamingTexture::MipInfo& mip = texture->mips[i];
+            mip.width  = MMath::Max(width  >> i, 1);
+            mip.height = MMath::Max(height >> i, 1);
+            mip.offset = offset;
+            mip.size   = mip.width * mip.height * 4;
+            offset += mip.size;
+        }
+
+        return offset - sizeof(DVKTextureStreamer::Header);
+    }
+
+    static void FillImageCreateInfo(VkImageCreateInfo& imageCreateInfo, int32 width, int32 height, int32 levels)
+    {
+        ZeroVulkanStruct(imageCreateInfo, VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO);
+        imageCreateInfo.imageType     = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format        = VK_FORMAT_R8G8B8A8_UNORM;
+        imageCreateInfo.mipLevels     = levels;
+        imageCreateInfo.arrayLayers   = 1;
+        imageCreateInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageCreateInfo.extent        = { (uint32_t)width, (uint32_t)height, 1 };
+        imageCreateInfo.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
+    DVKTexturePool::~DVKTexturePool()
+    {
+        if (memory != VK_NULL_HANDLE)
+        {
+            vkFreeMemory(device, memory, VULKAN_CPU_ALLOCATOR);
+            memory = VK_NULL_HANDLE;
+        }
+    }
+
+    DVKTexturePool* DVKTexturePool::Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkDeviceSize size, uint32 memoryTypeIndex)
+    {
+        VkDevice device = vulkanDevice->GetInstanceHandle();
+
+        VkMemoryAllocateInfo memAllocInfo;
+        ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
+        memAllocInfo.allocationSize  = size;
+        memAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &memory) != VK_SUCCESS)
+        {
+            MLOGE("Failed allocate texture pool : %u MB", (uint32)(size / (1024 * 1024)));
+            return nullptr;
+        }
+
+        DVKTexturePool* pool  = new DVKTexturePool();
+        pool->device          = device;
+        pool->memory          = memory;
+        pool->memoryTypeIndex = memoryTypeIndex;
+        pool->size            = size;
+
+        Block block;
+        block.offset = 0;
+        block.size   = size;
+        pool->freeBlocks.push_back(block);
+
+        return pool;
+    }
+
+    bool DVKTexturePool::Allocate(VkDeviceSize allocSize, VkDeviceSize alignment, VkDeviceSize& outOffset)
+    {
+        alignment = MMath::Max(alignment, (VkDeviceSize)1);
+
+        for (int32 i = 0; i < freeBlocks.size(); ++i)
+        {
+            Block& block = freeBlocks[i];
+
+            VkDeviceSize offset   = (block.offset + alignment - 1) / alignment * alignment;
+            VkDeviceSize padding  = offset - block.offset;
+            if (padding + allocSize > block.size)
+            {
+                continue;
+            }
+
+            VkDeviceSize end      = offset + allocSize;
+            VkDeviceSize blockEnd = block.offset + block.size;
+
+            // 对齐产生的空隙留在原来的空闲块中
+            if (padding > 0)
+            {
+                block.size = padding;
+                if (end < blockEnd)
+                {
+                    Block tail;
+                    tail.offset = end;
+                    tail.size   = blockEnd - end;
+                    freeBlocks.insert(freeBlocks.begin() + i + 1, tail);
+                }
+            }
+            else if (end < blockEnd)
+            {
+                block.offset = end;
+                block.size   = blockEnd - end;
+            }
+            else
+            {
+                freeBlocks.erase(freeBlocks.begin() + i);
+            }
+
+            used += allocSize;
+            outOffset = offset;
+
+            return true;
+        }
+
+        return false;
+    }
+
+    void DVKTexturePool::Free(VkDeviceSize offset, VkDeviceSize allocSize)
+    {
+        int32 index = 0;
+        while (index < freeBlocks.size() && freeBlocks[index].offset < offset)
+        {
+            index += 1;
+        }
+
+        Block block;
+        block.offset = offset;
+        block.size   = allocSize;
+        freeBlocks.insert(freeBlocks.begin() + index, block);
+
+        // 与后一个空闲块合并
+        if (index + 1 < freeBlocks.size() && freeBlocks[index].offset + freeBlocks[index].size == freeBlocks[index + 1].offset)
+        {
+            freeBlocks[index].size += freeBlocks[index + 1].size;
+            freeBlocks.erase(freeBlocks.begin() + index + 1);
+        }
+
+        // 与前一个空闲块合并
+        if (index > 0 && freeBlocks[index - 1].offset + freeBlocks[index - 1].size == freeBlocks[index].offset)
+        {
+            freeBlocks[index - 1].size += freeBlocks[index].size;
+            freeBlocks.erase(freeBlocks.begin() + index);
+        }
+
+        used -= allocSize;
+    }
+
+    DVKStreamingTexture::~DVKStreamingTexture()
+    {
+        // imageMemory为空，不会释放显存池
+        if (texture)
+        {
+            delete texture;
+            texture = nullptr;
+        }
+    }
+
+    uint32 DVKStreamingTexture::GetDataSize(int32 levels) const
+    {
+        uint32 size = 0;
+        for (int32 i = mipCount - levels; i < mipCount; ++i)
+        {
+            size += mips[i].size;
+        }
+        return size;
+    }
+
+    DVKTextureStreamer::~DVKTextureStreamer()
+    {
+        ReleaseRetired(true);
+
+        for (int32 i = 0; i < textures.size(); ++i)
+        {
+            if (bindlessTable)
+            {
+                bindlessTable->RemoveTexture(textures[i]->texture);
+            }
+            delete textures[i];
+        }
+        textures.clear();
+
+        if (lodBuffer)
+        {
+            if (bindlessTable)
+            {
+                bindlessTable->RemoveBuffer(lodBuffer);
+            }
+            delete lodBuffer;
+            lodBuffer = nullptr;
+        }
+
+        if (stagingBuffer)
+        {
+            delete stagingBuffer;
+            stagingBuffer = nullptr;
+        }
+
+        if (pool)
+        {
+            delete pool;
+            pool = nullptr;
+        }
+
+        device = nullptr;
+    }
+
+    DVKTextureStreamer* DVKTextureStreamer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const DVKTextureStreamingSettings& settings, DVKBindlessTable* bindlessTable)
+    {
+        VkDevice device = vulkanDevice->GetInstanceHandle();
+
+        // 所有流式纹理的格式与用途相同，用一个探测Image确定显存池的内存类型
+        VkImage probeImage = VK_NULL_HANDLE;
+        VkImageCreateInfo imageCreateInfo;
+        FillImageCreateInfo(imageCreateInfo, settings.residentSize, settings.residentSize, 1);
+        VERIFYVULKANRESULT(vkCreateImage(device, &imageCreateInfo, VULKAN_CPU_ALLOCATOR, &probeImage));
+
+        VkMemoryRequirements memReqs = {};
+        vkGetImageMemoryRequirements(device, probeImage, &memReqs);
+        vkDestroyImage(device, probeImage, VULKAN_CPU_ALLOCATOR);
+
+        uint32 memoryTypeIndex = 0;
+        vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
+
+        DVKTexturePool* pool = DVKTexturePool::Create(vulkanDevice, settings.poolSize, memoryTypeIndex);
+        if (!pool)
+        {
+            return nullptr;
+        }
+
+        DVKTextureStreamer* streamer = new DVKTextureStreamer();
+        streamer->device        = vulkanDevice;
+        streamer->cmdBuffer     = cmdBuffer;
+        streamer->bindlessTable = bindlessTable;
+        streamer->settings      = settings;
+        streamer->pool          = pool;
+
+        streamer->stagingBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            settings.uploadBudget
+        );
+        streamer->stagingBuffer->Map();
+
+        streamer->lodBuffer = DVKBuffer::CreateBuffer(
+            vulkanDevice,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            settings.maxTextures * sizeof(Vector4)
+        );
+        streamer->lodBuffer->Map();
+        streamer->lodBuffer->SetupDescriptor();
+        memset(streamer->lodBuffer->mapped, 0, settings.maxTextures * sizeof(Vector4));
+
+        if (bindlessTable)
+        {
+            bindlessTable->AddBuffer(streamer->lodBuffer);
+        }
+
+        return streamer;
+    }
+
+    std::string DVKTextureStreamer::GetCachePath(const std::string& filename, uint32 key)
+    {
+        char hashStr[16];
+        sprintf(hashStr, "%08x", key);
+        return filename + "." + hashStr + ".mips";
+    }
+
+    bool DVKTextureStreamer::LoadMips(DVKStreamingTexture* texture)
+    {
+        FileMappingRef source = FileManager::MapFile(texture->filename);
+        if (!source)
+        {
+            MLOGE("Failed load image : %s", texture->filename.c_str());
+            return false;
+        }
+
+        uint32 key = Crc::MemCrc32(source->GetData(), source->GetSize());
+        std::string cachePath = GetCachePath(texture->filename, key);
+
+        // 缓存有效时直接映射，mip数据按需从page cache读取
+        if (FileManager::FileExists(cachePath))
+        {
+            FileMappingRef mapping = FileManager::MapFile(cachePath);
+            if (mapping && mapping->GetSize() >= sizeof(Header))
+            {
+                Header header;
+                memcpy(&header, mapping->GetData(), sizeof(Header));
+
+                if (header.magic == Magic && header.version == Version && header.key == key && header.width > 0 && header.height > 0 &&
+                    header.dataSize == mapping->GetSize() - sizeof(Header) && SetupMips(texture, header.width, header.height) == header.dataSize)
+                {
+                    texture->mapping = mapping;
+                    return true;
+                }
+            }
+            MLOG("Texture mip cache out of date : %s", cachePath.c_str());
+        }
+
+        int32 comp   = 0;
+        int32 width  = 0;
+        int32 height = 0;
+        uint8* rgbaData = StbImage::LoadFromMemory(source->GetData(), source->GetSize(), &width, &height, &comp, 4);
+
+        source = nullptr;
+
+        if (rgbaData == nullptr)
+        {
+            MLOGE("Failed load image : %s", texture->filename.c_str());
+            return false;
+        }
+
+        Header header;
+        header.key      = key;
+        header.width    = width;
+        header.height   = height;
+        header.dataSize = SetupMips(texture, width, height);
+        header.mipCount = texture->mipCount;
+
+        std::vector<uint8> data(sizeof(Header) + header.dataSize);
+        memcpy(data.data(), &header, sizeof(Header));
+        memcpy(data.data() + texture->mips[0].offset, rgbaData, texture->mips[0].size);
+
+        StbImage::Free(rgbaData);
+
+        for (int32 i = 1; i < texture->mipCount; ++i)
+        {
+            const DVKStreamingTexture::MipInfo& src = texture->mips[i - 1];
+            const DVKStreamingTexture::MipInfo& dst = texture->mips[i];
+            DownsampleRGBA8(data.data() + src.offset, src.width, src.height, data.data() + dst.offset, dst.width, dst.height);
+        }
+
+        if (FileManager::WriteFile(cachePath, data.data(), (uint32)data.size()))
+        {
+            texture->mapping = FileManager::MapFile(cachePath);
+            if (texture->mapping)
+            {
+                return true;
+            }
+        }
+        else
+        {
+            MLOGE("Failed write texture mip cache : %s", cachePath.c_str());
+        }
+
+        texture->pixels.swap(data);
+
+        return true;
+    }
+
+    bool DVKTextureStreamer::CreateImage(DVKStreamingTexture* texture, int32 levels, VkImage& outImage, VkDeviceSize& outOffset, VkDeviceSize& outSize)
+    {
+        VkDevice vkDevice = device->GetInstanceHandle();
+        const DVKStreamingTexture::MipInfo& top = texture->mips[texture->mipCount - levels];
+
+        VkImageCreateInfo imageCreateInfo;
+        FillImageCreateInfo(imageCreateInfo, top.width, top.height, levels);
+        VERIFYVULKANRESULT(vkCreateImage(vkDevice, &imageCreateInfo, VULKAN_CPU_ALLOCATOR, &outImage));
+
+        VkMemoryRequirements memReqs = {};
+        vkGetImageMemoryRequirements(vkDevice, outImage, &memReqs);
+
+        if ((memReqs.memoryTypeBits & (1 << pool->memoryTypeIndex)) == 0 || !pool->Allocate(memReqs.size, memReqs.alignment, outOffset))
+        {
+            vkDestroyImage(vkDevice, outImage, VULKAN_CPU_ALLOCATOR);
+            outImage = VK_NULL_HANDLE;
+            return false;
+        }
+
+        VERIFYVULKANRESULT(vkBindImageMemory(vkDevice, outImage, pool->memory, outOffset));
+        outSize = memReqs.size;
+
+        return true;
+    }
+
+    void DVKTextureStreamer::SwapImage(DVKStreamingTexture* texture, int32 levels, VkImage image, VkDeviceSize offset, VkDeviceSize size)
+    {
+        DVKTexture* dvkTexture = texture->texture;
+
+        if (dvkTexture->image != VK_NULL_HANDLE)
+        {
+            RetiredImage retired;
+            retired.image       = dvkTexture->image;
+            retired.imageView   = dvkTexture->imageView;
+            retired.poolOffset  = texture->poolOffset;
+            retired.poolSize    = texture->poolSize;
+            retired.retireFrame = frame + settings.retireFrames;
+            retiredImages.push_back(retired);
+        }
+
+        const DVKStreamingTexture::MipInfo& top = texture->mips[texture->mipCount - levels];
+
+        VkImageViewCreateInfo viewInfo;
+        ZeroVulkanStruct(viewInfo, VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO);
+        viewInfo.image      = image;
+        viewInfo.viewType   = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format     = VK_FORMAT_R8G8B8A8_UNORM;
+        viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.layerCount = 1;
+        viewInfo.subresourceRange.levelCount = levels;
+        VERIFYVULKANRESULT(vkCreateImageView(dvkTexture->device, &viewInfo, VULKAN_CPU_ALLOCATOR, &dvkTexture->imageView));
+
+        // minLod相对新Image的level 0，保持切换前后采样同一个层级，之后在Update中逐渐降到0
+        if (texture->residentLevels > 0)
+        {
+            texture->minLod = MMath::Max(texture->minLod + (float)(levels - texture->residentLevels), 0.0f);
+        }
+
+        texture->residentLevels = levels;
+        texture->poolOffset     = offset;
+        texture->poolSize       = size;
+
+        dvkTexture->image      = image;
+        dvkTexture->width      = top.width;
+        dvkTexture->height     = top.height;
+        dvkTexture->mipLevels  = levels;
+        dvkTexture->descriptorInfo.imageView = dvkTexture->imageView;
+
+        if (bindlessTable)
+        {
+            bindlessTable->UpdateTexture(dvkTexture);
+        }
+    }
+
+    void DVKTextureStreamer::UploadBatch(const std::vector<DVKStreamingTexture*>& batch)
+    {
+        uint32 totalSize = 0;
+        for (int32 i = 0; i < batch.size(); ++i)
+        {
+            totalSize += batch[i]->GetDataSize(batch[i]->residentLevels);
+        }
+
+        if (stagingBuffer->size < totalSize)
+        {
+            delete stagingBuffer;
+            stagingBuffer = DVKBuffer::CreateBuffer(
+                device,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                totalSize
+            );
+            stagingBuffer->Map();
+        }
+
+        cmdBuffer->Begin();
+
+        uint32 bufferOffset = 0;
+        std::vector<VkBufferImageCopy> regions;
+
+        for (int32 i = 0; i < batch.size(); ++i)
+        {
+            DVKStreamingTexture* texture = batch[i];
+            VkImage image = texture->texture->image;
+            int32 first   = texture->GetResidentMip();
+            int32 levels  = texture->residentLevels;
+
+            VkImageSubresourceRange subresourceRange = {};
+            subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            subresourceRange.baseMipLevel   = 0;
+            subresourceRange.levelCount     = levels;
+            subresourceRange.baseArrayLayer = 0;
+            subresourceRange.layerCount     = 1;
+
+            ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::Undefined, ImageLayoutBarrier::TransferDest, subresourceRange);
+
+            regions.resize(levels);
+            for (int32 level = 0; level < levels; ++level)
+            {
+                const DVKStreamingTexture::MipInfo& mip = texture->mips[first + level];
+                memcpy((uint8*)stagingBuffer->mapped + bufferOffset, texture->GetMipData(first + level), mip.size);
+
+                VkBufferImageCopy& region = regions[level];
+                region = {};
+                region.bufferOffset                    = bufferOffset;
+                region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.mipLevel       = level;
+                region.imageSubresource.baseArrayLayer = 0;
+                region.imageSubresource.layerCount     = 1;
+                region.imageExtent.width               = mip.width;
+                region.imageExtent.height              = mip.height;
+                region.imageExtent.depth               = 1;
+
+                bufferOffset += mip.size;
+            }
+
+            vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, stagingBuffer->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32)regions.size(), regions.data());
+
+            ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::PixelShaderRead, subresourceRange);
+        }
+
+        cmdBuffer->Submit();
+
+        uploadedBytes    += totalSize;
+        uploadedTextures += (int32)batch.size();
+    }
+
+    DVKStreamingTexture* DVKTextureStreamer::LoadTexture(const std::string& filename)
+    {
+        if (textures.size() >= settings.maxTextures)
+        {
+            MLOGE("Texture streamer is full : %d", settings.maxTextures);
+            return nullptr;
+        }
+
+        DVKStreamingTexture* texture = new DVKStreamingTexture();
+        texture->filename = filename;
+
+        if (!LoadMips(texture))
+        {
+            delete texture;
+            return nullptr;
+        }
+
+        // 宽高都不超过residentSize的mip始终驻留，至少一个层级
+        texture->minLevels = 0;
+        for (int32 i = 0; i < texture->mipCount; ++i)
+        {
+            if (texture->mips[i].width <= settings.residentSize && texture->mips[i].height <= settings.residentSize)
+            {
+                texture->minLevels += 1;
+            }
+        }
+        texture->minLevels    = MMath::Max(texture->minLevels, 1);
+        texture->wantedLevels = texture->minLevels;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size   = 0;
+        if (!CreateImage(texture, texture->minLevels, image, offset, size))
+        {
+            MLOGE("Texture pool is full : %s", filename.c_str());
+            delete texture;
+            return nullptr;
+        }
+
+        VkDevice vkDevice = device->GetInstanceHandle();
+
+        // Sampler覆盖完整的mip链，实际的层级范围由Image与minLod决定
+        VkSamplerCreateInfo samplerInfo;
+        ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
+        samplerInfo.magFilter        = VK_FILTER_LINEAR;
+        samplerInfo.minFilter        = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode       = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.addressModeU     = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV     = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW     = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.compareOp        = VK_COMPARE_OP_NEVER;
+        samplerInfo.borderColor      = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        samplerInfo.maxAnisotropy    = 1.0;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxLod           = (float)texture->mipCount;
+        samplerInfo.minLod           = 0.0f;
+
+        DVKTexture* dvkTexture = new DVKTexture();
+        dvkTexture->device      = vkDevice;
+        dvkTexture->format      = VK_FORMAT_R8G8B8A8_UNORM;
+        dvkTexture->layerCount  = 1;
+        dvkTexture->imageLayout = GetImageLayout(ImageLayoutBarrier::PixelShaderRead);
+        VERIFYVULKANRESULT(vkCreateSampler(vkDevice, &samplerInfo, VULKAN_CPU_ALLOCATOR, &dvkTexture->imageSampler));
+
+        dvkTexture->descriptorInfo.sampler     = dvkTexture->imageSampler;
+        dvkTexture->descriptorInfo.imageLayout = dvkTexture->imageLayout;
+        texture->texture = dvkTexture;
+
+        SwapImage(texture, texture->minLevels, image, offset, size);
+        UploadBatch({ texture });
+
+        texture->index = (int32)textures.size();
+        textures.push_back(texture);
+
+        if (bindlessTable)
+        {
+            bindlessTable->AddTexture(dvkTexture);
+        }
+
+        Vector4* lods = (Vector4*)lodBuffer->mapped;
+        lods[texture->index] = Vector4(0.0f, (float)texture->GetResidentMip(), (float)texture->mipCount, 0.0f);
+
+        return texture;
+    }
+
+    void DVKTextureStreamer::Evict(DVKStreamingTexture* requester, VkDeviceSize needed, std::vector<DVKStreamingTexture*>& batch)
+    {
+        // 本帧没有使用的纹理需要的层级为常驻层级，都在候选之内。最久没有使用的排在前面
+        std::vector<DVKStreamingTexture*> victims;
+        for (int32 i = 0; i < textures.size(); ++i)
+        {
+            DVKStreamingTexture* texture = textures[i];
+            if (texture != requester && texture->residentLevels > texture->wantedLevels)
+            {
+                victims.push_back(texture);
+            }
+        }
+
+        std::sort(victims.begin(), victims.end(), [](const DVKStreamingTexture* a, const DVKStreamingTexture* b) {
+            return a->lastUsedFrame < b->lastUsedFrame;
+        });
+
+        VkDeviceSize freed = 0;
+        bool idle = false;
+        for (int32 i = 0; i < victims.size() && freed < needed; ++i)
+        {
+            DVKStreamingTexture* victim = victims[i];
+            VkDeviceSize oldSize = victim->poolSize;
+
+            VkImage image = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size   = 0;
+            if (!CreateImage(victim, victim->wantedLevels, image, offset, size))
+            {
+                // 显存池已满，新旧Image无法同时存在，否则永远腾不出空间
+                if (!idle)
+                {
+                    vkDeviceWaitIdle(device->GetInstanceHandle());
+                    ReleaseRetired(true);
+                    idle = true;
+                }
+
+                if (!CreateImage(victim, victim->wantedLevels, image, offset, size))
+                {
+                    // 旧Image的内容不再需要，新的层级从mip缓存重新上传
+                    ReleaseImage(victim);
+                    if (!CreateImage(victim, victim->wantedLevels, image, offset, size))
+                    {
+                        MLOGE("Texture pool can't fit evicted texture : %d", victim->index);
+                        continue;
+                    }
+                }
+            }
+
+            SwapImage(victim, victim->wantedLevels, image, offset, size);
+            batch.push_back(victim);
+
+            freed += oldSize - size;
+            evictedTextures += 1;
+        }
+    }
+
+    void DVKTextureStreamer::Update(float delta)
+    {
+        frame += 1;
+        ReleaseRetired(false);
+
+        std::vector<DVKStreamingTexture*> candidates;
+
+        for (int32 i = 0; i < textures.size(); ++i)
+        {
+            DVKStreamingTexture* texture = textures[i];
+
+            // 屏幕上的尺寸对应的mip及其以下的所有层级，本帧没有使用时只需要常驻层级
+            texture->wantedLevels = texture->minLevels;
+            if (texture->requestedPixels > 0.0f)
+            {
+                texture->lastUsedFrame = frame;
+
+                float ratio = MMath::Max(texture->width, texture->height) / texture->requestedPixels;
+                int32 mip   = ratio > 1.0f ? MMath::FloorToInt(MMath::Log2(ratio)) : 0;
+                mip = MMath::Min(mip, texture->mipCount - 1);
+
+                texture->wantedLevels = MMath::Max(texture->mipCount - mip, texture->minLevels);
+
+                if (texture->wantedLevels > texture->residentLevels)
+                {
+                    candidates.push_back(texture);
+                }
+            }
+        }
+
+        // 放大越严重越优先：请求的尺寸与当前最高层级尺寸之比
+        std::sort(candidates.begin(), candidates.end(), [](const DVKStreamingTexture* a, const DVKStreamingTexture* b) {
+            const DVKStreamingTexture::MipInfo& mipA = a->mips[a->GetResidentMip()];
+            const DVKStreamingTexture::MipInfo& mipB = b->mips[b->GetResidentMip()];
+            return a->requestedPixels / MMath::Max(mipA.width, mipA.height) > b->requestedPixels / MMath::Max(mipB.width, mipB.height);
+        });
+
+        std::vector<DVKStreamingTexture*> batch;
+        uint32 batchSize = 0;
+
+        for (int32 i = 0; i < candidates.size(); ++i)
+        {
+            DVKStreamingTexture* texture = candidates[i];
+
+            uint32 dataSize = texture->GetDataSize(texture->wantedLevels);
+            if (batch.size() > 0 && batchSize + dataSize > settings.uploadBudget)
+            {
+                break;
+            }
+
+            VkImage image = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size   = 0;
+            if (!CreateImage(texture, texture->wantedLevels, image, offset, size))
+            {
+                // 显存池放不下，先淘汰其它纹理。旧Image延迟释放时空间在之后的帧才可用，之后的帧再尝试
+                Evict(texture, dataSize, batch);
+                if (!CreateImage(texture, texture->wantedLevels, image, offset, size))
+                {
+                    break;
+                }
+            }
+
+            SwapImage(texture, texture->wantedLevels, image, offset, size);
+            batch.push_back(texture);
+            batchSize += dataSize;
+        }
+
+        if (batch.size() > 0)
+        {
+            UploadBatch(batch);
+        }
+
+        Vector4* lods = (Vector4*)lodBuffer->mapped;
+        for (int32 i = 0; i < textures.size(); ++i)
+        {
+            DVKStreamingTexture* texture = textures[i];
+            texture->requestedPixels = 0.0f;
+            texture->minLod = MMath::Max(texture->minLod - delta * settings.fadeSpeed, 0.0f);
+            lods[texture->index] = Vector4(texture->minLod, (float)texture->GetResidentMip(), (float)texture->mipCount, 0.0f);
+        }
+    }
+
+    void DVKTextureStreamer::ReleaseImage(DVKStreamingTexture* texture)
+    {
+        DVKTexture* dvkTexture = texture->texture;
+        if (dvkTexture->image == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        vkDestroyImageView(dvkTexture->device, dvkTexture->imageView, VULKAN_CPU_ALLOCATOR);
+        vkDestroyImage(dvkTexture->device, dvkTexture->image, VULKAN_CPU_ALLOCATOR);
+        pool->Free(texture->poolOffset, texture->poolSize);
+
+        dvkTexture->image     = VK_NULL_HANDLE;
+        dvkTexture->imageView = VK_NULL_HANDLE;
+        texture->poolOffset   = 0;
+        texture->poolSize     = 0;
+    }
+
+    void DVKTextureStreamer::ReleaseRetired(bool force)
+    {
+        VkDevice vkDevice = device->GetInstanceHandle();
+
+        for (int32 i = 0; i < retiredImages.size();)
+        {
+            RetiredImage& retired = retiredImages[i];
+            if (!force && retired.retireFrame > frame)
+            {
+                i += 1;
+                continue;
+            }
+
+            vkDestroyImageView(vkDevice, retired.imageView, VULKAN_CPU_ALLOCATOR);
+            vkDestroyImage(vkDevice, retired.image, VULKAN_CPU_ALLOCATOR);
+            pool->Free(retired.poolOffset, retired.poolSize);
+
+            retiredImages[i] = retiredImages.back();
+            retiredImages.pop_back();
+        }
+    }
+
+}
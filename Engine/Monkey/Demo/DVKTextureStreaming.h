@@ -0,0 +1,246 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+#include "DVKCommand.h"
+#include "DVKTexture.h"
+#include "DVKBindless.h"
+#include "FileManager.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+
+    struct DVKTextureStreamingSettings
+    {
+        // 所有流式纹理共用的显存池大小
+        VkDeviceSize    poolSize = 64 * 1024 * 1024;
+        // 最多管理的纹理数量，决定lodBuffer的大小
+        int32           maxTextures = 256;
+        // 宽高都不超过该值的mip始终驻留
+        int32           residentSize = 64;
+        // 每帧最多上传的字节数，单个纹理超出时仍然会上传
+        uint32          uploadBudget = 8 * 1024 * 1024;
+        // 新上传的mip淡入的速度，单位为每秒多少个层级
+        float           fadeSpeed = 4.0f;
+        // 被替换的Image延迟释放的帧数，需不小于同时在GPU上执行的帧数
+        int32           retireFrames = 3;
+    };
+
+    // 显存池：一块固定大小的VkDeviceMemory，first-fit分配，释放时合并相邻的空闲块
+    class DVKTexturePool
+    {
+    private:
+        DVKTexturePool()
+        {
+
+        }
+
+    public:
+        struct Block
+        {
+            VkDeviceSize    offset;
+            VkDeviceSize    size;
+        };
+
+        ~DVKTexturePool();
+
+        static DVKTexturePool* Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkDeviceSize size, uint32 memoryTypeIndex);
+
+        bool Allocate(VkDeviceSize allocSize, VkDeviceSize alignment, VkDeviceSize& outOffset);
+
+        void Free(VkDeviceSize offset, VkDeviceSize allocSize);
+
+    public:
+        VkDevice                device = VK_NULL_HANDLE;
+        VkDeviceMemory          memory = VK_NULL_HANDLE;
+        uint32                  memoryTypeIndex = 0;
+        VkDeviceSize            size = 0;
+        VkDeviceSize            used = 0;
+
+        // 按offset排序
+        std::vector<Block>      freeBlocks;
+    };
+
+    class DVKTextureStreamer;
+
+    // 流式纹理：完整的mip链(CPU端生成并缓存到磁盘)以映射的方式保留，显存中只驻留[GetResidentMip(), mipCount)这些层级。
+    // texture对象在整个生命周期内保持不变，驻留层级变化时重建其中的Image，bindlessIndex不变。
+    // Shader中texture的level 0对应GetResidentMip()，采样时需要把LOD钳制到lodBuffer中的minLod。
+    class DVKStreamingTexture
+    {
+    private:
+        DVKStreamingTexture()
+        {
+
+        }
+
+    public:
+        struct MipInfo
+        {
+            uint32  offset;
+            uint32  size;
+            int32   width;
+            int32   height;
+        };
+
+        ~DVKStreamingTexture();
+
+        // 本帧该纹理在屏幕上的尺寸(像素)，多次调用取最大值
+        FORCE_INLINE void RequestScreenSize(float pixels)
+        {
+            requestedPixels = MMath::Max(requestedPixels, pixels);
+        }
+
+        // 当前驻留的最高层级
+        FORCE_INLINE int32 GetResidentMip() const
+        {
+            return mipCount - residentLevels;
+        }
+
+        // levels个最低层级的数据量
+        uint32 GetDataSize(int32 levels) const;
+
+        FORCE_INLINE const uint8* GetMipData(int32 mip) const
+        {
+            return (mapping ? mapping->GetData() : pixels.data()) + mips[mip].offset;
+        }
+
+    public:
+        std::string             filename;
+        DVKTexture*             texture = nullptr;
+        // lodBuffer中的下标
+        int32                   index = -1;
+
+        int32                   width = 0;
+        int32                   height = 0;
+        int32                   mipCount = 0;
+        std::vector<MipInfo>    mips;
+
+        // 始终驻留的层级数
+        int32                   minLevels = 1;
+        int32                   residentLevels = 0;
+        int32                   wantedLevels = 0;
+
+        float                   requestedPixels = 0.0f;
+        uint64                  lastUsedFrame = 0;
+
+        // 相对当前Image的level 0，新的mip上传后从旧的最高层级逐渐降到0
+        float                   minLod = 0.0f;
+
+        VkDeviceSize            poolOffset = 0;
+        VkDeviceSize            poolSize = 0;
+
+    private:
+        friend class DVKTextureStreamer;
+
+        // 优先使用映射的缓存文件，写入失败时保留在内存中
+        FileMappingRef          mapping;
+        std::vector<uint8>      pixels;
+    };
+
+    // 纹理流送：每帧根据纹理在屏幕上的尺寸计算需要的层级，按放大程度排序后在uploadBudget内上传，
+    // 显存池放不下时按LRU把最久没有使用的纹理降到需要的层级(或者常驻层级)。所有上传合并为一次提交。
+    // bindlessTable不为空时纹理自动注册，Image重建后更新表项，lodBuffer也注册为storage buffer。
+    class DVKTextureStreamer
+    {
+    private:
+        DVKTextureStreamer()
+        {
+
+        }
+
+    public:
+        static const uint32 Magic   = 0x534B5644; // 'DVKS'
+        static const uint32 Version = 1;
+
+        struct Header
+        {
+            uint32  magic = Magic;
+            uint32  version = Version;
+            uint32  key = 0;
+            int32   width = 0;
+            int32   height = 0;
+            int32   mipCount = 0;
+            uint32  dataSize = 0;
+        };
+
+        // 被替换的Image，retireFrame之后才能释放
+        struct RetiredImage
+        {
+            VkImage         image;
+            VkImageView     imageView;
+            VkDeviceSize    poolOffset;
+            VkDeviceSize    poolSize;
+            uint64          retireFrame;
+        };
+
+        ~DVKTextureStreamer();
+
+        static DVKTextureStreamer* Create(
+            std::shared_ptr<VulkanDevice> vulkanDevice,
+            DVKCommandBuffer* cmdBuffer,
+            const DVKTextureStreamingSettings& settings = DVKTextureStreamingSettings(),
+            DVKBindlessTable* bindlessTable = nullptr
+        );
+
+        // 生成或者加载mip缓存，只上传常驻层级，失败返回nullptr
+        DVKStreamingTexture* LoadTexture(const std::string& filename);
+
+        // 计算需要的层级、淘汰、上传以及推进minLod，需在录制使用这些纹理的CommandBuffer之前调用
+        void Update(float delta);
+
+        static std::string GetCachePath(const std::string& filename, uint32 key);
+
+    private:
+
+        bool LoadMips(DVKStreamingTexture* texture);
+
+        // 创建levels个层级的Image并从显存池分配内存，失败时返回false
+        bool CreateImage(DVKStreamingTexture* texture, int32 levels, VkImage& outImage, VkDeviceSize& outOffset, VkDeviceSize& outSize);
+
+        // 用新的Image替换当前的Image，旧的进入延迟释放列表
+        void SwapImage(DVKStreamingTexture* texture, int32 levels, VkImage image, VkDeviceSize offset, VkDeviceSize size);
+
+        // 立即释放纹理当前的Image以及显存，只能在GPU空闲时调用，之后需要SwapImage
+        void ReleaseImage(DVKStreamingTexture* texture);
+
+        // 把驻留层级多于需要的纹理降到需要的层级，按LRU顺序直到腾出needed字节。
+        // 显存池放不下新的Image时等待GPU空闲，先释放延迟释放的Image，仍然不够时直接释放旧Image
+        void Evict(DVKStreamingTexture* requester, VkDeviceSize needed, std::vector<DVKStreamingTexture*>& batch);
+
+        // 上传batch中所有纹理当前Image的全部层级，合并为一次提交
+        void UploadBatch(const std::vector<DVKStreamingTexture*>& batch);
+
+        void ReleaseRetired(bool force);
+
+    public:
+        std::shared_ptr<VulkanDevice>       device;
+        DVKCommandBuffer*                   cmdBuffer = nullptr;
+        DVKBindlessTable*                   bindlessTable = nullptr;
+        DVKTextureStreamingSettings         settings;
+
+        DVKTexturePool*                     pool = nullptr;
+        DVKBuffer*                          stagingBuffer = nullptr;
+
+        // 每个纹理一个vec4，x:minLod y:驻留的最高层级 z:mip数量
+        DVKBuffer*                          lodBuffer = nullptr;
+
+        std::vector<DVKStreamingTexture*>   textures;
+        std::vector<RetiredImage>           retiredImages;
+
+        uint64                              frame = 0;
+
+        // 统计
+        uint32                              uploadedBytes = 0;
+        int32                               uploadedTextures = 0;
+        int32                               evictedTextures = 0;
+    };
+
+}
@@ -11,18 +11,19 @@ namespace vk_demo
 {
     FORCE_INLINE VkShaderModule LoadSPIPVShader(VkDevice device, const std::string& filepath)
     {
-        uint8* dataPtr  = nullptr;
-        uint32 dataSize = 0;
-        FileManager::ReadFile(filepath, dataPtr, dataSize);
+        FileMappingRef mapping = FileManager::MapFile(filepath);
+        if (!mapping)
+        {
+            return VK_NULL_HANDLE;
+        }
 
         VkShaderModuleCreateInfo moduleCreateInfo;
         ZeroVulkanStruct(moduleCreateInfo, VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO);
-        moduleCreateInfo.codeSize = dataSize;
-        moduleCreateInfo.pCode    = (uint32_t*)dataPtr;
+        moduleCreateInfo.codeSize = mapping->GetSize();
+        moduleCreateInfo.pCode    = (const uint32_t*)mapping->GetData();
 
         VkShaderModule shaderModule;
         VERIFYVULKANRESULT(vkCreateShaderModule(device, &moduleCreateInfo, VULKAN_CPU_ALLOCATOR, &shaderModule));
-        delete[] dataPtr;
 
         return shaderModule;
     }
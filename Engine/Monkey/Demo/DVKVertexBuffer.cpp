@@ -73,4 +73,244 @@ namespace vk_demo
         return vertexInputBinding;
     }
 
+    // 用临时Buffer查询可用的内存类型，CreateBuffer找不到内存类型时不会报错
+    static bool FindMemoryType(std::shared_ptr<VulkanDevice> vulkanDevice, VkBufferUsageFlags usageFlags, VkDeviceSize size, VkMemoryPropertyFlags required, VkMemoryPropertyFlags& outFlags)
+    {
+        VkDevice device = vulkanDevice->GetInstanceHandle();
+
+        VkBufferCreateInfo bufferCreateInfo;
+        ZeroVulkanStruct(bufferCreateInfo, VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO);
+        bufferCreateInfo.usage = usageFlags;
+        bufferCreateInfo.size  = size;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VERIFYVULKANRESULT(vkCreateBuffer(device, &bufferCreateInfo, VULKAN_CPU_ALLOCATOR, &buffer));
+
+        VkMemoryRequirements memReqs = {};
+        vkGetBufferMemoryRequirements(device, buffer, &memReqs);
+        vkDestroyBuffer(device, buffer, VULKAN_CPU_ALLOCATOR);
+
+        VulkanDeviceMemoryManager& memoryManager = vulkanDevice->GetMemoryManager();
+        uint32 memoryTypeIndex = 0;
+        if (memoryManager.GetMemoryTypeFromProperties(memReqs.memoryTypeBits, required, &memoryTypeIndex) != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        outFlags = memoryManager.GetMemoryProperties().memoryTypes[memoryTypeIndex].propertyFlags;
+        return true;
+    }
+
+    DVKDynamicVertexBuffer::~DVKDynamicVertexBuffer()
+    {
+        if (hostBuffer)
+        {
+            delete hostBuffer;
+            hostBuffer = nullptr;
+        }
+
+        if (deviceBuffer)
+        {
+            delete deviceBuffer;
+            deviceBuffer = nullptr;
+        }
+    }
+
+    DVKDynamicVertexBuffer* DVKDynamicVertexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkDeviceSize size, int32 frameCount, bool keepShadow, DVKDynamicUpload upload)
+    {
+        if (size == 0 || frameCount <= 0)
+        {
+            MLOGE("Invalid dynamic vertex buffer, size : %d, frame count : %d", (int32)size, frameCount);
+            return nullptr;
+        }
+
+        DVKDynamicVertexBuffer* vertexBuffer = new DVKDynamicVertexBuffer();
+        vertexBuffer->device     = vulkanDevice->GetInstanceHandle();
+        vertexBuffer->size       = size;
+        vertexBuffer->frameCount = frameCount;
+
+        // 区域大小按nonCoherentAtomSize对齐，Flush时不会碰到相邻的区域
+        VkDeviceSize atomSize = MMath::Max<VkDeviceSize>(vulkanDevice->GetLimits().nonCoherentAtomSize, 1);
+        vertexBuffer->atomSize   = atomSize;
+        vertexBuffer->regionSize = (size + atomSize - 1) / atomSize * atomSize;
+
+        VkDeviceSize totalSize = vertexBuffer->regionSize * frameCount;
+
+        VkMemoryPropertyFlags hostFlags    = 0;
+        VkMemoryPropertyFlags hostRequired = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (upload != DVKDynamicUpload::Staged && FindMemoryType(vulkanDevice, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, totalSize, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, hostFlags))
+        {
+            // 显存可以直接映射(UMA或者BAR)，不需要额外的拷贝
+            upload       = DVKDynamicUpload::Direct;
+            hostRequired = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        }
+        else if (upload == DVKDynamicUpload::Auto)
+        {
+            upload = DVKDynamicUpload::Staged;
+        }
+
+        VkBufferUsageFlags hostUsage = upload == DVKDynamicUpload::Direct ? VK_BUFFER_USAGE_VERTEX_BUFFER_BIT : VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        if (hostFlags == 0 && !FindMemoryType(vulkanDevice, hostUsage, totalSize, hostRequired, hostFlags))
+        {
+            MLOGE("Dynamic vertex buffer can't find host visible memory.");
+            delete vertexBuffer;
+            return nullptr;
+        }
+
+        vertexBuffer->upload   = upload;
+        vertexBuffer->coherent = (hostFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+        vertexBuffer->hostBuffer = DVKBuffer::CreateBuffer(vulkanDevice, hostUsage, hostRequired, totalSize);
+        vertexBuffer->hostBuffer->Map();
+        memset(vertexBuffer->hostBuffer->mapped, 0, totalSize);
+
+        if (upload == DVKDynamicUpload::Staged)
+        {
+            vertexBuffer->deviceBuffer = DVKBuffer::CreateBuffer(
+                vulkanDevice,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                totalSize
+            );
+        }
+
+        vertexBuffer->m_KeepShadow = keepShadow;
+        if (keepShadow)
+        {
+            vertexBuffer->m_Shadow.resize(size, 0);
+        }
+
+        // 第一次Upload时把每个区域完整同步一次
+        vertexBuffer->m_DirtyRanges.resize(frameCount);
+        for (int32 i = 0; i < frameCount; ++i)
+        {
+            vertexBuffer->m_DirtyRanges[i].begin = 0;
+            vertexBuffer->m_DirtyRanges[i].end   = size;
+        }
+
+        return vertexBuffer;
+    }
+
+    void DVKDynamicVertexBuffer::BeginFrame(int32 index)
+    {
+        frameIndex = index % frameCount;
+    }
+
+    void DVKDynamicVertexBuffer::MarkDirty(DirtyRange& range, VkDeviceSize begin, VkDeviceSize end)
+    {
+        if (range.begin == range.end)
+        {
+            range.begin = begin;
+            range.end   = end;
+        }
+        else
+        {
+            range.begin = MMath::Min(range.begin, begin);
+            range.end   = MMath::Max(range.end, end);
+        }
+    }
+
+    void DVKDynamicVertexBuffer::Write(const void* data, VkDeviceSize dataSize, VkDeviceSize offset)
+    {
+        void* dst = Lock(dataSize, offset);
+        if (dst)
+        {
+            memcpy(dst, data, dataSize);
+        }
+    }
+
+    void* DVKDynamicVertexBuffer::Lock(VkDeviceSize lockSize, VkDeviceSize offset)
+    {
+        if (lockSize == 0 || offset + lockSize > size)
+        {
+            MLOGE("Dynamic vertex buffer lock out of range : %d + %d > %d", (int32)offset, (int32)lockSize, (int32)size);
+            return nullptr;
+        }
+
+        if (m_KeepShadow)
+        {
+            for (int32 i = 0; i < m_DirtyRanges.size(); ++i)
+            {
+                MarkDirty(m_DirtyRanges[i], offset, offset + lockSize);
+            }
+            return m_Shadow.data() + offset;
+        }
+
+        MarkDirty(m_DirtyRanges[frameIndex], offset, offset + lockSize);
+        return (uint8*)hostBuffer->mapped + GetOffset() + offset;
+    }
+
+    void DVKDynamicVertexBuffer::Upload(VkCommandBuffer commandBuffer)
+    {
+        DirtyRange& range = m_DirtyRanges[frameIndex];
+        if (range.begin < range.end)
+        {
+            VkDeviceSize regionOffset = GetOffset();
+
+            if (m_KeepShadow)
+            {
+                memcpy((uint8*)hostBuffer->mapped + regionOffset + range.begin, m_Shadow.data() + range.begin, range.end - range.begin);
+            }
+
+            if (!coherent)
+            {
+                VkDeviceSize begin = range.begin / atomSize * atomSize;
+                VkDeviceSize end   = MMath::Min((range.end + atomSize - 1) / atomSize * atomSize, regionSize);
+                hostBuffer->Flush(end - begin, regionOffset + begin);
+            }
+
+            if (deviceBuffer)
+            {
+                VkBufferCopy copyRegion = {};
+                copyRegion.srcOffset = regionOffset + range.begin;
+                copyRegion.dstOffset = regionOffset + range.begin;
+                copyRegion.size      = range.end - range.begin;
+                vkCmdCopyBuffer(commandBuffer, hostBuffer->buffer, deviceBuffer->buffer, 1, &copyRegion);
+
+                VkBufferMemoryBarrier barrier;
+                ZeroVulkanStruct(barrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
+                barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask       = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.buffer              = deviceBuffer->buffer;
+                barrier.offset              = copyRegion.dstOffset;
+                barrier.size                = copyRegion.size;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+            }
+
+            range.begin = 0;
+            range.end   = 0;
+        }
+
+        if (!m_ReleasePending)
+        {
+            return;
+        }
+
+        for (int32 i = 0; i < m_DirtyRanges.size(); ++i)
+        {
+            if (m_DirtyRanges[i].begin < m_DirtyRanges[i].end)
+            {
+                return;
+            }
+        }
+
+        std::vector<uint8>().swap(m_Shadow);
+        m_KeepShadow     = false;
+        m_ReleasePending = false;
+    }
+
+    void DVKDynamicVertexBuffer::Bind(VkCommandBuffer cmdBuffer, uint32 binding)
+    {
+        VkBuffer     buffer = GetBuffer();
+        VkDeviceSize offset = GetOffset();
+        vkCmdBindVertexBuffers(cmdBuffer, binding, 1, &buffer, &offset);
+    }
+
+    void DVKDynamicVertexBuffer::ReleaseShadow()
+    {
+        m_ReleasePending = m_KeepShadow;
+    }
+
 }
\ No newline at end of file
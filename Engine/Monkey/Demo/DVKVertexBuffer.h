@@ -151,6 +151,48 @@ namespace vk_demo
         return format;
     }
 
+    // 量化后的顶点格式：位置/UV使用half，法线/切线使用snorm8，颜色使用unorm8，其余保持float。
+    // 所有格式都按4字节对齐，量化后的数据仍然可以存放在float数组中。
+    FORCE_INLINE int32 VertexAttributeToQuantizedSize(VertexAttribute attribute)
+    {
+        if (attribute == VertexAttribute::VA_Position)
+        {
+            return 4 * sizeof(uint16);
+        }
+        else if (attribute == VertexAttribute::VA_UV0 || attribute == VertexAttribute::VA_UV1)
+        {
+            return 2 * sizeof(uint16);
+        }
+        else if (attribute == VertexAttribute::VA_Normal || attribute == VertexAttribute::VA_Tangent || attribute == VertexAttribute::VA_Color)
+        {
+            return 4 * sizeof(uint8);
+        }
+
+        return VertexAttributeToSize(attribute);
+    }
+
+    FORCE_INLINE VkFormat VertexAttributeToQuantizedVkFormat(VertexAttribute attribute)
+    {
+        if (attribute == VertexAttribute::VA_Position)
+        {
+            return VK_FORMAT_R16G16B16A16_SFLOAT;
+        }
+        else if (attribute == VertexAttribute::VA_UV0 || attribute == VertexAttribute::VA_UV1)
+        {
+            return VK_FORMAT_R16G16_SFLOAT;
+        }
+        else if (attribute == VertexAttribute::VA_Normal || attribute == VertexAttribute::VA_Tangent)
+        {
+            return VK_FORMAT_R8G8B8A8_SNORM;
+        }
+        else if (attribute == VertexAttribute::VA_Color)
+        {
+            return VK_FORMAT_R8G8B8A8_UNORM;
+        }
+
+        return VertexAttributeToVkFormat(attribute);
+    }
+
     class DVKVertexBuffer
     {
     private:
@@ -187,4 +229,90 @@ namespace vk_demo
         std::vector<VertexAttribute>    attributes;
     };
 
+    enum class DVKDynamicUpload
+    {
+        // 存在DEVICE_LOCAL|HOST_VISIBLE的内存时直接写入，否则走Staged
+        Auto,
+        // 直接写入HOST_VISIBLE内存，GPU跨总线读取
+        Direct,
+        // 写入staging，Upload时拷贝到DEVICE_LOCAL内存
+        Staged,
+    };
+
+    // 每帧更新的顶点/实例数据。Buffer按frameCount切分为多个区域，常驻映射，每帧使用frameIndex对应的区域，
+    // CPU写入下一帧时不会覆盖GPU正在读取的数据。每个区域单独记录脏区间，Upload只拷贝变化的部分。
+    // keepShadow为true时保留一份CPU数据，局部写入会同步到所有区域；为false时只写入当前帧的区域，
+    // 调用者每帧需要重新写入所有用到的数据，适合粒子、调试线这类整体重建的数据。
+    class DVKDynamicVertexBuffer
+    {
+    private:
+        struct DirtyRange
+        {
+            VkDeviceSize    begin = 0;
+            VkDeviceSize    end = 0;
+        };
+
+        DVKDynamicVertexBuffer()
+        {
+
+        }
+
+    public:
+        ~DVKDynamicVertexBuffer();
+
+        static DVKDynamicVertexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkDeviceSize size, int32 frameCount, bool keepShadow = true, DVKDynamicUpload upload = DVKDynamicUpload::Auto);
+
+        // 选择本帧使用的区域，一般传入backBufferIndex，需在Write/Lock之前调用
+        void BeginFrame(int32 index);
+
+        void Write(const void* data, VkDeviceSize dataSize, VkDeviceSize offset = 0);
+
+        // 返回[offset, offset + lockSize)的写入地址并标记为脏，地址只在本帧有效
+        void* Lock(VkDeviceSize lockSize, VkDeviceSize offset = 0);
+
+        // 把当前区域的脏数据提交给GPU，Staged模式会录制拷贝命令，需在RenderPass之外调用
+        void Upload(VkCommandBuffer commandBuffer);
+
+        void Bind(VkCommandBuffer cmdBuffer, uint32 binding = 0);
+
+        // 所有区域同步完成后释放CPU数据，之后的写入按keepShadow为false处理
+        void ReleaseShadow();
+
+        VkBuffer GetBuffer() const
+        {
+            return deviceBuffer ? deviceBuffer->buffer : hostBuffer->buffer;
+        }
+
+        VkDeviceSize GetOffset() const
+        {
+            return frameIndex * regionSize;
+        }
+
+    private:
+
+        void MarkDirty(DirtyRange& range, VkDeviceSize begin, VkDeviceSize end);
+
+    public:
+        VkDevice            device = VK_NULL_HANDLE;
+        DVKDynamicUpload    upload = DVKDynamicUpload::Direct;
+
+        VkDeviceSize        size = 0;
+        VkDeviceSize        regionSize = 0;
+        VkDeviceSize        atomSize = 1;
+        int32               frameCount = 0;
+        int32               frameIndex = 0;
+        bool                coherent = true;
+
+        // Direct模式下直接作为Vertex Buffer，Staged模式下为staging
+        DVKBuffer*          hostBuffer = nullptr;
+        DVKBuffer*          deviceBuffer = nullptr;
+
+    private:
+
+        std::vector<uint8>      m_Shadow;
+        std::vector<DirtyRange> m_DirtyRanges;
+        bool                    m_KeepShadow = true;
+        bool                    m_ReleasePending = false;
+    };
+
 }
@@ -1,6 +1,7 @@
 ﻿#include "DemoBase.h"
 #include "DVKDefaultRes.h"
 #include "DVKCommand.h"
+#include "DVKAsyncCompute.h"
 
 void DemoBase::Setup()
 {
@@ -26,19 +27,29 @@ int32 DemoBase::AcquireBackbufferIndex()
 
 void DemoBase::Present(int backBufferIndex)
 {
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pWaitDstStageMask    = &m_WaitStageMask;
-    submitInfo.pWaitSemaphores      = &m_PresentComplete;
-    submitInfo.waitSemaphoreCount   = 1;
-    submitInfo.pSignalSemaphores    = &m_RenderComplete;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pCommandBuffers      = &(m_CommandBuffers[backBufferIndex]);
-    submitInfo.commandBufferCount   = 1;
+    Present(backBufferIndex, VK_NULL_HANDLE, 0);
+}
+
+void DemoBase::Present(int backBufferIndex, VkSemaphore waitSemaphore, VkPipelineStageFlags waitStageMask)
+{
+    vk_demo::DVKQueueSubmit submitInfo;
+    if (waitSemaphore != VK_NULL_HANDLE)
+    {
+        submitInfo.Wait(waitSemaphore, waitStageMask);
+    }
+    Present(backBufferIndex, submitInfo);
+}
+
+void DemoBase::Present(int backBufferIndex, const vk_demo::DVKQueueSubmit& extraInfo)
+{
+    vk_demo::DVKQueueSubmit submitInfo = extraInfo;
+    submitInfo.Wait(m_PresentComplete, m_WaitStageMask);
+    submitInfo.Signal(m_RenderComplete);
+    submitInfo.AddCommandBuffer(m_CommandBuffers[backBufferIndex]);
 
     vkResetFences(m_Device, 1, &(m_Fences[backBufferIndex]));
 
-    VERIFYVULKANRESULT(vkQueueSubmit(m_GfxQueue, 1, &submitInfo, m_Fences[backBufferIndex]));
+    VERIFYVULKANRESULT(submitInfo.Submit(m_GfxQueue, m_Fences[backBufferIndex]));
     vkWaitForFences(m_Device, 1, &(m_Fences[backBufferIndex]), true, MAX_uint64);
 
     // present
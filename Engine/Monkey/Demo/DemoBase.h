@@ -13,6 +13,11 @@
 
 #include <string>
 
+namespace vk_demo
+{
+    class DVKQueueSubmit;
+}
+
 class DemoBase : public AppModuleBase
 {
 public:
@@ -100,6 +105,12 @@ public:
 
     void Present(int backBufferIndex);
 
+    // 额外等待waitSemaphore，用于等待其它队列(例如Compute)的提交
+    void Present(int backBufferIndex, VkSemaphore waitSemaphore, VkPipelineStageFlags waitStageMask);
+
+    // submitInfo中的等待与发出会合并到本帧的Graphics提交中，可以使用timeline semaphore
+    void Present(int backBufferIndex, const vk_demo::DVKQueueSubmit& submitInfo);
+
     int32 AcquireBackbufferIndex();
 
     uint32 GetMemoryTypeFromProperties(uint32 typeBits, VkMemoryPropertyFlags properties);
@@ -3,18 +3,82 @@
 #include "Engine.h"
 #include "FileManager.h"
 
-#if PLATFORM_WINDOWS
+#include <atomic>
 
-#elif PLATFORM_MAC
+#if PLATFORM_WINDOWS
+    #include <Windows.h>
+#elif PLATFORM_MAC || PLATFORM_IOS || PLATFORM_LINUX
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#elif PLATFORM_ANDROID
+    #include <unistd.h>
+    #include "Application/Android/AndroidWindow.h"
+#endif
 
-#elif PLATFORM_IOS
+static std::atomic<uint32> g_TempFileCounter(0);
 
-#elif PLATFORM_LINUX
+FileMapping::~FileMapping()
+{
+    if (m_HeapData)
+    {
+        delete[] m_HeapData;
+        m_HeapData = nullptr;
+    }
+    else if (m_Data)
+    {
+#if PLATFORM_WINDOWS
+        UnmapViewOfFile(m_Data);
+#elif PLATFORM_MAC || PLATFORM_IOS || PLATFORM_LINUX
+        munmap((void*)m_Data, m_Size);
+#endif
+    }
 
+#if PLATFORM_WINDOWS
+    if (m_MappingHandle)
+    {
+        CloseHandle((HANDLE)m_MappingHandle);
+        m_MappingHandle = nullptr;
+    }
+    if (m_FileHandle)
+    {
+        CloseHandle((HANDLE)m_FileHandle);
+        m_FileHandle = nullptr;
+    }
 #elif PLATFORM_ANDROID
-    #include "Application/Android/AndroidWindow.h"
+    if (m_Asset)
+    {
+        AAsset_close(m_Asset);
+        m_Asset = nullptr;
+    }
 #endif
 
+    m_Data = nullptr;
+    m_Size = 0;
+}
+
+void FileMapping::Prefetch(uint32 offset, uint32 size) const
+{
+    if (!m_Data || m_HeapData || offset >= m_Size)
+    {
+        return;
+    }
+
+    if (size == 0 || offset + size > m_Size)
+    {
+        size = m_Size - offset;
+    }
+
+#if PLATFORM_MAC || PLATFORM_IOS || PLATFORM_LINUX
+    // madvise要求起始地址页对齐
+    const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)(m_Data + offset);
+    uintptr_t begin = start & ~(pageSize - 1);
+    madvise((void*)begin, size + (start - begin), MADV_WILLNEED);
+#endif
+}
+
 std::string FileManager::GetFilePath(const std::string& filepath)
 {
 #if defined (DEMO_RES_PATH)
@@ -24,6 +88,153 @@ std::string FileManager::GetFilePath(const std::string& filepath)
 #endif
 }
 
+bool FileManager::FileExists(const std::string& filepath)
+{
+    std::string finalPath = FileManager::GetFilePath(filepath);
+
+#if PLATFORM_ANDROID
+    AAsset* asset = AAssetManager_open(g_AndroidApp->activity->assetManager, finalPath.c_str(), AASSET_MODE_UNKNOWN);
+    if (!asset)
+    {
+        return false;
+    }
+    AAsset_close(asset);
+    return true;
+#else
+    FILE* file = fopen(finalPath.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    fclose(file);
+    return true;
+#endif
+}
+
+FileMappingRef FileManager::MapFile(const std::string& filepath)
+{
+    std::string finalPath = FileManager::GetFilePath(filepath);
+    FileMappingRef mapping(new FileMapping());
+
+#if PLATFORM_ANDROID
+
+    // AASSET_MODE_BUFFER让未压缩的asset直接映射apk中的数据
+    AAsset* asset = AAssetManager_open(g_AndroidApp->activity->assetManager, finalPath.c_str(), AASSET_MODE_BUFFER);
+    if (!asset)
+    {
+        MLOGE("File not found :%s", filepath.c_str());
+        return nullptr;
+    }
+
+    mapping->m_Asset = asset;
+    mapping->m_Size  = (uint32)AAsset_getLength(asset);
+    mapping->m_Data  = (const uint8*)AAsset_getBuffer(asset);
+
+#elif PLATFORM_WINDOWS
+
+    HANDLE file = CreateFileA(finalPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        MLOGE("File not found :%s", filepath.c_str());
+        return nullptr;
+    }
+
+    mapping->m_FileHandle = file;
+    mapping->m_Size = (uint32)GetFileSize(file, nullptr);
+
+    if (mapping->m_Size > 0)
+    {
+        HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (fileMapping)
+        {
+            mapping->m_MappingHandle = fileMapping;
+            mapping->m_Data = (const uint8*)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+
+#else
+
+    int32 fd = open(finalPath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        MLOGE("File not found :%s", filepath.c_str());
+        return nullptr;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0)
+    {
+        mapping->m_Size = (uint32)fileStat.st_size;
+    }
+
+    if (mapping->m_Size > 0)
+    {
+        void* data = mmap(nullptr, mapping->m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            mapping->m_Data = (const uint8*)data;
+        }
+    }
+
+    // 映射建立之后即可关闭文件描述符
+    close(fd);
+
+#endif
+
+    if (mapping->m_Size == 0)
+    {
+        MLOGE("File has no data :%s", filepath.c_str());
+        return nullptr;
+    }
+
+    // 平台不支持映射(例如压缩过的asset)，回退为一次性读取
+    if (mapping->m_Data == nullptr)
+    {
+        uint8* dataPtr  = nullptr;
+        uint32 dataSize = 0;
+        if (!FileManager::ReadFile(filepath, dataPtr, dataSize))
+        {
+            return nullptr;
+        }
+        mapping->m_HeapData = dataPtr;
+        mapping->m_Data     = dataPtr;
+        mapping->m_Size     = dataSize;
+    }
+
+    return mapping;
+}
+
+void FileManager::PrefetchFile(const std::string& filepath)
+{
+    std::string finalPath = FileManager::GetFilePath(filepath);
+
+#if PLATFORM_LINUX
+    int32 fd = open(finalPath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    // 内核异步预读，随后的MapFile/ReadFile直接命中page cache
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+#elif PLATFORM_MAC || PLATFORM_IOS
+    int32 fd = open(finalPath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0)
+    {
+        struct radvisory advisory;
+        advisory.ra_offset = 0;
+        advisory.ra_count  = (int)fileStat.st_size;
+        fcntl(fd, F_RDADVISE, &advisory);
+    }
+    close(fd);
+#endif
+}
+
 bool FileManager::ReadFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize)
 {
     std::string finalPath = FileManager::GetFilePath(filepath);
@@ -64,3 +275,51 @@ bool FileManager::ReadFile(const std::string& filepath, uint8*& dataPtr, uint32&
 
     return true;
 }
+
+bool FileManager::WriteFile(const std::string& filepath, const uint8* dataPtr, uint32 dataSize)
+{
+    std::string finalPath = FileManager::GetFilePath(filepath);
+
+    // 先写临时文件再改名，避免其它进程读到写了一半的数据。
+    // 临时文件名带上进程号和计数，多个线程或进程同时写同一个文件时互不覆盖
+#if PLATFORM_WINDOWS
+    uint32 processID = (uint32)GetCurrentProcessId();
+#else
+    uint32 processID = (uint32)getpid();
+#endif
+    char suffix[64];
+    sprintf(suffix, ".%u.%u.tmp", processID, g_TempFileCounter.fetch_add(1));
+    std::string tempPath = finalPath + suffix;
+
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file)
+    {
+        MLOGE("Failed open file for write :%s", filepath.c_str());
+        return false;
+    }
+
+    size_t written = fwrite(dataPtr, 1, dataSize, file);
+    fclose(file);
+
+    if (written != dataSize)
+    {
+        remove(tempPath.c_str());
+        MLOGE("Failed write file :%s", filepath.c_str());
+        return false;
+    }
+
+    // 直接覆盖目标文件，读取者要么看到旧文件要么看到新文件，不会出现文件不存在的窗口
+#if PLATFORM_WINDOWS
+    bool renamed = MoveFileExA(tempPath.c_str(), finalPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = rename(tempPath.c_str(), finalPath.c_str()) == 0;
+#endif
+    if (!renamed)
+    {
+        remove(tempPath.c_str());
+        MLOGE("Failed write file :%s", filepath.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -3,12 +3,71 @@
 #include "Common/Common.h"
 
 #include <string>
+#include <memory>
+
+struct AAsset;
+
+class FileMapping
+{
+public:
+    ~FileMapping();
+
+    const uint8* GetData() const
+    {
+        return m_Data;
+    }
+
+    uint32 GetSize() const
+    {
+        return m_Size;
+    }
+
+    // 提示系统提前把[offset, offset + size)读入page cache，不阻塞调用线程
+    void Prefetch(uint32 offset = 0, uint32 size = 0) const;
+
+private:
+    friend class FileManager;
+
+    FileMapping()
+    {
+
+    }
+
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+
+private:
+    const uint8*    m_Data = nullptr;
+    uint32          m_Size = 0;
+
+    // mmap失败时回退到堆内存
+    uint8*          m_HeapData = nullptr;
+
+#if PLATFORM_WINDOWS
+    void*           m_FileHandle = nullptr;
+    void*           m_MappingHandle = nullptr;
+#elif PLATFORM_ANDROID
+    AAsset*         m_Asset = nullptr;
+#endif
+};
+
+typedef std::shared_ptr<FileMapping> FileMappingRef;
 
 class FileManager
 {
 public:
     static bool ReadFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize);
 
+    static bool WriteFile(const std::string& filepath, const uint8* dataPtr, uint32 dataSize);
+
+    // 只读映射，数据由page cache提供，生命周期跟随返回的FileMappingRef
+    static FileMappingRef MapFile(const std::string& filepath);
+
+    // 异步预读提示，用于在真正加载前让系统开始IO
+    static void PrefetchFile(const std::string& filepath);
+
+    static bool FileExists(const std::string& filepath);
+
     static std::string GetFilePath(const std::string& filepath);
 
-};
\ No newline at end of file
+};
@@ -9,11 +9,13 @@ VulkanDevice::VulkanDevice(VkPhysicalDevice physicalDevice)
     , m_PhysicalDevice(physicalDevice)
     , m_GfxQueue(nullptr)
     , m_ComputeQueue(nullptr)
+    , m_AsyncComputeQueue(nullptr)
     , m_TransferQueue(nullptr)
     , m_PresentQueue(nullptr)
     , m_FenceManager(nullptr)
     , m_MemoryManager(nullptr)
 	, m_PhysicalDeviceFeatures2(nullptr)
+	, m_TimelineSemaphore(false)
 {
     
 }
@@ -36,13 +38,68 @@ void VulkanDevice::CreateDevice()
 
 	if (m_AppDeviceExtensions.size() > 0)
 	{
+		uint32 count = 0;
+		vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &count, nullptr);
+		std::vector<VkExtensionProperties> properties(count);
+		vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &count, properties.data());
+
 		MLOG("Using app device extensions");
 		for (int32 i = 0; i < m_AppDeviceExtensions.size(); ++i)
 		{
-			deviceExtensions.push_back(m_AppDeviceExtensions[i]);
+			// 不支持的扩展直接跳过，由使用者通过IsExtensionEnabled判断
+			bool supported = false;
+			for (int32 j = 0; j < properties.size(); ++j)
+			{
+				if (strcmp(properties[j].extensionName, m_AppDeviceExtensions[i]) == 0)
+				{
+					supported = true;
+					break;
+				}
+			}
+
+			if (!supported)
+			{
+				MLOGE("App device extension %s not supported.", m_AppDeviceExtensions[i]);
+				continue;
+			}
+
+			bool found = false;
+			for (int32 j = 0; j < deviceExtensions.size(); ++j)
+			{
+				found = found || strcmp(deviceExtensions[j], m_AppDeviceExtensions[i]) == 0;
+			}
+			if (!found)
+			{
+				deviceExtensions.push_back(m_AppDeviceExtensions[i]);
+			}
 			MLOG("* %s", m_AppDeviceExtensions[i]);
 		}
 	}
+
+	for (int32 i = 0; i < deviceExtensions.size(); ++i)
+	{
+		m_EnabledExtensions.push_back(deviceExtensions[i]);
+	}
+
+	m_TimelineSemaphore = false;
+	for (int32 i = 0; i < deviceExtensions.size(); ++i)
+	{
+		m_TimelineSemaphore = m_TimelineSemaphore || strcmp(deviceExtensions[i], VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0;
+	}
+
+	// 扩展可用时timelineSemaphore特性必然支持，App自己开启过该特性时不再重复添加
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures;
+	ZeroVulkanStruct(timelineFeatures, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR);
+	timelineFeatures.timelineSemaphore = VK_TRUE;
+
+	bool chainTimeline = m_TimelineSemaphore;
+	for (VkBaseOutStructure* next = (VkBaseOutStructure*)m_PhysicalDeviceFeatures2; next != nullptr; next = next->pNext)
+	{
+		if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR || next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES)
+		{
+			chainTimeline = false;
+		}
+	}
 	
     VkDeviceCreateInfo deviceInfo;
     ZeroVulkanStruct(deviceInfo, VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO);
@@ -55,9 +112,16 @@ void VulkanDevice::CreateDevice()
 		deviceInfo.pNext            = m_PhysicalDeviceFeatures2;
 		deviceInfo.pEnabledFeatures = nullptr;
 		m_PhysicalDeviceFeatures2->features = m_PhysicalDeviceFeatures;
+		if (chainTimeline) {
+			timelineFeatures.pNext = m_PhysicalDeviceFeatures2->pNext;
+			m_PhysicalDeviceFeatures2->pNext = &timelineFeatures;
+		}
 	}
 	else {
 		deviceInfo.pEnabledFeatures = &m_PhysicalDeviceFeatures;
+		if (chainTimeline) {
+			deviceInfo.pNext = &timelineFeatures;
+		}
 	}
 
     MLOG("Found %d Queue Families", (int32)m_QueueFamilyProps.size());
@@ -68,6 +132,7 @@ void VulkanDevice::CreateDevice()
 	int32 gfxQueueFamilyIndex 	   = -1;
 	int32 computeQueueFamilyIndex  = -1;
 	int32 transferQueueFamilyIndex = -1;
+	int32 asyncComputeFamilyIndex  = -1;
 	
 	for (int32 familyIndex = 0; familyIndex < m_QueueFamilyProps.size(); ++familyIndex)
 	{
@@ -89,6 +154,13 @@ void VulkanDevice::CreateDevice()
 				computeQueueFamilyIndex = familyIndex;
 				isValidQueue = true;
 			}
+
+			// 独立的Compute队列族，异步Compute可以和Graphics并行执行
+			if (asyncComputeFamilyIndex == -1 && (currProps.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0)
+			{
+				asyncComputeFamilyIndex = familyIndex;
+				isValidQueue = true;
+			}
 		}
 
 		if ((currProps.queueFlags & VK_QUEUE_TRANSFER_BIT) == VK_QUEUE_TRANSFER_BIT)
@@ -150,6 +222,10 @@ void VulkanDevice::CreateDevice()
 	deviceInfo.pQueueCreateInfos    = queueFamilyInfos.data();
 	
 	VkResult result = vkCreateDevice(m_PhysicalDevice, &deviceInfo, VULKAN_CPU_ALLOCATOR, &m_Device);
+
+	if (m_PhysicalDeviceFeatures2 && chainTimeline) {
+		m_PhysicalDeviceFeatures2->pNext = timelineFeatures.pNext;
+	}
 	if (result == VK_ERROR_INITIALIZATION_FAILED)
 	{
 		MLOG("%s", "Cannot create a Vulkan device. Try updating your video driver to a more recent version.\n");
@@ -163,6 +239,17 @@ void VulkanDevice::CreateDevice()
 	}
 	m_ComputeQueue = std::make_shared<VulkanQueue>(this, computeQueueFamilyIndex);
 
+	if (asyncComputeFamilyIndex != -1) {
+		m_AsyncComputeQueue = std::make_shared<VulkanQueue>(this, asyncComputeFamilyIndex);
+	}
+	else if (m_QueueFamilyProps[computeQueueFamilyIndex].queueCount > 1) {
+		m_AsyncComputeQueue = std::make_shared<VulkanQueue>(this, computeQueueFamilyIndex, 1);
+	}
+	else {
+		m_AsyncComputeQueue = m_ComputeQueue;
+	}
+	MLOG("Async compute queue family %d index %d", m_AsyncComputeQueue->GetFamilyIndex(), m_AsyncComputeQueue->GetQueueIndex());
+
 	if (transferQueueFamilyIndex == -1) {
 		transferQueueFamilyIndex = computeQueueFamilyIndex;
 	}
@@ -432,6 +519,17 @@ void VulkanDevice::Destroy()
 	m_Device = VK_NULL_HANDLE;
 }
 
+bool VulkanDevice::IsExtensionEnabled(const char* name) const
+{
+	for (int32 i = 0; i < m_EnabledExtensions.size(); ++i)
+	{
+		if (m_EnabledExtensions[i] == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
 bool VulkanDevice::IsFormatSupported(VkFormat format)
 {
 	auto ArePropertiesSupported = [](const VkFormatProperties& prop) -> bool 
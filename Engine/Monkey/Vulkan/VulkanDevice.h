@@ -10,6 +10,7 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <string>
 
 class VulkanFenceManager;
 class VulkanDeviceMemoryManager;
@@ -31,6 +32,8 @@ public:
     
     bool IsFormatSupported(VkFormat format);
     
+    bool IsExtensionEnabled(const char* name) const;
+    
     const VkComponentMapping& GetFormatComponentMapping(PixelFormat format) const;
     
     void SetupPresentQueue(VkSurfaceKHR surface);
@@ -45,6 +48,12 @@ public:
         return m_ComputeQueue;
     }
     
+    // 优先使用不带Graphics的队列族，其次是Graphics队列族中的第二个队列，都没有时与Graphics共用同一个队列
+    FORCE_INLINE std::shared_ptr<VulkanQueue> GetAsyncComputeQueue()
+    {
+        return m_AsyncComputeQueue;
+    }
+    
     FORCE_INLINE std::shared_ptr<VulkanQueue> GetTransferQueue()
     {
         return m_TransferQueue;
@@ -75,6 +84,12 @@ public:
         return m_PhysicalDeviceFeatures;
     }
     
+    // 设备支持时自动开启VK_KHR_timeline_semaphore
+    FORCE_INLINE bool SupportsTimelineSemaphore() const
+    {
+        return m_TimelineSemaphore;
+    }
+    
     FORCE_INLINE VkDevice GetInstanceHandle() const
     {
         return m_Device;
@@ -133,6 +148,7 @@ private:
 
     std::shared_ptr<VulkanQueue>            m_GfxQueue;
     std::shared_ptr<VulkanQueue>            m_ComputeQueue;
+    std::shared_ptr<VulkanQueue>            m_AsyncComputeQueue;
     std::shared_ptr<VulkanQueue>            m_TransferQueue;
     std::shared_ptr<VulkanQueue>            m_PresentQueue;
 
@@ -140,5 +156,7 @@ private:
     VulkanDeviceMemoryManager*              m_MemoryManager;
 
 	std::vector<const char*>				m_AppDeviceExtensions;
+	std::vector<std::string>				m_EnabledExtensions;
 	VkPhysicalDeviceFeatures2*				m_PhysicalDeviceFeatures2;
+	bool									m_TimelineSemaphore;
 };
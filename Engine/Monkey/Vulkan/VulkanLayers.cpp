@@ -89,12 +89,14 @@ static const char* G_DeviceExtensions[] =
 	VK_KHR_MAINTENANCE1_EXTENSION_NAME,
 
 #if PLATFORM_WINDOWS
+	VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
 
 #elif PLATFORM_MAC
 
 #elif PLATFORM_IOS
 
 #elif PLATFORM_LINUX
+	VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
 
 #elif PLATFORM_ANDROID
 	
@@ -2,12 +2,13 @@
 #include "VulkanDevice.h"
 #include "VulkanFence.h"
 
-VulkanQueue::VulkanQueue(VulkanDevice* device, uint32 familyIndex)
+VulkanQueue::VulkanQueue(VulkanDevice* device, uint32 familyIndex, uint32 queueIndex)
     : m_Queue(VK_NULL_HANDLE)
     , m_FamilyIndex(familyIndex)
+    , m_QueueIndex(queueIndex)
     , m_Device(device)
 {
-    vkGetDeviceQueue(m_Device->GetInstanceHandle(), m_FamilyIndex, 0, &m_Queue);
+    vkGetDeviceQueue(m_Device->GetInstanceHandle(), m_FamilyIndex, m_QueueIndex, &m_Queue);
 }
 
 VulkanQueue::~VulkanQueue()
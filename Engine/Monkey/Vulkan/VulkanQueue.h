@@ -10,7 +10,7 @@ class VulkanQueue
 {
 public:
     
-    VulkanQueue(VulkanDevice* device, uint32 familyIndex);
+    VulkanQueue(VulkanDevice* device, uint32 familyIndex, uint32 queueIndex = 0);
     
     virtual ~VulkanQueue();
     
@@ -18,6 +18,11 @@ public:
     {
         return m_FamilyIndex;
     }
+
+    FORCE_INLINE uint32 GetQueueIndex() const
+    {
+        return m_QueueIndex;
+    }
     
 	FORCE_INLINE VkQueue GetHandle() const
     {
@@ -27,6 +32,7 @@ public:
 private:
     VkQueue         m_Queue;
     uint32          m_FamilyIndex;
+    uint32          m_QueueIndex;
 	VulkanDevice*   m_Device;
 };
 
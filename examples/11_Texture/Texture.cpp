@@ -8,6 +8,7 @@
 #include "Math/Matrix4x4.h"
 
 #include <vector>
+#include <chrono>
 
 class TextureModule : public DemoBase
 {
@@ -147,19 +148,33 @@ private:
     void LoadAssets()
     {
         vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+        vk_demo::DVKAssetLoader* loader = vk_demo::DVKAssetLoader::Create(m_VulkanDevice, cmdBuffer);
 
-        m_Model = vk_demo::DVKModel::LoadFromFile(
+        auto timeStart = std::chrono::high_resolution_clock::now();
+
+        // 模型与纹理同时在工作线程上解码，主线程只负责上传
+        vk_demo::DVKAssetHandle model = loader->LoadModel(
             "assets/models/head.obj",
-            m_VulkanDevice,
-            cmdBuffer,
             { VertexAttribute::VA_Position, VertexAttribute::VA_UV0, VertexAttribute::VA_Normal, VertexAttribute::VA_Tangent }
         );
 
-        m_TexDiffuse       = vk_demo::DVKTexture::Create2D("assets/textures/head_diffuse.jpg", m_VulkanDevice, cmdBuffer);
-        m_TexNormal        = vk_demo::DVKTexture::Create2D("assets/textures/head_normal.jpg", m_VulkanDevice, cmdBuffer);
-        m_TexCurvature     = vk_demo::DVKTexture::Create2D("assets/textures/curvatureLUT.png", m_VulkanDevice, cmdBuffer);
-        m_TexPreIntegrated = vk_demo::DVKTexture::Create2D("assets/textures/preIntegratedLUT.png", m_VulkanDevice, cmdBuffer);
+        vk_demo::DVKAssetHandle texDiffuse       = loader->LoadTexture2D("assets/textures/head_diffuse.jpg");
+        vk_demo::DVKAssetHandle texNormal        = loader->LoadTexture2D("assets/textures/head_normal.jpg");
+        vk_demo::DVKAssetHandle texCurvature     = loader->LoadTexture2D("assets/textures/curvatureLUT.png");
+        vk_demo::DVKAssetHandle texPreIntegrated = loader->LoadTexture2D("assets/textures/preIntegratedLUT.png");
+
+        loader->Flush();
+
+        auto timeEnd = std::chrono::high_resolution_clock::now();
+        MLOG("Load assets : %.2fms, %d threads", std::chrono::duration<float, std::milli>(timeEnd - timeStart).count(), loader->GetThreadCount());
+
+        m_Model            = model->model;
+        m_TexDiffuse       = texDiffuse->texture;
+        m_TexNormal        = texNormal->texture;
+        m_TexCurvature     = texCurvature->texture;
+        m_TexPreIntegrated = texPreIntegrated->texture;
 
+        delete loader;
         delete cmdBuffer;
     }
 
@@ -447,6 +447,9 @@ private:
                 }
             }
 
+            vk_demo::DVKLayoutCacheStats layoutStats = vk_demo::DVKLayoutCache::GetStats();
+            ImGui::Text("SetLayout:%d/%d PipelineLayout:%d/%d Pool:%d Recycled:%d", layoutStats.setLayoutsCreated, layoutStats.setLayoutRequests, layoutStats.pipelineLayoutsCreated, layoutStats.pipelineLayoutRequests, layoutStats.descriptorPoolsCreated, layoutStats.descriptorSetsRecycled);
+
             ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::End();
         }
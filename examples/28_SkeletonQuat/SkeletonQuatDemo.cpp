@@ -8,6 +8,7 @@
 #include "Math/Quat.h"
 
 #include <vector>
+#include <chrono>
 
 class SkeletonQuatDemo : public DemoBase
 {
@@ -60,19 +61,14 @@ public:
 
 private:
 
-    struct ModelViewProjectionBlock
+    struct ViewProjectionBlock
     {
-        Matrix4x4 model;
         Matrix4x4 view;
         Matrix4x4 projection;
     };
 
-#define MAX_BONES 64
-    struct BonesTransformBlock
-    {
-        Vector4 dualQuats[MAX_BONES * 2];
-        Vector4 debugParam;
-    };
+#define MAX_CHARACTERS 1024
+#define MAX_PRESKIN_CHARACTERS 64
 
     void Draw(float time, float delta)
     {
@@ -84,61 +80,41 @@ private:
             m_ViewCamera.Update(time, delta);
         }
 
-        m_MVPData.view = m_ViewCamera.GetView();
-        m_MVPData.projection = m_ViewCamera.GetProjection();
+        m_ViewProjData.view = m_ViewCamera.GetView();
+        m_ViewProjData.projection = m_ViewCamera.GetProjection();
 
         UpdateAnimation(time, delta);
 
-        // 设置Room参数
-        // m_RoleModel->rootNode->localMatrix.AppendRotation(delta * 90.0f, Vector3::UpVector);
+        // 所有角色的调色板写入本帧的区域
+        auto timeStart = std::chrono::high_resolution_clock::now();
+        m_Palette->Update(bufferIndex, m_Instances, m_Parallel ? m_JobSystem : nullptr);
+        m_PaletteTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - timeStart).count();
+
+        // 拾取使用本帧调色板在CPU上蒙皮后的顶点
+        if (m_Pick && !hovered)
+        {
+            PickCharacter();
+        }
+
+        // 每个Mesh一组参数，所有角色实例化绘制
         m_RoleMaterial->BeginFrame();
         for (int32 i = 0; i < m_RoleModel->meshes.size(); ++i)
         {
-            vk_demo::DVKMesh* mesh = m_RoleModel->meshes[i];
-
-            // model data
-            m_MVPData.model = mesh->linkNode->GetGlobalMatrix();
-
-            // bones data
-            for (int32 j = 0; j < mesh->bones.size(); ++j)
-            {
-                int32 boneIndex = mesh->bones[j];
-                vk_demo::DVKBone* bone = m_RoleModel->bones[boneIndex];
-
-                // 获取骨骼的最终Transform矩阵
-                // 也可以使用对偶四元素来替换矩阵的计算
-                Matrix4x4 boneTransform = bone->finalTransform;
-                boneTransform.Append(mesh->linkNode->GetGlobalMatrix().Inverse());
-
-                // 从Transform矩阵中获取四元数以及位移信息
-                Quat quat   = boneTransform.ToQuat();
-                Vector3 pos = boneTransform.GetOrigin();
-
-                // 转为使用对偶四元数
-                float dx = (+0.5) * ( pos.x * quat.w + pos.y * quat.z - pos.z * quat.y);
-                float dy = (+0.5) * (-pos.x * quat.z + pos.y * quat.w + pos.z * quat.x);
-                float dz = (+0.5) * ( pos.x * quat.y - pos.y * quat.x + pos.z * quat.w);
-                float dw = (-0.5) * ( pos.x * quat.x + pos.y * quat.y + pos.z * quat.z);
-
-                // 设置参数
-                m_BonesData.dualQuats[j * 2 + 0].Set(quat.x, quat.y, quat.z, quat.w);
-                m_BonesData.dualQuats[j * 2 + 1].Set(dx, dy, dz, dw);
-            }
-
-            // 没有骨骼数据设置默认
-            if (mesh->bones.size() == 0)
-            {
-                m_BonesData.dualQuats[0].Set(0, 0, 0, 1);
-                m_BonesData.dualQuats[1].Set(0, 0, 0, 0);
-            }
-
+            vk_demo::DVKSkinMeshParam skinParam = m_Palette->GetMeshParam(i);
             m_RoleMaterial->BeginObject();
-            m_RoleMaterial->SetLocalUniform("bonesData", &m_BonesData, sizeof(BonesTransformBlock));
-            m_RoleMaterial->SetLocalUniform("uboMVP",    &m_MVPData,   sizeof(ModelViewProjectionBlock));
+            m_RoleMaterial->SetLocalUniform("uboViewProj", &m_ViewProjData, sizeof(ViewProjectionBlock));
+            m_RoleMaterial->SetLocalUniform("uboSkin",     &skinParam,      sizeof(vk_demo::DVKSkinMeshParam));
             m_RoleMaterial->EndObject();
         }
         m_RoleMaterial->EndFrame();
 
+        // 预蒙皮后的顶点在世界空间，只需要ViewProjection
+        m_CachedMaterial->BeginFrame();
+        m_CachedMaterial->BeginObject();
+        m_CachedMaterial->SetLocalUniform("uboViewProj", &m_ViewProjData, sizeof(ViewProjectionBlock));
+        m_CachedMaterial->EndObject();
+        m_CachedMaterial->EndFrame();
+
         SetupCommandBuffers(bufferIndex);
 
         DemoBase::Present(bufferIndex);
@@ -146,13 +122,145 @@ private:
 
     void UpdateAnimation(float time, float delta)
     {
-        if (m_AutoAnimation)
+        m_Instances.resize(m_NumCharacters);
+        for (int32 i = 0; i < m_Instances.size(); ++i)
         {
-            m_RoleModel->Update(time, delta);
+            vk_demo::DVKSkinInstance& instance = m_Instances[i];
+
+            // 叠加层：相对该动画第一帧的差值
+            if (m_AdditiveWeight > 0.0f)
+            {
+                vk_demo::DVKAnimLayer& layer = instance.GetLayer(1);
+                if (layer.animation != m_AdditiveIndex)
+                {
+                    layer.Play(m_AdditiveIndex);
+                }
+                layer.mode   = vk_demo::DVKAnimBlendMode::Additive;
+                layer.weight = m_AdditiveWeight;
+            }
+            else
+            {
+                instance.layers.resize(1);
+            }
+
+            if (m_AutoAnimation)
+            {
+                instance.Advance(m_Skeleton, delta * m_AnimSpeed);
+            }
+            else
+            {
+                instance.layers[0].time = m_AnimTime;
+            }
+        }
+    }
+
+    bool IntersectTriangle(const Vector3& orig, const Vector3& dir, const Vector3& v0, const Vector3& v1, const Vector3& v2, float* t)
+    {
+        Vector3 edge1 = v1 - v0;
+        Vector3 edge2 = v2 - v0;
+
+        Vector3 pvec = Vector3::CrossProduct(dir, edge2);
+
+        float det = Vector3::DotProduct(edge1, pvec);
+
+        Vector3 tvec;
+        if (det > 0)
+        {
+            tvec = orig - v0;
         }
         else
         {
-            m_RoleModel->GotoAnimation(m_AnimTime);
+            tvec = v0 - orig;
+            det = -det;
+        }
+
+        if (det < 0.0001f)
+        {
+            return false;
+        }
+
+        float u = Vector3::DotProduct(tvec, pvec);
+        if (u < 0.0f || u > det)
+        {
+            return false;
+        }
+
+        Vector3 qvec = Vector3::CrossProduct(tvec, edge1);
+
+        float v = Vector3::DotProduct(dir, qvec);
+        if (v < 0.0f || u + v > det)
+        {
+            return false;
+        }
+
+        *t = Vector3::DotProduct(edge2, qvec) / det;
+
+        return true;
+    }
+
+    void PickCharacter()
+    {
+        Matrix4x4 invProj = m_ViewCamera.GetProjection();
+        invProj.SetInverse();
+        Matrix4x4 invView = m_ViewCamera.GetView();
+        invView.SetInverse();
+        Vector2 mousePos  = InputManager::GetMousePosition();
+
+        // 屏幕坐标转换为世界空间的射线
+        Vector3 clipPos;
+        clipPos.x = (mousePos.x / GetWidth() * 2.0f - 1.0f);
+        clipPos.y = -(mousePos.y / GetHeight() * 2.0f - 1.0f);
+        clipPos.z = 1.0f;
+
+        Vector3 ray = invProj.TransformPosition(clipPos);
+        ray.x = ray.x * ray.z;
+        ray.y = ray.y * ray.z;
+        ray = invView.DeltaTransformVector(ray);
+        ray = ray.GetSafeNormal();
+
+        Vector3 origin = m_ViewCamera.GetTransform().GetOrigin();
+
+        // 绑定姿势的包围盒放大一些作为包围球，动画超出的部分也能覆盖
+        vk_demo::DVKBoundingBox bounds = m_RoleModel->rootNode->GetBounds();
+        Vector3 boundCenter = (bounds.min + bounds.max) * 0.5f;
+        float   boundRadius = (bounds.max - bounds.min).Size() * 0.75f;
+
+        float dist = MAX_flt;
+        m_PickedIndex = -1;
+
+        for (int32 i = 0; i < m_Palette->numInstances; ++i)
+        {
+            Vector3 center = m_Instances[i].world.TransformPosition(boundCenter);
+            Vector3 toCenter = center - origin;
+            float along = Vector3::DotProduct(toCenter, ray);
+            if (toCenter.SizeSquared() - along * along > boundRadius * boundRadius)
+            {
+                continue;
+            }
+
+            for (int32 meshID = 0; meshID < m_RoleModel->meshes.size(); ++meshID)
+            {
+                vk_demo::DVKMesh* mesh = m_RoleModel->meshes[meshID];
+                for (int32 primitiveID = 0; primitiveID < mesh->primitives.size(); ++primitiveID)
+                {
+                    const std::vector<uint32>& indices = mesh->primitives[primitiveID]->indices;
+                    m_SkinCache->ComputePositions(i, meshID, primitiveID, m_PickPositions);
+                    if (m_PickPositions.size() == 0)
+                    {
+                        continue;
+                    }
+
+                    for (int32 idx = 0; idx + 2 < indices.size(); idx += 3)
+                    {
+                        float t = 0;
+                        if (IntersectTriangle(origin, ray, m_PickPositions[indices[idx + 0]], m_PickPositions[indices[idx + 1]], m_PickPositions[indices[idx + 2]], &t) && t <= dist)
+                        {
+                            dist = t;
+                            m_PickedIndex = i;
+                        }
+                    }
+                }
+            }
         }
     }
 
@@ -170,11 +278,36 @@ private:
                 SetAnimation(m_AnimIndex);
             }
 
-            bool checked = m_BonesData.debugParam.x >= 1.0f;
-            ImGui::Checkbox("Optimize", &checked);
-            m_BonesData.debugParam.x = checked ? 1.0f : 0.0f;
+            ImGui::SliderFloat("CrossFade", &m_CrossFade, 0.0f, 2.0f);
+
+            ImGui::SliderInt("Additive", &m_AdditiveIndex, 0, m_RoleModel->animations.size() - 1);
+            ImGui::SliderFloat("AddWeight", &m_AdditiveWeight, 0.0f, 1.0f);
+
+            if (ImGui::SliderInt("Characters", &m_NumCharacters, 1, m_PreSkin ? MAX_PRESKIN_CHARACTERS : MAX_CHARACTERS))
+            {
+                SetupInstances();
+            }
+
+            if (ImGui::Checkbox("PreSkin", &m_PreSkin) && m_PreSkin && m_NumCharacters > MAX_PRESKIN_CHARACTERS)
+            {
+                m_NumCharacters = MAX_PRESKIN_CHARACTERS;
+                SetupInstances();
+            }
+
+            if (ImGui::Checkbox("DualQuat", &m_DualQuat))
+            {
+                CreatePalette();
+            }
 
-            ImGui::SliderFloat("Speed", &(m_RoleModel->GetAnimation().speed), 0.0f, 10.0f);
+            ImGui::Checkbox("Parallel", &m_Parallel);
+
+            ImGui::Checkbox("Pick", &m_Pick);
+            if (m_Pick)
+            {
+                ImGui::Text("Picked:%d", m_PickedIndex);
+            }
+
+            ImGui::SliderFloat("Speed", &m_AnimSpeed, 0.0f, 10.0f);
 
             ImGui::Checkbox("AutoPlay", &m_AutoAnimation);
 
@@ -183,6 +316,8 @@ private:
                 ImGui::SliderFloat("Time", &m_AnimTime, 0.0f, m_AnimDuration);
             }
 
+            ImGui::Text("Anim:%.1fKB -> %.1fKB (%.1fx)", m_AnimReport.rawBytes / 1024.0f, m_AnimReport.compressedBytes / 1024.0f, m_AnimReport.GetRatio());
+            ImGui::Text("Palette:%.3fms Threads:%d", m_PaletteTime, m_Parallel ? m_JobSystem->GetThreadCount() : 1);
             ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::End();
         }
@@ -197,10 +332,80 @@ private:
 
     void SetAnimation(int32 index)
     {
-        m_RoleModel->SetAnimation(index);
-        m_AnimDuration = m_RoleModel->animations[index].duration;
+        m_AnimDuration = m_Skeleton->GetDuration(index);
         m_AnimTime     = 0.0f;
         m_AnimIndex    = index;
+
+        for (int32 i = 0; i < m_Instances.size(); ++i)
+        {
+            m_Instances[i].layers[0].Play(index, m_CrossFade, MMath::RandRange(0.0f, m_AnimDuration));
+        }
+    }
+
+    void SetupInstances()
+    {
+        vk_demo::DVKBoundingBox bounds = m_RoleModel->rootNode->GetBounds();
+        Vector3 boundSize = bounds.max - bounds.min;
+        float spacing = MMath::Max(boundSize.x, boundSize.z) * 1.5f;
+
+        // 以原点为中心排成方阵，每个角色随机的起始时间与速度
+        int32 columns = MMath::CeilToInt(MMath::Sqrt((float)m_NumCharacters));
+        int32 oldSize = m_Instances.size();
+        m_Instances.resize(m_NumCharacters);
+        for (int32 i = 0; i < m_Instances.size(); ++i)
+        {
+            vk_demo::DVKSkinInstance& instance = m_Instances[i];
+            instance.world.SetIdentity();
+            instance.world.AppendTranslation(Vector3(
+                (i % columns - (columns - 1) * 0.5f) * spacing,
+                0,
+                (i / columns) * spacing
+            ));
+
+            if (i >= oldSize)
+            {
+                vk_demo::DVKAnimLayer& layer = instance.layers[0];
+                layer.animation = m_AnimIndex;
+                layer.time      = MMath::RandRange(0.0f, m_AnimDuration);
+                layer.speed     = MMath::RandRange(0.8f, 1.2f);
+            }
+        }
+    }
+
+    void CreatePalette()
+    {
+        if (m_Palette)
+        {
+            vkDeviceWaitIdle(m_Device);
+            delete m_Palette;
+        }
+
+        m_Palette = vk_demo::DVKSkinPalette::Create(
+            m_VulkanDevice,
+            m_Skeleton,
+            MAX_CHARACTERS,
+            GetVulkanRHI()->GetSwapChain()->GetBackBufferCount(),
+            m_DualQuat ? vk_demo::DVKSkinPacking::DualQuat : vk_demo::DVKSkinPacking::Matrix3x4
+        );
+        m_RoleMaterial->SetStorageBuffer("palette", m_Palette->buffer);
+
+        // 预蒙皮读取的是调色板的Buffer，需要一起重建
+        if (m_SkinCache)
+        {
+            delete m_SkinCache;
+        }
+
+        vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+        m_SkinCache = vk_demo::DVKSkinCache::Create(
+            m_VulkanDevice,
+            m_PipelineCache,
+            cmdBuffer,
+            m_PreSkinShader,
+            m_Palette,
+            m_RoleAttributes,
+            MAX_PRESKIN_CHARACTERS
+        );
+        delete cmdBuffer;
     }
 
     void LoadAssets()
@@ -212,16 +417,20 @@ private:
             "assets/models/xiaonan/nvhai.fbx",
             m_VulkanDevice,
             cmdBuffer,
-            {
-                VertexAttribute::VA_Position,
-                VertexAttribute::VA_UV0,
-                VertexAttribute::VA_Normal,
-                VertexAttribute::VA_SkinPack,
-            }
+            m_RoleAttributes
         );
         m_RoleModel->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
 
+        // 压缩动画，之后采样使用压缩后的数据
+        m_RoleModel->CompressAnimations(vk_demo::DVKAnimCompressionSettings(), &m_AnimReport);
+        m_AnimReport.Print();
+
+        // 骨架由所有角色共享，调色板按角色并行计算
+        m_JobSystem = vk_demo::DVKJobSystem::Create();
+        m_Skeleton  = vk_demo::DVKSkeleton::Create(m_RoleModel);
+
         SetAnimation(0);
+        SetupInstances();
 
         // shader
         m_RoleShader = vk_demo::DVKShader::Create(
@@ -248,6 +457,30 @@ private:
         m_RoleMaterial->PreparePipeline();
         m_RoleMaterial->SetTexture("diffuseMap", m_RoleDiffuse);
 
+        // 预蒙皮
+        m_PreSkinShader = vk_demo::DVKShader::Create(
+            m_VulkanDevice,
+            "assets/shaders/28_SkeletonQuat/PreSkin.comp.spv"
+        );
+
+        m_CachedShader = vk_demo::DVKShader::Create(
+            m_VulkanDevice,
+            true,
+            "assets/shaders/28_SkeletonQuat/Cached.vert.spv",
+            "assets/shaders/28_SkeletonQuat/obj.frag.spv"
+        );
+
+        m_CachedMaterial = vk_demo::DVKMaterial::Create(
+            m_VulkanDevice,
+            m_RenderPass,
+            m_PipelineCache,
+            m_CachedShader
+        );
+        m_CachedMaterial->PreparePipeline();
+        m_CachedMaterial->SetTexture("diffuseMap", m_RoleDiffuse);
+
+        CreatePalette();
+
         delete cmdBuffer;
     }
 
@@ -257,6 +490,15 @@ private:
         delete m_RoleDiffuse;
         delete m_RoleMaterial;
         delete m_RoleModel;
+
+        delete m_SkinCache;
+        delete m_PreSkinShader;
+        delete m_CachedShader;
+        delete m_CachedMaterial;
+
+        delete m_Palette;
+        delete m_Skeleton;
+        delete m_JobSystem;
     }
 
     void SetupCommandBuffers(int32 backBufferIndex)
@@ -281,6 +523,12 @@ private:
         ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
         VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
+        // 每帧只蒙皮一次，之后所有Pass都可以直接使用缓存
+        if (m_PreSkin)
+        {
+            m_SkinCache->Dispatch(commandBuffer);
+        }
+
         VkClearValue clearValues[2];
         clearValues[0].color        = {
             { 0.2f, 0.2f, 0.2f, 1.0f }
@@ -302,11 +550,28 @@ private:
         vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
         vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_RoleMaterial->GetPipeline());
-        for (int32 j = 0; j < m_RoleModel->meshes.size(); ++j)
+        if (m_PreSkin)
         {
-            m_RoleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, j);
-            m_RoleModel->meshes[j]->BindDrawCmd(commandBuffer);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_CachedMaterial->GetPipeline());
+            m_CachedMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+            for (int32 i = 0; i < m_SkinCache->numInstances; ++i)
+            {
+                m_SkinCache->BindDrawCmd(commandBuffer, i);
+            }
+        }
+        else
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_RoleMaterial->GetPipeline());
+            for (int32 j = 0; j < m_RoleModel->meshes.size(); ++j)
+            {
+                vk_demo::DVKMesh* mesh = m_RoleModel->meshes[j];
+                for (int32 k = 0; k < mesh->primitives.size(); ++k)
+                {
+                    mesh->primitives[k]->indexBuffer->instanceCount = m_Palette->numInstances;
+                }
+                m_RoleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, j);
+                mesh->BindDrawCmd(commandBuffer);
+            }
         }
 
         m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
@@ -322,10 +587,8 @@ private:
         Vector3 boundSize   = bounds.max - bounds.min;
         Vector3 boundCenter = bounds.min + boundSize * 0.5f;
 
-        m_ViewCamera.SetPosition(boundCenter.x, boundCenter.y, boundCenter.z - boundSize.Size() * 2.0);
-        m_ViewCamera.Perspective(PI / 4, GetWidth(), GetHeight(), 0.10f, 3000.0f);
-
-        m_BonesData.debugParam.Set(0, 0, 0, 0);
+        m_ViewCamera.SetPosition(boundCenter.x, boundCenter.y + boundSize.y * 2.0f, boundCenter.z - boundSize.Size() * 4.0);
+        m_ViewCamera.Perspective(PI / 4, GetWidth(), GetHeight(), 0.10f, 30000.0f);
     }
 
     void CreateGUI()
@@ -345,20 +608,51 @@ private:
     bool                        m_Ready = false;
     vk_demo::DVKCamera          m_ViewCamera;
 
-    ModelViewProjectionBlock    m_MVPData;
-    BonesTransformBlock         m_BonesData;
+    ViewProjectionBlock         m_ViewProjData;
 
     vk_demo::DVKModel*          m_RoleModel = nullptr;
     vk_demo::DVKShader*         m_RoleShader = nullptr;
     vk_demo::DVKTexture*        m_RoleDiffuse = nullptr;
     vk_demo::DVKMaterial*       m_RoleMaterial = nullptr;
 
+    std::vector<VertexAttribute> m_RoleAttributes = {
+        VertexAttribute::VA_Position,
+        VertexAttribute::VA_UV0,
+        VertexAttribute::VA_Normal,
+        VertexAttribute::VA_SkinPack,
+    };
+
+    vk_demo::DVKShader*         m_PreSkinShader = nullptr;
+    vk_demo::DVKShader*         m_CachedShader = nullptr;
+    vk_demo::DVKMaterial*       m_CachedMaterial = nullptr;
+    vk_demo::DVKSkinCache*      m_SkinCache = nullptr;
+
+    vk_demo::DVKJobSystem*      m_JobSystem = nullptr;
+    vk_demo::DVKSkeleton*       m_Skeleton = nullptr;
+    vk_demo::DVKSkinPalette*    m_Palette = nullptr;
+    vk_demo::DVKAnimCompressionReport m_AnimReport;
+    std::vector<vk_demo::DVKSkinInstance> m_Instances;
+
     ImageGUIContext*            m_GUI = nullptr;
 
     bool                        m_AutoAnimation = true;
     float                       m_AnimDuration = 0.0f;
     float                       m_AnimTime = 0.0f;
     int32                       m_AnimIndex = 0;
+    float                       m_AnimSpeed = 1.0f;
+    float                       m_CrossFade = 0.3f;
+    int32                       m_AdditiveIndex = 0;
+    float                       m_AdditiveWeight = 0.0f;
+
+    int32                       m_NumCharacters = 256;
+    bool                        m_DualQuat = true;
+    bool                        m_Parallel = true;
+    bool                        m_PreSkin = false;
+    float                       m_PaletteTime = 0.0f;
+
+    bool                        m_Pick = false;
+    int32                       m_PickedIndex = -1;
+    std::vector<Vector3>        m_PickPositions;
 };
 
 std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
@@ -89,6 +89,11 @@ private:
         m_MVPData.view = m_ViewCamera.GetView();
         m_MVPData.projection = m_ViewCamera.GetProjection();
 
+        if (m_AutoLod)
+        {
+            UpdateLods();
+        }
+
         m_RoleMaterial->BeginFrame();
         for (int32 j = 0; j < m_RoleModel->meshes.size(); ++j)
         {
@@ -108,6 +113,41 @@ private:
         m_MVPData.model.AppendRotation(60.0f * delta, Vector3::ForwardVector);
     }
 
+    void UpdateLods()
+    {
+        vk_demo::DVKMesh* mesh = m_RoleModel->meshes[0];
+        vk_demo::DVKPrimitive* primitive = mesh->primitives[0];
+
+        int32 lodCount = MMath::Max((int32)primitive->lods.size(), 1);
+        m_LodInstanceCounts.assign(lodCount, 0);
+
+        // 每个实例按自己的屏幕误差选择LOD，lod状态逐实例保存用于滞后判断
+        int32 instanceCount = primitive->indexBuffer->instanceCount;
+        for (int32 i = 0; i < instanceCount; ++i)
+        {
+            Matrix4x4 world = m_InstanceMatrices[i];
+            world.Append(m_MVPData.model);
+
+            float errorScale = mesh->GetLodErrorScale(world, m_ViewCamera, m_FrameHeight);
+            m_InstanceLods[i] = primitive->SelectLod(errorScale, m_LodThreshold, 0.25f, m_InstanceLods[i]);
+            m_LodInstanceCounts[m_InstanceLods[i]] += 1;
+        }
+
+        // 按LOD分桶写入实例数据，每个LOD只需一次DrawCall
+        std::vector<uint32> offsets(lodCount, 0);
+        for (int32 i = 1; i < lodCount; ++i)
+        {
+            offsets[i] = offsets[i - 1] + m_LodInstanceCounts[i - 1];
+        }
+
+        float* dst = (float*)m_LodInstanceBuffer->mapped;
+        for (int32 i = 0; i < instanceCount; ++i)
+        {
+            uint32 slot = offsets[m_InstanceLods[i]]++;
+            memcpy(dst + slot * 8, primitive->instanceDatas.data() + i * 8, sizeof(float) * 8);
+        }
+    }
+
     bool UpdateUI(float time, float delta)
     {
         m_GUI->StartFrame();
@@ -122,8 +162,34 @@ private:
             ImGui::Checkbox("AutoSpin", &m_AutoSpin);
             ImGui::SliderInt("Instance", &(primitive->indexBuffer->instanceCount), 1, INSTANCE_COUNT);
 
-            ImGui::Text("DrawCall:1");
-            ImGui::Text("Triangle:%d", primitive->triangleNum * primitive->indexBuffer->instanceCount);
+            if (primitive->lods.size() > 0)
+            {
+                ImGui::Checkbox("AutoLOD", &m_AutoLod);
+            }
+
+            if (m_AutoLod)
+            {
+                ImGui::SliderFloat("Error(px)", &m_LodThreshold, 0.25f, 16.0f);
+
+                int32 drawCall = 0;
+                int32 triangle = 0;
+                for (int32 i = 0; i < m_LodInstanceCounts.size(); ++i)
+                {
+                    if (m_LodInstanceCounts[i] > 0)
+                    {
+                        drawCall += 1;
+                        triangle += primitive->lods[i].indexCount / 3 * m_LodInstanceCounts[i];
+                    }
+                }
+
+                ImGui::Text("DrawCall:%d", drawCall);
+                ImGui::Text("Triangle:%d", triangle);
+            }
+            else
+            {
+                ImGui::Text("DrawCall:1");
+                ImGui::Text("Triangle:%d", primitive->triangleNum * primitive->indexBuffer->instanceCount);
+            }
             ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
             ImGui::End();
         }
@@ -162,6 +228,9 @@ private:
         m_RoleMaterial->PreparePipeline();
         m_RoleMaterial->SetTexture("diffuseMap", m_RoleTexture);
 
+        vk_demo::DVKModelLoadOptions options;
+        options.generateLods = true;
+
         m_RoleModel = vk_demo::DVKModel::LoadFromFile(
             "assets/models/LizardMage/LizardMage_Lowpoly.obj",
             m_VulkanDevice,
@@ -170,7 +239,8 @@ private:
                 VertexAttribute::VA_Position,
                 VertexAttribute::VA_Normal,
                 VertexAttribute::VA_UV0
-            }
+            },
+            options
         );
 
         // instance data
@@ -178,6 +248,8 @@ private:
         Matrix4x4 meshGlobal = mesh->linkNode->GetGlobalMatrix();
         vk_demo::DVKPrimitive* primitive = m_RoleModel->meshes[0]->primitives[0];
         primitive->instanceDatas.resize(8 * INSTANCE_COUNT);
+        m_InstanceMatrices.resize(INSTANCE_COUNT);
+        m_InstanceLods.resize(INSTANCE_COUNT, 0);
 
         for (int32 i = 0; i < INSTANCE_COUNT; ++i)
         {
@@ -189,6 +261,7 @@ private:
             Matrix4x4 matrix = meshGlobal;
             matrix.AppendRotation(MMath::RandRange(0.0f, 360.0f), Vector3::UpVector);
             matrix.AppendTranslation(translate);
+            m_InstanceMatrices[i] = matrix;
 
             Quat quat   = matrix.ToQuat();
             Vector3 pos = matrix.GetOrigin();
@@ -211,11 +284,25 @@ private:
         primitive->indexBuffer->instanceCount = INSTANCE_COUNT;
         primitive->instanceBuffer = vk_demo::DVKVertexBuffer::Create(m_VulkanDevice, cmdBuffer, primitive->instanceDatas, m_RoleShader->instancesAttributes);
 
+        // 按LOD重排后的实例数据，每帧由CPU写入
+        m_LodInstanceBuffer = vk_demo::DVKBuffer::CreateBuffer(
+            m_VulkanDevice,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            primitive->instanceDatas.size() * sizeof(float)
+        );
+        m_LodInstanceBuffer->Map();
+
+        m_AutoLod = primitive->lods.size() > 0;
+
         delete cmdBuffer;
     }
 
     void DestroyAssets()
     {
+        m_LodInstanceBuffer->UnMap();
+        delete m_LodInstanceBuffer;
+
         delete m_RoleModel;
         delete m_RoleShader;
         delete m_RoleMaterial;
@@ -268,10 +355,17 @@ private:
             vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
 
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_RoleMaterial->GetPipeline());
-            for (int32 i = 0; i < m_RoleModel->meshes.size(); ++i)
+            if (m_AutoLod)
             {
-                m_RoleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
-                m_RoleModel->meshes[i]->BindDrawCmd(commandBuffer);
+                DrawLods(commandBuffer);
+            }
+            else
+            {
+                for (int32 i = 0; i < m_RoleModel->meshes.size(); ++i)
+                {
+                    m_RoleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
+                    m_RoleModel->meshes[i]->BindDrawCmd(commandBuffer);
+                }
             }
 
             m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
@@ -282,6 +376,30 @@ private:
         VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
     }
 
+    void DrawLods(VkCommandBuffer commandBuffer)
+    {
+        vk_demo::DVKPrimitive* primitive = m_RoleModel->meshes[0]->primitives[0];
+
+        m_RoleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(primitive->vertexBuffer->dvkBuffer->buffer), &(primitive->vertexBuffer->offset));
+        vkCmdBindVertexBuffers(commandBuffer, 1, 1, &(m_LodInstanceBuffer->buffer), &offset);
+        vkCmdBindIndexBuffer(commandBuffer, primitive->indexBuffer->dvkBuffer->buffer, 0, primitive->indexBuffer->indexType);
+
+        uint32 firstInstance = 0;
+        for (int32 i = 0; i < m_LodInstanceCounts.size(); ++i)
+        {
+            if (m_LodInstanceCounts[i] == 0)
+            {
+                continue;
+            }
+            const vk_demo::DVKPrimitiveLod& lod = primitive->lods[i];
+            vkCmdDrawIndexed(commandBuffer, lod.indexCount, m_LodInstanceCounts[i], lod.firstIndex, 0, firstInstance);
+            firstInstance += m_LodInstanceCounts[i];
+        }
+    }
+
     void InitParmas()
     {
         vk_demo::DVKBoundingBox bounds = m_RoleModel->rootNode->GetBounds();
@@ -319,6 +437,14 @@ private:
 
     bool                        m_AutoSpin = false;
 
+    // LOD
+    bool                        m_AutoLod = false;
+    float                       m_LodThreshold = 1.0f;
+    std::vector<Matrix4x4>      m_InstanceMatrices;
+    std::vector<int32>          m_InstanceLods;
+    std::vector<uint32>         m_LodInstanceCounts;
+    vk_demo::DVKBuffer*         m_LodInstanceBuffer = nullptr;
+
     ImageGUIContext*            m_GUI = nullptr;
 };
 
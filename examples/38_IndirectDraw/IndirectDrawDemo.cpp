@@ -571,12 +571,63 @@ private:
         }
 
         UpdateCascade();
+        UpdateLods();
 
         SetupCommandBuffers(bufferIndex);
 
         DemoBase::Present(bufferIndex);
     }
 
+    void UpdateLods()
+    {
+        const int32 instanceStride = 10;
+
+        float* instanceDst = (float*)m_IndirectInstanceBuffer->mapped;
+        std::vector<uint32> offsets;
+
+        for (int32 i = 0; i < m_PlantLods.size(); ++i)
+        {
+            PlantLod& plantLod = m_PlantLods[i];
+            VkDrawIndexedIndirectCommand* commands = m_IndirectCommands.data() + plantLod.firstCommand;
+
+            for (int32 l = 0; l < plantLod.lodCount; ++l)
+            {
+                commands[l].instanceCount = 0;
+            }
+
+            for (int32 n = 0; n < INSTANCE_COUNT; ++n)
+            {
+                int32 lod = 0;
+                if (m_AutoLod)
+                {
+                    float errorScale = plantLod.mesh->GetLodErrorScale(m_InstanceMatrices[n], m_ViewCamera, m_FrameHeight);
+                    lod = plantLod.primitive->SelectLod(errorScale, m_LodThreshold, 0.25f, plantLod.instanceLods[n]);
+                }
+                plantLod.instanceLods[n] = lod;
+                commands[lod].instanceCount += 1;
+            }
+
+            // 同一Primitive的实例区间内按LOD分段
+            offsets.resize(plantLod.lodCount);
+            uint32 firstInstance = INSTANCE_COUNT * i;
+            for (int32 l = 0; l < plantLod.lodCount; ++l)
+            {
+                commands[l].firstInstance = firstInstance;
+                offsets[l]     = firstInstance;
+                firstInstance += commands[l].instanceCount;
+            }
+
+            for (int32 n = 0; n < INSTANCE_COUNT; ++n)
+            {
+                uint32 src = INSTANCE_COUNT * i + n;
+                uint32 dst = offsets[plantLod.instanceLods[n]]++;
+                memcpy(instanceDst + dst * instanceStride, m_InstanceDatas.data() + src * instanceStride, sizeof(float) * instanceStride);
+            }
+        }
+
+        memcpy(m_IndirectCmdBuffer->mapped, m_IndirectCommands.data(), m_IndirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand));
+    }
+
     bool UpdateUI(float time, float delta)
     {
         m_GUI->StartFrame();
@@ -587,6 +638,17 @@ private:
             ImGui::Begin("IndirectDrawDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
             ImGui::Text("Supported:%s", m_VulkanDevice->GetPhysicalFeatures().multiDrawIndirect ? "True" : "False");
 
+            int32 triangles = 0;
+            for (int32 i = 0; i < m_IndirectCommands.size(); ++i)
+            {
+                triangles += m_IndirectCommands[i].indexCount / 3 * m_IndirectCommands[i].instanceCount;
+            }
+
+            ImGui::Checkbox("AutoLOD", &m_AutoLod);
+            ImGui::SliderFloat("Error(px)", &m_LodThreshold, 0.25f, 16.0f);
+            ImGui::Text("Triangle:%d", triangles);
+            ImGui::Separator();
+
             // shadow bias
             ImGui::SliderFloat("Bias", &m_CascadeParam.bias.x, 0.0f, 0.05f, "%.4f");
             ImGui::SliderFloat("Step", &m_CascadeParam.bias.y, 0.0f, 10.0f);
@@ -727,6 +789,9 @@ private:
         m_GroundMaterial->SetTexture("shadowMap", m_ShadowMap);
 
         // plants model
+        vk_demo::DVKModelLoadOptions options;
+        options.generateLods = true;
+
         m_PlantsModel = vk_demo::DVKModel::LoadFromFile(
             "assets/models/low_poly_tree.fbx",
             m_VulkanDevice,
@@ -735,7 +800,8 @@ private:
                 VertexAttribute::VA_Position,
                 VertexAttribute::VA_Color,
                 VertexAttribute::VA_Normal
-            }
+            },
+            options
         );
 
         m_PlantsShader = vk_demo::DVKShader::Create(
@@ -756,11 +822,14 @@ private:
 
         // indirect
         std::vector<float> vertices;
-        std::vector<float> instanceDatas;
+        std::vector<float>& instanceDatas = m_InstanceDatas;
         std::vector<uint32> indices;
         int32 objCount = 0;
-        int32 triFirst = 0;
+        int32 vertFirst = 0;
+        int32 indexFirst = 0;
         m_IndirectCommands.clear();
+        m_PlantLods.clear();
+        m_InstanceMatrices.resize(INSTANCE_COUNT);
 
         std::vector<Vector4> instancePositions(INSTANCE_COUNT);
         std::vector<Quat> instanceRotations(INSTANCE_COUNT);
@@ -770,6 +839,8 @@ private:
             float radius = MMath::FRandRange(0.0f, GROUND_RADIUS);
             float angle  = MMath::FRandRange(-PI, PI);
 
+            float scale = 10.0f + MMath::FRandRange(0.0f, 5.0f);
+
             Matrix4x4 matrix;
             matrix.AppendRotation(MMath::RandRange(0.0f, 360.0f), Vector3::UpVector);
             matrix.AppendTranslation(Vector3(MMath::Sin(angle) * radius, 0.0f, MMath::Cos(angle) * radius));
@@ -781,7 +852,9 @@ private:
             float dz = (+0.5) * ( pos.x * quat.y - pos.y * quat.x + pos.z * quat.w);
             float dw = (-0.5) * ( pos.x * quat.x + pos.y * quat.y + pos.z * quat.z);
 
-            float scale = 10.0f + MMath::FRandRange(0.0f, 5.0f);
+            // 用于计算LOD，Shader中先缩放再做对偶四元数变换
+            m_InstanceMatrices[i] = matrix;
+            m_InstanceMatrices[i].PrependScale(Vector3(scale, scale, scale));
 
             instancePositions[i] = Vector4(dx, dy, dz, dw);
             instanceRotations[i] = quat;
@@ -801,10 +874,14 @@ private:
                     vertices.push_back(primitive->vertices[n]);
                 }
 
-                // indices
+                // indices，LOD索引紧跟在LOD0之后
                 for (int32 n = 0; n < primitive->indices.size(); ++n)
                 {
-                    indices.push_back(primitive->indices[n] + triFirst);
+                    indices.push_back(primitive->indices[n] + vertFirst);
+                }
+                for (int32 n = 0; n < primitive->lodIndices.size(); ++n)
+                {
+                    indices.push_back(primitive->lodIndices[n] + vertFirst);
                 }
 
                 // instance
@@ -827,28 +904,33 @@ private:
                     instanceDatas.push_back(i);
                 }
 
-                VkDrawIndexedIndirectCommand indirectCommand = {};
-                indirectCommand.instanceCount = INSTANCE_COUNT;
-                indirectCommand.firstInstance = INSTANCE_COUNT * objCount;
-                indirectCommand.firstIndex    = triFirst;
-                indirectCommand.indexCount    = primitive->triangleNum * 3;
-                m_IndirectCommands.push_back(indirectCommand);
+                // 每一级LOD一条命令，实例数每帧按LOD分桶后更新
+                PlantLod plantLod;
+                plantLod.mesh         = m_PlantsModel->meshes[i];
+                plantLod.primitive    = primitive;
+                plantLod.firstCommand = m_IndirectCommands.size();
+                plantLod.lodCount     = MMath::Max((int32)primitive->lods.size(), 1);
+                plantLod.instanceLods.resize(INSTANCE_COUNT, 0);
+                m_PlantLods.push_back(plantLod);
 
-                objCount += 1;
-                triFirst += indirectCommand.indexCount;
+                for (int32 l = 0; l < plantLod.lodCount; ++l)
+                {
+                    VkDrawIndexedIndirectCommand indirectCommand = {};
+                    indirectCommand.instanceCount = l == 0 ? INSTANCE_COUNT : 0;
+                    indirectCommand.firstInstance = INSTANCE_COUNT * objCount;
+                    indirectCommand.firstIndex    = indexFirst + (primitive->lods.size() > 0 ? primitive->lods[l].firstIndex : 0);
+                    indirectCommand.indexCount    = primitive->lods.size() > 0 ? primitive->lods[l].indexCount : primitive->indices.size();
+                    m_IndirectCommands.push_back(indirectCommand);
+                }
+
+                objCount   += 1;
+                vertFirst  += primitive->vertexCount;
+                indexFirst += primitive->indices.size() + primitive->lodIndices.size();
             }
         }
 
         // 创建上传Buffer
         {
-            vk_demo::DVKBuffer* instanceStagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
-                m_VulkanDevice,
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                instanceDatas.size() * sizeof(float),
-                instanceDatas.data()
-            );
-
             vk_demo::DVKBuffer* vertStagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
                 m_VulkanDevice,
                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -865,14 +947,6 @@ private:
                 indices.data()
             );
 
-            vk_demo::DVKBuffer* cmdStagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
-                m_VulkanDevice,
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                m_IndirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand),
-                m_IndirectCommands.data()
-            );
-
             m_IndirectVertexBuffer = vk_demo::DVKBuffer::CreateBuffer(
                 m_VulkanDevice,
                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
@@ -880,12 +954,15 @@ private:
                 vertStagingBuffer->size
             );
 
+            // 实例数据与命令每帧按LOD重写，直接放在HostVisible内存中
             m_IndirectInstanceBuffer = vk_demo::DVKBuffer::CreateBuffer(
                 m_VulkanDevice,
-                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                instanceStagingBuffer->size
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                instanceDatas.size() * sizeof(float),
+                instanceDatas.data()
             );
+            m_IndirectInstanceBuffer->Map();
 
             m_IndirectIndexBuffer = vk_demo::DVKBuffer::CreateBuffer(
                 m_VulkanDevice,
@@ -896,10 +973,12 @@ private:
 
             m_IndirectCmdBuffer = vk_demo::DVKBuffer::CreateBuffer(
                 m_VulkanDevice,
-                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                cmdStagingBuffer->size
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                m_IndirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand),
+                m_IndirectCommands.data()
             );
+            m_IndirectCmdBuffer->Map();
 
             cmdBuffer->Begin();
 
@@ -908,22 +987,14 @@ private:
             copyRegion.size = vertices.size() * sizeof(float);
             vkCmdCopyBuffer(cmdBuffer->cmdBuffer, vertStagingBuffer->buffer, m_IndirectVertexBuffer->buffer, 1, &copyRegion);
 
-            copyRegion.size = instanceDatas.size() * sizeof(float);
-            vkCmdCopyBuffer(cmdBuffer->cmdBuffer, instanceStagingBuffer->buffer, m_IndirectInstanceBuffer->buffer, 1, &copyRegion);
-
             copyRegion.size = indices.size() * sizeof(uint32),
             vkCmdCopyBuffer(cmdBuffer->cmdBuffer, indexStagingBuffer->buffer, m_IndirectIndexBuffer->buffer, 1, &copyRegion);
 
-            copyRegion.size = m_IndirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand),
-            vkCmdCopyBuffer(cmdBuffer->cmdBuffer, cmdStagingBuffer->buffer, m_IndirectCmdBuffer->buffer, 1, &copyRegion);
-
             cmdBuffer->End();
             cmdBuffer->Submit();
 
             delete vertStagingBuffer;
-            delete instanceStagingBuffer;
             delete indexStagingBuffer;
-            delete cmdStagingBuffer;
         }
 
         delete cmdBuffer;
@@ -944,6 +1015,9 @@ private:
         delete m_PlantsShader;
         delete m_PlantsMaterial;
 
+        m_IndirectCmdBuffer->UnMap();
+        m_IndirectInstanceBuffer->UnMap();
+
         delete m_IndirectCmdBuffer;
         delete m_IndirectVertexBuffer;
         delete m_IndirectInstanceBuffer;
@@ -1274,6 +1348,21 @@ private:
     vk_demo::DVKShader*         m_PlantsShader = nullptr;
     vk_demo::DVKMaterial*       m_PlantsMaterial = nullptr;
 
+    struct PlantLod
+    {
+        vk_demo::DVKMesh*       mesh = nullptr;
+        vk_demo::DVKPrimitive*  primitive = nullptr;
+        int32                   firstCommand = 0;
+        int32                   lodCount = 1;
+        std::vector<int32>      instanceLods;
+    };
+
+    bool                        m_AutoLod = true;
+    float                       m_LodThreshold = 1.0f;
+    std::vector<PlantLod>       m_PlantLods;
+    std::vector<Matrix4x4>      m_InstanceMatrices;
+    std::vector<float>          m_InstanceDatas;
+
     IndirectCommandArray        m_IndirectCommands;
     vk_demo::DVKBuffer*         m_IndirectCmdBuffer = nullptr;
     vk_demo::DVKBuffer*         m_IndirectVertexBuffer = nullptr;
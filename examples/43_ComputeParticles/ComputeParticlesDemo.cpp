@@ -35,8 +35,8 @@ public:
         DemoBase::Prepare();
 
         CreateGUI();
-        InitParmas();
         LoadAssets();
+        InitParmas();
 
         m_Ready = true;
 
@@ -61,16 +61,11 @@ public:
 
 private:
 
-    struct ParticleVertex
-    {
-        Vector4 position;
-        Vector4 velocity;
-    };
-
     struct ParticleParam
     {
-        Vector4 data0;
-        Vector4 data1;
+        Matrix4x4 view;
+        Matrix4x4 projection;
+        Vector4   data;
     };
 
     void Draw(float time, float delta)
@@ -78,13 +73,22 @@ private:
         int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
 
         UpdateFPS(time, delta);
-        UpdateUI(time, delta);
 
-        SetupComputeCommand();
+        bool hovered = UpdateUI(time, delta);
+        if (!hovered)
+        {
+            m_ViewCamera.Update(time, delta);
+        }
+
+        // 本帧绘制上一帧Compute的结果，只需等待上一次提交，本帧的Compute与Graphics可以并行
+        vk_demo::DVKQueueSubmit submitInfo;
+        m_AsyncCompute->WaitFor(submitInfo, m_ComputeValue, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+
+        SetupComputeCommand(delta);
 
         SetupGfxCommand(bufferIndex);
 
-        DemoBase::Present(bufferIndex);
+        DemoBase::Present(bufferIndex, submitInfo);
     }
 
     bool UpdateUI(float time, float delta)
@@ -96,14 +100,18 @@ private:
             ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
             ImGui::Begin("ComputeParticlesDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
-            ImGui::SliderInt("Count", &m_PointCount, PARTICLE_COUNT / 10, PARTICLE_COUNT);
+            vk_demo::DVKGPUParticleConfig& config = m_Particles->config;
 
-            ImGui::SliderFloat("PointSize", &m_ParticleParams.data1.x, 1.0f, 15.0f);
-            ImGui::SliderFloat("Intensity", &m_ParticleParams.data1.y, 0.1f, 1.0f);
-            ImGui::SliderFloat("Range",     &m_ParticleParams.data0.z, 0.0001f, 0.01f, "%5f");
-            ImGui::SliderFloat("Drag",      &m_ParticleParams.data1.z, 0.0f, 1.0f);
-            ImGui::SliderFloat("Ease",      &m_ParticleParams.data1.w, 0.0f, 1.0f);
+            ImGui::SliderFloat("EmitRate",  &config.emitRate, 0.0f, PARTICLE_COUNT, "%.0f");
+            ImGui::SliderFloat("LifeMin",   &config.lifeMin, 0.1f, 5.0f);
+            ImGui::SliderFloat("LifeMax",   &config.lifeMax, 0.1f, 5.0f);
+            ImGui::SliderFloat("Spread",    &config.velocityRandom, 0.0f, 5.0f);
+            ImGui::SliderFloat("Drag",      &config.drag, 0.0f, 2.0f);
+            ImGui::SliderFloat("Attractor", &config.attractorStrength, 0.0f, 50.0f);
+            ImGui::SliderFloat("PointSize", &m_ParticleParams.data.x, 1.0f, 15.0f);
+            ImGui::SliderFloat("Intensity", &m_ParticleParams.data.y, 0.1f, 1.0f);
 
+            ImGui::Checkbox("Sort", &config.sort);
             ImGui::Checkbox("Mouse", &m_Animation);
 
             if (m_Animation)
@@ -113,19 +121,14 @@ private:
                 float dy = mousePos.y / GetHeight();
                 dx = (dx - 0.5f) * 2.0f;
                 dy = -(dy - 0.5f) * 2.0f;
-                m_ParticleParams.data0.x = dx;
-                m_ParticleParams.data0.y = dy;
+                config.attractorPosition = Vector3(dx * 6.0f, dy * 4.0f + 3.0f, 0.0f);
             }
             else
             {
-                m_ParticleParams.data0.x = MMath::Sin(time * time * 0.01);
-                m_ParticleParams.data0.y = MMath::Cos(time);
+                config.attractorPosition = Vector3(MMath::Sin(time) * 4.0f, 4.0f + MMath::Cos(time * 0.7f), MMath::Cos(time) * 2.0f);
             }
 
-            m_ParticleParams.data0.w = PARTICLE_COUNT;
-
-            m_ComputeProcessor->SetUniform("param", &m_ParticleParams, sizeof(ParticleParam));
-
+            ImGui::Text("Alive:%d Capacity:%d", (int32)m_Particles->GetAliveCount(), PARTICLE_COUNT);
             ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
             ImGui::End();
         }
@@ -140,57 +143,8 @@ private:
 
     void LoadAssets()
     {
-        m_ComputeCommand = vk_demo::DVKCommandBuffer::Create(
-            m_VulkanDevice,
-            m_ComputeCommandPool,
-            VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            m_VulkanDevice->GetComputeQueue()
-        );
-
         vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
 
-        {
-            std::vector<ParticleVertex> vertices(PARTICLE_COUNT);
-            for (int32 i = 0; i < PARTICLE_COUNT; ++i)
-            {
-                vertices[i].position.x = MMath::FRandRange(-1.0f, 1.0f);
-                vertices[i].position.y = MMath::FRandRange(-1.0f, 1.0f);
-                vertices[i].position.z = vertices[i].position.x;
-                vertices[i].position.w = vertices[i].position.y;
-
-                vertices[i].velocity.x = 0.0f;
-                vertices[i].velocity.y = 0.0f;
-                vertices[i].velocity.z = 0.0f;
-                vertices[i].velocity.w = (vertices[i].position.x + 1.0f) / 2.0f;
-            }
-
-            vk_demo::DVKBuffer* stagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
-                m_VulkanDevice,
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                vertices.size() * sizeof(ParticleVertex),
-                vertices.data()
-            );
-
-            m_ParticleBuffer = vk_demo::DVKBuffer::CreateBuffer(
-                m_VulkanDevice,
-                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                vertices.size() * sizeof(ParticleVertex)
-            );
-
-            cmdBuffer->Begin();
-
-            VkBufferCopy copyRegion = {};
-            copyRegion.size = vertices.size() * sizeof(ParticleVertex);
-            vkCmdCopyBuffer(cmdBuffer->cmdBuffer, stagingBuffer->buffer, m_ParticleBuffer->buffer, 1, &copyRegion);
-
-            cmdBuffer->End();
-            cmdBuffer->Submit();
-
-            delete stagingBuffer;
-        }
-
         m_GradientTexture = vk_demo::DVKTexture::Create2D(
             "assets/textures/gradient.png",
             m_VulkanDevice,
@@ -207,6 +161,30 @@ private:
             ImageLayoutBarrier::PixelShaderRead
         );
 
+        m_ArgsShader     = vk_demo::DVKShader::Create(m_VulkanDevice, "assets/shaders/43_ComputeParticles/ParticleArgs.comp.spv");
+        m_EmitShader     = vk_demo::DVKShader::Create(m_VulkanDevice, "assets/shaders/43_ComputeParticles/ParticleEmit.comp.spv");
+        m_SimulateShader = vk_demo::DVKShader::Create(m_VulkanDevice, "assets/shaders/43_ComputeParticles/ParticleSimulate.comp.spv");
+        m_SortShader     = vk_demo::DVKShader::Create(m_VulkanDevice, "assets/shaders/43_ComputeParticles/ParticleSort.comp.spv");
+        m_CompactShader  = vk_demo::DVKShader::Create(m_VulkanDevice, "assets/shaders/43_ComputeParticles/ParticleCompact.comp.spv");
+
+        // 粒子数据在Compute队列上初始化，之后只有绘制用到的区间需要转移所有权
+        m_AsyncCompute = vk_demo::DVKAsyncCompute::Create(m_VulkanDevice, 2);
+        vk_demo::DVKCommandBuffer* computeCmdBuffer = m_AsyncCompute->CreateCommandBuffer();
+
+        m_Particles = vk_demo::DVKGPUParticles::Create(
+            m_VulkanDevice,
+            m_PipelineCache,
+            computeCmdBuffer,
+            m_ArgsShader,
+            m_EmitShader,
+            m_SimulateShader,
+            m_SortShader,
+            m_CompactShader,
+            PARTICLE_COUNT
+        );
+
+        delete computeCmdBuffer;
+
         m_ParticleShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
             true,
@@ -214,6 +192,7 @@ private:
             "assets/shaders/43_ComputeParticles/Particle.frag.spv"
         );
 
+        // 排序后由远及近绘制，使用预乘Alpha混合
         m_ParticleMaterial = vk_demo::DVKMaterial::Create(
             m_VulkanDevice,
             m_RenderPass,
@@ -231,91 +210,45 @@ private:
         m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].blendEnable = VK_TRUE;
         m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].colorBlendOp = VK_BLEND_OP_ADD;
         m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
         m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].alphaBlendOp = VK_BLEND_OP_ADD;
-        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_DST_ALPHA;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
         m_ParticleMaterial->PreparePipeline();
         m_ParticleMaterial->SetTexture("diffuseMap",  m_DiffuseTexture);
         m_ParticleMaterial->SetTexture("gradientMap", m_GradientTexture);
-
-        m_ComputeShader = vk_demo::DVKShader::Create(
-            m_VulkanDevice,
-            "assets/shaders/43_ComputeParticles/Particle.comp.spv"
-        );
-
-        m_ComputeProcessor = vk_demo::DVKCompute::Create(
-            m_VulkanDevice,
-            m_PipelineCache,
-            m_ComputeShader
-        );
-        m_ComputeProcessor->SetStorageBuffer("inVertex", m_ParticleBuffer);
+        m_Particles->BindMaterial(m_ParticleMaterial);
 
         delete cmdBuffer;
     }
 
     void DestroyAssets()
     {
-        delete m_ParticleBuffer;
+        // 析构时等待最后一次Compute提交完成
+        delete m_AsyncCompute;
+
+        delete m_Particles;
+
         delete m_ParticleMaterial;
         delete m_ParticleShader;
 
         delete m_GradientTexture;
         delete m_DiffuseTexture;
 
-        delete m_ComputeShader;
-        delete m_ComputeProcessor;
-
-        delete m_ComputeCommand;
+        delete m_ArgsShader;
+        delete m_EmitShader;
+        delete m_SimulateShader;
+        delete m_SortShader;
+        delete m_CompactShader;
     }
 
-    void SetupComputeCommand()
+    void SetupComputeCommand(float delta)
     {
-        m_ComputeCommand->Begin();
-
-        VkBufferMemoryBarrier bufferBarrier;
-        ZeroVulkanStruct(bufferBarrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
-        bufferBarrier.buffer = m_ParticleBuffer->buffer;
-        bufferBarrier.size   = m_ParticleBuffer->size;
-        bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        bufferBarrier.srcQueueFamilyIndex = m_VulkanDevice->GetGraphicsQueue()->GetFamilyIndex();
-        bufferBarrier.dstQueueFamilyIndex = m_VulkanDevice->GetComputeQueue()->GetFamilyIndex();
-
-        vkCmdPipelineBarrier(
-            m_ComputeCommand->cmdBuffer,
-            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            0,
-            0,
-            nullptr,
-            1,
-            &bufferBarrier,
-            0,
-            nullptr
-        );
-
-        m_ComputeProcessor->BindDispatch(m_ComputeCommand->cmdBuffer, 32, 32, 1);
-
-        bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        bufferBarrier.srcQueueFamilyIndex = m_VulkanDevice->GetComputeQueue()->GetFamilyIndex();
-        bufferBarrier.dstQueueFamilyIndex = m_VulkanDevice->GetGraphicsQueue()->GetFamilyIndex();
-
-        vkCmdPipelineBarrier(
-            m_ComputeCommand->cmdBuffer,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
-            0,
-            0,
-            nullptr,
-            1,
-            &bufferBarrier,
-            0,
-            nullptr
-        );
+        VkCommandBuffer computeCommand = m_AsyncCompute->Begin();
+        m_Particles->Simulate(computeCommand, MMath::Min(delta, 0.05f), m_ViewCamera.GetTransform().GetOrigin());
 
-        m_ComputeCommand->Submit();
+        // 不等待完成，Graphics在下一帧等待该值
+        m_ComputeValue = m_AsyncCompute->Submit();
     }
 
     void SetupGfxCommand(int32 backBufferIndex)
@@ -340,6 +273,8 @@ private:
         ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
         VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
+        m_Particles->AcquireDrawBuffers(commandBuffer);
+
         VkClearValue clearValues[2];
         clearValues[0].color        = {
             { 0.2f, 0.2f, 0.2f, 1.0f }
@@ -363,16 +298,18 @@ private:
 
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ParticleMaterial->GetPipeline());
 
-        VkDeviceSize offsets[1] = { 0 };
+        m_ParticleParams.view       = m_ViewCamera.GetView();
+        m_ParticleParams.projection = m_ViewCamera.GetProjection();
+        m_ParticleParams.data.z     = m_ViewCamera.GetProjectionScale((float)m_FrameHeight) * 0.1f;
 
         m_ParticleMaterial->BeginFrame();
         m_ParticleMaterial->BeginObject();
         m_ParticleMaterial->SetLocalUniform("param", &m_ParticleParams, sizeof(ParticleParam));
         m_ParticleMaterial->EndObject();
 
+        // 顶点数量由Compute写入的Indirect参数决定
         m_ParticleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(m_ParticleBuffer->buffer), offsets);
-        vkCmdDraw(commandBuffer, m_PointCount, 1, 0, 0);
+        m_Particles->Draw(commandBuffer);
 
         m_ParticleMaterial->EndFrame();
 
@@ -383,17 +320,26 @@ private:
 
     void InitParmas()
     {
-        m_ParticleParams.data0.x = 0.0f;
-        m_ParticleParams.data0.y = 0.0f;
-        m_ParticleParams.data0.z = 0.0001f;
-        m_ParticleParams.data0.w = PARTICLE_COUNT;
-
-        m_ParticleParams.data1.x = 8.0f;
-        m_ParticleParams.data1.y = 0.5f;
-        m_ParticleParams.data1.z = 0.95f;
-        m_ParticleParams.data1.w = 0.25f;
-
-        m_PointCount = PARTICLE_COUNT / 2;
+        m_ViewCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight(), 0.1f, 500.0f);
+        m_ViewCamera.SetPosition(0.0f, 3.0f, -15.0f);
+        m_ViewCamera.LookAt(0.0f, 3.0f, 0.0f);
+
+        vk_demo::DVKGPUParticleConfig& config = m_Particles->config;
+        config.emitterPosition   = Vector3(0.0f, 0.0f, 0.0f);
+        config.emitterRadius     = 0.2f;
+        config.velocity          = Vector3(0.0f, 8.0f, 0.0f);
+        config.velocityRandom    = 2.0f;
+        config.gravity           = Vector3(0.0f, -6.0f, 0.0f);
+        config.drag              = 0.3f;
+        config.attractorStrength = 20.0f;
+        config.lifeMin           = 1.0f;
+        config.lifeMax           = 3.0f;
+        config.emitRate          = PARTICLE_COUNT / 4;
+
+        m_ParticleParams.data.x = 4.0f;
+        m_ParticleParams.data.y = 0.5f;
+        m_ParticleParams.data.z = 1.0f;
+        m_ParticleParams.data.w = 0.0f;
     }
 
     void CreateGUI()
@@ -412,19 +358,25 @@ private:
 
     bool                            m_Ready = false;
 
-    vk_demo::DVKBuffer*             m_ParticleBuffer = nullptr;
+    vk_demo::DVKCamera              m_ViewCamera;
+
     vk_demo::DVKShader*             m_ParticleShader = nullptr;
     vk_demo::DVKMaterial*           m_ParticleMaterial = nullptr;
 
     vk_demo::DVKTexture*            m_GradientTexture = nullptr;
     vk_demo::DVKTexture*            m_DiffuseTexture = nullptr;
 
-    vk_demo::DVKShader*             m_ComputeShader = nullptr;
-    vk_demo::DVKCompute*            m_ComputeProcessor = nullptr;
-    vk_demo::DVKCommandBuffer*      m_ComputeCommand = nullptr;
+    vk_demo::DVKShader*             m_ArgsShader = nullptr;
+    vk_demo::DVKShader*             m_EmitShader = nullptr;
+    vk_demo::DVKShader*             m_SimulateShader = nullptr;
+    vk_demo::DVKShader*             m_SortShader = nullptr;
+    vk_demo::DVKShader*             m_CompactShader = nullptr;
+    vk_demo::DVKGPUParticles*       m_Particles = nullptr;
+
+    vk_demo::DVKAsyncCompute*       m_AsyncCompute = nullptr;
+    uint64                          m_ComputeValue = 0;
 
     ParticleParam                   m_ParticleParams;
-    int32                           m_PointCount = 0;
     bool                            m_Animation = false;
 
     ImageGUIContext*                m_GUI = nullptr;
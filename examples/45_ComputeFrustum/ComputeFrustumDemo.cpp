@@ -10,14 +10,15 @@
 
 #define OBJECT_COUNT 1024 * 256
 
-// incorrect usage of compute shader
+// 剔除在GPU上完成并直接生成Indirect命令，CPU不回读结果
 class ComputeFrustumDemo : public DemoBase
 {
 public:
     ComputeFrustumDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
         : DemoBase(width, height, title, cmdLine)
     {
-
+        // 可选扩展，设备不支持时不会开启，DVKGPUCulling回退到固定数量的Indirect
+        deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
     }
 
     virtual ~ComputeFrustumDemo()
@@ -36,6 +37,7 @@ public:
         DemoBase::Prepare();
 
         CreateGUI();
+        CreateRenderTarget();
         InitParmas();
         LoadAssets();
 
@@ -47,6 +49,7 @@ public:
     virtual void Exist() override
     {
         DestroyAssets();
+        DestroyRenderTarget();
         DestroyGUI();
         DemoBase::Release();
     }
@@ -69,12 +72,6 @@ private:
         Matrix4x4 proj;
     };
 
-    struct FrustumParamBlock
-    {
-        Vector4 count;
-        Vector4 frustumPlanes[6];
-    };
-
     void Draw(float time, float delta)
     {
         int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
@@ -85,16 +82,11 @@ private:
         if (!hovered)
         {
             m_ViewCamera.Update(time, delta);
-            UpdateFrustumPlanes();
         }
 
+        m_ViewCamera.GetFrustumPlanes(m_FrustumPlanes);
         m_DrawCall = 0;
 
-        if (m_UseGPU)
-        {
-            SetupComputeCommand();
-        }
-
         SetupGfxCommand(bufferIndex);
 
         DemoBase::Present(bufferIndex);
@@ -110,7 +102,9 @@ private:
             ImGui::Begin("ComputeFrustumDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
             ImGui::Checkbox("Compute", &m_UseGPU);
+            ImGui::Checkbox("HiZ Occlusion", &m_GPUCulling->hizOcclusion);
             ImGui::Text("DrawCall:%d", m_DrawCall);
+            ImGui::Text("DrawIndirectCount:%s", m_GPUCulling->SupportDrawCount() ? "True" : "False");
 
             ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
             ImGui::End();
@@ -124,6 +118,28 @@ private:
         return hovered;
     }
 
+    // 与主视图同尺寸的深度，用于生成Hi-Z
+    void CreateRenderTarget()
+    {
+        m_DepthTexture = vk_demo::DVKTexture::CreateRenderTarget(
+            m_VulkanDevice,
+            PixelFormatToVkFormat(m_DepthFormat, false),
+            VK_IMAGE_ASPECT_DEPTH_BIT,
+            m_FrameWidth,
+            m_FrameHeight / 2,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+        );
+
+        vk_demo::DVKRenderPassInfo passInfo(m_DepthTexture, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE);
+        m_DepthRTT = vk_demo::DVKRenderTarget::Create(m_VulkanDevice, passInfo);
+    }
+
+    void DestroyRenderTarget()
+    {
+        delete m_DepthRTT;
+        delete m_DepthTexture;
+    }
+
     void LoadAssets()
     {
         vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
@@ -176,64 +192,85 @@ private:
         );
         m_Material->PreparePipeline();
 
-        {
-            m_CullingBuffer = vk_demo::DVKBuffer::CreateBuffer(
-                m_VulkanDevice,
-                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                OBJECT_COUNT * sizeof(Vector4)
-            );
-            m_CullingBuffer->Map();
-
-            vk_demo::DVKBuffer* stagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
-                m_VulkanDevice,
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                OBJECT_COUNT * sizeof(Matrix4x4),
-                m_ObjModels
-            );
-
-            m_MatrixBuffer = vk_demo::DVKBuffer::CreateBuffer(
-                m_VulkanDevice,
-                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                OBJECT_COUNT * sizeof(Matrix4x4)
-            );
-
-            cmdBuffer->Begin();
+        m_InstanceShader = vk_demo::DVKShader::Create(
+            m_VulkanDevice,
+            true,
+            "assets/shaders/45_ComputeFrustum/Instance.vert.spv",
+            "assets/shaders/45_ComputeFrustum/Solid.frag.spv"
+        );
 
-            VkBufferCopy copyRegion = {};
-            copyRegion.size = OBJECT_COUNT * sizeof(Matrix4x4);
-            vkCmdCopyBuffer(cmdBuffer->cmdBuffer, stagingBuffer->buffer, m_MatrixBuffer->buffer, 1, &copyRegion);
+        m_InstanceMaterial = vk_demo::DVKMaterial::Create(
+            m_VulkanDevice,
+            m_RenderPass,
+            m_PipelineCache,
+            m_InstanceShader
+        );
+        m_InstanceMaterial->PreparePipeline();
 
-            cmdBuffer->End();
-            cmdBuffer->Submit();
+        m_DepthShader = vk_demo::DVKShader::Create(
+            m_VulkanDevice,
+            true,
+            "assets/shaders/45_ComputeFrustum/Instance.vert.spv",
+            "assets/shaders/45_ComputeFrustum/Depth.frag.spv"
+        );
 
-            delete stagingBuffer;
-        }
+        m_DepthMaterial = vk_demo::DVKMaterial::Create(
+            m_VulkanDevice,
+            m_DepthRTT,
+            m_PipelineCache,
+            m_DepthShader
+        );
+        m_DepthMaterial->pipelineInfo.colorAttachmentCount = 0;
+        m_DepthMaterial->PreparePipeline();
 
-        m_ComputeShader = vk_demo::DVKShader::Create(
+        m_HiZShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
-            "assets/shaders/45_ComputeFrustum/Frustum.comp.spv"
+            "assets/shaders/45_ComputeFrustum/HiZ.comp.spv"
         );
 
-        m_ComputeProcessor = vk_demo::DVKCompute::Create(
+        m_CullShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
-            m_PipelineCache,
-            m_ComputeShader
+            "assets/shaders/45_ComputeFrustum/Cull.comp.spv"
         );
-        m_ComputeProcessor->SetStorageBuffer("inMatrix",   m_MatrixBuffer);
-        m_ComputeProcessor->SetStorageBuffer("outCulling", m_CullingBuffer);
 
-        m_ComputeCommand = vk_demo::DVKCommandBuffer::Create(
+        m_CompactShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
-            m_ComputeCommandPool,
-            VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            m_VulkanDevice->GetComputeQueue()
+            "assets/shaders/45_ComputeFrustum/Compact.comp.spv"
         );
 
-        m_FrustumParam.count.x = OBJECT_COUNT;
-        m_FrustumParam.count.y = m_Radius;
+        // 球体只有一个Draw，实例数据为模型矩阵
+        {
+            vk_demo::DVKPrimitive* primitive = m_ModelSphere->meshes[0]->primitives[0];
+
+            std::vector<vk_demo::DVKCullingDraw> draws(1);
+            draws[0].indexCount   = primitive->indexBuffer->indexCount;
+            draws[0].firstIndex   = 0;
+            draws[0].vertexOffset = 0;
+
+            std::vector<Vector4> bounds(OBJECT_COUNT);
+            std::vector<uint32>  drawIndices(OBJECT_COUNT, 0);
+            std::vector<float>   instanceData(OBJECT_COUNT * 16);
+            for (int32 i = 0; i < OBJECT_COUNT; ++i)
+            {
+                bounds[i] = Vector4(m_ObjModels[i].GetOrigin(), m_Radius);
+                memcpy(instanceData.data() + i * 16, &m_ObjModels[i], sizeof(Matrix4x4));
+            }
+
+            m_GPUCulling = vk_demo::DVKGPUCulling::Create(
+                m_VulkanDevice,
+                m_PipelineCache,
+                cmdBuffer,
+                m_CullShader,
+                m_CompactShader,
+                draws,
+                bounds,
+                drawIndices,
+                instanceData,
+                16
+            );
+
+            m_GPUCulling->SetHiZ(m_HiZShader, m_DepthTexture, cmdBuffer);
+        }
 
         delete cmdBuffer;
     }
@@ -242,44 +279,110 @@ private:
     {
         delete m_ModelSphere;
 
-        delete m_MatrixBuffer;
-        delete m_CullingBuffer;
-
         delete m_Material;
         delete m_Shader;
 
-        delete m_ComputeShader;
-        delete m_ComputeProcessor;
-        delete m_ComputeCommand;
+        delete m_InstanceMaterial;
+        delete m_InstanceShader;
+
+        delete m_DepthMaterial;
+        delete m_DepthShader;
+
+        delete m_GPUCulling;
+        delete m_CullShader;
+        delete m_CompactShader;
+        delete m_HiZShader;
     }
 
     bool IsInFrustum(int32 index)
     {
-        if (m_UseGPU)
-        {
-            Vector4* cullData = (Vector4*)m_CullingBuffer->mapped;
-            return cullData[index].x > 0.0f;
-        }
-        else
-        {
-            Vector3 pos = m_ObjModels[index].GetOrigin();
+        Vector3 pos = m_ObjModels[index].GetOrigin();
 
-            for (int32 i = 0; i < 6; ++i)
+        for (int32 i = 0; i < 6; ++i)
+        {
+            Vector4& plane = m_FrustumPlanes[i];
+            float projDist = (plane.x * pos.x) + (plane.y * pos.y) + (plane.z * pos.z) + plane.w + m_Radius;
+            if (projDist <= 0)
             {
-                Vector4& plane = m_FrustumParam.frustumPlanes[i];
-                float projDist = (plane.x * pos.x) + (plane.y * pos.y) + (plane.z * pos.z) + plane.w + m_Radius;
-                if (projDist <= 0)
-                {
-                    return false;
-                }
+                return false;
             }
-
-            return true;
         }
+
+        return true;
+    }
+
+    // 一次Indirect提交全部可见球体，开销与物体数量无关
+    void RenderSpheresIndirect(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera)
+    {
+        m_InstanceMaterial->BeginFrame();
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_InstanceMaterial->GetPipeline());
+
+        m_MVPParam.model.SetIdentity();
+        m_MVPParam.view = camera.GetView();
+        m_MVPParam.proj = camera.GetProjection();
+
+        m_InstanceMaterial->BeginObject();
+        m_InstanceMaterial->SetLocalUniform("uboMVP", &m_MVPParam, sizeof(ModelViewProjectionBlock));
+        m_InstanceMaterial->EndObject();
+
+        m_InstanceMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+
+        vk_demo::DVKPrimitive* primitive = m_ModelSphere->meshes[0]->primitives[0];
+        VkDeviceSize offsets[1] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(primitive->vertexBuffer->dvkBuffer->buffer), &(primitive->vertexBuffer->offset));
+        vkCmdBindVertexBuffers(commandBuffer, 1, 1, &(m_GPUCulling->instanceBuffer->buffer), offsets);
+        vkCmdBindIndexBuffer(commandBuffer, primitive->indexBuffer->dvkBuffer->buffer, 0, primitive->indexBuffer->indexType);
+
+        m_GPUCulling->Draw(commandBuffer);
+        m_DrawCall += 1;
+
+        m_InstanceMaterial->EndFrame();
+    }
+
+    // 上一帧的可见球体作为遮挡体，用当前相机渲染深度后生成Hi-Z。
+    // 遮挡体都是真实存在的物体，结果是保守的，新出现的物体只会晚一帧被剔除。
+    void RenderOccluderDepth(VkCommandBuffer commandBuffer)
+    {
+        m_DepthRTT->BeginRenderPass(commandBuffer);
+
+        m_DepthMaterial->BeginFrame();
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DepthMaterial->GetPipeline());
+
+        m_MVPParam.model.SetIdentity();
+        m_MVPParam.view = m_ViewCamera.GetView();
+        m_MVPParam.proj = m_ViewCamera.GetProjection();
+
+        m_DepthMaterial->BeginObject();
+        m_DepthMaterial->SetLocalUniform("uboMVP", &m_MVPParam, sizeof(ModelViewProjectionBlock));
+        m_DepthMaterial->EndObject();
+
+        m_DepthMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+
+        vk_demo::DVKPrimitive* primitive = m_ModelSphere->meshes[0]->primitives[0];
+        VkDeviceSize offsets[1] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(primitive->vertexBuffer->dvkBuffer->buffer), &(primitive->vertexBuffer->offset));
+        vkCmdBindVertexBuffers(commandBuffer, 1, 1, &(m_GPUCulling->instanceBuffer->buffer), offsets);
+        vkCmdBindIndexBuffer(commandBuffer, primitive->indexBuffer->dvkBuffer->buffer, 0, primitive->indexBuffer->indexType);
+
+        m_GPUCulling->Draw(commandBuffer);
+
+        m_DepthMaterial->EndFrame();
+
+        m_DepthRTT->EndRenderPass(commandBuffer);
+
+        m_GPUCulling->BuildHiZ(commandBuffer, m_ViewCamera.GetViewProjection());
     }
 
     void RenderSpheres(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera)
     {
+        if (m_UseGPU)
+        {
+            RenderSpheresIndirect(commandBuffer, camera);
+            return;
+        }
+
         m_Material->BeginFrame();
 
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
@@ -309,16 +412,6 @@ private:
         m_Material->EndFrame();
     }
 
-    void SetupComputeCommand()
-    {
-        m_ComputeCommand->Begin();
-
-        m_ComputeProcessor->SetUniform("paramData", &m_FrustumParam, sizeof(FrustumParamBlock));
-        m_ComputeProcessor->BindDispatch(m_ComputeCommand->cmdBuffer, 32, 32, 1);
-
-        m_ComputeCommand->Submit();
-    }
-
     void SetupGfxCommand(int32 backBufferIndex)
     {
         VkViewport viewport = {};
@@ -341,6 +434,19 @@ private:
         ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
         VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
+        // 与绘制在同一个CommandBuffer中，不需要额外的Submit与等待
+        if (m_UseGPU)
+        {
+            // 第一次Cull之前instanceBuffer中没有有效数据
+            if (m_GPUCulling->hizOcclusion && m_Culled)
+            {
+                RenderOccluderDepth(commandBuffer);
+            }
+
+            m_GPUCulling->Cull(commandBuffer, m_ViewCamera);
+            m_Culled = true;
+        }
+
         VkClearValue clearValues[2];
         clearValues[0].color        = {
             { 0.2f, 0.2f, 0.2f, 1.0f }
@@ -386,58 +492,6 @@ private:
         VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
     }
 
-    void UpdateFrustumPlanes()
-    {
-        Matrix4x4 matrix = m_ViewCamera.GetViewProjection();
-
-        Vector4* frustumPlanes = &(m_FrustumParam.frustumPlanes[0]);
-
-        // left
-        frustumPlanes[0].x = matrix.m[0][3] + matrix.m[0][0];
-        frustumPlanes[0].y = matrix.m[1][3] + matrix.m[1][0];
-        frustumPlanes[0].z = matrix.m[2][3] + matrix.m[2][0];
-        frustumPlanes[0].w = matrix.m[3][3] + matrix.m[3][0];
-
-        // right
-        frustumPlanes[1].x = matrix.m[0][3] - matrix.m[0][0];
-        frustumPlanes[1].y = matrix.m[1][3] - matrix.m[1][0];
-        frustumPlanes[1].z = matrix.m[2][3] - matrix.m[2][0];
-        frustumPlanes[1].w = matrix.m[3][3] - matrix.m[3][0];
-
-        // top
-        frustumPlanes[2].x = matrix.m[0][3] + matrix.m[0][1];
-        frustumPlanes[2].y = matrix.m[1][3] + matrix.m[1][1];
-        frustumPlanes[2].z = matrix.m[2][3] + matrix.m[2][1];
-        frustumPlanes[2].w = matrix.m[3][3] + matrix.m[3][1];
-
-        // bottom
-        frustumPlanes[3].x = matrix.m[0][3] - matrix.m[0][1];
-        frustumPlanes[3].y = matrix.m[1][3] - matrix.m[1][1];
-        frustumPlanes[3].z = matrix.m[2][3] - matrix.m[2][1];
-        frustumPlanes[3].w = matrix.m[3][3] - matrix.m[3][1];
-
-        // near
-        frustumPlanes[4].x = matrix.m[0][2];
-        frustumPlanes[4].y = matrix.m[1][2];
-        frustumPlanes[4].z = matrix.m[2][2];
-        frustumPlanes[4].w = matrix.m[3][2];
-
-        // far
-        frustumPlanes[5].x = matrix.m[0][3] - matrix.m[0][2];
-        frustumPlanes[5].y = matrix.m[1][3] - matrix.m[1][2];
-        frustumPlanes[5].z = matrix.m[2][3] - matrix.m[2][2];
-        frustumPlanes[5].w = matrix.m[3][3] - matrix.m[3][2];
-
-        for (auto i = 0; i < 6; i++)
-        {
-            float length = MMath::Sqrt(frustumPlanes[i].x * frustumPlanes[i].x + frustumPlanes[i].y * frustumPlanes[i].y + frustumPlanes[i].z * frustumPlanes[i].z);
-            frustumPlanes[i].x /= length;
-            frustumPlanes[i].y /= length;
-            frustumPlanes[i].z /= length;
-            frustumPlanes[i].w /= length;
-        }
-    }
-
     void InitParmas()
     {
         m_ViewCamera.SetPosition(0, 19.73f, -200.0f);
@@ -474,18 +528,25 @@ private:
     vk_demo::DVKMaterial*           m_Material = nullptr;
     vk_demo::DVKShader*             m_Shader = nullptr;
 
-    vk_demo::DVKBuffer*             m_MatrixBuffer = nullptr;
-    vk_demo::DVKBuffer*             m_CullingBuffer = nullptr;
+    vk_demo::DVKMaterial*           m_InstanceMaterial = nullptr;
+    vk_demo::DVKShader*             m_InstanceShader = nullptr;
 
     Matrix4x4                       m_ObjModels[OBJECT_COUNT];
 
     vk_demo::DVKCamera              m_ViewCamera;
     vk_demo::DVKCamera              m_TopCamera;
 
-    FrustumParamBlock               m_FrustumParam;
-    vk_demo::DVKShader*             m_ComputeShader = nullptr;
-    vk_demo::DVKCompute*   m_ComputeProcessor = nullptr;
-    vk_demo::DVKCommandBuffer*      m_ComputeCommand = nullptr;
+    Vector4                         m_FrustumPlanes[6];
+    vk_demo::DVKShader*             m_CullShader = nullptr;
+    vk_demo::DVKShader*             m_CompactShader = nullptr;
+    vk_demo::DVKGPUCulling*         m_GPUCulling = nullptr;
+    bool                            m_Culled = false;
+
+    vk_demo::DVKTexture*            m_DepthTexture = nullptr;
+    vk_demo::DVKRenderTarget*       m_DepthRTT = nullptr;
+    vk_demo::DVKShader*             m_DepthShader = nullptr;
+    vk_demo::DVKMaterial*           m_DepthMaterial = nullptr;
+    vk_demo::DVKShader*             m_HiZShader = nullptr;
 
     ModelViewProjectionBlock        m_MVPParam;
     float                           m_Radius;
@@ -124,6 +124,7 @@ private:
 
         UpdateFPS(time, delta);
         bool hovered = UpdateUI(time, delta);
+        m_ModelLine->BeginFrame(bufferIndex);
         UpdateLine(time, delta);
 
         if (!hovered)
@@ -296,7 +297,11 @@ private:
             m_SimpleLine.LineTo(triV0.x, triV0.y, triV0.z);
         }
 
-        m_ModelLine->CopyFrom(m_SimpleLine.vertices.data(), sizeof(float) * m_SimpleLine.vertices.size());
+        // 只写入本帧用到的顶点
+        if (m_SimpleLine.index > 0)
+        {
+            m_ModelLine->Write(m_SimpleLine.vertices.data(), sizeof(float) * m_SimpleLine.index);
+        }
     }
 
     void LoadAssets()
@@ -328,15 +333,14 @@ private:
         );
         m_Material->PreparePipeline();
 
+        // 线段每帧重新生成，SimpleLine本身就是CPU端的数据，不需要再保留一份副本
         m_SimpleLine.Resize(6 * 128);
-        m_ModelLine = vk_demo::DVKBuffer::CreateBuffer(
+        m_ModelLine = vk_demo::DVKDynamicVertexBuffer::Create(
             m_VulkanDevice,
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
             m_SimpleLine.vertices.size() * sizeof(float),
-            m_SimpleLine.vertices.data()
+            GetVulkanRHI()->GetSwapChain()->GetBackBufferCount(),
+            false
         );
-        m_ModelLine->Map();
 
         m_ShaderLine = vk_demo::DVKShader::Create(
             m_VulkanDevice,
@@ -394,6 +398,8 @@ private:
         ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
         VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
+        m_ModelLine->Upload(commandBuffer);
+
         VkClearValue clearValues[2];
         clearValues[0].color        = {
             { 0.2f, 0.2f, 0.2f, 1.0f }
@@ -446,9 +452,11 @@ private:
         m_MaterialLine->EndObject();
         m_MaterialLine->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
 
-        VkDeviceSize offsets[1] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(m_ModelLine->buffer), offsets);
-        vkCmdDraw(commandBuffer, m_ModelLine->size / sizeof(float), 1, 0, 0);
+        if (m_SimpleLine.index > 0)
+        {
+            m_ModelLine->Bind(commandBuffer);
+            vkCmdDraw(commandBuffer, m_SimpleLine.index / 3, 1, 0, 0);
+        }
 
         m_MaterialLine->EndFrame();
 
@@ -481,7 +489,7 @@ private:
     bool                        m_Ready = false;
 
     SimpleLine                  m_SimpleLine;
-    vk_demo::DVKBuffer*         m_ModelLine = nullptr;
+    vk_demo::DVKDynamicVertexBuffer* m_ModelLine = nullptr;
     vk_demo::DVKMaterial*       m_MaterialLine = nullptr;
     vk_demo::DVKShader*         m_ShaderLine = nullptr;
 
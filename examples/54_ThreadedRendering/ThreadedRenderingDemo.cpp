@@ -10,6 +10,8 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 
 // less than m_VulkanDevice->GetLimits().maxUniformBufferRange
@@ -38,8 +40,6 @@ struct ModelViewProjectionBlock
     Matrix4x4 proj;
 };
 
-std::mutex writeMutex;
-
 class ParticleModel
 {
 public:
@@ -64,20 +64,10 @@ public:
         m_MVPParam.view  = camera.GetView();
         m_MVPParam.proj  = camera.GetProjection();
 
-        {
-            std::lock_guard<std::mutex> lockGuard(writeMutex);
-
-            m_Material->BeginFrame();
-
-            m_Material->BeginObject();
-            m_Material->SetLocalUniform("uboMVP",       &m_MVPParam,        sizeof(ModelViewProjectionBlock));
-            m_Material->SetLocalUniform("uboTransform", &m_InstanceData,    sizeof(InstanceData));
-            m_Material->EndObject();
+        // DVKMaterial的DynamicOffset按线程保存，RingBuffer分配无锁，多个线程可以同时录制
+        RecordUniforms();
 
-            m_Material->EndFrame();
-
-            m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-        }
+        m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
 
         vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(primitive->vertexBuffer->dvkBuffer->buffer), &(primitive->vertexBuffer->offset));
         vkCmdBindVertexBuffers(commandBuffer, 1, 1, &(primitive->instanceBuffer->dvkBuffer->buffer), &(primitive->instanceBuffer->offset));
@@ -86,6 +76,18 @@ public:
 
     }
 
+    void RecordUniforms()
+    {
+        m_Material->BeginFrame();
+
+        m_Material->BeginObject();
+        m_Material->SetLocalUniform("uboMVP",       &m_MVPParam,        sizeof(ModelViewProjectionBlock));
+        m_Material->SetLocalUniform("uboTransform", &m_InstanceData,    sizeof(InstanceData));
+        m_Material->EndObject();
+
+        m_Material->EndFrame();
+    }
+
     void Update(std::vector<Matrix4x4>& bonesData, vk_demo::DVKCamera& camera, float time, float delta)
     {
         // ring buffer
@@ -289,6 +291,8 @@ private:
 
         UpdateAnimation(time, delta);
 
+        auto recordStart = std::chrono::high_resolution_clock::now();
+
         // notify fram start
         {
             std::lock_guard<std::mutex> lockGuard(m_FrameStartLock);
@@ -306,6 +310,8 @@ private:
             }
         }
 
+        m_RecordTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+
         SetupCommandBuffers(bufferIndex);
 
         DemoBase::Present(bufferIndex);
@@ -320,6 +326,20 @@ private:
             ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
             ImGui::Begin("ThreadedRenderingDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
+            ImGui::Text("Threads:%d Record:%.3fms", (int32)m_Threads.size(), m_RecordTime);
+
+            if (ImGui::Button("Benchmark"))
+            {
+                RunBenchmark();
+            }
+
+            // 每毫秒录制的Object数量，Mutex为旧的全局锁方式
+            for (int32 i = 0; i < m_BenchmarkResults.size(); ++i)
+            {
+                const BenchmarkResult& result = m_BenchmarkResults[i];
+                ImGui::Text("%2d threads Mutex:%7.1f LockFree:%7.1f obj/ms", result.threads, result.mutexRate, result.lockFreeRate);
+            }
+
             ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
             ImGui::End();
         }
@@ -332,6 +352,86 @@ private:
         return hovered;
     }
 
+    float BenchmarkRecording(int32 numThreads, bool useMutex)
+    {
+        const int32 objectCount = 1024;
+
+        std::mutex recordMutex;
+        std::atomic<int32> readyCount(0);
+        std::atomic<bool> start(false);
+        std::vector<std::thread> threads;
+
+        for (int32 t = 0; t < numThreads; ++t)
+        {
+            threads.push_back(std::thread(
+                [&, t]
+                {
+                    ParticleModel* particle = m_Particles[t % m_Particles.size()];
+
+                    readyCount.fetch_add(1);
+                    while (!start.load())
+                    {
+                        std::this_thread::yield();
+                    }
+
+                    for (int32 i = 0; i < objectCount; ++i)
+                    {
+                        if (useMutex)
+                        {
+                            std::lock_guard<std::mutex> lockGuard(recordMutex);
+                            particle->RecordUniforms();
+                        }
+                        else
+                        {
+                            particle->RecordUniforms();
+                        }
+                    }
+                }
+            ));
+        }
+
+        while (readyCount.load() != numThreads)
+        {
+            std::this_thread::yield();
+        }
+
+        auto timeStart = std::chrono::high_resolution_clock::now();
+        start.store(true);
+
+        for (int32 t = 0; t < numThreads; ++t)
+        {
+            threads[t].join();
+        }
+
+        float elapsed = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - timeStart).count();
+        return numThreads * objectCount / MMath::Max(elapsed, 0.001f);
+    }
+
+    void RunBenchmark()
+    {
+        // 工作线程此时都在等待下一帧，GPU也已经执行完上一帧，RingBuffer可以随意写入
+        m_BenchmarkResults.clear();
+
+        int32 maxThreads = MMath::Max((int32)std::thread::hardware_concurrency(), 1);
+        for (int32 numThreads = 1; ; numThreads *= 2)
+        {
+            numThreads = MMath::Min(numThreads, maxThreads);
+
+            BenchmarkResult result;
+            result.threads      = numThreads;
+            result.mutexRate    = BenchmarkRecording(numThreads, true);
+            result.lockFreeRate = BenchmarkRecording(numThreads, false);
+            m_BenchmarkResults.push_back(result);
+
+            MLOG("Benchmark threads=%d mutex=%.1f lockfree=%.1f obj/ms", result.threads, result.mutexRate, result.lockFreeRate);
+
+            if (numThreads == maxThreads)
+            {
+                break;
+            }
+        }
+    }
+
     void UpdateAnimation(float time, float delta)
     {
         m_RoleModel->Update(time, delta);
@@ -765,10 +865,7 @@ private:
             }
         }
 
-        {
-            std::lock_guard<std::mutex> lockGuard(writeMutex);
-            MLOG("Thread exist -> index = %d", threadData->index);
-        }
+        MLOG("Thread exist -> index = %d", threadData->index);
     }
 
     void CreateGUI()
@@ -787,6 +884,13 @@ private:
 
     typedef std::vector<vk_demo::DVKCommandBuffer*> CommandBufferArray;
 
+    struct BenchmarkResult
+    {
+        int32   threads;
+        float   mutexRate;
+        float   lockFreeRate;
+    };
+
     bool                        m_Ready = false;
 
     vk_demo::DVKModel*          m_Quad = nullptr;
@@ -821,6 +925,9 @@ private:
     float                       m_FrameDelta;
     int32                       m_bufferIndex;
 
+    float                       m_RecordTime = 0.0f;
+    std::vector<BenchmarkResult> m_BenchmarkResults;
+
     ImageGUIContext*            m_GUI = nullptr;
 };
 
@@ -33,8 +33,7 @@ public:
         DemoBase::Prepare();
 
         CreateGUI();
-        GenImposterAssets();
-        LoadModelAssets();
+        LoadAssets();
         InitParmas();
 
         m_Ready = true;
@@ -91,6 +90,11 @@ private:
             ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
             ImGui::Begin("ImposterDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
+            ImGui::SliderFloat("Switch Distance", &m_SwitchDistance, 0.0f, 40.0f);
+            ImGui::Text("Mesh:%d Imposter:%d", (int32)m_NearList.size(), (int32)m_FarList.size());
+
+            ImGui::Separator();
+
             ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
             ImGui::End();
         }
@@ -103,55 +107,12 @@ private:
         return hovered;
     }
 
-    void GenImposterAssets()
+    void LoadAssets()
     {
-        int32 imageSize = 4096;
-
         vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
 
-        vk_demo::DVKTexture* texSourceDepth = vk_demo::DVKTexture::CreateRenderTarget(
-            m_VulkanDevice,
-            PixelFormatToVkFormat(m_DepthFormat, false),
-            VK_IMAGE_ASPECT_DEPTH_BIT,
-            imageSize,
-            imageSize,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
-        );
-
-        // diffuse rtt
-        m_ImposterDiffuse = vk_demo::DVKTexture::CreateRenderTarget(
-            m_VulkanDevice,
-            VK_FORMAT_R8G8B8A8_UNORM,
-            VK_IMAGE_ASPECT_COLOR_BIT,
-            imageSize,
-            imageSize,
-            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
-        );
-
-        vk_demo::DVKRenderPassInfo diffuseRttInfo(
-            m_ImposterDiffuse, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
-            texSourceDepth, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE
-        );
-        vk_demo::DVKRenderTarget* diffuseRtSource = vk_demo::DVKRenderTarget::Create(m_VulkanDevice, diffuseRttInfo);
-
-        // normal rtt
-        m_ImposterNormal = vk_demo::DVKTexture::CreateRenderTarget(
-            m_VulkanDevice,
-            VK_FORMAT_R8G8B8A8_UNORM,
-            VK_IMAGE_ASPECT_COLOR_BIT,
-            imageSize,
-            imageSize,
-            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
-        );
-
-        vk_demo::DVKRenderPassInfo normalRttInfo(
-            m_ImposterNormal, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
-            texSourceDepth, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE
-        );
-        vk_demo::DVKRenderTarget* normalRtSource = vk_demo::DVKRenderTarget::Create(m_VulkanDevice, normalRttInfo);
-
-        // imposter object
-        vk_demo::DVKModel* model = vk_demo::DVKModel::LoadFromFile(
+        // 近处直接绘制模型
+        m_Model = vk_demo::DVKModel::LoadFromFile(
             "assets/models/halloween-pumpkin/model.fbx",
             m_VulkanDevice,
             cmdBuffer,
@@ -162,222 +123,78 @@ private:
                 VertexAttribute::VA_Tangent
             }
         );
-        model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+        m_Model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
 
-        vk_demo::DVKTexture* texAlbedo = vk_demo::DVKTexture::Create2D(
+        m_TexAlbedo = vk_demo::DVKTexture::Create2D(
             "assets/models/halloween-pumpkin/BaseColor.jpg",
             m_VulkanDevice,
             cmdBuffer
         );
 
-        vk_demo::DVKTexture* texNormal = vk_demo::DVKTexture::Create2D(
+        m_TexNormal = vk_demo::DVKTexture::Create2D(
             "assets/models/halloween-pumpkin/Normal.jpg",
             m_VulkanDevice,
             cmdBuffer
         );
 
-        // diffuse shader
-        vk_demo::DVKShader* diffuseShader = vk_demo::DVKShader::Create(
+        m_DiffuseShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
             true,
             "assets/shaders/58_Imposter/diffuse.vert.spv",
             "assets/shaders/58_Imposter/diffuse.frag.spv"
         );
 
-        vk_demo::DVKMaterial* diffuseMaterial = vk_demo::DVKMaterial::Create(
+        m_MeshMaterial = vk_demo::DVKMaterial::Create(
             m_VulkanDevice,
-            diffuseRtSource->GetRenderPass(),
+            m_RenderPass,
             m_PipelineCache,
-            diffuseShader
+            m_DiffuseShader
         );
-        diffuseMaterial->PreparePipeline();
-        diffuseMaterial->SetTexture("texAlbedo", texAlbedo);
-        diffuseMaterial->SetTexture("texNormal", texNormal);
+        m_MeshMaterial->PreparePipeline();
+        m_MeshMaterial->SetTexture("texAlbedo", m_TexAlbedo);
+        m_MeshMaterial->SetTexture("texNormal", m_TexNormal);
 
-        // normal shader
-        vk_demo::DVKShader* normalShader = vk_demo::DVKShader::Create(
-            m_VulkanDevice,
-            true,
+        // 远处使用Imposter，源文件与参数都没有变化时直接加载缓存
+        vk_demo::DVKImposterInfo imposterInfo;
+        imposterInfo.frames    = m_TileCount;
+        imposterInfo.frameSize = 128;
+        imposterInfo.hemi      = true;
+
+        std::vector<std::string> sourceFiles = {
+            "assets/models/halloween-pumpkin/model.fbx",
+            "assets/models/halloween-pumpkin/BaseColor.jpg",
+            "assets/models/halloween-pumpkin/Normal.jpg",
+            "assets/shaders/58_Imposter/diffuse.vert.spv",
+            "assets/shaders/58_Imposter/diffuse.frag.spv",
             "assets/shaders/58_Imposter/normal.vert.spv",
             "assets/shaders/58_Imposter/normal.frag.spv"
-        );
-
-        vk_demo::DVKMaterial* normalMaterial = vk_demo::DVKMaterial::Create(
-            m_VulkanDevice,
-            normalRtSource->GetRenderPass(),
-            m_PipelineCache,
-            normalShader
-        );
-        normalMaterial->PreparePipeline();
-        normalMaterial->SetTexture("texAlbedo", texAlbedo);
-        normalMaterial->SetTexture("texNormal", texNormal);
-
-        // prepare
-        vk_demo::DVKBoundingBox bounds = model->rootNode->GetBounds();
-        Vector3 boundSize   = bounds.max - bounds.min;
-        Vector3 boundCenter = bounds.min + boundSize * 0.5f;
-
-        Vector3 lookAt = boundCenter;
-        float distance = 500.0f;
-        float projSize = boundSize.Size() * 0.5f;
-
-        vk_demo::DVKCamera imposterCamera;
-        imposterCamera.Orthographic(-projSize, projSize, -projSize, projSize, 0.1, 3000);
-        imposterCamera.SetPosition(Vector3(0, 0, -distance));
-
-        float maxTileAngle = 180.0f;
-        int32 tileSize     = imageSize / m_TileCount;
-
-        VkViewport viewport = {};
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        VkRect2D scissor = {};
-        scissor.extent.width  = tileSize;
-        scissor.extent.height = tileSize;
-
-        const float DEGREES_TO_RADIANS = PI / 180.0f;
-
-        // imposter diffuse
-        {
-            cmdBuffer->Begin();
-            diffuseRtSource->BeginRenderPass(cmdBuffer->cmdBuffer);
-
-            for (int32 i = 0; i < m_TileCount; ++i)
-            {
-                float tiltAngle = 90 - i * (maxTileAngle / (m_TileCount - 1)) - 180 / (m_TileCount * 2);
-
-                for (int32 j = 0; j < m_TileCount; ++j)
-                {
-                    float panAngle = 0 - j * (360 / m_TileCount) - 360 / (m_TileCount * 2);
-
-                    Vector3 target;
-                    target.x = lookAt.x + distance * MMath::Sin(panAngle * DEGREES_TO_RADIANS) * MMath::Cos(tiltAngle * DEGREES_TO_RADIANS);
-                    target.z = lookAt.z + distance * MMath::Cos(panAngle * DEGREES_TO_RADIANS) * MMath::Cos(tiltAngle * DEGREES_TO_RADIANS);
-                    target.y = lookAt.y + distance * MMath::Sin(tiltAngle * DEGREES_TO_RADIANS);
-
-                    imposterCamera.SetPosition(target);
-                    imposterCamera.LookAt(lookAt);
-
-                    {
-                        float tx = j * tileSize;
-                        float ty = i * tileSize;
-
-                        viewport.x       = tx;
-                        viewport.y       = tileSize + ty;
-                        viewport.width   = tileSize;
-                        viewport.height  = tileSize * -1;
-                        scissor.offset.x = tx;
-                        scissor.offset.y = ty;
-
-                        vkCmdSetViewport(cmdBuffer->cmdBuffer, 0, 1, &viewport);
-                        vkCmdSetScissor(cmdBuffer->cmdBuffer,  0, 1, &scissor);
-
-                        vkCmdBindPipeline(cmdBuffer->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, diffuseMaterial->GetPipeline());
-
-                        diffuseMaterial->BeginFrame();
-
-                        m_MVPParam.model = model->meshes[0]->linkNode->GetGlobalMatrix();
-                        m_MVPParam.view  = imposterCamera.GetView();
-                        m_MVPParam.proj  = imposterCamera.GetProjection();
-
-                        diffuseMaterial->BeginObject();
-                        diffuseMaterial->SetLocalUniform("uboMVP",   &m_MVPParam, sizeof(ModelViewProjectionBlock));
-                        diffuseMaterial->EndObject();
-
-                        diffuseMaterial->BindDescriptorSets(cmdBuffer->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-                        model->meshes[0]->BindDrawCmd(cmdBuffer->cmdBuffer);
-
-                        diffuseMaterial->EndFrame();
-                    }
-                }
-            }
-
-            diffuseRtSource->EndRenderPass(cmdBuffer->cmdBuffer);
-            cmdBuffer->Submit();
-        }
+        };
+        uint32 imposterKey    = vk_demo::DVKImposter::ComputeKey(sourceFiles, imposterInfo);
+        std::string cachePath = vk_demo::DVKImposter::GetCachePath(sourceFiles[0], imposterKey);
 
-        // normal
+        m_Imposter = vk_demo::DVKImposter::LoadFromFile(m_VulkanDevice, cmdBuffer, cachePath, imposterKey);
+        if (m_Imposter == nullptr)
         {
-            cmdBuffer->Begin();
-            normalRtSource->BeginRenderPass(cmdBuffer->cmdBuffer);
-
-            for (int32 i = 0; i < m_TileCount; ++i)
-            {
-                float tiltAngle = 90 - i * (maxTileAngle / (m_TileCount - 1)) - 180 / (m_TileCount * 2);
-
-                for (int32 j = 0; j < m_TileCount; ++j)
-                {
-                    float panAngle = 0 - j * (360 / m_TileCount) - 360 / (m_TileCount * 2);
-
-                    Vector3 target;
-                    target.x = lookAt.x + distance * MMath::Sin(panAngle * DEGREES_TO_RADIANS) * MMath::Cos(tiltAngle * DEGREES_TO_RADIANS);
-                    target.z = lookAt.z + distance * MMath::Cos(panAngle * DEGREES_TO_RADIANS) * MMath::Cos(tiltAngle * DEGREES_TO_RADIANS);
-                    target.y = lookAt.y + distance * MMath::Sin(tiltAngle * DEGREES_TO_RADIANS);
-
-                    imposterCamera.SetPosition(target);
-                    imposterCamera.LookAt(lookAt);
-
-                    {
-                        float tx = j * tileSize;
-                        float ty = i * tileSize;
-
-                        viewport.x       = tx;
-                        viewport.y       = tileSize + ty;
-                        viewport.width   = tileSize;
-                        viewport.height  = tileSize * -1;
-                        scissor.offset.x = tx;
-                        scissor.offset.y = ty;
-
-                        vkCmdSetViewport(cmdBuffer->cmdBuffer, 0, 1, &viewport);
-                        vkCmdSetScissor(cmdBuffer->cmdBuffer,  0, 1, &scissor);
-
-                        vkCmdBindPipeline(cmdBuffer->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, normalMaterial->GetPipeline());
-
-                        normalMaterial->BeginFrame();
-
-                        m_MVPParam.model = model->meshes[0]->linkNode->GetGlobalMatrix();
-                        m_MVPParam.view  = imposterCamera.GetView();
-                        m_MVPParam.proj  = imposterCamera.GetProjection();
-
-                        normalMaterial->BeginObject();
-                        normalMaterial->SetLocalUniform("uboMVP",   &m_MVPParam, sizeof(ModelViewProjectionBlock));
-                        normalMaterial->EndObject();
-
-                        normalMaterial->BindDescriptorSets(cmdBuffer->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-                        model->meshes[0]->BindDrawCmd(cmdBuffer->cmdBuffer);
-
-                        normalMaterial->EndFrame();
-                    }
-                }
-            }
-
-            normalRtSource->EndRenderPass(cmdBuffer->cmdBuffer);
-            cmdBuffer->Submit();
+            vk_demo::DVKShader* normalShader = vk_demo::DVKShader::Create(
+                m_VulkanDevice,
+                true,
+                "assets/shaders/58_Imposter/normal.vert.spv",
+                "assets/shaders/58_Imposter/normal.frag.spv"
+            );
+
+            vk_demo::DVKImposterBakeInfo bakeInfo;
+            bakeInfo.model         = m_Model;
+            bakeInfo.pipelineCache = m_PipelineCache;
+            bakeInfo.albedoShader  = m_DiffuseShader;
+            bakeInfo.normalShader  = normalShader;
+            bakeInfo.textures["texAlbedo"] = m_TexAlbedo;
+            bakeInfo.textures["texNormal"] = m_TexNormal;
+
+            m_Imposter = vk_demo::DVKImposter::Bake(m_VulkanDevice, cmdBuffer, bakeInfo, imposterInfo, cachePath, imposterKey);
+
+            delete normalShader;
         }
 
-        delete model;
-
-        delete texNormal;
-        delete texAlbedo;
-
-        delete texSourceDepth;
-
-        delete diffuseShader;
-        delete diffuseMaterial;
-        delete diffuseRtSource;
-
-        delete normalShader;
-        delete normalMaterial;
-        delete normalRtSource;
-
-        delete cmdBuffer;
-    }
-
-    void LoadModelAssets()
-    {
-        vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
-
         m_ImposterShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
             true,
@@ -391,6 +208,7 @@ private:
             m_PipelineCache,
             m_ImposterShader
         );
+        m_ImposterMaterial->pipelineInfo.rasterizationState.cullMode                  = VK_CULL_MODE_NONE;
         m_ImposterMaterial->pipelineInfo.blendAttachmentStates[0].blendEnable         = VK_TRUE;
         m_ImposterMaterial->pipelineInfo.blendAttachmentStates[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
         m_ImposterMaterial->pipelineInfo.blendAttachmentStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
@@ -400,19 +218,37 @@ private:
         m_ImposterMaterial->pipelineInfo.blendAttachmentStates[0].alphaBlendOp        = VK_BLEND_OP_ADD;
 
         m_ImposterMaterial->PreparePipeline();
-        m_ImposterMaterial->SetTexture("originTexture", m_ImposterDiffuse);
-        m_ImposterMaterial->SetTexture("originNormal",  m_ImposterNormal);
+        m_ImposterMaterial->SetTexture("originTexture", m_Imposter->albedoTexture);
+        m_ImposterMaterial->SetTexture("originNormal",  m_Imposter->normalTexture);
+
+        // 摆放成一片
+        float spacing = m_Imposter->radius * 2.5f;
+        for (int32 i = 0; i < m_FieldSize; ++i)
+        {
+            for (int32 j = 0; j < m_FieldSize; ++j)
+            {
+                float x = (j - m_FieldSize * 0.5f) * spacing;
+                float z = (i - m_FieldSize * 0.5f) * spacing;
+                m_Positions.push_back(Vector3(x, 0, z));
+            }
+        }
 
         delete cmdBuffer;
     }
 
     void DestroyAssets()
     {
+        delete m_Model;
+        delete m_TexAlbedo;
+        delete m_TexNormal;
+
+        delete m_DiffuseShader;
+        delete m_MeshMaterial;
+
         delete m_ImposterShader;
         delete m_ImposterMaterial;
 
-        delete m_ImposterDiffuse;
-        delete m_ImposterNormal;
+        delete m_Imposter;
     }
 
     void SetupCommandBuffers(int32 backBufferIndex)
@@ -458,62 +294,84 @@ private:
         vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
         vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
 
-        m_MVPParam.model.SetIdentity();
-        // billboard
-        m_MVPParam.model.LookAt(m_ViewCamera.GetTransform().GetOrigin());
-        // flip quad face
-        m_MVPParam.model.RotateY(180);
-        // view projection
         m_MVPParam.view = m_ViewCamera.GetView();
         m_MVPParam.proj = m_ViewCamera.GetProjection();
 
-        // calc uv from viewDir
-        Vector3 viewDir = m_ViewCamera.GetTransform().GetForward();
-        float xzX = viewDir.x;
-        float xzZ = viewDir.z;
-        float xzL = MMath::Sqrt(xzX * xzX + xzZ * xzZ);
-        if (xzL != 0)
-        {
-            xzX = xzX / xzL;
-            xzZ = xzZ / xzL;
-        }
+        Vector3 viewPos  = m_ViewCamera.GetTransform().GetOrigin();
+        Vector4 lightDir = -m_ViewCamera.GetTransform().GetForward();
 
-        float rotX = MMath::Acos(-xzZ) * 0.5;
-        if (xzX >= 0)
+        // 按距离切换模型与Imposter
+        m_NearList.clear();
+        m_FarList.clear();
+        for (int32 i = 0; i < m_Positions.size(); ++i)
         {
-            rotX = PI - rotX;
+            float distance = (m_Positions[i] + m_Imposter->center - viewPos).Size();
+            if (distance < m_SwitchDistance * m_Imposter->radius)
+            {
+                m_NearList.push_back(i);
+            }
+            else
+            {
+                m_FarList.push_back(i);
+            }
         }
-        rotX = 1.0 - rotX / PI;
 
-        if (viewDir.y <= -1)
+        // mesh
+        if (m_NearList.size() > 0)
         {
-            viewDir.y = -1;
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_MeshMaterial->GetPipeline());
+            m_MeshMaterial->BeginFrame();
+
+            int32 objIndex = 0;
+            for (int32 i = 0; i < m_NearList.size(); ++i)
+            {
+                for (int32 j = 0; j < m_Model->meshes.size(); ++j)
+                {
+                    m_MVPParam.model = m_Model->meshes[j]->linkNode->GetGlobalMatrix();
+                    m_MVPParam.model.AppendTranslation(m_Positions[m_NearList[i]]);
+
+                    m_MeshMaterial->BeginObject();
+                    m_MeshMaterial->SetLocalUniform("uboMVP", &m_MVPParam, sizeof(ModelViewProjectionBlock));
+                    m_MeshMaterial->EndObject();
+
+                    m_MeshMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, objIndex);
+                    m_Model->meshes[j]->BindDrawCmd(commandBuffer);
+
+                    objIndex += 1;
+                }
+            }
+
+            m_MeshMaterial->EndFrame();
         }
-        else if (viewDir.y >= 1)
+
+        // imposter
+        if (m_FarList.size() > 0)
         {
-            viewDir.y = 1;
-        }
-        float rotY = 1.0 - MMath::Acos(viewDir.y) / PI;
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ImposterMaterial->GetPipeline());
+            m_ImposterMaterial->BeginFrame();
 
-        float uScale = 1.0f / m_TileCount;
-        float vScale = 1.0f / m_TileCount;
-        float uStep  = int32(rotX * m_TileCount) * uScale;
-        float vStep  = int32(rotY * m_TileCount) * vScale;
+            for (int32 i = 0; i < m_FarList.size(); ++i)
+            {
+                const Vector3& position = m_Positions[m_FarList[i]];
 
-        Vector4 uvScale  = Vector4(uScale, vScale, uStep, vStep);
-        Vector4 lightDir = -viewDir;
+                Vector3 viewDir = viewPos - (position + m_Imposter->center);
+                viewDir.Normalize();
 
-        m_ImposterMaterial->BeginFrame();
-        m_ImposterMaterial->BeginObject();
-        m_ImposterMaterial->SetLocalUniform("uboMVP",     &m_MVPParam, sizeof(ModelViewProjectionBlock));
-        m_ImposterMaterial->SetLocalUniform("uboUVScale", &uvScale,    sizeof(Vector4));
-        m_ImposterMaterial->SetLocalUniform("uboLight",   &lightDir,   sizeof(Vector4));
-        m_ImposterMaterial->EndObject();
-        m_ImposterMaterial->EndFrame();
+                m_MVPParam.model = m_Imposter->GetBillboardMatrix(position, viewPos);
+                Vector4 uvScale  = m_Imposter->GetFrameUVScale(viewDir);
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ImposterMaterial->GetPipeline());
-        m_ImposterMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-        vk_demo::DVKDefaultRes::fullQuad->meshes[0]->BindDrawCmd(commandBuffer);
+                m_ImposterMaterial->BeginObject();
+                m_ImposterMaterial->SetLocalUniform("uboMVP",     &m_MVPParam, sizeof(ModelViewProjectionBlock));
+                m_ImposterMaterial->SetLocalUniform("uboUVScale", &uvScale,    sizeof(Vector4));
+                m_ImposterMaterial->SetLocalUniform("uboLight",   &lightDir,   sizeof(Vector4));
+                m_ImposterMaterial->EndObject();
+
+                m_ImposterMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
+                vk_demo::DVKDefaultRes::fullQuad->meshes[0]->BindDrawCmd(commandBuffer);
+            }
+
+            m_ImposterMaterial->EndFrame();
+        }
 
         m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
 
@@ -524,9 +382,12 @@ private:
 
     void InitParmas()
     {
-        m_ViewCamera.SetPosition(0, 0, -5.0f);
+        float radius = m_Imposter->radius;
+        float extent = radius * 2.5f * m_FieldSize;
+
+        m_ViewCamera.SetPosition(0, radius * 4.0f, -radius * 12.0f);
         m_ViewCamera.LookAt(0, 0, 0);
-        m_ViewCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight(), 1.0f, 100.0f);
+        m_ViewCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight(), radius * 0.1f, extent * 2.0f);
     }
 
     void CreateGUI()
@@ -545,16 +406,27 @@ private:
 
     bool                        m_Ready = false;
 
-    // combine
+    // mesh
+    vk_demo::DVKModel*          m_Model = nullptr;
+    vk_demo::DVKTexture*        m_TexAlbedo = nullptr;
+    vk_demo::DVKTexture*        m_TexNormal = nullptr;
+    vk_demo::DVKShader*         m_DiffuseShader = nullptr;
+    vk_demo::DVKMaterial*       m_MeshMaterial = nullptr;
+
+    // imposter
+    vk_demo::DVKImposter*       m_Imposter = nullptr;
     vk_demo::DVKShader*         m_ImposterShader = nullptr;
     vk_demo::DVKMaterial*       m_ImposterMaterial = nullptr;
 
-    // imposter diffuse + normal
-    vk_demo::DVKTexture*        m_ImposterDiffuse = nullptr;
-    vk_demo::DVKTexture*        m_ImposterNormal = nullptr;
-
     int32                       m_TileCount = 16;
 
+    // 单位为包围球半径
+    float                       m_SwitchDistance = 15.0f;
+    int32                       m_FieldSize = 32;
+    std::vector<Vector3>        m_Positions;
+    std::vector<int32>          m_NearList;
+    std::vector<int32>          m_FarList;
+
     vk_demo::DVKCamera          m_ViewCamera;
     ModelViewProjectionBlock    m_MVPParam;
 
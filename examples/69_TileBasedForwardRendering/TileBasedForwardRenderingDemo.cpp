@@ -7,62 +7,16 @@
 #include "Math/Matrix4x4.h"
 
 #include <vector>
+#include <algorithm>
 
-#define LIGHT_SIZE 512
-#define TILE_SIZE 16
-#define LIGHT_SIZE_PER_TILE 63
+#define MAX_LIGHT_SIZE 32768
+#define TILE_SIZE 64
+#define SLICE_SIZE 24
 
-struct PointLight
+struct ShadingParamBlock
 {
-    Vector3 position;
-    float radius = 2.5f;
-
-    Vector3 color = Vector3(1.0f, 1.0f, 1.0f);
-    float padding;
-
-    PointLight()
-    {
-
-    }
-
-    PointLight(const Vector3& inPosition, float inRadius, const Vector3& inColor)
-        : position(inPosition)
-        , radius(inRadius)
-        , color(inColor)
-    {
-
-    }
-};
-
-struct LightsParamBlock
-{
-    Vector4 count = Vector4(0, 0, 0, 0);
-    PointLight lights[LIGHT_SIZE];
-
-    LightsParamBlock()
-    {
-
-    }
-};
-
-struct LightsInfo
-{
-    Vector3 position[LIGHT_SIZE];
-    Vector3 direction[LIGHT_SIZE];
-};
-
-struct LightVisiblity
-{
-    uint32 count;
-    uint32 lightindices[LIGHT_SIZE_PER_TILE];
-};
-
-struct CullingParamBlock
-{
-    Matrix4x4 invViewProj;
-    Vector4 frameSize;
-    Vector4 tileNum;
-    Vector4 pos;
+    Vector4 cameraPos;
+    Vector4 debug;
 };
 
 struct ModelViewProjectionBlock
@@ -136,13 +90,17 @@ private:
 
         UpdateLights(time, delta);
 
-        m_CullingParam.invViewProj = m_ViewCamera.GetViewProjection();
-        m_CullingParam.invViewProj.SetInverse();
-
-        m_CullingParam.pos = m_ViewCamera.GetTransform().GetOrigin();
+        m_ShadingParam.cameraPos = m_ViewCamera.GetTransform().GetOrigin();
 
         SetupCommandBuffers(bufferIndex);
         DemoBase::Present(bufferIndex);
+
+        // Present会等待Fence，此时GPU结果已经可读
+        if (m_Validate)
+        {
+            ValidateClusters();
+            m_Validate = false;
+        }
     }
 
     void UpdateLights(float time, float delta)
@@ -151,12 +109,44 @@ private:
         Vector3 extend = bounds.max - bounds.min;
         float size = MMath::Min(extend.x, MMath::Min(extend.y, extend.z));
 
-        for (int32 i = 0; i < m_LightParam.count.x; ++i)
+        for (int32 i = 0; i < m_LightCount; ++i)
         {
-            PointLight& light = m_LightParam.lights[i];
+            m_Lights[i].position = m_LightOrigins[i] + m_LightMoves[i] * MMath::Cos(time) * size;
+        }
+
+        m_ClusteredLights->UpdateLights(m_Lights.data(), m_LightCount);
+    }
+
+    void ValidateClusters()
+    {
+        vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+        std::vector<uint32> gpuGrid;
+        std::vector<uint32> gpuIndices;
+        m_ClusteredLights->ReadBack(cmdBuffer, gpuGrid, gpuIndices);
+
+        delete cmdBuffer;
+
+        std::vector<uint32> cpuGrid;
+        std::vector<uint32> cpuIndices;
+        vk_demo::DVKClusteredLights::BuildCPU(m_ClusteredLights->grid, m_ClusterView, m_Lights.data(), m_LightCount, cpuGrid, cpuIndices);
 
-            light.position = m_LightInfo.position[i] + m_LightInfo.direction[i] * MMath::Cos(time) * size;
+        // 同一个簇内的顺序取决于GPU的执行顺序，排序后再比较
+        m_Mismatches = 0;
+        int32 numClusters = m_ClusteredLights->grid.GetClusterCount();
+        for (int32 i = 0; i < numClusters; ++i)
+        {
+            std::vector<uint32> gpuList(gpuIndices.begin() + gpuGrid[i * 2 + 0], gpuIndices.begin() + gpuGrid[i * 2 + 0] + gpuGrid[i * 2 + 1]);
+            std::vector<uint32> cpuList(cpuIndices.begin() + cpuGrid[i * 2 + 0], cpuIndices.begin() + cpuGrid[i * 2 + 0] + cpuGrid[i * 2 + 1]);
+            std::sort(gpuList.begin(), gpuList.end());
+            std::sort(cpuList.begin(), cpuList.end());
+            if (gpuList != cpuList)
+            {
+                m_Mismatches += 1;
+            }
         }
+
+        MLOG("Cluster validate : clusters=%d lights=%d gpuIndices=%d cpuIndices=%d mismatches=%d", numClusters, m_LightCount, (int32)gpuIndices.size(), (int32)cpuIndices.size(), m_Mismatches);
     }
 
     bool UpdateUI(float time, float delta)
@@ -168,9 +158,20 @@ private:
             ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
             ImGui::Begin("TileBasedForwardRenderingDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
-            int index = m_Debug.x;
-            ImGui::Combo("Debug", &index, "None\0Normal\0\Tile\0");
-            m_Debug.x = index;
+            int index = m_ShadingParam.debug.x;
+            ImGui::Combo("Debug", &index, "None\0Normal\0Cluster\0");
+            m_ShadingParam.debug.x = index;
+
+            ImGui::SliderInt("Lights", &m_LightCount, 1, MAX_LIGHT_SIZE);
+
+            if (ImGui::Button("Validate"))
+            {
+                m_Validate = true;
+            }
+
+            ImGui::Text("Clusters:%dx%dx%d", m_ClusteredLights->grid.tilesX, m_ClusteredLights->grid.tilesY, m_ClusteredLights->grid.slices);
+            ImGui::Text("Indices:%d/%d", (int32)m_ClusteredLights->GetLastIndexCount(), m_ClusteredLights->indexCapacity);
+            ImGui::Text("Mismatches:%d", m_Mismatches);
 
             ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
             ImGui::End();
@@ -186,46 +187,46 @@ private:
 
     void InitLights()
     {
-        m_LightParam.count.Set(LIGHT_SIZE, LIGHT_SIZE, LIGHT_SIZE, LIGHT_SIZE);
-
         vk_demo::DVKBoundingBox bounds = m_Model->rootNode->GetBounds();
 
-        for (int32 i = 0; i < LIGHT_SIZE; ++i)
-        {
-            Vector3 position;
-            position.x = MMath::FRandRange(bounds.min.x, bounds.max.x);
-            position.y = MMath::FRandRange(bounds.min.y, bounds.max.y);
-            position.z = MMath::FRandRange(bounds.min.z, bounds.max.z);
+        m_Lights.resize(MAX_LIGHT_SIZE);
+        m_LightOrigins.resize(MAX_LIGHT_SIZE);
+        m_LightMoves.resize(MAX_LIGHT_SIZE);
 
-            float radius = MMath::FRandRange(0.5f, 2.5f);
+        for (int32 i = 0; i < MAX_LIGHT_SIZE; ++i)
+        {
+            vk_demo::DVKClusterLight& light = m_Lights[i];
 
-            Vector3 color;
-            color.x = MMath::FRandRange(0.0f, 2.5f);
-            color.y = MMath::FRandRange(0.0f, 2.5f);
-            color.z = MMath::FRandRange(0.0f, 2.5f);
+            light.position.x = MMath::FRandRange(bounds.min.x, bounds.max.x);
+            light.position.y = MMath::FRandRange(bounds.min.y, bounds.max.y);
+            light.position.z = MMath::FRandRange(bounds.min.z, bounds.max.z);
+            light.radius     = MMath::FRandRange(0.5f, 2.5f);
 
-            PointLight light(position, radius, color);
+            light.color.x = MMath::FRandRange(0.0f, 2.5f);
+            light.color.y = MMath::FRandRange(0.0f, 2.5f);
+            light.color.z = MMath::FRandRange(0.0f, 2.5f);
 
-            m_LightParam.lights[i] = light;
+            // 四分之一为朝下的聚光灯
+            if (i % 4 == 0)
+            {
+                float angle = MMath::FRandRange(0.3f, 0.8f);
+                light.type      = (float)vk_demo::DVKClusterLightType::Spot;
+                light.radius   *= 2.0f;
+                light.direction = Vector3(MMath::FRandRange(-0.5f, 0.5f), -1.0f, MMath::FRandRange(-0.5f, 0.5f));
+                light.direction.Normalize();
+                light.cosOuter  = MMath::Cos(angle);
+                light.cosInner  = MMath::Cos(angle * 0.7f);
+            }
 
-            m_LightInfo.direction[i] = Vector3(
+            m_LightMoves[i] = Vector3(
                 MMath::FRandRange(-1.0f, 1.0f),
                 MMath::FRandRange(-1.0f, 1.0f),
                 MMath::FRandRange(-1.0f, 1.0f)
             );
-            m_LightInfo.direction[i].Normalize();
+            m_LightMoves[i].Normalize();
 
-            m_LightInfo.position[i] = position;
+            m_LightOrigins[i] = light.position;
         }
-
-        m_TileCountPerRow = (m_FrameWidth - 1) / TILE_SIZE + 1;
-        m_TileCountPerCol = (m_FrameHeight - 1) / TILE_SIZE + 1;
-
-        m_CullingParam.frameSize.x = m_FrameWidth;
-        m_CullingParam.frameSize.y = m_FrameHeight;
-
-        m_CullingParam.tileNum.x = m_TileCountPerRow;
-        m_CullingParam.tileNum.y = m_TileCountPerCol;
     }
 
     void LoadAssets()
@@ -263,58 +264,28 @@ private:
         // lights
         InitLights();
 
-        // depth
-        m_PreDepthTexture = vk_demo::DVKTexture::CreateRenderTarget(
-            m_VulkanDevice,
-            PixelFormatToVkFormat(m_DepthFormat, false),
-            VK_IMAGE_ASPECT_DEPTH_BIT,
-            m_FrameWidth,
-            m_FrameHeight,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
-        );
-
-        vk_demo::DVKRenderPassInfo passInfo(m_PreDepthTexture, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE);
-        m_PreDepthRTT = vk_demo::DVKRenderTarget::Create(m_VulkanDevice, passInfo);
-
-        m_DepthShader = vk_demo::DVKShader::Create(
-            m_VulkanDevice,
-            true,
-            "assets/shaders/69_TileBasedForwardRendering/depth.vert.spv",
-            "assets/shaders/69_TileBasedForwardRendering/depth.frag.spv"
-        );
-
-        m_DepthMaterial = vk_demo::DVKMaterial::Create(
+        // clusters
+        m_AssignShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
-            m_PreDepthRTT,
-            m_PipelineCache,
-            m_DepthShader
+            "assets/shaders/69_TileBasedForwardRendering/ClusterAssign.comp.spv"
         );
-        m_DepthMaterial->pipelineInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
-        m_DepthMaterial->pipelineInfo.colorAttachmentCount = 0;
-        m_DepthMaterial->PreparePipeline();
 
-        // tiles
-        m_LightsCullingBuffer = vk_demo::DVKBuffer::CreateBuffer(
+        m_ScanShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            sizeof(LightVisiblity) * m_TileCountPerRow * m_TileCountPerCol
+            "assets/shaders/69_TileBasedForwardRendering/ClusterScan.comp.spv"
         );
 
-        m_ComputeShader = vk_demo::DVKShader::Create(
-            m_VulkanDevice,
-            "assets/shaders/69_TileBasedForwardRendering/lightCulling.comp.spv"
-        );
+        vk_demo::DVKClusterGrid grid;
+        grid.Setup(m_ViewCamera, m_FrameWidth, m_FrameHeight, TILE_SIZE, SLICE_SIZE);
 
-        m_ComputeProcessor = vk_demo::DVKCompute::Create(
+        m_ClusteredLights = vk_demo::DVKClusteredLights::Create(
             m_VulkanDevice,
             m_PipelineCache,
-            m_ComputeShader
+            m_AssignShader,
+            m_ScanShader,
+            grid,
+            m_LightCount
         );
-        m_ComputeProcessor->SetStorageBuffer("lightsCullingBuffer", m_LightsCullingBuffer);
-        m_ComputeProcessor->SetTexture("depthTexture", m_PreDepthTexture);
-
-        m_Material->SetStorageBuffer("lightsCullingBuffer", m_LightsCullingBuffer);
 
         delete cmdBuffer;
     }
@@ -325,42 +296,9 @@ private:
         delete m_Shader;
         delete m_Material;
 
-        delete m_DepthShader;
-        delete m_DepthMaterial;
-        delete m_PreDepthTexture;
-        delete m_PreDepthRTT;
-
-        delete m_ComputeShader;
-        delete m_ComputeProcessor;
-        delete m_LightsCullingBuffer;
-    }
-
-    void PreDepthPass(int backBufferIndex)
-    {
-        VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
-
-        m_PreDepthRTT->BeginRenderPass(commandBuffer);
-
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DepthMaterial->GetPipeline());
-        for (int32 i = 0; i < m_Model->meshes.size(); ++i)
-        {
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DepthMaterial->GetPipeline());
-
-            m_MVPParam.model = m_Model->meshes[i]->linkNode->GetGlobalMatrix();
-            m_MVPParam.view  = m_ViewCamera.GetView();
-            m_MVPParam.proj  = m_ViewCamera.GetProjection();
-
-            m_DepthMaterial->BeginFrame();
-            m_DepthMaterial->BeginObject();
-            m_DepthMaterial->SetLocalUniform("uboMVP",   &m_MVPParam, sizeof(ModelViewProjectionBlock));
-            m_DepthMaterial->EndObject();
-            m_DepthMaterial->EndFrame();
-
-            m_DepthMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-            m_Model->meshes[i]->BindDrawCmd(commandBuffer);
-        }
-
-        m_PreDepthRTT->EndRenderPass(commandBuffer);
+        delete m_AssignShader;
+        delete m_ScanShader;
+        delete m_ClusteredLights;
     }
 
     void FinnalPass(int backBufferIndex)
@@ -402,6 +340,9 @@ private:
         vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
         vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
 
+        // Buffer扩容后需要重新绑定，句柄未变化时不会更新DescriptorSet
+        m_ClusteredLights->BindMaterial(m_Material);
+
         for (int32 i = 0; i < m_Model->meshes.size(); ++i)
         {
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
@@ -414,9 +355,8 @@ private:
 
             m_Material->BeginObject();
             m_Material->SetLocalUniform("uboMVP",       &m_MVPParam,        sizeof(ModelViewProjectionBlock));
-            m_Material->SetLocalUniform("uboLights",    &m_LightParam,      sizeof(LightsParamBlock));
-            m_Material->SetLocalUniform("uboCulling",   &m_CullingParam,    sizeof(CullingParamBlock));
-            m_Material->SetLocalUniform("uboDebug",     &m_Debug,           sizeof(Vector4));
+            m_Material->SetLocalUniform("uboCluster",   &m_ClusterParam,    sizeof(vk_demo::DVKClusterParamBlock));
+            m_Material->SetLocalUniform("uboShading",   &m_ShadingParam,    sizeof(ShadingParamBlock));
             m_Material->EndObject();
 
             m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
@@ -430,55 +370,6 @@ private:
         vkCmdEndRenderPass(commandBuffer);
     }
 
-    void SetupComputeCommand(int32 backBufferIndex)
-    {
-        VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
-
-        VkBufferMemoryBarrier bufferBarrier;
-        ZeroVulkanStruct(bufferBarrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
-        bufferBarrier.buffer = m_LightsCullingBuffer->buffer;
-        bufferBarrier.size   = m_LightsCullingBuffer->size;
-        bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        bufferBarrier.srcQueueFamilyIndex = m_VulkanDevice->GetGraphicsQueue()->GetFamilyIndex();
-        bufferBarrier.dstQueueFamilyIndex = m_VulkanDevice->GetComputeQueue()->GetFamilyIndex();
-
-        vkCmdPipelineBarrier(
-            commandBuffer,
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            0,
-            0,
-            nullptr,
-            1,
-            &bufferBarrier,
-            0,
-            nullptr
-        );
-
-        m_ComputeProcessor->SetUniform("uboCulling", &m_CullingParam, sizeof(CullingParamBlock));
-        m_ComputeProcessor->SetUniform("uboLights", &m_LightParam, sizeof(LightsParamBlock));
-        m_ComputeProcessor->BindDispatch(commandBuffer, m_TileCountPerRow, m_TileCountPerCol, 1);
-
-        bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        bufferBarrier.srcQueueFamilyIndex = m_VulkanDevice->GetComputeQueue()->GetFamilyIndex();
-        bufferBarrier.dstQueueFamilyIndex = m_VulkanDevice->GetGraphicsQueue()->GetFamilyIndex();
-
-        vkCmdPipelineBarrier(
-            commandBuffer,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-            0,
-            0,
-            nullptr,
-            1,
-            &bufferBarrier,
-            0,
-            nullptr
-        );
-    }
-
     void SetupCommandBuffers(int32 backBufferIndex)
     {
         VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
@@ -487,8 +378,10 @@ private:
         ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
         VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
-        PreDepthPass(backBufferIndex);
-        SetupComputeCommand(backBufferIndex);
+        m_ClusterView = m_ViewCamera.GetView();
+        m_ClusteredLights->Build(commandBuffer, m_ClusterView);
+        m_ClusteredLights->GetParam(m_ClusterView, m_ClusterParam);
+
         FinnalPass(backBufferIndex);
 
         VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
@@ -516,37 +409,35 @@ private:
 
 private:
 
-    bool                        m_Ready = false;
+    bool                                m_Ready = false;
 
     // scene
-    vk_demo::DVKModel*          m_Model = nullptr;
-    vk_demo::DVKShader*         m_Shader = nullptr;
-    vk_demo::DVKMaterial*       m_Material = nullptr;
-
-    // pre-depth rt
-    vk_demo::DVKShader*         m_DepthShader = nullptr;
-    vk_demo::DVKMaterial*       m_DepthMaterial = nullptr;
-    vk_demo::DVKTexture*        m_PreDepthTexture = nullptr;
-    vk_demo::DVKRenderTarget*   m_PreDepthRTT = nullptr;
+    vk_demo::DVKModel*                  m_Model = nullptr;
+    vk_demo::DVKShader*                 m_Shader = nullptr;
+    vk_demo::DVKMaterial*               m_Material = nullptr;
 
-    // compute shader
-    vk_demo::DVKShader*         m_ComputeShader = nullptr;
-    vk_demo::DVKCompute*        m_ComputeProcessor = nullptr;
-    vk_demo::DVKBuffer*         m_LightsCullingBuffer = nullptr;
+    // clusters
+    vk_demo::DVKShader*                 m_AssignShader = nullptr;
+    vk_demo::DVKShader*                 m_ScanShader = nullptr;
+    vk_demo::DVKClusteredLights*        m_ClusteredLights = nullptr;
+    vk_demo::DVKClusterParamBlock       m_ClusterParam;
+    Matrix4x4                           m_ClusterView;
 
-    vk_demo::DVKCamera          m_ViewCamera;
+    // lights
+    int32                               m_LightCount = 4096;
+    std::vector<vk_demo::DVKClusterLight> m_Lights;
+    std::vector<Vector3>                m_LightOrigins;
+    std::vector<Vector3>                m_LightMoves;
 
-    Vector4                     m_Debug;
+    bool                                m_Validate = false;
+    int32                               m_Mismatches = 0;
 
-    LightsInfo                  m_LightInfo;
-    LightsParamBlock            m_LightParam;
-    CullingParamBlock           m_CullingParam;
-    ModelViewProjectionBlock    m_MVPParam;
+    vk_demo::DVKCamera                  m_ViewCamera;
 
-    int32                       m_TileCountPerRow = 0;
-    int32                       m_TileCountPerCol = 0;
+    ShadingParamBlock                   m_ShadingParam;
+    ModelViewProjectionBlock            m_MVPParam;
 
-    ImageGUIContext*            m_GUI = nullptr;
+    ImageGUIContext*                    m_GUI = nullptr;
 };
 
 std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
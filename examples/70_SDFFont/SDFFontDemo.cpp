@@ -99,6 +99,8 @@ private:
         m_Material->EndObject();
         m_Material->EndFrame();
 
+        UpdateText(time, bufferIndex);
+
         SetupCommandBuffers(bufferIndex);
 
         DemoBase::Present(bufferIndex);
@@ -141,6 +143,11 @@ private:
 
             ImGui::Separator();
 
+            ImGui::SliderInt("Labels", &m_NumLabels, 0, 4000);
+            ImGui::Text("Glyphs:%d Atlas:%dx%d", m_TextBatch->numGlyphs, m_Font->atlasWidth, m_Font->atlasHeight);
+
+            ImGui::Separator();
+
             ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::End();
         }
@@ -203,6 +210,30 @@ private:
         m_Material->PreparePipeline();
         m_Material->SetTexture("textureMap", m_Texture);
 
+        // 运行时生成的SDF字形图集，所有文字合并为一次绘制
+        m_JobSystem = vk_demo::DVKJobSystem::Create();
+        m_Font      = vk_demo::DVKSDFFont::Create(m_VulkanDevice, "assets/fonts/Ubuntu-Regular.ttf", m_JobSystem);
+        m_TextBatch = vk_demo::DVKTextBatch::Create(
+            m_VulkanDevice,
+            cmdBuffer,
+            m_Font,
+            65536,
+            GetVulkanRHI()->GetSwapChain()->GetBackBufferCount()
+        );
+
+        m_TextMaterial = vk_demo::DVKMaterial::Create(
+            m_VulkanDevice,
+            m_RenderPass,
+            m_PipelineCache,
+            m_Shader
+        );
+        m_TextMaterial->pipelineInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
+        m_TextMaterial->pipelineInfo.depthStencilState.depthTestEnable = VK_FALSE;
+        m_TextMaterial->pipelineInfo.depthStencilState.depthWriteEnable = VK_FALSE;
+        m_TextMaterial->pipelineInfo.blendAttachmentStates[0] = m_Material->pipelineInfo.blendAttachmentStates[0];
+        m_TextMaterial->PreparePipeline();
+        m_TextBatch->BindMaterial(m_TextMaterial, "textureMap");
+
         delete cmdBuffer;
     }
 
@@ -212,6 +243,42 @@ private:
         delete m_Texture;
         delete m_Material;
         delete m_Model;
+
+        delete m_TextBatch;
+        delete m_TextMaterial;
+        delete m_Font;
+        delete m_JobSystem;
+    }
+
+    void UpdateText(float time, int32 backBufferIndex)
+    {
+        m_Font->BeginFrame();
+        m_TextBatch->Begin(backBufferIndex);
+
+        m_TextBatch->AddText("Runtime SDF Text", 400.0f, 20.0f, 48.0f);
+
+        // 每帧变化的标签，字形只在第一次出现时生成
+        char label[64];
+        int32 columns = MMath::Max(1, (int32)(m_FrameWidth - 400) / 120);
+        for (int32 i = 0; i < m_NumLabels; ++i)
+        {
+            float x = 400.0f + (i % columns) * 120.0f;
+            float y = 90.0f + (i / columns) * 16.0f;
+            snprintf(label, sizeof(label), "#%04d %7.2f", i, MMath::Sin(time + i * 0.1f) * 100.0f);
+            m_TextBatch->AddText(label, x, y, 14.0f);
+        }
+
+        m_TextMVP.model.SetIdentity();
+        m_TextMVP.view.SetIdentity();
+        m_TextMVP.projection.SetIdentity();
+        m_TextMVP.projection.Orthographic(0, m_FrameWidth, m_FrameHeight, 0, -1.0f, 1.0f);
+
+        m_TextMaterial->BeginFrame();
+        m_TextMaterial->BeginObject();
+        m_TextMaterial->SetLocalUniform("uboMVP",    &m_TextMVP,     sizeof(ModelViewProjectionBlock));
+        m_TextMaterial->SetLocalUniform("uboSDF",    &m_TextSDFData, sizeof(SDFParamBlock));
+        m_TextMaterial->EndObject();
+        m_TextMaterial->EndFrame();
     }
 
     void SetupCommandBuffers(int32 backBufferIndex)
@@ -236,6 +303,9 @@ private:
         ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
         VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
+        // 字形图集与顶点需要在RenderPass之外上传
+        m_TextBatch->End(commandBuffer);
+
         VkClearValue clearValues[2];
         clearValues[0].color        = {
             { 0.2f, 0.2f, 0.2f, 1.0f }
@@ -264,6 +334,10 @@ private:
             m_Model->meshes[j]->BindDrawCmd(commandBuffer);
         }
 
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_TextMaterial->GetPipeline());
+        m_TextMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+        m_TextBatch->Draw(commandBuffer);
+
         m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
 
         vkCmdEndRenderPass(commandBuffer);
@@ -280,6 +354,11 @@ private:
         m_SDFData.glowColor = Vector4(0.0f, 1.0f, 0.0f, 1.0f);
         m_SDFData.shadowColor = Vector4(0.0f, 0.0f, 0.0f, 1.0f);
 
+        // 小字号下一个像素对应的距离更大，边缘需要更宽的过渡
+        m_TextSDFData = m_SDFData;
+        m_TextSDFData.param0 = Vector4(0.5f, 0.4f, 0.25f, 0.1f);
+        m_TextSDFData.param2 = Vector4(0.0f, 0.0f, 0.0f, 0.0f);
+
         m_ViewCamera.SetPosition(0, 0, -2.5f);
         m_ViewCamera.Perspective(PI / 4, GetWidth(), GetHeight(), 0.10f, 3000.0f);
     }
@@ -309,6 +388,15 @@ private:
     vk_demo::DVKTexture*        m_Texture = nullptr;
     vk_demo::DVKMaterial*       m_Material = nullptr;
 
+    ModelViewProjectionBlock    m_TextMVP;
+    SDFParamBlock               m_TextSDFData;
+    int32                       m_NumLabels = 1000;
+
+    vk_demo::DVKJobSystem*      m_JobSystem = nullptr;
+    vk_demo::DVKSDFFont*        m_Font = nullptr;
+    vk_demo::DVKTextBatch*      m_TextBatch = nullptr;
+    vk_demo::DVKMaterial*       m_TextMaterial = nullptr;
+
     ImageGUIContext*            m_GUI = nullptr;
 };
 
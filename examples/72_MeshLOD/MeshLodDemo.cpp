@@ -6,18 +6,8 @@
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
 
-#include "meshoptimizer.h"
-
 #include <vector>
 
-#define LOD_GROUP_SIZE 15
-
-struct LodGroup
-{
-    uint32 start;
-    uint32 count;
-};
-
 struct ModelViewProjectionBlock
 {
     Matrix4x4 model;
@@ -103,10 +93,28 @@ private:
             ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
             ImGui::Begin("MeshLodDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
-            int32 totalCount = m_IndexBuffer->indexCount;
+            ImGui::Checkbox("AutoLOD", &m_AutoLod);
+            if (m_AutoLod)
+            {
+                ImGui::SliderFloat("Error(px)", &m_LodThreshold, 0.25f, 16.0f);
+            }
+            else
+            {
+                ImGui::SliderInt("LOD", &m_LodIndex, 0, m_MaxLod);
+            }
+
+            int32 triangles = 0;
+            for (int32 i = 0; i < m_Model->meshes.size(); ++i)
+            {
+                vk_demo::DVKMesh* mesh = m_Model->meshes[i];
+                for (int32 j = 0; j < mesh->primitives.size(); ++j)
+                {
+                    triangles += mesh->primitives[j]->GetLodTriangleNum();
+                }
+            }
 
-            ImGui::SliderInt("LOD", &m_LodIndex, 0, LOD_GROUP_SIZE - 1);
-            ImGui::Text("Tri:%d\n", m_LodGroups[m_LodIndex].count / 3);
+            vk_demo::DVKPrimitive* primitive = m_Model->meshes[0]->primitives[0];
+            ImGui::Text("LOD:%d/%d Tri:%d", primitive->lodIndex, (int32)primitive->lods.size(), triangles);
 
             ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
             ImGui::End();
@@ -120,136 +128,14 @@ private:
         return hovered;
     }
 
-    void ProcessMesh(vk_demo::DVKCommandBuffer* cmdBuffer)
-    {
-        const uint32 VertexStride = 6;
-
-        std::vector<float> tempVertices;
-        std::vector<uint32> tempIndices;
-
-        for (int32 m = 0; m < m_Model->meshes.size(); ++m)
-        {
-            vk_demo::DVKMesh* mesh = m_Model->meshes[m];
-            for (int32 p = 0; p < mesh->primitives.size(); ++p)
-            {
-                vk_demo::DVKPrimitive* primitive = mesh->primitives[p];
-                uint32 indexStart = tempVertices.size() / VertexStride;
-
-                for (int32 i = 0; i < primitive->vertices.size(); ++i)
-                {
-                    tempVertices.push_back(primitive->vertices[i]);
-                }
-
-                for (int32 i = 0; i < primitive->indices.size(); ++i)
-                {
-                    tempIndices.push_back(primitive->indices[i] + indexStart);
-                }
-            }
-        }
-
-        // Indexing
-        std::vector<uint32> remap;
-        remap.resize(tempVertices.size() / VertexStride);
-        size_t totalVertices = meshopt_generateVertexRemap(
-            remap.data(),
-            tempIndices.data(),
-            tempIndices.size(),
-            tempVertices.data(),
-            tempVertices.size() / VertexStride,
-            sizeof(float) * VertexStride
-        );
-
-        std::vector<uint32> indices;
-        indices.resize(tempIndices.size());
-        meshopt_remapIndexBuffer(
-            indices.data(),
-            tempIndices.data(),
-            tempIndices.size(),
-            remap.data()
-        );
-
-        std::vector<float> vertices;
-        vertices.resize(totalVertices * VertexStride);
-        meshopt_remapVertexBuffer(
-            vertices.data(),
-            tempVertices.data(),
-            tempVertices.size() / VertexStride,
-            sizeof(float) * VertexStride,
-            remap.data()
-        );
-
-        // Vertex cache optimization
-        meshopt_optimizeVertexCache(
-            indices.data(),
-            indices.data(),
-            indices.size(),
-            vertices.size() / VertexStride
-        );
-
-        // Overdraw optimization
-        meshopt_optimizeOverdraw(
-            indices.data(),
-            indices.data(),
-            indices.size(),
-            vertices.data(),
-            vertices.size() / VertexStride,
-            sizeof(float) * VertexStride,
-            3.0f
-        );
-
-        // Vertex fetch optimization
-        meshopt_optimizeVertexFetch(
-            vertices.data(),
-            indices.data(),
-            indices.size(),
-            vertices.data(),
-            vertices.size() / VertexStride,
-            sizeof(float) * VertexStride
-        );
-
-        // Simplification
-        uint32 indexCount = indices.size();
-
-        m_LodGroups[0].start = 0;
-        m_LodGroups[0].count = indices.size();
-
-        float bias = 1.0f / LOD_GROUP_SIZE;
-        for (int lodIdx = 1; lodIdx < LOD_GROUP_SIZE; ++lodIdx)
-        {
-            float threshold = 1.0f - lodIdx * bias;
-            uint32 lodIndexCount = indexCount * threshold / 3 * 3;
-
-            std::vector<uint32> lodIndices;
-            lodIndices.resize(lodIndexCount);
-
-            uint32 realCount = meshopt_simplifySloppy(
-                lodIndices.data(),
-                indices.data(),
-                indexCount,
-                vertices.data(),
-                vertices.size() / VertexStride,
-                sizeof(float) * VertexStride,
-                lodIndexCount
-            );
-            lodIndices.resize(realCount);
-
-            m_LodGroups[lodIdx].start = indices.size();
-            m_LodGroups[lodIdx].count = lodIndices.size();
-
-            for (int32 i = 0; i < lodIndices.size(); ++i)
-            {
-                indices.push_back(lodIndices[i]);
-            }
-        }
-
-        m_VertexBuffer = vk_demo::DVKVertexBuffer::Create(m_VulkanDevice, cmdBuffer, vertices, { VertexAttribute::VA_Position, VertexAttribute::VA_Normal });
-        m_IndexBuffer  = vk_demo::DVKIndexBuffer::Create(m_VulkanDevice, cmdBuffer, indices);
-    }
-
     void LoadAssets()
     {
         vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
 
+        vk_demo::DVKModelLoadOptions options;
+        options.generateLods = true;
+        options.maxLods      = 15;
+
         m_Model = vk_demo::DVKModel::LoadFromFile(
             "assets/models/suzanne.obj",
             m_VulkanDevice,
@@ -257,9 +143,19 @@ private:
             {
                 VertexAttribute::VA_Position,
                 VertexAttribute::VA_Normal
-            }
+            },
+            options
         );
 
+        for (int32 i = 0; i < m_Model->meshes.size(); ++i)
+        {
+            vk_demo::DVKMesh* mesh = m_Model->meshes[i];
+            for (int32 j = 0; j < mesh->primitives.size(); ++j)
+            {
+                m_MaxLod = MMath::Max(m_MaxLod, (int32)mesh->primitives[j]->lods.size() - 1);
+            }
+        }
+
         m_Shader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
             true,
@@ -276,8 +172,6 @@ private:
         );
         m_Material->PreparePipeline();
 
-        ProcessMesh(cmdBuffer);
-
         delete cmdBuffer;
     }
 
@@ -287,9 +181,6 @@ private:
 
         delete m_Material;
         delete m_Shader;
-
-        delete m_VertexBuffer;
-        delete m_IndexBuffer;
     }
 
     void SetupCommandBuffers(int32 backBufferIndex)
@@ -337,23 +228,40 @@ private:
 
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
         m_Material->BeginFrame();
-        m_MVPParam.model.SetIdentity();
-        m_MVPParam.model.RotateY(180);
-        m_MVPParam.view  = m_ViewCamera.GetView();
-        m_MVPParam.proj  = m_ViewCamera.GetProjection();
 
-        m_Material->BeginObject();
-        m_Material->SetLocalUniform("uboMVP",      &m_MVPParam,         sizeof(ModelViewProjectionBlock));
-        m_Material->EndObject();
+        Matrix4x4 world;
+        world.RotateY(180);
 
-        m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+        if (m_AutoLod)
+        {
+            m_Model->SelectLods(world, m_ViewCamera, m_FrameHeight, m_LodThreshold);
+        }
 
-        int32 indexCount = m_LodGroups[m_LodIndex].count;
-        int32 indexStart = m_LodGroups[m_LodIndex].start;
+        for (int32 i = 0; i < m_Model->meshes.size(); ++i)
+        {
+            vk_demo::DVKMesh* mesh = m_Model->meshes[i];
 
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(m_VertexBuffer->dvkBuffer->buffer), &(m_VertexBuffer->offset));
-        vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer->dvkBuffer->buffer, 0, m_IndexBuffer->indexType);
-        vkCmdDrawIndexed(commandBuffer, indexCount, 1, indexStart, 0, 0);
+            if (!m_AutoLod)
+            {
+                for (int32 j = 0; j < mesh->primitives.size(); ++j)
+                {
+                    vk_demo::DVKPrimitive* primitive = mesh->primitives[j];
+                    primitive->lodIndex = MMath::Min(m_LodIndex, MMath::Max((int32)primitive->lods.size() - 1, 0));
+                }
+            }
+
+            m_MVPParam.model = mesh->linkNode->GetGlobalMatrix();
+            m_MVPParam.model.Append(world);
+            m_MVPParam.view  = m_ViewCamera.GetView();
+            m_MVPParam.proj  = m_ViewCamera.GetProjection();
+
+            m_Material->BeginObject();
+            m_Material->SetLocalUniform("uboMVP",      &m_MVPParam,         sizeof(ModelViewProjectionBlock));
+            m_Material->EndObject();
+
+            m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
+            mesh->BindDrawCmd(commandBuffer);
+        }
 
         m_Material->EndFrame();
 
@@ -392,10 +300,10 @@ private:
     vk_demo::DVKCamera              m_ViewCamera;
     ModelViewProjectionBlock        m_MVPParam;
 
-    LodGroup                        m_LodGroups[LOD_GROUP_SIZE];
+    bool                            m_AutoLod = true;
+    float                           m_LodThreshold = 1.0f;
     int32                           m_LodIndex = 0;
-    vk_demo::DVKVertexBuffer*       m_VertexBuffer = nullptr;
-    vk_demo::DVKIndexBuffer*        m_IndexBuffer = nullptr;
+    int32                           m_MaxLod = 0;
 
     ImageGUIContext*                m_GUI = nullptr;
 };
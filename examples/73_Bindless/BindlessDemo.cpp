@@ -0,0 +1,383 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+
+#include <vector>
+
+#define OBJECT_ROWS 16
+#define OBJECT_COUNT (OBJECT_ROWS * OBJECT_ROWS)
+
+struct ObjectData
+{
+    Matrix4x4   model;
+    uint32      params[4];  // x:纹理下标 y:流式纹理在lodBuffer中的下标
+};
+
+struct PushConstantBlock
+{
+    Matrix4x4   viewProj;
+    uint32      params[4];  // x:ObjectBuffer的下标 y:lodBuffer的下标
+};
+
+class BindlessDemo : public DemoBase
+{
+public:
+    BindlessDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+        : DemoBase(width, height, title, cmdLine)
+    {
+        deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+        instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
+        ZeroVulkanStruct(m_IndexingFeatures, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT);
+        vk_demo::DVKBindlessTable::SetupFeatures(m_IndexingFeatures);
+
+        ZeroVulkanStruct(m_EnabledFeatures2, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2);
+        m_EnabledFeatures2.pNext = &m_IndexingFeatures;
+
+        physicalDeviceFeatures = &m_EnabledFeatures2;
+    }
+
+    virtual ~BindlessDemo()
+    {
+
+    }
+
+    virtual bool PreInit() override
+    {
+        return true;
+    }
+
+    virtual bool Init() override
+    {
+        DemoBase::Setup();
+        DemoBase::Prepare();
+
+        CreateGUI();
+        InitParmas();
+        LoadAssets();
+        CreatePipeline();
+
+        m_Ready = true;
+
+        return true;
+    }
+
+    virtual void Exist() override
+    {
+        DemoBase::Release();
+
+        DestroyAssets();
+        DestroyGUI();
+    }
+
+    virtual void Loop(float time, float delta) override
+    {
+        if (!m_Ready)
+        {
+            return;
+        }
+        Draw(time, delta);
+    }
+
+private:
+
+    void Draw(float time, float delta)
+    {
+        int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+        UpdateFPS(time, delta);
+        bool hovered = UpdateUI(time, delta);
+
+        if (!hovered)
+        {
+            m_ViewCamera.Update(time, delta);
+        }
+
+        UpdateStreaming(delta);
+
+        SetupCommandBuffers(bufferIndex);
+
+        DemoBase::Present(bufferIndex);
+    }
+
+    void UpdateStreaming(float delta)
+    {
+        // 按物体到相机的距离估算纹理在屏幕上的尺寸，四边形边长为2
+        Vector3 cameraPos  = m_ViewCamera.GetTransform().GetOrigin();
+        float projectScale = m_ViewCamera.GetProjectionScale((float)m_FrameHeight);
+
+        for (int32 i = 0; i < OBJECT_COUNT; ++i)
+        {
+            float distance = MMath::Max((m_ObjectPositions[i] - cameraPos).Size(), 0.01f);
+            m_Textures[i % m_Textures.size()]->RequestScreenSize(2.0f * projectScale / distance);
+        }
+
+        m_Streamer->Update(delta);
+
+        // Image重建后的纹理表项在这里一次写入
+        m_BindlessTable->UpdateDescriptors();
+    }
+
+    bool UpdateUI(float time, float delta)
+    {
+        m_GUI->StartFrame();
+
+        {
+            ImGui::SetNextWindowPos(ImVec2(0, 0));
+            ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+            ImGui::Begin("BindlessDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+            ImGui::Text("Objects:%d Textures:%d DescriptorSet binds:1", OBJECT_COUNT, (int32)m_Textures.size());
+            ImGui::Text("Pool:%.1fMB/%.1fMB", m_Streamer->pool->used / (1024.0f * 1024.0f), m_Streamer->pool->size / (1024.0f * 1024.0f));
+            ImGui::Text("Uploaded:%d (%.1fKB) Evicted:%d", m_Streamer->uploadedTextures, m_Streamer->uploadedBytes / 1024.0f, m_Streamer->evictedTextures);
+
+            ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+            ImGui::End();
+        }
+
+        bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
+
+        m_GUI->EndFrame();
+        m_GUI->Update();
+
+        return hovered;
+    }
+
+    void LoadAssets()
+    {
+        vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+        m_BindlessTable = vk_demo::DVKBindlessTable::Create(m_VulkanDevice, 1024, 64, sizeof(PushConstantBlock));
+
+        // 显存池故意设得比全部纹理的完整mip链小，拉远拉近相机可以观察到淘汰和重新上传
+        vk_demo::DVKTextureStreamingSettings settings;
+        settings.poolSize     = 8 * 1024 * 1024;
+        settings.maxTextures  = 64;
+        settings.uploadBudget = 2 * 1024 * 1024;
+
+        m_StreamCommand = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+        m_Streamer      = vk_demo::DVKTextureStreamer::Create(m_VulkanDevice, m_StreamCommand, settings, m_BindlessTable);
+
+        const char* textureFiles[] = {
+            "assets/textures/UV_Grid_Sm.jpg",
+            "assets/textures/brick_diffuse.jpg",
+            "assets/textures/game0.jpg",
+            "assets/textures/head_diffuse.jpg",
+            "assets/textures/water.jpg",
+            "assets/textures/ground.png",
+            "assets/textures/timg.jpg",
+            "assets/textures/perlin-512.png",
+        };
+
+        for (int32 i = 0; i < 8; ++i)
+        {
+            // 只上传常驻的低层级，高层级在Update中按需加载
+            vk_demo::DVKStreamingTexture* texture = m_Streamer->LoadTexture(textureFiles[i]);
+            if (texture)
+            {
+                m_Textures.push_back(texture);
+            }
+        }
+
+        // 每个物体一个矩阵和纹理下标，全部放在同一个storage buffer中
+        std::vector<ObjectData> objects(OBJECT_COUNT);
+        for (int32 i = 0; i < OBJECT_COUNT; ++i)
+        {
+            float x = (i % OBJECT_ROWS - OBJECT_ROWS * 0.5f) * 2.5f;
+            float y = (i / OBJECT_ROWS - OBJECT_ROWS * 0.5f) * 2.5f;
+
+            objects[i].model.SetIdentity();
+            objects[i].model.SetOrigin(Vector3(x, y, 0));
+            objects[i].params[0] = m_Textures[i % m_Textures.size()]->texture->bindlessIndex;
+            objects[i].params[1] = m_Textures[i % m_Textures.size()]->index;
+            objects[i].params[2] = 0;
+            objects[i].params[3] = 0;
+
+            m_ObjectPositions.push_back(Vector3(x, y, 0));
+        }
+
+        m_ObjectBuffer = vk_demo::DVKBuffer::CreateBuffer(
+            m_VulkanDevice,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            objects.size() * sizeof(ObjectData),
+            objects.data()
+        );
+        m_ObjectBuffer->SetupDescriptor();
+        m_BindlessTable->AddBuffer(m_ObjectBuffer);
+
+        // 所有的注册合并为一次vkUpdateDescriptorSets
+        m_BindlessTable->UpdateDescriptors();
+
+        m_Quad = vk_demo::DVKModel::Create(
+            m_VulkanDevice,
+            cmdBuffer,
+            {
+                -1.0f,  1.0f, 0.0f, 0.0f, 0.0f,
+                 1.0f,  1.0f, 0.0f, 1.0f, 0.0f,
+                 1.0f, -1.0f, 0.0f, 1.0f, 1.0f,
+                -1.0f, -1.0f, 0.0f, 0.0f, 1.0f
+            },
+            { 0, 1, 2, 0, 2, 3 },
+            {
+                VertexAttribute::VA_Position,
+                VertexAttribute::VA_UV0
+            }
+        );
+        m_Quad->meshes[0]->primitives[0]->indexBuffer->instanceCount = OBJECT_COUNT;
+
+        delete cmdBuffer;
+    }
+
+    void CreatePipeline()
+    {
+        vk_demo::DVKShaderModule* vertModule = vk_demo::DVKShaderModule::Create(m_VulkanDevice, "assets/shaders/73_Bindless/obj.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+        vk_demo::DVKShaderModule* fragModule = vk_demo::DVKShaderModule::Create(m_VulkanDevice, "assets/shaders/73_Bindless/obj.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+        vk_demo::DVKGfxPipelineInfo pipelineInfo;
+        pipelineInfo.vertShaderModule = vertModule->handle;
+        pipelineInfo.fragShaderModule = fragModule->handle;
+        pipelineInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
+
+        // Layout由全局资源表提供，所有使用资源表的Pipeline之间保持兼容
+        m_Pipeline = vk_demo::DVKGfxPipeline::Create(
+            m_VulkanDevice,
+            m_PipelineCache,
+            pipelineInfo,
+            { m_Quad->GetInputBinding() },
+            m_Quad->GetInputAttributes(),
+            m_BindlessTable->pipelineLayout,
+            m_RenderPass
+        );
+
+        delete vertModule;
+        delete fragModule;
+    }
+
+    void DestroyAssets()
+    {
+        delete m_Pipeline;
+        delete m_Quad;
+
+        // 流式纹理由streamer负责从资源表中移除并释放
+        delete m_Streamer;
+        delete m_StreamCommand;
+        m_Textures.clear();
+
+        m_BindlessTable->RemoveBuffer(m_ObjectBuffer);
+        delete m_ObjectBuffer;
+
+        delete m_BindlessTable;
+    }
+
+    void SetupCommandBuffers(int32 backBufferIndex)
+    {
+        VkViewport viewport = {};
+        viewport.x        = 0;
+        viewport.y        = m_FrameHeight;
+        viewport.width    = m_FrameWidth;
+        viewport.height   = -(float)m_FrameHeight;    // flip y axis
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor = {};
+        scissor.extent.width  = m_FrameWidth;
+        scissor.extent.height = m_FrameHeight;
+        scissor.offset.x = 0;
+        scissor.offset.y = 0;
+
+        VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+        VkCommandBufferBeginInfo cmdBeginInfo;
+        ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+        VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+        VkClearValue clearValues[2];
+        clearValues[0].color        = {
+            { 0.2f, 0.2f, 0.2f, 1.0f }
+        };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+
+        VkRenderPassBeginInfo renderPassBeginInfo;
+        ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+        renderPassBeginInfo.renderPass               = m_RenderPass;
+        renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+        renderPassBeginInfo.clearValueCount          = 2;
+        renderPassBeginInfo.pClearValues             = clearValues;
+        renderPassBeginInfo.renderArea.offset.x      = 0;
+        renderPassBeginInfo.renderArea.offset.y      = 0;
+        renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+        renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
+
+        // 整个场景只绑定一次DescriptorSet，物体数据和纹理都通过下标访问
+        m_PushConstants.viewProj  = m_ViewCamera.GetViewProjection();
+        m_PushConstants.params[0] = m_ObjectBuffer->bindlessIndex;
+        m_PushConstants.params[1] = m_Streamer->lodBuffer->bindlessIndex;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipeline->pipeline);
+        m_BindlessTable->BindDescriptorSet(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+        m_BindlessTable->PushConstants(commandBuffer, &m_PushConstants, sizeof(PushConstantBlock));
+        m_Quad->meshes[0]->BindDrawCmd(commandBuffer);
+
+        m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+        vkCmdEndRenderPass(commandBuffer);
+        VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+    }
+
+    void InitParmas()
+    {
+        m_ViewCamera.SetPosition(0, 0, -50.0f);
+        m_ViewCamera.LookAt(0, 0, 0);
+        m_ViewCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight(), 1.0f, 500.0f);
+
+        memset(&m_PushConstants, 0, sizeof(PushConstantBlock));
+    }
+
+    void CreateGUI()
+    {
+        m_GUI = new ImageGUIContext();
+        m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf");
+    }
+
+    void DestroyGUI()
+    {
+        m_GUI->Destroy();
+        delete m_GUI;
+    }
+
+private:
+
+    bool                                            m_Ready = false;
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT   m_IndexingFeatures;
+    VkPhysicalDeviceFeatures2                       m_EnabledFeatures2;
+
+    vk_demo::DVKBindlessTable*                      m_BindlessTable = nullptr;
+    vk_demo::DVKCommandBuffer*                      m_StreamCommand = nullptr;
+    vk_demo::DVKTextureStreamer*                    m_Streamer = nullptr;
+    std::vector<vk_demo::DVKStreamingTexture*>      m_Textures;
+    vk_demo::DVKBuffer*                             m_ObjectBuffer = nullptr;
+    std::vector<Vector3>                            m_ObjectPositions;
+
+    vk_demo::DVKModel*                              m_Quad = nullptr;
+    vk_demo::DVKGfxPipeline*                        m_Pipeline = nullptr;
+
+    vk_demo::DVKCamera                              m_ViewCamera;
+    PushConstantBlock                               m_PushConstants;
+
+    ImageGUIContext*                                m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+    return std::make_shared<BindlessDemo>(1400, 900, "BindlessDemo", cmdLine);
+}
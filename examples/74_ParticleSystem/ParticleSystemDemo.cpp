@@ -0,0 +1,485 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+
+#include <vector>
+#include <chrono>
+
+// 粒子容量上限，实例数据为16字节
+#define MAX_PARTICLES (1 << 21)
+
+struct ModelViewProjectionBlock
+{
+    Matrix4x4 model;
+    Matrix4x4 view;
+    Matrix4x4 proj;
+};
+
+// 粒子发射的模板顶点，从蒙皮模型中提取后紧凑存放
+struct EmitterVertices
+{
+    std::vector<Vector3>    positions;
+    std::vector<IntVector4> skinIndices;
+    std::vector<Vector4>    skinWeights;
+};
+
+// 线程安全的随机数，每个批次各自一份
+struct FastRandom
+{
+    uint32 state;
+
+    FastRandom(uint32 seed)
+        : state(seed * 2654435761u + 1)
+    {
+
+    }
+
+    FORCE_INLINE float Next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state & 0xFFFFFF) / 16777216.0f;
+    }
+
+    FORCE_INLINE float Range(float inMin, float inMax)
+    {
+        return inMin + (inMax - inMin) * Next();
+    }
+};
+
+class ParticleSystemDemo : public DemoBase
+{
+public:
+    ParticleSystemDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+        : DemoBase(width, height, title, cmdLine)
+    {
+
+    }
+
+    virtual ~ParticleSystemDemo()
+    {
+
+    }
+
+    virtual bool PreInit() override
+    {
+        return true;
+    }
+
+    virtual bool Init() override
+    {
+        DemoBase::Setup();
+        DemoBase::Prepare();
+
+        CreateGUI();
+        LoadAnimModel();
+        LoadAssets();
+        InitParmas();
+
+        m_Ready = true;
+        return true;
+    }
+
+    virtual void Exist() override
+    {
+        DestroyAssets();
+        DestroyGUI();
+        DemoBase::Release();
+    }
+
+    virtual void Loop(float time, float delta) override
+    {
+        if (!m_Ready)
+        {
+            return;
+        }
+        Draw(time, delta);
+    }
+
+private:
+
+    void Draw(float time, float delta)
+    {
+        int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+        UpdateFPS(time, delta);
+
+        bool hovered = UpdateUI(time, delta);
+        if (!hovered)
+        {
+            m_ViewCamera.Update(time, delta);
+        }
+
+        UpdateAnimation(time, delta);
+
+        // 实例数据写入本帧的区域，不会覆盖GPU还在读取的数据
+        auto spawnStart = std::chrono::high_resolution_clock::now();
+        SpawnParticles();
+        auto simulateStart = std::chrono::high_resolution_clock::now();
+        m_InstanceBuffer->BeginFrame(bufferIndex);
+        vk_demo::DVKParticleInstance* instances = nullptr;
+        if (m_ParticleSystem->numParticles > 0)
+        {
+            instances = (vk_demo::DVKParticleInstance*)m_InstanceBuffer->Lock(m_ParticleSystem->numParticles * sizeof(vk_demo::DVKParticleInstance));
+        }
+        m_ParticleSystem->Simulate(delta, m_JobSystem, instances);
+        auto simulateEnd = std::chrono::high_resolution_clock::now();
+
+        m_SpawnTime    = std::chrono::duration<float, std::milli>(simulateStart - spawnStart).count();
+        m_SimulateTime = std::chrono::duration<float, std::milli>(simulateEnd - simulateStart).count();
+
+        SetupCommandBuffers(bufferIndex);
+
+        DemoBase::Present(bufferIndex);
+    }
+
+    bool UpdateUI(float time, float delta)
+    {
+        m_GUI->StartFrame();
+
+        {
+            ImGui::SetNextWindowPos(ImVec2(0, 0));
+            ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+            ImGui::Begin("ParticleSystemDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+            ImGui::SliderInt("Spawn/Vertex", &m_SpawnPerVertex, 1, 32);
+
+            ImGui::Text("Threads:%d Particles:%d", m_JobSystem->GetThreadCount(), m_ParticleSystem->numParticles);
+            ImGui::Text("Spawn:%.3fms Simulate:%.3fms", m_SpawnTime, m_SimulateTime);
+
+            ImGui::Text("%.3f ms/frame (%d FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+            ImGui::End();
+        }
+
+        bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
+
+        m_GUI->EndFrame();
+        m_GUI->Update();
+
+        return hovered;
+    }
+
+    void UpdateAnimation(float time, float delta)
+    {
+        m_RoleModel->Update(time, delta);
+
+        vk_demo::DVKMesh* mesh = m_RoleModel->meshes[0];
+        for (int32 i = 0; i < mesh->bones.size(); ++i)
+        {
+            int32 index = mesh->bones[i];
+            m_BonesData[index] = m_RoleModel->bones[index]->finalTransform;
+        }
+    }
+
+    // 每个模板顶点蒙皮一次，然后在该位置发射m_SpawnPerVertex个粒子
+    void SpawnParticles()
+    {
+        int32 spawnPerVertex = m_SpawnPerVertex;
+        int32 first = m_ParticleSystem->numParticles;
+        int32 count = m_ParticleSystem->Spawn((int32)m_Emitter.positions.size() * spawnPerVertex);
+        int32 numVertices = (count + spawnPerVertex - 1) / spawnPerVertex;
+        uint32 frameSeed  = ++m_FrameIndex;
+
+        vk_demo::DVKParticleStreams& particles = m_ParticleSystem->particles;
+
+        m_JobSystem->ParallelFor(
+            numVertices,
+            1024,
+            [&](int32 begin, int32 end, int32 threadIndex)
+            {
+                FastRandom random(frameSeed * 7919 + begin);
+
+                for (int32 v = begin; v < end; ++v)
+                {
+                    const Vector3& position      = m_Emitter.positions[v];
+                    const IntVector4& skinIndices = m_Emitter.skinIndices[v];
+                    const Vector4& skinWeights   = m_Emitter.skinWeights[v];
+
+                    Vector3 finalPos =
+                        m_BonesData[skinIndices.x].TransformPosition(position) * skinWeights.x +
+                        m_BonesData[skinIndices.y].TransformPosition(position) * skinWeights.y +
+                        m_BonesData[skinIndices.z].TransformPosition(position) * skinWeights.z +
+                        m_BonesData[skinIndices.w].TransformPosition(position) * skinWeights.w;
+
+                    int32 indexBegin = first + v * spawnPerVertex;
+                    int32 indexEnd   = MMath::Min(indexBegin + spawnPerVertex, first + count);
+
+                    for (int32 index = indexBegin; index < indexEnd; ++index)
+                    {
+                        Vector3 direction(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f));
+                        direction = direction.GetSafeNormal() * random.Range(5.0f, 15.0f);
+
+                        particles.positionX[index] = finalPos.x;
+                        particles.positionY[index] = finalPos.y;
+                        particles.positionZ[index] = finalPos.z;
+                        particles.velocityX[index] = direction.x;
+                        particles.velocityY[index] = direction.y;
+                        particles.velocityZ[index] = direction.z;
+                        particles.gravity[index]   = random.Range(-20.0f, 0.0f);
+                        particles.age[index]       = 0.0f;
+                        particles.lifeTime[index]  = random.Range(0.25f, 0.50f);
+                        particles.color[index]     = MMath::FloorToFloat(random.Range(0.0f, 255.0f));
+                    }
+                }
+            }
+        );
+    }
+
+    void LoadAnimModel()
+    {
+        m_RoleModel = vk_demo::DVKModel::LoadFromFile(
+            "assets/models/xiaonan/nvhai.fbx",
+            m_VulkanDevice,
+            nullptr,
+            {
+                VertexAttribute::VA_Position,
+                VertexAttribute::VA_Normal,
+                VertexAttribute::VA_SkinIndex,
+                VertexAttribute::VA_SkinWeight
+            }
+        );
+
+        m_RoleModel->SetAnimation(0);
+        m_BonesData.resize(m_RoleModel->meshes[0]->bones.size());
+
+        // 提取发射顶点，之后每帧不再按stride读取原始顶点数据
+        vk_demo::DVKMesh* mesh = m_RoleModel->meshes[0];
+        for (int32 p = 0; p < mesh->primitives.size(); ++p)
+        {
+            vk_demo::DVKPrimitive* primitive = mesh->primitives[p];
+            int32 stride = primitive->vertices.size() / primitive->vertexCount;
+
+            for (int32 index = 0; index < primitive->vertices.size(); index += stride)
+            {
+                const float* vertex = primitive->vertices.data() + index;
+                m_Emitter.positions.push_back(Vector3(vertex[0], vertex[1], vertex[2]));
+                m_Emitter.skinIndices.push_back(IntVector4(vertex[6], vertex[7], vertex[8], vertex[9]));
+                m_Emitter.skinWeights.push_back(Vector4(vertex[10], vertex[11], vertex[12], vertex[13]));
+            }
+        }
+    }
+
+    void LoadAssets()
+    {
+        vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+        // scene model
+        m_ParticleModel = vk_demo::DVKModel::LoadFromFile(
+            "assets/models/plane_z.obj",
+            m_VulkanDevice,
+            cmdBuffer,
+            {
+                VertexAttribute::VA_Position,
+                VertexAttribute::VA_UV0,
+            }
+        );
+
+        m_ParticleShader = vk_demo::DVKShader::Create(
+            m_VulkanDevice,
+            true,
+            "assets/shaders/74_ParticleSystem/obj.vert.spv",
+            "assets/shaders/74_ParticleSystem/obj.frag.spv"
+        );
+
+        m_ParticleTexture = vk_demo::DVKTexture::Create2D(
+            "assets/textures/flare3.png",
+            m_VulkanDevice,
+            cmdBuffer
+        );
+
+        m_ParticleMaterial = vk_demo::DVKMaterial::Create(
+            m_VulkanDevice,
+            m_RenderPass,
+            m_PipelineCache,
+            m_ParticleShader
+        );
+        m_ParticleMaterial->pipelineInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
+        m_ParticleMaterial->pipelineInfo.rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+        m_ParticleMaterial->pipelineInfo.inputAssemblyState.primitiveRestartEnable = VK_FALSE;
+        m_ParticleMaterial->pipelineInfo.depthStencilState.depthTestEnable = VK_FALSE;
+        m_ParticleMaterial->pipelineInfo.depthStencilState.depthWriteEnable = VK_FALSE;
+        m_ParticleMaterial->pipelineInfo.depthStencilState.stencilTestEnable = VK_FALSE;
+        m_ParticleMaterial->pipelineInfo.depthStencilState.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].blendEnable = VK_TRUE;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].colorBlendOp = VK_BLEND_OP_ADD;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].alphaBlendOp = VK_BLEND_OP_ADD;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        m_ParticleMaterial->pipelineInfo.blendAttachmentStates[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_DST_ALPHA;
+        m_ParticleMaterial->PreparePipeline();
+        m_ParticleMaterial->SetTexture("diffuseMap", m_ParticleTexture);
+
+        // particle system
+        m_JobSystem      = vk_demo::DVKJobSystem::Create();
+        m_ParticleSystem = vk_demo::DVKParticleSystem::Create(MAX_PARTICLES);
+
+        // 模拟时直接写入，作为binding 1的实例数据。每帧整体重写，不需要保留CPU副本
+        m_InstanceBuffer = vk_demo::DVKDynamicVertexBuffer::Create(
+            m_VulkanDevice,
+            MAX_PARTICLES * sizeof(vk_demo::DVKParticleInstance),
+            GetVulkanRHI()->GetSwapChain()->GetBackBufferCount(),
+            false
+        );
+
+        delete cmdBuffer;
+    }
+
+    void DestroyAssets()
+    {
+        delete m_JobSystem;
+        delete m_ParticleSystem;
+        delete m_InstanceBuffer;
+
+        delete m_RoleModel;
+        delete m_ParticleModel;
+        delete m_ParticleShader;
+        delete m_ParticleMaterial;
+        delete m_ParticleTexture;
+    }
+
+    void SetupCommandBuffers(int32 backBufferIndex)
+    {
+        float w  = m_FrameWidth;
+        float h  = m_FrameHeight;
+        float tx = 0;
+        float ty = 0;
+
+        VkViewport viewport = {};
+        viewport.x        = tx;
+        viewport.y        = m_FrameHeight - ty;
+        viewport.width    = w;
+        viewport.height   = -h;    // flip y axis
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor = {};
+        scissor.extent.width  = w;
+        scissor.extent.height = h;
+        scissor.offset.x = tx;
+        scissor.offset.y = ty;
+
+        VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+        VkCommandBufferBeginInfo cmdBeginInfo;
+        ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+        VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+        m_InstanceBuffer->Upload(commandBuffer);
+
+        VkClearValue clearValues[2];
+        clearValues[0].color        = {
+            { 0.2f, 0.2f, 0.2f, 1.0f }
+        };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+
+        VkRenderPassBeginInfo renderPassBeginInfo;
+        ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+        renderPassBeginInfo.renderPass               = m_RenderPass;
+        renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+        renderPassBeginInfo.clearValueCount          = 2;
+        renderPassBeginInfo.pClearValues             = clearValues;
+        renderPassBeginInfo.renderArea.offset.x      = 0;
+        renderPassBeginInfo.renderArea.offset.y      = 0;
+        renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+        renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        // 所有粒子一次Instance绘制
+        if (m_ParticleSystem->numParticles > 0)
+        {
+            vk_demo::DVKPrimitive* primitive = m_ParticleModel->meshes[0]->primitives[0];
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ParticleMaterial->GetPipeline());
+
+            m_MVPParam.model = m_ParticleModel->meshes[0]->linkNode->GetGlobalMatrix();
+            m_MVPParam.view  = m_ViewCamera.GetView();
+            m_MVPParam.proj  = m_ViewCamera.GetProjection();
+
+            m_ParticleMaterial->BeginFrame();
+            m_ParticleMaterial->BeginObject();
+            m_ParticleMaterial->SetLocalUniform("uboMVP", &m_MVPParam, sizeof(ModelViewProjectionBlock));
+            m_ParticleMaterial->EndObject();
+            m_ParticleMaterial->EndFrame();
+
+            m_ParticleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(primitive->vertexBuffer->dvkBuffer->buffer), &(primitive->vertexBuffer->offset));
+            m_InstanceBuffer->Bind(commandBuffer, 1);
+            vkCmdBindIndexBuffer(commandBuffer, primitive->indexBuffer->dvkBuffer->buffer, 0, primitive->indexBuffer->indexType);
+            vkCmdDrawIndexed(commandBuffer, primitive->indexBuffer->indexCount, m_ParticleSystem->numParticles, 0, 0, 0);
+        }
+
+        // ui pass
+        m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
+        vkCmdEndRenderPass(commandBuffer);
+
+        VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+    }
+
+    void InitParmas()
+    {
+        vk_demo::DVKBoundingBox bounds = m_RoleModel->rootNode->GetBounds();
+        Vector3 boundSize   = bounds.max - bounds.min;
+        Vector3 boundCenter = bounds.min + boundSize * 0.5f;
+        boundCenter.z -= boundSize.Size() * 1.5f;
+
+        m_ViewCamera.SetPosition(boundCenter);
+        m_ViewCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight(), 1.0f, 1500.0f);
+    }
+
+    void CreateGUI()
+    {
+        m_GUI = new ImageGUIContext();
+        m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf");
+    }
+
+    void DestroyGUI()
+    {
+        m_GUI->Destroy();
+        delete m_GUI;
+    }
+
+private:
+
+    bool                            m_Ready = false;
+
+    vk_demo::DVKModel*              m_RoleModel = nullptr;
+    vk_demo::DVKModel*              m_ParticleModel = nullptr;
+    vk_demo::DVKShader*             m_ParticleShader = nullptr;
+    vk_demo::DVKTexture*            m_ParticleTexture = nullptr;
+    vk_demo::DVKMaterial*           m_ParticleMaterial = nullptr;
+
+    vk_demo::DVKJobSystem*          m_JobSystem = nullptr;
+    vk_demo::DVKParticleSystem*     m_ParticleSystem = nullptr;
+    vk_demo::DVKDynamicVertexBuffer* m_InstanceBuffer = nullptr;
+
+    EmitterVertices                 m_Emitter;
+    int32                           m_SpawnPerVertex = 4;
+    uint32                          m_FrameIndex = 0;
+
+    vk_demo::DVKCamera              m_ViewCamera;
+
+    ModelViewProjectionBlock        m_MVPParam;
+    std::vector<Matrix4x4>          m_BonesData;
+
+    float                           m_SpawnTime = 0.0f;
+    float                           m_SimulateTime = 0.0f;
+
+    ImageGUIContext*                m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+    return std::make_shared<ParticleSystemDemo>(1400, 900, "ParticleSystemDemo", cmdLine);
+}
@@ -0,0 +1,30 @@
+#version 450
+
+// 预蒙皮输出的顶点已经在世界空间
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec2 inUV0;
+layout (location = 2) in vec3 inNormal;
+
+layout (binding = 0) uniform ViewProjectionBlock
+{
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+} uboViewProj;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec4 outColor;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main()
+{
+	outUV     = inUV0;
+	outNormal = inNormal;
+	outColor  = vec4(1.0, 1.0, 1.1, 1.0);
+
+	gl_Position = uboViewProj.projectionMatrix * uboViewProj.viewMatrix * vec4(inPosition, 1.0);
+}
@@ -5,28 +5,31 @@ layout (location = 1) in vec2  inUV0;
 layout (location = 2) in vec3  inNormal;
 layout (location = 3) in vec3  inSkinPack;
 
-layout (binding = 0) uniform MVPBlock 
+layout (binding = 0) uniform ViewProjectionBlock
 {
-	mat4 modelMatrix;
 	mat4 viewMatrix;
 	mat4 projectionMatrix;
-} uboMVP;
+} uboViewProj;
 
-#define MAX_BONES 64
+// x: 第一个实例中当前Mesh数据块的起始位置 y: 每个实例占用的vec4数量 z: 0为3x4矩阵 1为对偶四元数
+layout (binding = 1) uniform SkinParamBlock
+{
+	uvec4 param;
+} uboSkin;
 
-layout (binding = 1) uniform BonesTransformBlock 
+// 每个实例每个Mesh：世界矩阵(3个vec4)，之后为骨骼调色板
+layout (std430, binding = 3) readonly buffer PaletteBuffer
 {
-	mat2x4 	dualQuats[MAX_BONES];
-	vec4 	debugParam;
-} bonesData;
+	vec4 datas[];
+} palette;
 
 layout (location = 0) out vec2 outUV;
 layout (location = 1) out vec3 outNormal;
 layout (location = 2) out vec4 outColor;
 
-out gl_PerVertex 
+out gl_PerVertex
 {
-    vec4 gl_Position;   
+    vec4 gl_Position;
 };
 
 ivec4 UnPackUInt32To4Byte(uint packIndex)
@@ -45,49 +48,16 @@ ivec2 UnPackUInt32To2Short(uint packIndex)
 	return ivec2(idx0, idx1);
 }
 
-mat4x4 DualQuat2Matrix(vec4 real, vec4 dual) {
-	
-	float len2 = dot(real, real);
-	float qx = real.x;
-	float qy = real.y;
-	float qz = real.z;
-	float qw = real.w;
-
-	float tx = dual.x;
-	float ty = dual.y;
-	float tz = dual.z;
-	float tw = dual.w; 
-	
-	mat4x4 matrix;
-	matrix[0][0] = qw * qw + qx * qx - qy * qy - qz * qz;
-	matrix[1][0] = 2 * qx * qy - 2 * qw * qz;
-	matrix[2][0] = 2 * qx * qz + 2 * qw * qy;
-	matrix[0][1] = 2 * qx * qy + 2 * qw * qz;
-	matrix[1][1] = qw * qw + qy * qy - qx * qx - qz * qz;
-	matrix[2][1] = 2 * qy * qz - 2 * qw * qx;
-	matrix[0][2] = 2 * qx * qz - 2 * qw * qy;
-	matrix[1][2] = 2 * qy * qz + 2 * qw * qx;
-	matrix[2][2] = qw * qw + qz * qz - qx * qx - qy * qy;
-
-	matrix[3][0] = -2 * tw * qx + 2 * qw * tx - 2 * ty * qz + 2 * qy * tz;
-	matrix[3][1] = -2 * tw * qy + 2 * tx * qz - 2 * qx * tz + 2 * qw * ty;
-	matrix[3][2] = -2 * tw * qz + 2 * qx * ty + 2 * qw * tz - 2 * tx * qy;
-
-	matrix[0][3] = 0;
-	matrix[1][3] = 0;
-	matrix[2][3] = 0;
-	matrix[3][3] = len2;
-
-	matrix /= len2;
-
-	return matrix;
+mat2x4 LoadDualQuat(int index)
+{
+	return mat2x4(palette.datas[index + 0], palette.datas[index + 1]);
 }
 
 vec3 DualQuatTransformPosition(mat2x4 dualQuat, vec3 position)
 {
 	float len = length(dualQuat[0]);
 	dualQuat /= len;
-	
+
 	vec3 result = position.xyz + 2.0 * cross(dualQuat[0].xyz, cross(dualQuat[0].xyz, position.xyz) + dualQuat[0].w * position.xyz);
 	vec3 trans  = 2.0 * (dualQuat[0].w * dualQuat[1].xyz - dualQuat[1].w * dualQuat[0].xyz + cross(dualQuat[0].xyz, dualQuat[1].xyz));
 	result += trans;
@@ -100,7 +70,7 @@ vec3 DualQuatTransformVector(mat2x4 dualQuat, vec3 vector)
 	return vector + 2.0 * cross(dualQuat[0].xyz, cross(dualQuat[0].xyz, vector) + dualQuat[0].w * vector);
 }
 
-void main() 
+void main()
 {
 	// skin info
 	ivec4 skinIndex   = UnPackUInt32To4Byte(uint(inSkinPack.x));
@@ -108,55 +78,64 @@ void main()
 	ivec2 skinWeight1 = UnPackUInt32To2Short(uint(inSkinPack.z));
 	vec4  skinWeight  = vec4(skinWeight0 / 65535.0, skinWeight1 / 65535.0);
 
-	// dual quats
-	mat2x4 dualQuat0 = bonesData.dualQuats[skinIndex.x];
-	mat2x4 dualQuat1 = bonesData.dualQuats[skinIndex.y];
-	mat2x4 dualQuat2 = bonesData.dualQuats[skinIndex.z];
-	mat2x4 dualQuat3 = bonesData.dualQuats[skinIndex.w];
-	
-	if (dot(dualQuat0[0], dualQuat1[0]) < 0.0) {
-		dualQuat1 *= -1.0;
-	}
-	if (dot(dualQuat0[0], dualQuat2[0]) < 0.0) {
-		dualQuat2 *= -1.0;
-	}
-	if (dot(dualQuat0[0], dualQuat3[0]) < 0.0) {
-		dualQuat3 *= -1.0;
-	}
+	int base  = int(uboSkin.param.x + uint(gl_InstanceIndex) * uboSkin.param.y);
+	int bones = base + 3;
 
-	mat2x4 blendDualQuat = dualQuat0 * skinWeight.x;
-	blendDualQuat += dualQuat1 * skinWeight.y;
-	blendDualQuat += dualQuat2 * skinWeight.z;
-	blendDualQuat += dualQuat3 * skinWeight.w;
-
-	vec4 position;
+	vec3 position;
 	vec3 normal;
 
-	// 对偶四元素还原Matrix进行计算
-	if (bonesData.debugParam.x < 1.0)
+	// 3x4矩阵，线性混合
+	if (uboSkin.param.z == 0)
 	{
-		mat4x4 boneMatrix = DualQuat2Matrix(blendDualQuat[0], blendDualQuat[1]);
-		position = boneMatrix * vec4(inPosition.xyz, 1.0);
-		normal   = mat3(boneMatrix) * inNormal;
+		ivec4 offsets = bones + skinIndex * 3;
+		vec4 row0 = palette.datas[offsets.x + 0] * skinWeight.x + palette.datas[offsets.y + 0] * skinWeight.y + palette.datas[offsets.z + 0] * skinWeight.z + palette.datas[offsets.w + 0] * skinWeight.w;
+		vec4 row1 = palette.datas[offsets.x + 1] * skinWeight.x + palette.datas[offsets.y + 1] * skinWeight.y + palette.datas[offsets.z + 1] * skinWeight.z + palette.datas[offsets.w + 1] * skinWeight.w;
+		vec4 row2 = palette.datas[offsets.x + 2] * skinWeight.x + palette.datas[offsets.y + 2] * skinWeight.y + palette.datas[offsets.z + 2] * skinWeight.z + palette.datas[offsets.w + 2] * skinWeight.w;
+
+		position = vec3(dot(row0, vec4(inPosition, 1.0)), dot(row1, vec4(inPosition, 1.0)), dot(row2, vec4(inPosition, 1.0)));
+		normal   = vec3(dot(row0.xyz, inNormal), dot(row1.xyz, inNormal), dot(row2.xyz, inNormal));
 
 		outColor = vec4(1.1, 1.0, 1.0, 1.0);
 	}
-	// 不还原，直接计算
+	// 对偶四元数
 	else
 	{
-		position.xyz = DualQuatTransformPosition(blendDualQuat, inPosition.xyz);
-		position.w   = 1.0;
-		normal = DualQuatTransformVector(blendDualQuat, inNormal);
+		ivec4 offsets = bones + skinIndex * 2;
+		mat2x4 dualQuat0 = LoadDualQuat(offsets.x);
+		mat2x4 dualQuat1 = LoadDualQuat(offsets.y);
+		mat2x4 dualQuat2 = LoadDualQuat(offsets.z);
+		mat2x4 dualQuat3 = LoadDualQuat(offsets.w);
+
+		if (dot(dualQuat0[0], dualQuat1[0]) < 0.0) {
+			dualQuat1 *= -1.0;
+		}
+		if (dot(dualQuat0[0], dualQuat2[0]) < 0.0) {
+			dualQuat2 *= -1.0;
+		}
+		if (dot(dualQuat0[0], dualQuat3[0]) < 0.0) {
+			dualQuat3 *= -1.0;
+		}
+
+		mat2x4 blendDualQuat = dualQuat0 * skinWeight.x;
+		blendDualQuat += dualQuat1 * skinWeight.y;
+		blendDualQuat += dualQuat2 * skinWeight.z;
+		blendDualQuat += dualQuat3 * skinWeight.w;
+
+		position = DualQuatTransformPosition(blendDualQuat, inPosition.xyz);
+		normal   = DualQuatTransformVector(blendDualQuat, inNormal);
 
 		outColor = vec4(1.0, 1.1, 1.0, 1.0);
 	}
 
+	// 实例的世界矩阵
+	mat4 modelMatrix = transpose(mat4(palette.datas[base + 0], palette.datas[base + 1], palette.datas[base + 2], vec4(0.0, 0.0, 0.0, 1.0)));
+
 	// 转换法线
-	mat3 normalMatrix = transpose(inverse(mat3(uboMVP.modelMatrix)));
+	mat3 normalMatrix = transpose(inverse(mat3(modelMatrix)));
 	normal = normalize(normalMatrix * normal);
 
 	outUV     = inUV0;
 	outNormal = normal;
-	
-	gl_Position = uboMVP.projectionMatrix * uboMVP.viewMatrix * uboMVP.modelMatrix * position;
-}
\ No newline at end of file
+
+	gl_Position = uboViewProj.projectionMatrix * uboViewProj.viewMatrix * modelMatrix * vec4(position, 1.0);
+}
@@ -1,12 +1,13 @@
 #version 450
 
-layout (binding = 1) uniform sampler2D diffuseMap;
-layout (binding = 2) uniform sampler2D gradientMap;
+layout (binding = 2) uniform sampler2D diffuseMap;
+layout (binding = 3) uniform sampler2D gradientMap;
 
-layout (binding = 0) uniform ParticleParam 
+layout (binding = 1) uniform ParticleParam 
 {
-	vec4 data0;
-    vec4 data1;
+	mat4 view;
+	mat4 proj;
+	vec4 data;
 } param;
 
 layout (location = 0) in float inGradient;
@@ -16,7 +17,9 @@ layout (location = 0) out vec4 outFragColor;
 void main ()
 {
 	vec4 diffuse  = texture(diffuseMap, gl_PointCoord);
-    vec4 gradient = texture(gradientMap, vec2(inGradient, 0));
-    diffuse.xyzw *= gradient.xyzw * param.data1.y;
-	outFragColor  = diffuse;
-}
\ No newline at end of file
+	vec4 gradient = texture(gradientMap, vec2(inGradient, 0));
+
+	// 生命末尾淡出，输出预乘Alpha
+	float alpha   = diffuse.a * gradient.a * param.data.y * (1.0 - inGradient);
+	outFragColor  = vec4(diffuse.rgb * gradient.rgb * alpha, alpha);
+}
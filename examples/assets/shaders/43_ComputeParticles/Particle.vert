@@ -1,25 +1,32 @@
 #version 450
 
-layout (location = 0) in vec4 inCustom0;
-layout (location = 1) in vec4 inCustom1;
-
-layout (location = 0) out float outGradient;
+layout (std430, binding = 0) buffer DrawList 
+{
+	vec4 items[ ];
+} drawList;
 
-layout (binding = 0) uniform ParticleParam 
+layout (binding = 1) uniform ParticleParam 
 {
-	vec4 data0;
-    vec4 data1;
+	mat4 view;
+	mat4 proj;
+	vec4 data;	// x:粒子大小 y:强度 z:投影缩放
 } param;
 
+layout (location = 0) out float outGradient;
+
 out gl_PerVertex 
 {
-    vec4  gl_Position;
-    float gl_PointSize;
+	vec4  gl_Position;
+	float gl_PointSize;
 };
 
 void main() 
 {
-    gl_PointSize = param.data1.x;
-    outGradient  = inCustom1.w;
-	gl_Position  = vec4(inCustom0.xy, 1.0, 1.0);
-}
\ No newline at end of file
+	// firstVertex为slot * capacity，直接用gl_VertexIndex索引
+	vec4 item = drawList.items[gl_VertexIndex];
+	vec4 viewPos = param.view * vec4(item.xyz, 1.0);
+
+	outGradient  = item.w;
+	gl_Position  = param.proj * viewPos;
+	gl_PointSize = clamp(param.data.x * param.data.z / max(gl_Position.w, 0.01), 1.0, 64.0);
+}
@@ -0,0 +1,32 @@
+#version 450
+
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec4 inInstanceModel0;
+layout (location = 3) in vec4 inInstanceModel1;
+layout (location = 4) in vec4 inInstanceModel2;
+layout (location = 5) in vec4 inInstanceModel3;
+
+layout (binding = 0) uniform MVPBlock 
+{
+	mat4 modelMatrix;
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+} uboMVP;
+
+layout (location = 0) out vec3 outNormal;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;   
+};
+
+void main() 
+{
+	mat4 modelMatrix = mat4(inInstanceModel0, inInstanceModel1, inInstanceModel2, inInstanceModel3);
+	mat3 normalMatrix = transpose(inverse(mat3(modelMatrix)));
+	vec3 normal = normalize(normalMatrix * inNormal.xyz);
+	outNormal = normal;
+	
+	gl_Position = uboMVP.projectionMatrix * uboMVP.viewMatrix * modelMatrix * vec4(inPosition.xyz, 1.0);
+}
@@ -1,22 +0,0 @@
-#version 450
-
-layout (location = 0) in vec3 inPosition;
-layout (location = 1) in vec2 inUV0;
-layout (location = 2) in vec3 inNormal;
-
-layout (binding = 0) uniform MVPBlock 
-{
-	mat4 modelMatrix;
-	mat4 viewMatrix;
-	mat4 projectionMatrix;
-} uboMVP;
-
-out gl_PerVertex 
-{
-    vec4 gl_Position;   
-};
-
-void main() 
-{
-	gl_Position = uboMVP.projectionMatrix * uboMVP.viewMatrix * uboMVP.modelMatrix * vec4(inPosition.xyz, 1.0);
-}
\ No newline at end of file
@@ -1,55 +1,60 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-#define LIGHT_SIZE 512
-#define TILE_SIZE 16
-#define LIGHT_SIZE_PER_TILE 63
-
 #define PI 3.14159265359
 #define saturate(x) clamp(x, 0.0, 1.0)
 
-struct PointLight 
+struct Light
 {
-	vec3 pos;
+	vec3 position;
 	float radius;
 
 	vec3 color;
-    float padding;
-};
+	float type;
 
-struct LightVisiblity
-{
-	uint count;
-	uint lightIndices[LIGHT_SIZE_PER_TILE];
+	vec3 direction;
+	float cosOuter;
+
+	float cosInner;
+	float padding0;
+	float padding1;
+	float padding2;
 };
 
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec3 inWorldPos;
 
-layout(binding = 1) buffer readonly LightsCullingBuffer
+layout(std430, binding = 1) readonly buffer LightsBuffer
 {
-    LightVisiblity lightVisiblities[];
-} lightsCullingBuffer;
+	Light lights[ ];
+} clusterLights;
 
-layout (binding = 2) uniform LightsBlock 
+// x:offset y:count
+layout(std430, binding = 2) readonly buffer GridBuffer
 {
-    vec4 lightCount;
-	PointLight lights[LIGHT_SIZE];
-} uboLights;
+	uvec2 grid[ ];
+} clusterGrid;
 
-layout (binding = 3) uniform CullingBlock 
+layout(std430, binding = 3) readonly buffer IndexBuffer
 {
-    mat4 invProj;
-    vec4 frameSize;
-    vec4 tileNum;
-    vec4 pos;
-} uboCulling;
+	uint indices[ ];
+} clusterIndices;
 
-layout (binding = 4) uniform DebugBlock 
+layout (binding = 4) uniform ClusterParam
+{
+	mat4 view;
+	vec4 grid;		// x:tilesX y:tilesY z:slices w:tileSize
+	vec4 screen;	// x:width y:height z:projScaleX w:projScaleY
+	vec4 depth;		// x:near y:far z:log(far/near) w:光源数量
+	vec4 mode;
+} uboCluster;
+
+layout (binding = 5) uniform ShadingBlock 
 {
-    vec4 param;
-} uboDebug;
+	vec4 cameraPos;
+	vec4 debug;		// x:0无 1法线 2簇内光源数量
+} uboShading;
 
 layout (location = 0) out vec4 outFragColor;
 
@@ -123,73 +128,95 @@ vec3 ACESFitted(vec3 color)
     return color;
 }
 
-void main() 
+vec3 Heatmap(float t)
 {
-    ivec2 screen = ivec2(gl_FragCoord.xy);
-    screen.y = int(uboCulling.frameSize.y - screen.y); // flip y
-    
-    ivec2 tileID = ivec2(screen.xy / TILE_SIZE);
-    uint tileIndex = tileID.y * uint(uboCulling.tileNum.x) + tileID.x;
-
-    vec3 color = vec3(0.0, 0.0, 0.0);
-    vec3 diffuse = vec3(1.0, 1.0, 1.0);
-
-    uint lightNum = lightsCullingBuffer.lightVisiblities[tileIndex].count;
-    if (uboDebug.param.x == 1) 
-    {
-        outFragColor = vec4((inNormal + 1.0) * 0.5, 1.0);
-        return;
-    }
-    else if (uboDebug.param.x == 2) 
-    {
-        outFragColor = vec4(float(lightNum) / float(LIGHT_SIZE_PER_TILE));
-        return;
-    }
-
-    for (int i = 0; i < lightNum; ++i)
-	{
-        PointLight light = uboLights.lights[lightsCullingBuffer.lightVisiblities[tileIndex].lightIndices[i]];
-
-        float dist = distance(light.pos, inWorldPos);
-        if (dist > light.radius) {
-            continue;
-        }
-
-        vec3 N = inNormal;
-        vec3 L = normalize(light.pos - inWorldPos);
-        vec3 V = normalize(uboCulling.pos.xyz - inWorldPos.xyz);
-        vec3 H = normalize(L + V);
+	t = saturate(t);
+	return saturate(vec3(t * 4.0 - 2.0, t < 0.5 ? t * 4.0 : 4.0 - t * 4.0, 2.0 - t * 4.0));
+}
 
-        float roughness = 0.5;
-        float metallic  = 0.5;
-        vec3 albedo = diffuse;
+void main() 
+{
+	vec2 screen = gl_FragCoord.xy;
+	screen.y = uboCluster.screen.y - screen.y; // flip y
 
-        vec3 F0 = vec3(0.04);
-        F0 = mix(F0, albedo, metallic);
+	float viewZ = (uboCluster.view * vec4(inWorldPos, 1.0)).z;
+	int slice = 0;
+	if (viewZ > uboCluster.depth.x) {
+		slice = clamp(int(floor(log(viewZ / uboCluster.depth.x) / uboCluster.depth.z * uboCluster.grid.z)), 0, int(uboCluster.grid.z) - 1);
+	}
 
-        albedo = albedo * (1 - metallic) * (1 - 0.04);
+	ivec2 tileID = clamp(ivec2(screen / uboCluster.grid.w), ivec2(0), ivec2(uboCluster.grid.xy) - 1);
+	uint clusterIndex = uint((slice * int(uboCluster.grid.y) + tileID.y) * int(uboCluster.grid.x) + tileID.x);
 
-        // F
-        vec3  F = FresnelSchlick(H, V, F0);
-        // D
-        float D = NormalDistributionGGX(N, H, roughness);
-        // G
-        float G = GeometrySmith(N, V, L, roughness);
-        // BRDF
-        vec3 brdf = (D * F * G) / (4.0 * max(dot(V, N), 0) * max(dot(L, N), 0) + 0.0001f);
-        // KD
-        vec3 KD = (vec3(1.0f) - F);
+	uint lightOffset = clusterGrid.grid[clusterIndex].x;
+	uint lightNum    = clusterGrid.grid[clusterIndex].y;
 
-        vec3 wi = (KD * albedo / PI + brdf) * max(dot(N, L), 0) * light.color.xyz;
+	if (uboShading.debug.x == 1) 
+	{
+		outFragColor = vec4((inNormal + 1.0) * 0.5, 1.0);
+		return;
+	}
+	else if (uboShading.debug.x == 2) 
+	{
+		outFragColor = vec4(Heatmap(float(lightNum) / 32.0), 1.0);
+		return;
+	}
 
-        float att = clamp(1.0 - dist * dist / (light.radius * light.radius), 0.0, 1.0);
+	vec3 color = vec3(0.0, 0.0, 0.0);
+	vec3 diffuse = vec3(1.0, 1.0, 1.0);
 
-        color += wi * att;
+	for (uint i = 0; i < lightNum; ++i)
+	{
+		Light light = clusterLights.lights[clusterIndices.indices[lightOffset + i]];
+
+		float dist = distance(light.position, inWorldPos);
+		if (dist > light.radius) {
+			continue;
+		}
+
+		vec3 N = inNormal;
+		vec3 L = normalize(light.position - inWorldPos);
+		vec3 V = normalize(uboShading.cameraPos.xyz - inWorldPos.xyz);
+		vec3 H = normalize(L + V);
+
+		float spot = 1.0;
+		if (light.type == 1.0) {
+			spot = smoothstep(light.cosOuter, light.cosInner, dot(-L, light.direction));
+			if (spot <= 0.0) {
+				continue;
+			}
+		}
+
+		float roughness = 0.5;
+		float metallic  = 0.5;
+		vec3 albedo = diffuse;
+
+		vec3 F0 = vec3(0.04);
+		F0 = mix(F0, albedo, metallic);
+
+		albedo = albedo * (1 - metallic) * (1 - 0.04);
+
+		// F
+		vec3  F = FresnelSchlick(H, V, F0);
+		// D
+		float D = NormalDistributionGGX(N, H, roughness);
+		// G
+		float G = GeometrySmith(N, V, L, roughness);
+		// BRDF
+		vec3 brdf = (D * F * G) / (4.0 * max(dot(V, N), 0) * max(dot(L, N), 0) + 0.0001f);
+		// KD
+		vec3 KD = (vec3(1.0f) - F);
+
+		vec3 wi = (KD * albedo / PI + brdf) * max(dot(N, L), 0) * light.color.xyz;
+
+		float att = clamp(1.0 - dist * dist / (light.radius * light.radius), 0.0, 1.0);
+
+		color += wi * att * spot;
 	}
 
-    color.xyz = ACESFitted(color.xyz);
-    color.xyz = pow(color.xyz, vec3(1.0 / 2.2));
-    color.xyz = saturate(color.xyz);
+	color.xyz = ACESFitted(color.xyz);
+	color.xyz = pow(color.xyz, vec3(1.0 / 2.2));
+	color.xyz = saturate(color.xyz);
 
-    outFragColor = vec4(color, 1.0);
+	outFragColor = vec4(color, 1.0);
 }
\ No newline at end of file
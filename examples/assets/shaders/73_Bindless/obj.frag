@@ -0,0 +1,32 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) flat in uint inTexture;
+layout (location = 2) flat in uint inStream;
+
+layout (set = 0, binding = 0) uniform sampler2D textures[];
+
+// 流式纹理的LOD信息，x:minLod y:驻留的最高层级 z:mip数量
+layout (set = 0, binding = 1) readonly buffer LodBuffer
+{
+	vec4 lods[];
+} lodBuffers[];
+
+layout (push_constant) uniform PushConsts
+{
+	mat4  viewProjMatrix;
+	uvec4 params;		// x:ObjectBuffer的下标 y:lodBuffer的下标
+} pushConsts;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	// 同一个Draw中相邻像素可能来自不同的纹理
+	// 新上传的层级从minLod逐渐淡入，避免突然变清晰
+	float minLod = lodBuffers[pushConsts.params.y].lods[inStream].x;
+	float lod    = max(textureQueryLod(textures[nonuniformEXT(inTexture)], inUV).y, minLod);
+	outFragColor = textureLod(textures[nonuniformEXT(inTexture)], inUV, lod);
+}
@@ -0,0 +1,43 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec2 inUV0;
+
+struct ObjectData
+{
+	mat4  modelMatrix;
+	uvec4 params;		// x:纹理下标 y:lodBuffer中的下标
+};
+
+// 全局资源表，binding 0为纹理数组，binding 1为storage buffer数组
+layout (set = 0, binding = 1) readonly buffer ObjectBuffer
+{
+	ObjectData objects[];
+} buffers[];
+
+layout (push_constant) uniform PushConsts
+{
+	mat4  viewProjMatrix;
+	uvec4 params;		// x:ObjectBuffer的下标 y:lodBuffer的下标
+} pushConsts;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) flat out uint outTexture;
+layout (location = 2) flat out uint outStream;
+
+out gl_PerVertex 
+{
+	vec4 gl_Position;
+};
+
+void main() 
+{
+	ObjectData object = buffers[pushConsts.params.x].objects[gl_InstanceIndex];
+
+	outUV       = inUV0;
+	outTexture  = object.params.x;
+	outStream   = object.params.y;
+	gl_Position = pushConsts.viewProjMatrix * object.modelMatrix * vec4(inPosition, 1.0);
+}
@@ -0,0 +1,42 @@
+#version 450
+
+layout (location = 0) in vec3  inPosition;
+layout (location = 1) in vec2  inUV0;
+// xyz:粒子位置 w:整数部分为颜色索引，小数部分为生命进度
+layout (location = 2) in vec4  inInstancePosition;
+
+layout (binding = 0) uniform MVPBlock 
+{
+	mat4 modelMatrix;
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+} uboMVP;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outColor;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;   
+};
+
+vec3 HueToRGB(float hue)
+{
+	vec3 rgb = abs(hue * 6.0 - vec3(3.0, 2.0, 4.0)) * vec3(1.0, -1.0, -1.0) + vec3(-1.0, 2.0, 2.0);
+	return clamp(rgb, 0.0, 1.0);
+}
+
+void main() 
+{
+	float colorIndex = floor(inInstancePosition.w);
+	float progress   = inInstancePosition.w - colorIndex;
+
+	// 在视空间展开面片，始终朝向相机
+	vec4 position = uboMVP.viewMatrix * uboMVP.modelMatrix * vec4(inInstancePosition.xyz, 1.0);
+	position.xy  += inPosition.xy;
+	
+	outUV    = inUV0;
+	outColor = vec4(HueToRGB(colorIndex / 256.0), progress);
+	
+	gl_Position = uboMVP.projectionMatrix * position;
+}
\ No newline at end of file
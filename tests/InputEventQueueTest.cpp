@@ -0,0 +1,354 @@
+﻿#include "Common/Common.h"
+#include "Application/InputEventQueue.h"
+#include "Application/Linux/LinuxInputTranslator.h"
+#include "GenericPlatform/InputManager.h"
+
+#include <X11/keysym.h>
+
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+
+// 构造xcb事件，经过LinuxInputTranslator和InputEventQueue分发给记录调用的Handler，不需要X服务器
+
+static int32 s_Failed = 0;
+
+#define CHECK(cond) \
+    if (!(cond)) \
+    { \
+        printf("%s:%d: CHECK(%s) failed.\n", __FILE__, __LINE__, #cond); \
+        s_Failed += 1; \
+    }
+
+static const xcb_atom_t s_WmDeleteWindow = 321;
+
+class RecordMessageHandler : public GenericApplicationMessageHandler
+{
+public:
+    virtual bool OnKeyDown(const KeyboardType key) override
+    {
+        calls.push_back("KeyDown " + std::to_string((int32)key));
+        return true;
+    }
+
+    virtual bool OnKeyUp(const KeyboardType key) override
+    {
+        calls.push_back("KeyUp " + std::to_string((int32)key));
+        return true;
+    }
+
+    virtual bool OnMouseDown(MouseType type, const Vector2& pos) override
+    {
+        calls.push_back("MouseDown " + std::to_string((int32)type) + " " + ToString(pos));
+        return true;
+    }
+
+    virtual bool OnMouseUp(MouseType type, const Vector2& pos) override
+    {
+        calls.push_back("MouseUp " + std::to_string((int32)type) + " " + ToString(pos));
+        return true;
+    }
+
+    virtual bool OnMouseMove(const Vector2& pos) override
+    {
+        calls.push_back("MouseMove " + ToString(pos));
+        return true;
+    }
+
+    virtual bool OnSizeChanged(const int32 width, const int32 height) override
+    {
+        calls.push_back("SizeChanged " + std::to_string(width) + "x" + std::to_string(height));
+        return true;
+    }
+
+    virtual void OnRequestingExit() override
+    {
+        calls.push_back("RequestingExit");
+    }
+
+    static std::string ToString(const Vector2& pos)
+    {
+        return std::to_string((int32)pos.x) + "," + std::to_string((int32)pos.y);
+    }
+
+    std::vector<std::string> calls;
+};
+
+static xcb_generic_event_t* MakeMotion(xcb_motion_notify_event_t& event, int16 x, int16 y)
+{
+    memset(&event, 0, sizeof(event));
+    event.response_type = XCB_MOTION_NOTIFY;
+    event.event_x       = x;
+    event.event_y       = y;
+    return (xcb_generic_event_t*)&event;
+}
+
+static xcb_generic_event_t* MakeButton(xcb_button_press_event_t& event, uint8 type, xcb_button_t button)
+{
+    memset(&event, 0, sizeof(event));
+    event.response_type = type;
+    event.detail        = button;
+    return (xcb_generic_event_t*)&event;
+}
+
+static xcb_generic_event_t* MakeKey(xcb_key_press_event_t& event, uint8 type, xcb_keycode_t key)
+{
+    memset(&event, 0, sizeof(event));
+    event.response_type = type;
+    event.detail        = key;
+    return (xcb_generic_event_t*)&event;
+}
+
+static xcb_generic_event_t* MakeConfigure(xcb_configure_notify_event_t& event, uint16 width, uint16 height)
+{
+    memset(&event, 0, sizeof(event));
+    event.response_type = XCB_CONFIGURE_NOTIFY;
+    event.width         = width;
+    event.height        = height;
+    return (xcb_generic_event_t*)&event;
+}
+
+static xcb_generic_event_t* MakeClientMessage(xcb_client_message_event_t& event, xcb_atom_t atom)
+{
+    memset(&event, 0, sizeof(event));
+    event.response_type   = XCB_CLIENT_MESSAGE;
+    event.format          = 32;
+    event.data.data32[0]  = atom;
+    return (xcb_generic_event_t*)&event;
+}
+
+static bool TranslateAndPush(LinuxInputTranslator& translator, InputEventQueue& queue, const xcb_generic_event_t* event)
+{
+    InputEvent inputEvent;
+    if (!translator.Translate(event, s_WmDeleteWindow, inputEvent))
+    {
+        return false;
+    }
+    queue.Push(inputEvent);
+    return true;
+}
+
+static void TestOrderAndCoalesce()
+{
+    LinuxInputTranslator translator;
+    translator.SetWindowSize(800, 600);
+
+    InputEventQueue queue(64);
+    RecordMessageHandler handler;
+
+    xcb_motion_notify_event_t    motion;
+    xcb_button_press_event_t     button;
+    xcb_key_press_event_t        key;
+    xcb_configure_notify_event_t configure;
+    xcb_client_message_event_t   message;
+
+    CHECK(TranslateAndPush(translator, queue, MakeMotion(motion, 10, 10)));
+    CHECK(TranslateAndPush(translator, queue, MakeMotion(motion, 20, 20)));
+    CHECK(TranslateAndPush(translator, queue, MakeButton(button, XCB_BUTTON_PRESS, XCB_BUTTON_INDEX_1)));
+    // 滚轮不处理
+    CHECK(!TranslateAndPush(translator, queue, MakeButton(button, XCB_BUTTON_PRESS, XCB_BUTTON_INDEX_4)));
+    CHECK(TranslateAndPush(translator, queue, MakeMotion(motion, 30, 30)));
+    // 大小没有变化
+    CHECK(!TranslateAndPush(translator, queue, MakeConfigure(configure, 800, 600)));
+    CHECK(TranslateAndPush(translator, queue, MakeConfigure(configure, 1024, 600)));
+    CHECK(TranslateAndPush(translator, queue, MakeConfigure(configure, 1024, 768)));
+    CHECK(TranslateAndPush(translator, queue, MakeKey(key, XCB_KEY_PRESS, XK_a)));
+    CHECK(TranslateAndPush(translator, queue, MakeButton(button, XCB_BUTTON_RELEASE, XCB_BUTTON_INDEX_1)));
+    CHECK(TranslateAndPush(translator, queue, MakeKey(key, XCB_KEY_RELEASE, XK_a)));
+    CHECK(TranslateAndPush(translator, queue, MakeMotion(motion, 40, 40)));
+    // 其它ClientMessage不处理
+    CHECK(!TranslateAndPush(translator, queue, MakeClientMessage(message, XCB_ATOM_NOTICE)));
+    CHECK(TranslateAndPush(translator, queue, MakeClientMessage(message, s_WmDeleteWindow)));
+
+    int32 dispatched = queue.Dispatch(&handler);
+
+    std::string keyA = std::to_string((int32)KeyboardType::KEY_A);
+    std::string left = std::to_string((int32)MouseType::MOUSE_BUTTON_LEFT);
+
+    std::vector<std::string> expected = {
+        "MouseMove 20,20",
+        "MouseDown " + left + " 20,20",
+        "MouseMove 30,30",
+        "KeyDown " + keyA,
+        "MouseUp " + left + " 30,30",
+        "KeyUp " + keyA,
+        "MouseMove 40,40",
+        "RequestingExit",
+        "SizeChanged 1024x768",
+    };
+
+    CHECK(handler.calls == expected);
+    if (handler.calls != expected)
+    {
+        for (size_t i = 0; i < handler.calls.size(); ++i)
+        {
+            printf("  %s\n", handler.calls[i].c_str());
+        }
+    }
+
+    InputEventStats stats = queue.GetStats();
+    CHECK(dispatched == (int32)expected.size());
+    CHECK(stats.received == 11);
+    CHECK(stats.dispatched == (int32)expected.size());
+    // 10,10被20,20合并，1024x600被1024x768合并
+    CHECK(stats.coalesced == 2);
+    CHECK(stats.dropped == 0);
+    CHECK(queue.IsEmpty());
+}
+
+static void TestDrop()
+{
+    LinuxInputTranslator translator;
+    InputEventQueue queue(4);
+    RecordMessageHandler handler;
+
+    CHECK(queue.GetCapacity() == 4);
+
+    std::atomic<bool> running(true);
+
+    xcb_motion_notify_event_t motion;
+    int32 pushed = 0;
+    for (int32 i = 1; i <= 6; ++i)
+    {
+        InputEvent inputEvent;
+        CHECK(translator.Translate(MakeMotion(motion, i, i), s_WmDeleteWindow, inputEvent));
+        pushed += queue.PushOrWait(inputEvent, running) ? 1 : 0;
+    }
+
+    CHECK(pushed == 4);
+    CHECK(queue.GetStats().dropped == 2);
+
+    // 只有被放弃的事件计入dropped，单纯Push失败不计入
+    xcb_key_press_event_t key;
+    InputEvent keyEvent;
+    CHECK(translator.Translate(MakeKey(key, XCB_KEY_PRESS, XK_a), s_WmDeleteWindow, keyEvent));
+    CHECK(!queue.Push(keyEvent));
+    CHECK(queue.GetStats().dropped == 2);
+
+    // 退出时不再等待
+    running = false;
+    CHECK(!queue.PushOrWait(keyEvent, running));
+    CHECK(queue.GetStats().dropped == 3);
+
+    queue.Dispatch(&handler);
+
+    // 队列满后的事件被丢弃，分发的是进入队列的最后一个
+    CHECK(handler.calls.size() == 1);
+    CHECK(handler.calls.size() == 1 && handler.calls[0] == "MouseMove 4,4");
+
+    InputEventStats stats = queue.GetStats();
+    CHECK(stats.received == 4);
+    CHECK(stats.dispatched == 1);
+    CHECK(stats.coalesced == 3);
+    CHECK(stats.dropped == 3);
+
+    queue.ResetStats();
+    CHECK(queue.GetStats().dropped == 0);
+    CHECK(queue.GetStats().received == 0);
+}
+
+// 只记录MouseMove与MouseDown的x坐标，用于检查顺序
+class SequenceMessageHandler : public GenericApplicationMessageHandler
+{
+public:
+    virtual bool OnMouseDown(MouseType type, const Vector2& pos) override
+    {
+        downs.push_back((int32)pos.x);
+        all.push_back((int32)pos.x);
+        return true;
+    }
+
+    virtual bool OnMouseMove(const Vector2& pos) override
+    {
+        all.push_back((int32)pos.x);
+        return true;
+    }
+
+    std::vector<int32> downs;
+    std::vector<int32> all;
+};
+
+static void TestConcurrentProducer()
+{
+    const int32 numEvents = 20000;
+
+    InputEventQueue queue(8);
+    SequenceMessageHandler handler;
+    std::atomic<bool> running(true);
+    std::atomic<bool> finished(false);
+    int32 accepted = 0;
+
+    // 和输入线程一样，在另一个线程经过LinuxInputTranslator写入。每4个事件一次按下，其余为移动
+    std::thread producer([&]() {
+        LinuxInputTranslator translator;
+        xcb_motion_notify_event_t motion;
+        xcb_button_press_event_t  button;
+        for (int32 i = 1; i <= numEvents; ++i)
+        {
+            InputEvent inputEvent;
+            translator.Translate(MakeMotion(motion, i, 0), s_WmDeleteWindow, inputEvent);
+            if (i % 4 == 0)
+            {
+                translator.Translate(MakeButton(button, XCB_BUTTON_PRESS, XCB_BUTTON_INDEX_1), s_WmDeleteWindow, inputEvent);
+            }
+            accepted += queue.PushOrWait(inputEvent, running) ? 1 : 0;
+        }
+        finished = true;
+    });
+
+    while (!finished.load() || !queue.IsEmpty())
+    {
+        queue.Dispatch(&handler);
+        std::this_thread::yield();
+    }
+
+    producer.join();
+
+    InputEventStats stats = queue.GetStats();
+
+    // 按下事件一个都不能丢，并且保持顺序
+    CHECK(handler.downs.size() == numEvents / 4);
+    for (size_t i = 0; i < handler.downs.size(); ++i)
+    {
+        if (handler.downs[i] != (int32)(i + 1) * 4)
+        {
+            CHECK(handler.downs[i] == (int32)(i + 1) * 4);
+            break;
+        }
+    }
+
+    // 合并与丢弃之后剩下的事件仍然按产生的顺序分发
+    bool ordered = true;
+    for (size_t i = 1; i < handler.all.size(); ++i)
+    {
+        ordered = ordered && handler.all[i - 1] < handler.all[i];
+    }
+    CHECK(ordered);
+
+    CHECK(stats.received == accepted);
+    CHECK(stats.received + stats.dropped == numEvents);
+    CHECK(stats.dispatched == (int32)handler.all.size());
+    CHECK(stats.received == stats.dispatched + stats.coalesced);
+    printf("concurrent: received=%d dispatched=%d coalesced=%d dropped=%d\n", stats.received, stats.dispatched, stats.coalesced, stats.dropped);
+}
+
+int main(int argc, char** argv)
+{
+    InputManager::Init();
+
+    TestOrderAndCoalesce();
+    TestDrop();
+    TestConcurrentProducer();
+
+    if (s_Failed > 0)
+    {
+        printf("%d check(s) failed.\n", s_Failed);
+        return 1;
+    }
+
+    printf("All checks passed.\n");
+    return 0;
+}